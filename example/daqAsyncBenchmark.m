@@ -0,0 +1,62 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqAsyncBenchmark.m
+%
+% Measures an acquire-then-analyse loop with blocking calls and with the
+% 'Async' option, where the next block is captured while the previous
+% one is analysed.
+%
+% The analysis is emulated by a pause of about the length of a block, so
+% the overlapped loop should take about half the time.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 3.0; % Voltage range we want to measure
+Device = 'SimDev1'; % Change this value for the name of the device installed
+                    % in your system.
+Channel = 'SimDev1/ai0:3'; % Same as above
+Rate = 100000; % Sampling rate in samples per second
+Samples = 20000; % Samples per block
+Type = 'Voltage';
+Blocks = 20; % Number of blocks adquired in each case
+Analysis = Samples / Rate; % Seconds spent analysing each block
+
+% Blocking: the device is idle while each block is analysed
+tic;
+
+for i = 1:Blocks
+    Data = daqAdquireData(Rate, Channel, Range, Type, Samples, Device);
+    pause(Analysis);
+end
+
+Blocking = toc;
+
+% Overlapped: the next block is adquired while this one is analysed
+tic;
+Handle = daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Async', true);
+
+for i = 1:Blocks
+    Data = daqAdquireData('fetch', Handle);
+    
+    if i < Blocks
+        Handle = daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Async', true);
+    end
+    
+    pause(Analysis);
+end
+
+Overlapped = toc;
+
+fprintf('Acquisition time per block: %.1f ms\n', 1000 * Samples / Rate);
+fprintf('Blocking:   %.3f s, %.1f MS/s\n', Blocking, Blocks * Samples * 4 / Blocking / 1e6);
+fprintf('Overlapped: %.3f s, %.1f MS/s\n', Overlapped, Blocks * Samples * 4 / Overlapped / 1e6);
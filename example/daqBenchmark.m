@@ -0,0 +1,113 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqBenchmark.m
+%
+% Measures daqAdquireData end to end: the latency of each call for several
+% block sizes, with and without the task cache, and the throughput of
+% long acquisitions in each output mode.
+%
+% It runs on the simulated device SimDev1 by default, so no hardware is
+% needed and results can be compared between machines. The simulator
+% delivers samples at the sampling rate; with 'Realtime' disabled it
+% delivers them as fast as they are read, which leaves only the time spent
+% by the library itself. Set Device and Channel to measure a real device.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 5.0; % Voltage range we want to measure
+Device = 'SimDev1'; % Simulated device, or the name of a real one
+Channel = 'SimDev1/ai0:3'; % Same as above
+Rate = 100000; % Sampling rate in samples per second
+Type = 'Voltage';
+Blocks = [10 100 1000 10000]; % Samples per call in the latency test
+Calls = 100; % Calls measured for each block size
+Samples = 2000000; % Samples per channel in the throughput test
+Simulated = strncmp(Device, 'SimDev', 6);
+
+if Simulated
+    daqAdquireData('simulate');
+    daqAdquireData('simulate', Device, 'Signal', 'sine', 'Noise', 0.01);
+end
+
+daqAdquireData('clear');
+
+%% Per-call latency
+fprintf('Per-call latency on %s, %d S/s\n', Channel, Rate);
+fprintf('%8s %12s %12s %12s %12s %12s\n', 'Samples', 'Acquisition', 'Cached', 'Cached p95', 'Uncached', 'Uncached p95');
+
+for Block = Blocks
+    Cached = zeros(1, Calls);
+    Uncached = zeros(1, Calls);
+
+    % The first call creates the task, the rest reuse it
+    daqAdquireData(Rate, Channel, Range, Type, Block, Device);
+
+    for i = 1:Calls
+        tic;
+        daqAdquireData(Rate, Channel, Range, Type, Block, Device);
+        Cached(i) = toc;
+    end
+
+    for i = 1:Calls
+        daqAdquireData('evict', Rate, Channel, Range, Type, Block, Device);
+        tic;
+        daqAdquireData(Rate, Channel, Range, Type, Block, Device);
+        Uncached(i) = toc;
+    end
+
+    fprintf('%8d %9.3f ms %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n', Block, 1000 * Block / Rate, ...
+            1000 * median(Cached), 1000 * prctile(Cached, 95), 1000 * median(Uncached), 1000 * prctile(Uncached, 95));
+end
+
+daqAdquireData('clear');
+
+%% Throughput
+Modes = {'Double', {}; ...
+         'Raw', {'Raw', true}; ...
+         'Decimate 10', {'Decimate', 10, 'Filter', 'cic'}; ...
+         'Spectrum 4096', {'Spectrum', 4096}};
+
+if Simulated
+    Clocks = [true false];
+else
+    Clocks = true;
+end
+
+for Realtime = Clocks
+    if Simulated
+        daqAdquireData('simulate', Device, 'Realtime', Realtime);
+    end
+
+    if Realtime
+        fprintf('\nThroughput at %d S/s, %d samples per channel\n', Rate, Samples);
+    else
+        fprintf('\nThroughput without the sampling clock, %d samples per channel\n', Samples);
+    end
+
+    for i = 1:size(Modes, 1)
+        Start = cputime;
+        tic;
+        daqAdquireData(Rate, Channel, Range, Type, Samples, Device, Modes{i, 2}{:});
+        Elapsed = toc;
+        Load = (cputime - Start) / Elapsed;
+
+        fprintf('%14s: %7.3f s, %8.2f MS/s per channel, CPU load %5.1f%%\n', Modes{i, 1}, Elapsed, ...
+                Samples / Elapsed / 1e6, 100 * Load);
+    end
+
+    daqAdquireData('clear');
+end
+
+if Simulated
+    daqAdquireData('simulate');
+end
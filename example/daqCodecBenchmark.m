@@ -0,0 +1,78 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqCodecBenchmark.m
+%
+% Measures the compression ratio and speed of daqCompress and
+% daqDecompress on simulated signals and, if given, on recorded codes,
+% and checks that every signal comes back unchanged.
+%
+% Ratios are given against the raw int16 codes and against the float64
+% volts daqAdquireData returns by default.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 10.0; % Voltage range we want to measure
+Rate = 1000000; % Sampling rate in samples per second
+Samples = 1000000; % Samples per signal
+Type = 'Voltage';
+Recording = ''; % MAT-file with the codes of a real capture made with 'Raw'
+                % in a variable named Codes, if any
+
+% Simulated signals: a slow sine, a sine with noise, a step and full
+% scale noise, which is the worst case
+Signals = {'sine', 'sine', 'step', 'noise'};
+Amplitudes = [5, 5, 5, 5];
+Frequencies = [10, 1000, 0, 0];
+Noise = [0, 0.01, 0, 0];
+Names = {'Slow sine', 'Sine with noise', 'Step', 'Full scale noise'};
+Codes = cell(1, numel(Signals) + 1);
+
+for i = 1:numel(Signals)
+    daqAdquireData('simulate', 'SimDev1/ai0', 'Signal', Signals{i}, 'Amplitude', Amplitudes(i), ...
+                   'Frequency', Frequencies(i), 'Noise', Noise(i), 'Delay', 0.5);
+    Codes{i} = daqAdquireData(Rate, 'SimDev1/ai0', Range, Type, Samples, 'SimDev1', 'Raw', true);
+end
+
+daqAdquireData('simulate');
+
+if ~isempty(Recording)
+    Loaded = load(Recording, 'Codes');
+    Codes{end} = Loaded.Codes;
+    Names{end + 1} = 'Recording';
+else
+    Codes(end) = [];
+end
+
+for i = 1:numel(Codes)
+    tic;
+    Compressed = daqCompress(Codes{i});
+    Compress = toc;
+    
+    tic;
+    Restored = daqDecompress(Compressed);
+    Decompress = toc;
+    
+    if ~isequal(Restored, Codes{i})
+        error('%s did not survive compression.', Names{i});
+    end
+    
+    fprintf('%-17s %6.2fx int16, %6.2fx float64, compress %6.1f MS/s, decompress %6.1f MS/s\n', Names{i}, ...
+            2 * numel(Codes{i}) / numel(Compressed), 8 * numel(Codes{i}) / numel(Compressed), ...
+            numel(Codes{i}) / Compress / 1e6, numel(Codes{i}) / Decompress / 1e6);
+end
+
+% Compressing as the blocks arrive must keep up with the device
+[Compressed, Scaling, Timing] = daqAdquireData(Rate, 'SimDev1/ai0', Range, Type, 10 * Samples, 'SimDev1', 'Compress', true);
+
+fprintf('While adquiring: %.2fx int16, %.1f%% of the time compressing\n', 2 * 10 * Samples / numel(Compressed), ...
+        100 * Timing.Seconds.Process / Timing.Seconds.Total);
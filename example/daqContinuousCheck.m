@@ -0,0 +1,90 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqContinuousCheck.m
+%
+% Checks continuous mode against a simulated device, whose channels are
+% sines known in advance. The buffer between reads is kept small, so the
+% ring wraps around dozens of times, and the samples read are compared
+% against the sines to find any lost, repeated or misplaced one. MATLAB
+% then falls behind for longer than the ring holds but not the driver
+% buffer, which is as large, so nothing may be lost, and finally for
+% longer than both, which must be reported as an overrun after the
+% samples already adquired are read. Set Device to a real device to watch its behaviour
+% instead; only the last two checks mean something there.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 3.0; % Voltage range we want to measure
+Rate = 10000; % Sampling rate in samples per second
+Buffer = 2000; % Samples kept between reads, 0.2 s
+Seconds = 10; % Length of the wraparound check
+Type = 'Voltage';
+Device = 'SimDev1';
+Channel = [Device '/ai0:2'];
+Frequency = [50 130 310]; % Sine of each channel, in Hz
+Code = 2 * Range / 65536; % Volts per code of the converter
+
+daqAdquireData('simulate');
+
+for k = 1:numel(Frequency)
+    daqAdquireData('simulate', sprintf('%s/ai%d', Device, k - 1), 'Signal', 'sine', 'Amplitude', 1, ...
+                   'Frequency', Frequency(k), 'Offset', 0, 'Noise', 0);
+end
+
+% Every sample read so far must continue the sines where they were
+Expected = @(First, Count) sin(2 * pi * (First + (0:Count - 1)') * Frequency / Rate);
+Check = @(Data, First, Label) fprintf('%-26s %8d samples, largest error %.2f codes\n', Label, size(Data, 1), ...
+                                      max([0; max(abs(Data - Expected(First, size(Data, 1))), [], 2)]) / Code);
+
+% Wraparound: reads of every size, most of them smaller than the ring.
+% Asking for the normal priority only turns the reader statistics on.
+daqAdquireData('resetstats');
+daqAdquireData('start', Rate, Channel, Range, Type, Buffer, Device, 'Priority', 0);
+
+Data = zeros(0, numel(Frequency));
+Start = tic;
+
+while toc(Start) < Seconds
+    Data = [Data; daqAdquireData('read')]; %#ok<AGROW>
+    pause(0.02 * rand());
+end
+
+Check(Data, 0, 'Wraparound');
+fprintf('%-26s %8.1f times\n', 'Ring wrapped around', size(Data, 1) / Buffer);
+
+% Full ring: the reader waits and the driver buffer keeps the samples
+First = size(Data, 1);
+pause(1.5 * Buffer / Rate);
+Data = daqAdquireData('read');
+Stats = daqAdquireData('rtstats');
+
+Check(Data, First, 'Full ring');
+fprintf('%-26s %8d waits\n', 'Reader waited for room', Stats.Stalls);
+
+% Overrun: what was adquired comes first, then the error
+First = First + size(Data, 1);
+pause(3);
+Data = daqAdquireData('read');
+
+Check(Data, First, 'Before the overrun');
+pause(0.1);
+
+try
+    daqAdquireData('read');
+    fprintf('%-26s none\n', 'Overrun');
+catch Error
+    fprintf('%-26s %s\n', 'Overrun', Error.message);
+end
+
+daqAdquireData('stop');
+daqAdquireData('simulate');
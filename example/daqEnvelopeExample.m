@@ -0,0 +1,73 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqEnvelopeExample.m
+%
+% Adquires a long capture together with its min/max envelope and plots
+% it, drawing again from the envelope whenever the view is zoomed or
+% panned, so only a couple of points per pixel are ever plotted.
+%
+% It also compares the time to draw the whole capture from the
+% envelope with the time to reduce it in MATLAB.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 10.0; % Voltage range we want to measure
+Rate = 1000000; % Sampling rate in samples per second
+Samples = 20000000; % Samples to adquire, 20 seconds
+Channel = 'SimDev1/ai0';
+Device = 'SimDev1';
+Type = 'Voltage';
+
+% A slow sine with noise and a few spikes, which a decimated plot would miss
+daqAdquireData('simulate', Channel, 'Signal', 'sine', 'Amplitude', 4, 'Frequency', 0.5, 'Noise', 0.05);
+[Data, Envelope] = daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Envelope', true);
+daqAdquireData('simulate');
+
+Data(round(Samples * [0.2 0.5 0.8])) = [9 -9 9];
+
+% Spikes were added after the capture, so the envelope is built again
+tic;
+Envelope = daqEnvelope(Data);
+fprintf('Envelope of %d samples built in %.1f ms\n', Samples, toc * 1000);
+
+Pixels = 1000;
+
+tic;
+[X, Y] = daqEnvelope(Envelope, Data, 1, Samples, Pixels);
+fprintf('Whole capture drawn from the envelope in %.3f ms\n', toc * 1000);
+
+tic;
+Blocks = reshape(Data(1:floor(Samples / Pixels) * Pixels), [], Pixels);
+Reference = [min(Blocks); max(Blocks)];
+fprintf('Whole capture reduced in MATLAB in %.3f ms\n', toc * 1000);
+
+Figure = figure('Name', 'daqEnvelope');
+Axes = axes('Parent', Figure);
+Line = plot(Axes, X, Y);
+xlabel(Axes, 'Sample');
+ylabel(Axes, 'Volts');
+
+% Every zoom or pan draws the visible range again at the width of the axes
+Zoom = zoom(Figure);
+Pan = pan(Figure);
+Zoom.ActionPostCallback = @(Object, Event) updateEnvelope(Line, Axes, Envelope, Data);
+Pan.ActionPostCallback = @(Object, Event) updateEnvelope(Line, Axes, Envelope, Data);
+
+function updateEnvelope(Line, Axes, Envelope, Data)
+    Limits = xlim(Axes);
+    Position = getpixelposition(Axes);
+    First = max(1, floor(Limits(1)));
+    Last = min(Envelope.Length, ceil(Limits(2)));
+    [X, Y] = daqEnvelope(Envelope, Data, First, max(First, Last), max(1, round(Position(3))));
+    set(Line, 'XData', X, 'YData', Y);
+end
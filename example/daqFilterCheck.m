@@ -0,0 +1,108 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqFilterCheck.m
+%
+% Checks that decimating while adquiring, with no filter, a FIR filter
+% or a CIC filter, matches downsample(filter(b, 1, x), factor) computed
+% in MATLAB on the full-rate capture, and that 'Resample' matches
+% resample in its passband. The simulated device produces exactly the
+% same samples on every capture, so the full-rate capture is the input
+% the native filter saw; a real device would need a signal that
+% repeats as exactly.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 5.0; % Voltage range we want to measure
+Rate = 100000; % Sampling rate in samples per second
+Samples = 100003; % Not a multiple of any factor, to check the tail
+Factor = 8; % Decimation factor
+Order = 3; % Order of the CIC filter
+Type = 'Voltage';
+Device = 'SimDev1';
+Channel = [Device '/ai0:2'];
+Frequency = [50 730 4100]; % Sine of each channel, in Hz; the last one aliases
+
+% The native filter and MATLAB only differ in the order of the sums
+Tolerance = 1e-9;
+
+% 'Resample' and resample design different filters, so they only agree
+% on a tone well inside the passband, away from the ends
+ResampleTolerance = 5e-3;
+Edge = 100;
+
+daqAdquireData('simulate');
+
+for k = 1:numel(Frequency)
+    daqAdquireData('simulate', sprintf('%s/ai%d', Device, k - 1), 'Signal', 'sine', 'Amplitude', 1, ...
+                   'Frequency', Frequency(k), 'Offset', 0, 'Noise', 0);
+end
+
+X = daqAdquireData(Rate, Channel, Range, Type, Samples, Device);
+
+% Low-pass FIR below the new Nyquist frequency, and the CIC taps: Order
+% moving averages of Factor samples
+Taps = sinc((-32:32)' / Factor) / Factor .* (0.54 + 0.46 * cos(pi * (-32:32)' / 32));
+Cic = 1;
+
+for k = 1:Order
+    Cic = conv(Cic, ones(Factor, 1) / Factor);
+end
+
+Cases = {'Decimate only', {}, 1; ...
+         'FIR filter', {'Filter', Taps}, Taps; ...
+         'CIC filter', {'Filter', 'cic', 'FilterOrder', Order}, Cic};
+
+Failed = false;
+
+for Case = 1:size(Cases, 1)
+    Y = daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Decimate', Factor, Cases{Case, 2}{:});
+    Reference = filter(Cases{Case, 3}, 1, X);
+    Reference = Reference(1:Factor:end, :);
+
+    if ~isequal(size(Y), size(Reference))
+        fprintf('%-16s %d by %d samples instead of %d by %d FAILED\n', Cases{Case, 1}, size(Y), size(Reference));
+        Failed = true;
+        continue;
+    end
+
+    Error = max(abs(Y(:) - Reference(:)));
+    fprintf('%-16s largest difference %.2e V', Cases{Case, 1}, Error);
+
+    if Error > Tolerance
+        fprintf(' FAILED\n');
+        Failed = true;
+    else
+        fprintf('\n');
+    end
+end
+
+if exist('resample', 'file') == 2
+    Y = daqAdquireData(Rate, [Device '/ai0'], Range, Type, Samples, Device, 'Resample', [1 Factor]);
+    Reference = resample(X(:, 1), 1, Factor);
+    Count = min(numel(Y), numel(Reference));
+    View = Edge + 1:Count - Edge;
+
+    Error = max(abs(Y(View) - Reference(View)'));
+    fprintf('%-16s largest difference %.2e V', 'Resample', Error);
+
+    if Error > ResampleTolerance
+        fprintf(' FAILED\n');
+        Failed = true;
+    else
+        fprintf('\n');
+    end
+end
+
+daqAdquireData('simulate');
+
+assert(~Failed, 'The filtered captures do not match MATLAB.');
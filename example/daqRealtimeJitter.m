@@ -0,0 +1,74 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqRealtimeJitter.m
+%
+% Runs a continuous adquisition while MATLAB is kept busy with large
+% FFTs, first with the reader thread at normal priority and then pinned
+% to the last core at a real-time priority, and compares how late the
+% reads returned against the sample clock. It then does the same with a
+% long blocking capture. Set Device to a real device to measure it; on
+% Linux, real-time priorities need CAP_SYS_NICE or an rtprio limit.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 10.0; % Voltage range we want to measure
+Rate = 200000; % Sampling rate in samples per second
+Seconds = 10; % Length of each run
+Type = 'Voltage';
+Device = 'SimDev1';
+Channel = [Device '/ai0:3'];
+Core = feature('numcores') - 1; % Core the reader thread is pinned to
+Priority = 80;
+
+Runs = {'Normal', {'Priority', 0}; ...
+        'Real time', {'CPU', Core, 'Priority', Priority}};
+
+fprintf('%-10s %8s %9s %7s %14s %14s\n', 'Reader', 'Reads', 'Overruns', 'Stalls', 'Max jitter ms', '99% jitter ms');
+
+for Run = 1:size(Runs, 1)
+    daqAdquireData('resetstats');
+    daqAdquireData('start', Rate, Channel, Range, Type, Rate, Device, Runs{Run, 2}{:});
+
+    Start = tic;
+    Total = 0;
+
+    % Load MATLAB and the memory system while the reader runs
+    while toc(Start) < Seconds
+        Load = abs(fft(randn(2^20, 4)));
+        Total = Total + size(daqAdquireData('read'), 1);
+    end
+
+    daqAdquireData('stop');
+    Stats = daqAdquireData('rtstats');
+
+    % Upper edge of the bin holding the 99th percentile of the jitter
+    Share = cumsum(Stats.Jitter) / max(sum(Stats.Jitter), 1);
+    Edge = Stats.BinEdges(find(Share >= 0.99, 1));
+
+    fprintf('%-10s %8d %9d %7d %14.3f %14.3f\n', Runs{Run, 1}, Stats.Reads, Stats.Overruns, Stats.Stalls, ...
+            1000 * Stats.MaxJitter, 1000 * Edge);
+end
+
+fprintf('Granted: CPU %d, priority %d, memory locked %d\n', Stats.CPU, Stats.Priority, Stats.Locked);
+
+% A blocking capture read by a pinned real-time thread while MATLAB waits
+daqAdquireData('resetstats');
+Data = daqAdquireData(Rate, Channel, Range, Type, Seconds * Rate, Device, 'CPU', Core, 'Priority', Priority);
+Stats = daqAdquireData('rtstats');
+
+fprintf('Blocking: %d reads, largest read %.1f ms, max jitter %.3f ms\n', Stats.Reads, ...
+        1000 * Stats.MaxLatency, 1000 * Stats.MaxJitter);
+
+bar(log2(Stats.BinEdges(1:end - 1) * 1e6), Stats.Latency(1:end - 1));
+xlabel('log_2 of the read latency (us)');
+ylabel('Reads');
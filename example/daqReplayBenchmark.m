@@ -0,0 +1,85 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqReplayBenchmark.m
+%
+% Records a capture from a simulated device, replays it through
+% daqAdquireData in real time, and then as fast as it can be read to find
+% the throughput ceiling of every output mode on this machine. The same
+% samples are also replayed from a raw file of singles and from a CSV
+% file. Set Capture to the path of any recording to benchmark on it.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 10.0; % Voltage range we want to measure
+Rate = 100000; % Sampling rate in samples per second
+Seconds = 10; % Length of the recording
+Samples = 20000000; % Samples per channel replayed in the throughput test
+Type = 'Voltage';
+Capture = [tempname '.bin']; % Recording to replay
+
+daqAdquireData('simulate', 'SimDev1', 'Signal', 'sine', 'Noise', 0.01);
+daqAdquireData(Rate, 'SimDev1/ai0:3', Range, Type, Seconds * Rate, 'SimDev1', 'File', Capture);
+daqAdquireData('simulate');
+
+Device = ['file:' Capture];
+Channel = [Device '/ai0:3'];
+
+%% Real time
+daqAdquireData('replay');
+tic;
+Data = daqAdquireData(Rate, Channel, Range, Type, Rate, Device);
+fprintf('1 s of the recording replayed in %.3f s\n', toc);
+
+daqAdquireData('replay', Device, 'Speed', 4);
+tic;
+daqAdquireData(Rate, Channel, Range, Type, Rate, Device);
+fprintf('1 s replayed at 4 times real time in %.3f s\n', toc);
+
+%% Throughput
+daqAdquireData('replay', Device, 'Speed', 0, 'Loop', true);
+
+Modes = {'Double', {}; ...
+         'Raw', {'Raw', true}; ...
+         'Single', {'OutputClass', 'single'}; ...
+         'Decimate 10', {'Decimate', 10, 'Filter', 'cic'}; ...
+         'Spectrum 4096', {'Spectrum', 4096}; ...
+         'XCorr 100', {'XCorr', 100}};
+
+fprintf('%-14s %12s %12s\n', 'Mode', 'MS/s', 'Seconds');
+
+for Mode = 1:size(Modes, 1)
+    tic;
+    daqAdquireData(Rate, Channel, Range, Type, Samples, Device, Modes{Mode, 2}{:});
+    Elapsed = toc;
+    fprintf('%-14s %12.1f %12.3f\n', Modes{Mode, 1}, 4 * Samples / Elapsed / 1e6, Elapsed);
+end
+
+%% Other formats
+Raw = [tempname '.dat'];
+File = fopen(Raw, 'w');
+fwrite(File, Data', 'single');
+fclose(File);
+
+daqAdquireData('replay', ['file:' Raw], 'Format', 'single', 'Channels', 4, 'Speed', 0);
+Singles = daqAdquireData(Rate, ['file:' Raw '/ai0:3'], Range, Type, Rate, ['file:' Raw]);
+fprintf('Raw singles: largest difference %g V\n', max(abs(Singles(:) - Data(:))));
+
+Text = [tempname '.csv'];
+dlmwrite(Text, Data(1:1000, :), 'precision', '%.17g');
+
+daqAdquireData('replay', ['file:' Text], 'Speed', 0);
+Lines = daqAdquireData(Rate, ['file:' Text '/ai0:3'], Range, Type, 1000, ['file:' Text]);
+fprintf('CSV: largest difference %g V\n', max(max(abs(Lines - Data(1:1000, :)))));
+
+daqAdquireData('replay');
+delete(Capture, Raw, Text);
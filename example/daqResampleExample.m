@@ -0,0 +1,59 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqResampleExample.m
+%
+% Captures the same tone on two simulated devices sampling at different
+% rates, brings both to a common timebase with daqResample and plots
+% them together. It also times daqResample against resample from the
+% Signal Processing Toolbox, when it is installed, on the longer capture.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 10.0; % Voltage range we want to measure
+Rates = [100000, 44100]; % Sampling rate of each device
+Rate = 48000; % Common rate to bring both captures to
+Seconds = 2;
+Type = 'Voltage';
+Tone = 1000; % Frequency of the simulated sine, in Hz
+
+daqAdquireData('simulate', 'SimDev1', 'Signal', 'sine', 'Amplitude', 1, 'Frequency', Tone);
+daqAdquireData('simulate', 'SimDev2', 'Signal', 'sine', 'Amplitude', 1, 'Frequency', Tone);
+
+A = daqAdquireData(Rates(1), 'SimDev1/ai0:1', Range, Type, Seconds * Rates(1), 'SimDev1');
+B = daqAdquireData(Rates(2), 'SimDev2/ai0', Range, Type, Seconds * Rates(2), 'SimDev2');
+
+% Both devices start at the same time here; pass the start time of each
+% capture as a fourth argument otherwise
+tic;
+Aligned = daqResample({A, B}, Rates, Rate);
+Native = toc;
+
+fprintf('%d channels aligned at %d S/s in %.1f ms\n', size(Aligned, 2), Rate, 1000 * Native);
+
+% The same rate change in a single call while acquiring
+C = daqAdquireData(Rates(2), 'SimDev2/ai0', Range, Type, Seconds * Rates(2), 'SimDev2', 'Resample', [160 147]);
+fprintf('Resampled while acquiring: %d samples\n', numel(C));
+
+if exist('resample', 'file') == 2
+    tic;
+    Reference = resample(A, 12, 25);
+    fprintf('resample on the first capture: %.1f ms\n', 1000 * toc);
+end
+
+View = 1:round(Rate / Tone * 3);
+plot((View - 1) / Rate, Aligned(View, :));
+xlabel('Time (s)');
+ylabel('Voltage (V)');
+legend('SimDev1/ai0', 'SimDev1/ai1', 'SimDev2/ai0');
+
+daqAdquireData('simulate');
@@ -0,0 +1,52 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqScaleCheck.m
+%
+% Checks that codes adquired with 'Raw' and scaled by daqScaleData match
+% the volts the driver returns for the same samples, within one code, on
+% every range. The simulated device produces exactly the same samples on
+% every capture, so the two are compared sample by sample; a real device
+% would need a signal that repeats as exactly.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Ranges = [0.2, 1.0, 5.0, 10.0]; % Voltage ranges checked
+Rate = 100000; % Sampling rate in samples per second
+Samples = 100003; % Not a multiple of the vector width, to check the tail
+Type = 'Voltage';
+Device = 'SimDev1';
+Channel = [Device '/ai0:3'];
+
+% Sines that sweep the whole range without noise, so captures repeat
+daqAdquireData('simulate');
+
+for Range = Ranges
+    daqAdquireData('simulate', Device, 'Signal', 'sine', 'Amplitude', 0.99 * Range, 'Noise', 0);
+
+    [Codes, Scaling] = daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Raw', true);
+    Volts = daqAdquireData(Rate, Channel, Range, Type, Samples, Device);
+    Scaled = daqScaleData(Codes, Scaling);
+
+    % The linear coefficient is the size of one code
+    Error = max(abs(Scaled - Volts), [], 1) ./ abs(Scaling(2, :));
+
+    fprintf('Range %5.1f V: largest difference %.3f codes', Range, max(Error));
+
+    if max(Error) > 1
+        fprintf(' FAILED\n');
+    else
+        fprintf('\n');
+    end
+end
+
+daqAdquireData('simulate');
@@ -0,0 +1,153 @@
+/*************************************************************/
+// daqSharedReader.cpp
+//
+// Standalone reader of an adquisition published with
+// daqAdquireData('publish', Name, ...), to show that any program can
+// follow it without MATLAB. Every second it prints the blocks read
+// and lost and the RMS value of each channel.
+//
+// Build it against the headers of the library, without the driver:
+//
+//     g++ -std=c++11 -O2 -DDAQ_NO_NIDAQMX -I../src daqSharedReader.cpp -o daqSharedReader -lrt
+//
+// and run it as daqSharedReader Name.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include <chrono>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include "daqShared.h"
+
+// Value of code nCode of a channel with nCoeffs coefficients
+static double scaleCode(const float64 *lpCoeffs, uInt32 nCoeffs, int16 nCode)
+{
+    double fValue = 0;
+    
+    for (uInt32 k = nCoeffs; k > 0; k--)
+    {
+        fValue = fValue * nCode + lpCoeffs[k - 1];
+    }
+    
+    return fValue;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s Name\n", argv[0]);
+        return 1;
+    }
+    
+    DaqSharedMemory Memory;
+    
+    if (!Memory.Open(argv[1]) || !daqSharedCheckHeader((const DaqSharedHeader*) Memory.Data(), Memory.Size()))
+    {
+        fprintf(stderr, "Nothing is published under '%s'.\n", argv[1]);
+        return 1;
+    }
+    
+    const DaqSharedHeader *pHeader = (const DaqSharedHeader*) Memory.Data();
+    uInt32 nChannels = pHeader->nChannels, nBlockScans = pHeader->nBlockScans;
+    bool bRaw = (pHeader->nSampleType == DAQ_FILE_INT16);
+    std::vector<float64> Volts((size_t) nChannels * nBlockScans);
+    std::vector<int16> Codes(bRaw ? (size_t) nChannels * nBlockScans : 0);
+    std::vector<double> Squares(nChannels);
+    
+    printf("%.*s: %u channels at %g S/s, blocks of %u samples, %s\n", (int) pHeader->nChannelsLength, daqSharedChannels(pHeader),
+           nChannels, pHeader->fRate, nBlockScans, bRaw ? "int16" : "double");
+    
+    uInt64 nSequence = daqSharedOldest(pHeader, pHeader->nPublished.load(std::memory_order_acquire));
+    uInt64 nRead = 0, nLost = 0, nScans = 0;
+    auto tReport = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    
+    while (true)
+    {
+        uInt64 nPublished = pHeader->nPublished.load(std::memory_order_acquire);
+        uInt64 nOldest = daqSharedOldest(pHeader, nPublished);
+        
+        if (nSequence < nOldest)
+        {
+            nLost += nOldest - nSequence;
+            nSequence = nOldest;
+        }
+        
+        if (nSequence == nPublished)
+        {
+            if (pHeader->nState.load() != DAQ_SHARED_RUNNING)
+            {
+                break;
+            }
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        
+        for (; nSequence < nPublished; nSequence++)
+        {
+            void *lpOut = bRaw ? (void*) Codes.data() : (void*) Volts.data();
+            uInt32 nBlock = 0;
+            
+            if (!daqSharedCopyBlock(pHeader, nSequence, lpOut, nBlockScans, &nBlock))
+            {
+                nLost++;
+                continue;
+            }
+            
+            for (uInt32 i = 0; i < nChannels; i++)
+            {
+                for (uInt32 j = 0; j < nBlock; j++)
+                {
+                    size_t n = (size_t) i * nBlockScans + j;
+                    double fValue = bRaw ? scaleCode(daqSharedScaling(pHeader) + (size_t) i * pHeader->nCoeffs, pHeader->nCoeffs, Codes[n]) :
+                                           Volts[n];
+                    
+                    Squares[i] += fValue * fValue;
+                }
+            }
+            
+            nRead++;
+            nScans += nBlock;
+        }
+        
+        if (std::chrono::steady_clock::now() >= tReport)
+        {
+            printf("%llu blocks read, %llu lost, RMS", (unsigned long long) nRead, (unsigned long long) nLost);
+            
+            for (uInt32 i = 0; i < nChannels; i++)
+            {
+                printf(" %.4f", nScans > 0 ? sqrt(Squares[i] / nScans) : 0.0);
+                Squares[i] = 0;
+            }
+            
+            printf("\n");
+            nScans = 0;
+            tReport += std::chrono::seconds(1);
+        }
+    }
+    
+    printf("The adquisition stopped after %llu blocks", (unsigned long long) pHeader->nPublished.load());
+    
+    if (pHeader->nError.load() != 0)
+    {
+        printf(" with DAQmx error %d", (int) pHeader->nError.load());
+    }
+    
+    printf(".\n");
+    
+    return 0;
+}
@@ -0,0 +1,71 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqSpectrumBenchmark.m
+%
+% Checks that the 'Spectrum' mode of daqAdquireData keeps up with the
+% device at its maximum single channel rate for several spectrum lengths.
+%
+% The spectrum is computed on the MATLAB thread while the driver buffers
+% the next samples, so it keeps up as long as the call takes about as long
+% as the capture itself and no buffer overflow is reported. The CPU load is
+% the processor time spent by MATLAB divided by the capture time.
+%
+% On the simulated device the samples can also be produced as fast as
+% they are read, which gives the throughput of the spectrum itself: it
+% keeps up with the device as long as that is above the maximum rate.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 3.0; % Voltage range we want to measure
+Device = 'SimDev1'; % Change this value for the name of the device installed
+                    % in your system.
+Channel = 'SimDev1/ai0'; % Same as above
+Properties = daqDeviceProperties(Device);
+Rate = Properties.AIMaxSingleChannelRate;
+Type = 'Voltage';
+Duration = 10; % Seconds adquired for each spectrum length
+Lengths = [256 1024 4096 16384 65536]; % Spectrum lengths measured
+
+Samples = Rate * Duration;
+
+fprintf('%d S/s for %d s (%d samples)\n', Rate, Duration, Samples);
+
+for NFFT = Lengths
+    Start = cputime;
+    tic;
+
+    try
+        [Pxx, F] = daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Spectrum', NFFT);
+        Elapsed = toc;
+        Load = (cputime - Start) / Duration;
+
+        fprintf('NFFT %6d: %.2f s elapsed, CPU load %5.1f%%, %d bins\n', NFFT, Elapsed, 100 * Load, numel(F));
+    catch Error
+        fprintf('NFFT %6d: did not keep up (%s)\n', NFFT, Error.message);
+    end
+end
+
+% Throughput without the sample clock, simulated devices only
+if strncmp(Device, 'SimDev', 6)
+    daqAdquireData('simulate', Device, 'Realtime', false);
+
+    for NFFT = Lengths
+        tic;
+        daqAdquireData(Rate, Channel, Range, Type, Samples, Device, 'Spectrum', NFFT);
+        Throughput = Samples / toc;
+
+        fprintf('NFFT %6d: %.1f MS/s, %.1f times the maximum rate\n', NFFT, Throughput / 1e6, Throughput / Rate);
+    end
+
+    daqAdquireData('simulate', Device, 'Realtime', true);
+end
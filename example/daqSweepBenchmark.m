@@ -0,0 +1,62 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqSweepBenchmark.m
+%
+% Compares a characterization sweep of short captures over rates, ranges
+% and channels run as a loop of daqAdquireData calls with the same sweep
+% run in a single call, against the time the captures themselves take.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Device = 'SimDev1'; % Change this value for the name of the device installed
+                    % in your system.
+Channels = {'SimDev1/ai0', 'SimDev1/ai1', 'SimDev1/ai0:3', 'SimDev1/ai0:7'};
+Ranges = [1, 10];
+Rates = [10000, 50000, 100000, 200000, 500000];
+Samples = 100; % Short captures, so the overhead of each one shows
+Type = 'Voltage';
+Repeats = 25; % Times the whole table is swept, 1000 captures in total
+
+[C, R, F, K] = ndgrid(1:numel(Channels), 1:numel(Ranges), 1:numel(Rates), 1:Repeats);
+Rows = numel(C);
+Configs = cell(Rows, 6);
+
+for i = 1:Rows
+    Configs(i, :) = {Rates(F(i)), Channels{C(i)}, Ranges(R(i)), Type, Samples, Device};
+end
+
+Acquisition = sum(Samples ./ [Configs{:, 1}]);
+
+% The usual loop, with the task cache evicting tasks as the rates change
+daqAdquireData('clear');
+tic;
+
+for i = 1:Rows
+    daqAdquireData(Configs{i, :});
+end
+
+Loop = toc;
+daqAdquireData('clear');
+
+% The same captures in a single call
+tic;
+[Results, Timing] = daqAdquireData(Configs);
+Sweep = toc;
+
+Clock = cellfun(@(T) T.Seconds.Clock, Timing);
+Cached = cellfun(@(T) T.Cached, Timing);
+
+fprintf('%d captures, %.1f ms of acquisition\n', Rows, 1000 * Acquisition);
+fprintf('Loop:  %.1f ms, %.3f ms overhead per capture\n', 1000 * Loop, 1000 * (Loop - Acquisition) / Rows);
+fprintf('Sweep: %.1f ms, %.3f ms overhead per capture\n', 1000 * Sweep, 1000 * (Sweep - Acquisition) / Rows);
+fprintf('Sweep captures on a reused task: %d, clock reconfigured %d times\n', sum(Cached), sum(Clock > 0));
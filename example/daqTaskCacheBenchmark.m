@@ -0,0 +1,62 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqTaskCacheBenchmark.m
+%
+% Measures the per-call latency of daqAdquireData when small blocks are
+% polled at a high rate, with and without the task cache.
+%
+% Without the cache every call creates, configures and clears its task;
+% this is emulated by evicting the task after each call. The simulated
+% device takes as long as a real one to configure a task, so the
+% benchmark runs without hardware.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Range = 3.0; % Voltage range we want to measure
+Device = 'SimDev1'; % Change this value for the name of the device installed
+                    % in your system.
+Channel = 'SimDev1/ai0'; % Same as above
+Rate = 100000; % Sampling rate in samples per second
+Samples = 100; % Small blocks, so the task setup dominates each call
+Type = 'Voltage';
+Calls = 200; % Number of calls measured in each case
+
+daqAdquireData('clear');
+
+% Without cache: every call pays for the whole task setup
+Uncached = zeros(1, Calls);
+
+for i = 1:Calls
+    tic;
+    daqAdquireData(Rate, Channel, Range, Type, Samples, Device);
+    Uncached(i) = toc;
+    daqAdquireData('evict', Rate, Channel, Range, Type, Samples, Device);
+end
+
+% With cache: the first call creates the task, the rest reuse it
+daqAdquireData(Rate, Channel, Range, Type, Samples, Device);
+Cached = zeros(1, Calls);
+
+for i = 1:Calls
+    tic;
+    daqAdquireData(Rate, Channel, Range, Type, Samples, Device);
+    Cached(i) = toc;
+end
+
+daqAdquireData('clear');
+
+Acquisition = Samples / Rate;
+
+fprintf('Acquisition time per call: %.3f ms\n', 1000 * Acquisition);
+fprintf('Without cache: median %.3f ms, max %.3f ms per call\n', 1000 * median(Uncached), 1000 * max(Uncached));
+fprintf('With cache:    median %.3f ms, max %.3f ms per call\n', 1000 * median(Cached), 1000 * max(Cached));
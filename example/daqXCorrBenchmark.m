@@ -0,0 +1,74 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% daqXCorrBenchmark.m
+%
+% Estimates the delays between channels of a capture with daqXCorr and
+% times it on 1, 2, 4... threads, and against a loop of xcorr over the
+% same pairs when the Signal Processing Toolbox is installed. The
+% capture is white noise delayed by a known number of samples on every
+% channel, so the delays found can be checked.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Lesser General Public
+% License as published by the Free Software Foundation; either
+% version 3.0 of the License, or (at your option) any later version.
+
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Lesser General Public License for more details.
+
+% You should have received a copy of the GNU Lesser General Public
+% License along with this library.
+
+Channels = 16;
+Samples = 2^20;
+MaxLag = 1000; % Largest delay searched, in samples
+Delays = round(linspace(0, 500, Channels)); % Delay of every channel
+
+Source = randn(Samples + max(Delays), 1);
+Data = zeros(Samples, Channels);
+
+for Channel = 1:Channels
+    Data(:, Channel) = Source((1:Samples) + max(Delays) - Delays(Channel)) + 0.5 * randn(Samples, 1);
+end
+
+% Every pair of distinct channels, as daqXCorr takes them by default
+[First, Second] = find(triu(ones(Channels), 1));
+Pairs = sortrows([First, Second]);
+
+fprintf('%d channels, %d pairs, %d samples, lags up to %d\n', Channels, size(Pairs, 1), Samples, MaxLag);
+
+Threads = 1;
+Single = 0;
+
+while Threads <= feature('numcores')
+    tic;
+    [Lags, Peaks] = daqXCorr(Data, 'MaxLag', MaxLag, 'Scale', 'coeff', 'Threads', Threads);
+    Elapsed = toc;
+
+    if Threads == 1
+        Single = Elapsed;
+    end
+
+    fprintf('%2d threads: %.2f s, %.1f times one thread\n', Threads, Elapsed, Single / Elapsed);
+    Threads = 2 * Threads;
+end
+
+Expected = Delays(Pairs(:, 1)) - Delays(Pairs(:, 2));
+fprintf('Delays found: %d of %d\n', sum(Lags(:)' == Expected), numel(Expected));
+
+if exist('xcorr', 'file') == 2
+    tic;
+
+    for Pair = 1:size(Pairs, 1)
+        R = xcorr(Data(:, Pairs(Pair, 1)), Data(:, Pairs(Pair, 2)), MaxLag, 'coeff');
+    end
+
+    fprintf('xcorr over every pair: %.2f s\n', toc);
+end
+
+% The same correlations while acquiring, on the default sines of a
+% simulated device, without keeping the samples
+[Lags, Peaks] = daqAdquireData(100000, 'SimDev1/ai0:3', 10.0, 'Voltage', 1000000, 'SimDev1', ...
+                               'XCorr', 100, 'Scale', 'coeff');
+disp([Lags, Peaks]);
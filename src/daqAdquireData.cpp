@@ -19,7 +19,9 @@
 //
 //     - ChannelName: name of the physical channel that is going to be used
 //                    for the adquisition. Check the channel names avaible
-//                    using the function "daqDeviceProperties"
+//                    using the function "daqDeviceProperties". Several
+//                    channels are adquired at once using a list or a range
+//                    like "Dev1/ai0, Dev1/ai3" or "Dev1/ai0:7"
 //
 //      - InputRange: maximum amplitude expected to adquire. Must not exceed
 //                    the maximum ranges supported by the device
@@ -36,7 +38,457 @@
 //                    "daqDeviceList"
 //
 //    - AdquiredData: a row vector with the data adquired by the device with length
-//                    equal to the number of samples told to adquire
+//                    equal to the number of samples told to adquire. When
+//                    several channels are used, a matrix with one column
+//                    per channel and one row per sample. The samples are
+//                    read in chunks straight into it, and the driver
+//                    buffers a few chunks or two seconds of them, so a
+//                    capture needs about the memory of its result. Several
+//                    channels also take one chunk per channel of scratch
+//                    memory, from which each chunk is moved to its column.
+//                    If the device stops early, only the samples read are
+//                    returned
+//
+//                    ------ OPTIONS ------
+//
+// Options are given as name/value pairs after the arguments above:
+//
+// [AdquiredData, Scaling] = daqAdquireData(..., Device (s), 'Raw', true)
+//
+//           - 'Raw': returns the raw ADC codes as int16 instead of volts,
+//                    which takes a quarter of the memory. Scaling holds
+//                    the polynomial coefficients that turn the codes of
+//                    each channel into volts, one column per channel and
+//                    lowest order first. Use "daqScaleData" to convert
+//
+// [AdquiredData] = daqAdquireData(..., Device (s), 'OutputClass', 'single')
+// [AdquiredData, Quantum] = daqAdquireData(..., Device (s), 'OutputClass', 'int32')
+//
+//   - 'OutputClass': class of the samples in volts: 'double' (default),
+//                    'single', which takes half the memory and rounds
+//                    them by at most 1/32 of a code for converters of
+//                    up to 20 bits, or 'int32' fixed point, where
+//                    AdquiredData * Quantum gives the volts and Quantum
+//                    is InputRange / 2^30. Raw codes are read and scaled
+//                    straight into the output as every block arrives;
+//                    converters wider than 16 bits are read in volts
+//                    instead, since their codes do not fit an int16
+//
+// [Compressed, Scaling] = daqAdquireData(..., Device (s), 'Compress', true)
+//
+//      - 'Compress': adquires raw codes and compresses every block as it
+//                    is read, without losing any information, so only
+//                    the compressed capture is kept in memory. Compressed
+//                    is a uint8 column; use "daqDecompress" to get the
+//                    codes back and "daqScaleData" with Scaling to turn
+//                    them into volts
+//
+// [Info] = daqAdquireData(..., Device (s), 'File', FileName (s))
+//
+//          - 'File': streams the adquisition to the given file instead of
+//                    returning it, so its length is only limited by the
+//                    disk. Blocks are written by a background thread while
+//                    the next ones are adquired. Combine with 'Raw' to store
+//                    int16 codes. Info holds the number of Samples, Bytes
+//                    and Blocks written, the MaxQueueDepth of blocks waiting
+//                    for the disk and the number of Stalls, times the
+//                    adquisition had to wait for the disk. Use "daqReadFile"
+//                    to read the file back
+//
+// [AdquiredData] = daqAdquireData(..., Device (s), 'Decimate', Factor (n),
+//     'Filter', Filter, 'FilterOrder', Order (n))
+// [AdquiredData] = daqAdquireData(..., Device (s), 'Resample', [Up Down] (n))
+//
+//      - 'Decimate': keeps one of every Factor samples. Only the decimated
+//                    samples are stored, so NumberOfSamples can be much
+//                    larger than what fits in memory
+//
+//        - 'Filter': filter applied to each channel before decimating. It
+//                    is either a vector of FIR coefficients, giving the
+//                    same result as downsample(filter(Filter, 1, x), Factor),
+//                    or 'cic' for a cascade of Order moving averages of
+//                    Factor samples (Order defaults to 3). The filter runs
+//                    on every block as it is adquired
+//
+//      - 'Resample': resamples every channel by Up/Down, natural values up
+//                    to 1024, with a windowed-sinc polyphase filter that
+//                    removes what the lower rate cannot hold, as every
+//                    block is adquired. Output m is the input at
+//                    m * Down / Up; use "daqResample" to align captures
+//                    taken at different rates afterwards
+//
+// [Spectrum, Frequency] = daqAdquireData(..., Device (s), 'Spectrum', NFFT (n),
+//     'Overlap', Overlap (n))
+//
+//      - 'Spectrum': returns the power spectral density of each channel
+//                    instead of the samples, estimated with Welch's method
+//                    on segments of NFFT samples (a power of two) with a
+//                    Hann window. Spectrum has NFFT/2+1 rows, in V^2/Hz,
+//                    and one column per channel; Frequency holds the
+//                    frequency of each row. It matches
+//                    pwelch(x, hann(NFFT), Overlap, NFFT, SamplingPeriod),
+//                    but every segment is transformed as soon as it is
+//                    adquired, so the memory used does not depend on
+//                    NumberOfSamples
+//
+//       - 'Overlap': samples shared by consecutive segments. Defaults to
+//                    NFFT/2
+//
+// [Stats] = daqAdquireData(..., Device (s), 'Statistics', Window (n), 'Bins', Bins (n))
+//
+//    - 'Statistics': returns only the aggregates of every Window samples
+//                    of each channel, computed as the samples are read,
+//                    so the memory used does not depend on
+//                    NumberOfSamples. Stats holds the Window and the
+//                    Min, Max, Mean, RMS and Std (normalized by N - 1)
+//                    of every window, laid out as the samples would be
+//                    with one row per window. The last window may be
+//                    shorter
+//
+//          - 'Bins': also counts the samples of the whole adquisition
+//                    of each channel in Bins equal bins between
+//                    -InputRange and InputRange. Stats.Histogram has one
+//                    column per channel and Stats.BinEdges the Bins + 1
+//                    edges. Samples out of range count in the outer bins
+//
+// [AdquiredData, Envelope] = daqAdquireData(..., Device (s), 'Envelope', true)
+//
+//      - 'Envelope': also returns the min/max envelope of the capture,
+//                    built from every block as it is read, to plot long
+//                    captures with "daqEnvelope" without going through
+//                    all of their samples again
+//
+// [Lags, Peaks, Correlation] = daqAdquireData(..., Device (s), 'XCorr', MaxLag (n),
+//     'Pairs', Pairs (f), 'Scale', Scale (s))
+//
+//         - 'XCorr': returns the cross-correlation of every pair of
+//                    channels from lag -MaxLag to MaxLag instead of the
+//                    samples, computed on every block as it is adquired,
+//                    so only the correlations are ever stored. Lags holds
+//                    the lag of the largest absolute correlation of each
+//                    pair, positive when the first channel lags the
+//                    second, Peaks the correlation there and Correlation
+//                    one column per pair, as "daqXCorr" returns them for
+//                    the whole capture
+//
+//         - 'Pairs': channels to correlate, one pair per row. Defaults to
+//                    every pair of distinct channels, or [1 1] for one
+//
+//         - 'Scale': 'none' (the default), 'biased', 'unbiased' or
+//                    'coeff', as in xcorr
+//
+// [Events, Times] = daqAdquireData(..., Device (s), 'Trigger', Type (s),
+//     'Level', Level (f), 'TriggerChannel', Channel (n), 'PreTrigger', Pre (n),
+//     'PostTrigger', Post (n), 'HoldOff', HoldOff (n), 'MaxEvents', Max (n))
+//
+//       - 'Trigger': adquires continuously and keeps only the samples
+//                    around each event found on TriggerChannel (1 by
+//                    default): 'rising' or 'falling' when it crosses
+//                    Level, 'slope' when it changes by Level or more from
+//                    one sample to the next (or by Level or less if it is
+//                    negative), and 'window' when it leaves [Low High].
+//                    NumberOfSamples is the most samples scanned; the
+//                    adquisition stops as soon as MaxEvents (1 by default)
+//                    events are complete
+//
+//        - Events: Pre + Post samples of every event, Pre before the
+//                    trigger and Post (1000 by default) from it on, one
+//                    column per event, or one page per event with one
+//                    column per channel. Events cut off by the end of the
+//                    adquisition are left out
+//
+//         - Times: seconds from the start of the adquisition to each
+//                    trigger
+//
+//       - 'HoldOff': samples after a trigger in which no other is
+//                    accepted. Defaults to Post, so events do not overlap
+//
+// [AdquiredData] = daqAdquireData(..., Device (s), 'CPU', Core (n), 'Priority', Priority (n))
+//
+//           - 'CPU': reads on a thread of its own, pinned to Core (counted
+//                    from 0), while MATLAB waits. The memory the samples
+//                    go to is written to and locked beforehand, so no read
+//                    waits for the system to bring in a page, and every
+//                    read is measured for 'rtstats'. Only 'Raw' and
+//                    'OutputClass' may be combined with it
+//
+//      - 'Priority': real-time priority of that thread, from 1 to 99:
+//                    SCHED_FIFO on Linux and, on Windows, the highest
+//                    priority or time-critical from 50 on. 0 keeps the
+//                    normal scheduling, to compare against. Either option
+//                    alone moves the reads to their own thread
+//
+//                    ------ SEVERAL DEVICES ------
+//
+// [AdquiredData (f)] = daqAdquireData(SamplingPeriod (n), {Channels1 (s), Channels2 (s), ...},
+//     InputRange (f), AdquisitionType (s), NumberOfSamples (n), {Device1 (s), Device2 (s), ...})
+//
+//         - Devices: several devices adquired at once, each with the
+//                    channels in the matching cell. The first one is
+//                    the master: the others take its sample clock and
+//                    start trigger, which the driver routes over the RTSI
+//                    cable or the PXI backplane, so every sample is taken
+//                    at the same instant on every device. Each device is
+//                    read on its own thread, so the call lasts about as
+//                    long as a single device would. AdquiredData has the
+//                    columns of each device in order. No options are
+//                    accepted, and the task cache is not used
+//
+//                    ------ ASYNCHRONOUS ADQUISITION ------
+//
+// [Handle] = daqAdquireData(..., Device (s), 'Async', true)
+// [Done] = daqAdquireData('isdone', Handle)
+// [Done] = daqAdquireData('wait', Handle, Timeout (f))
+// [AdquiredData, Scaling] = daqAdquireData('fetch', Handle)
+// daqAdquireData('cancel', Handle)
+//
+//         - 'Async': returns at once with a Handle while a background
+//                    thread adquires. MATLAB can meanwhile process the
+//                    previous block, so a loop that adquires and then
+//                    analyses keeps the device busy. Only 'Raw' may be
+//                    combined with it, and each outstanding adquisition
+//                    needs its own channels. The task cache is not used
+//
+//        - 'isdone': tells, without blocking, whether the adquisition
+//                    has ended
+//
+//          - 'wait': blocks until the adquisition ends or Timeout
+//                    seconds go by (forever if not given) and tells
+//                    whether it has ended
+//
+//         - 'fetch': waits for the adquisition and returns the samples
+//                    as a blocking call would, with the Scaling if 'Raw'
+//                    was set. The samples are not copied: the thread
+//                    reads them into the memory of the output. The
+//                    Handle is released
+//
+//        - 'cancel': stops the adquisition within about a tenth of a
+//                    second and discards its samples
+//
+//                    ------ TIMING ------
+//
+// [AdquiredData, Timing] = daqAdquireData(...)
+// [AdquiredData, Scaling, Timing] = daqAdquireData(..., 'Raw', true)
+// [Compressed, Scaling, Timing] = daqAdquireData(..., 'Compress', true)
+// [Spectrum, Frequency, Timing] = daqAdquireData(..., 'Spectrum', NFFT (n))
+// [Events, Times, Timing] = daqAdquireData(..., 'Trigger', Type (s), ...)
+// [Stats, Timing] = daqAdquireData(..., 'Statistics', Window (n))
+// [AdquiredData, Envelope, Timing] = daqAdquireData(..., 'Envelope', true)
+// [Lags, Peaks, Correlation, Timing] = daqAdquireData(..., 'XCorr', MaxLag (n))
+// [Info, Timing] = daqAdquireData(..., 'File', FileName (s))
+// [AdquiredData, Timing] = daqAdquireData(..., {Device1 (s), Device2 (s), ...})
+//
+//          - Timing: where the time of the call went. Seconds holds the
+//                    time spent creating the task (Create), adding the
+//                    channels (Channel), configuring the sample clock
+//                    (Clock), checking the device limits (Limits),
+//                    committing (Commit) and starting it (Start), in the
+//                    driver reads (Read), creating and filling the outputs
+//                    (Copy), filtering, transforming, compressing,
+//                    reducing, scanning for triggers or queueing the
+//                    samples for the disk
+//                    (Process), stopping the task (Stop) and in the
+//                    whole call (Total). Cached tells whether the task
+//                    came from the task cache. Also holds
+//                    SamplesRequested and SamplesRead per channel, the
+//                    Bytes and number of driver Reads, and the first
+//                    driver Error code, or 0
+//
+// [Stats] = daqAdquireData('stats')
+// daqAdquireData('stats', Enable)
+// daqAdquireData('resetstats')
+//
+//         - 'stats': returns the totals of every blocking call since the
+//                    last reset: Calls, Errors, LastError, Samples, Bytes,
+//                    Reads, the total and maximum Seconds of each phase,
+//                    and a Histogram of each phase's duration with the
+//                    upper BinEdges in seconds, doubling from 1 us. They
+//                    are only collected after daqAdquireData('stats', true),
+//                    so calls are not timed unless asked to
+//
+//    - 'resetstats': clears the totals, and those of 'rtstats'
+//
+// [Realtime] = daqAdquireData('rtstats')
+//
+//       - 'rtstats': returns the reads of every thread started with 'CPU'
+//                    or 'Priority' since the last reset, a continuous
+//                    adquisition still running included: the number of
+//                    Reads and Samples, Overruns, reads that found the
+//                    driver buffer overwritten, Stalls, waits of the
+//                    continuous reader for 'read' to make room, and the
+//                    Latency and Jitter of the reads as histograms with
+//                    the BinEdges of 'stats' and their maxima, MaxLatency
+//                    and MaxJitter, in seconds. Latency is how long a read
+//                    took, and Jitter how far from the schedule of the
+//                    sample clock it returned, which grows when the thread
+//                    wakes up late. CPU, Priority and Locked tell what the
+//                    system granted to the last thread: pinning it needs
+//                    no privileges, but a real-time priority and locked
+//                    memory may need CAP_SYS_NICE and a large enough
+//                    memlock limit on Linux. Whatever is refused is left
+//                    as it was, shown as -1, 0 or false, and the reads go
+//                    on
+//
+//                    ------ CONTINUOUS MODE ------
+//
+// daqAdquireData('start', SamplingPeriod (n), ChannelName (s), InputRange (f),
+//     AdquisitionType (s), BufferSamples (n), Device (s), 'CPU', Core (n),
+//     'Priority', Priority (n))
+// [AdquiredData (f)] = daqAdquireData('read')
+// daqAdquireData('stop')
+//
+//         - 'start': starts adquiring continuously on a background thread.
+//                    The arguments are the same as above, except for
+//                    BufferSamples, which is the number of samples kept
+//                    between two 'read' calls. Only one continuous
+//                    adquisition may be running at the same time. 'CPU'
+//                    and 'Priority' set up the background thread as they
+//                    do for a blocking call, with the buffer locked in
+//                    memory
+//
+//          - 'read': returns, without blocking, every sample adquired since
+//                    the previous 'read', laid out as above. It is empty
+//                    if nothing has arrived yet. No sample is ever dropped:
+//                    if the buffer overflows, the samples already adquired
+//                    are returned first and the next 'read' raises the error
+//
+//          - 'stop': stops the adquisition and releases the device
+//
+//                    ------ PUBLISHING ------
+//
+// daqAdquireData('publish', Name (s), SamplingPeriod (n), ChannelName (s),
+//     InputRange (f), AdquisitionType (s), BlockSamples (n), Device (s),
+//     'Blocks', Blocks (n), 'Raw', Raw)
+// daqAdquireData('unpublish')
+//
+//       - 'publish': adquires continuously on a background thread into a
+//                    ring of Blocks blocks (64 by default) of BlockSamples
+//                    samples per channel, in memory shared under Name with
+//                    any number of readers in other MATLAB sessions or
+//                    programs, which attach with "daqSubscribe". The
+//                    driver writes every block straight into the ring and
+//                    the writer never waits for the readers: one that
+//                    falls more than Blocks blocks behind is told how many
+//                    it lost. With 'Raw', int16 codes are published
+//                    together with their scaling. Only one adquisition
+//                    may be published from a session at the same time
+//
+//     - 'unpublish': stops publishing and releases the device. Readers
+//                    can still get the blocks left in the ring
+//
+//                    ------ TASK CACHE ------
+//
+// The tasks used by blocking calls are kept configured between calls, so
+// repeating an adquisition with the same arguments only starts, reads and
+// stops the task. They are released with:
+//
+// daqAdquireData('evict', SamplingPeriod (n), ChannelName (s), InputRange (f),
+//     AdquisitionType (s), NumberOfSamples (n), Device (s))
+// daqAdquireData('clear')
+//
+//         - 'evict': releases the task matching the arguments, if any
+//
+//         - 'clear': releases every cached task
+//
+//                    ------ SWEEPS ------
+//
+// [Results, Timing] = daqAdquireData(Configs (c))
+//
+// - c denotes a cell array
+//
+//         - Configs: one row per adquisition with the six arguments of a
+//                    blocking call, in the same order. Every row is
+//                    checked, and the task of each device, channels and
+//                    range created, before the first capture, so a bad
+//                    row fails the sweep at once. Rows sharing a task only
+//                    change its sample clock, and only when it differs
+//                    from the previous row on that task. The tasks are
+//                    released when the sweep ends
+//
+//         - Results: a column cell array with the samples of each row,
+//                    laid out as a blocking call returns them
+//
+//          - Timing: a column cell array with the timing of each row, as
+//                    described above. Cached tells whether the task had
+//                    already run a previous row
+//
+//                    ------ DEVICE CACHE ------
+//
+// The rate and range limits of each device are read from the driver the
+// first time it is used and kept for the rest of the session.
+//
+// daqAdquireData('refresh')
+//
+//       - 'refresh': queries the devices again on their next use
+//
+//                    ------ SIMULATED DEVICES ------
+//
+// Devices named SimDev1, SimDev2... are simulated in software, so the
+// library can be tried and benchmarked without hardware. They have eight
+// channels, ai0 to ai7, sampled simultaneously at up to 1 MS/s, and
+// deliver samples at the requested rate as a real device would. By
+// default channel aiK outputs a 1 V sine of 100*(K+1) Hz.
+//
+// daqAdquireData('simulate', Target (s), 'Signal', Shape (s),
+//     'Amplitude', A (f), 'Frequency', F (f), 'Offset', O (f), 'Noise', N (f),
+//     'Delay', D (f), 'Latency', L (f), 'SetupLatency', S (f), 'Realtime', R)
+// daqAdquireData('simulate')
+//
+//      - 'simulate': configures the signal of a simulated device, such as
+//                    'SimDev1', or of one of its channels, such as
+//                    'SimDev1/ai2', for the adquisitions started from then
+//                    on. Options not given keep their current value.
+//                    Without a target, every simulated device is reset
+//
+//        - 'Signal': 'sine', 'noise' (gaussian, with a standard deviation
+//                    of Amplitude), 'step' (from 0 to Amplitude after
+//                    Delay seconds) or 'output' (Amplitude times the last
+//                    value written to ao0 for even channels or ao1 for
+//                    odd ones, through a first order lag of Delay
+//                    seconds, to close a loop with "daqControlLoop"),
+//                    plus Offset volts and gaussian noise with a standard
+//                    deviation of Noise volts
+//
+//       - 'Latency': seconds every read takes besides waiting for the
+//                    samples. 'SetupLatency' is the time to configure a
+//                    task. Both apply to a whole device
+//
+//      - 'Realtime': when false, samples are produced as fast as they are
+//                    read instead of at the sampling rate, to measure the
+//                    overhead of the library itself
+//
+//                    ------ REPLAY DEVICES ------
+//
+// A device named 'file:' followed by a path, such as 'file:/data/run.bin',
+// plays back the capture stored in that file through every mode above,
+// so a processing chain can be tried on real signals without hardware.
+// Its channels are the columns of the capture, 'file:/data/run.bin/ai0'
+// and on. The file may be a recording made with 'File', a .csv or .txt
+// file with one scan per line, or raw samples interleaved by scan. One
+// sample is delivered per tick of the sampling rate requested, at the
+// ranges of the simulated devices. Raw codes are those of a recording, or
+// volts quantized to the range otherwise. A finite capture may not be
+// longer than the file unless it loops; a continuous one stops receiving
+// samples at its end.
+//
+// daqAdquireData('replay', Device (s), 'Speed', S (f), 'Loop', L,
+//     'Format', F (s), 'Channels', C (n))
+// daqAdquireData('replay')
+//
+//        - 'replay': configures a replay device for the tasks started from
+//                    then on. Options not given keep their current value.
+//                    Without a device, every replay device is reset and
+//                    the cached tasks are cleared
+//
+//         - 'Speed': times real time the samples are delivered at, 1 by
+//                    default. At 0 they are delivered as fast as they are
+//                    read, to measure the throughput of the processing
+//
+//          - 'Loop': when true, the file starts over at its end
+//
+//        - 'Format': 'double' (the default), 'single' or 'int16', the type
+//                    of the samples of a raw file. 'Channels' is how many
+//                    channels it interleaves, 1 by default
 //
 // Created 15/5/2012
 // Cesar Gonzalez Segura
@@ -55,18 +507,170 @@
 // You should have received a copy of the GNU Lesser General Public
 // License along with this library.
 
-#include "NIDAQmx.h"
+#include "daqDriver.h"
 #include "mex.h"
 #include "string.h"
-#pragma comment(lib, "NIDAQmx.lib")
+#include "daqAsync.h"
+#include "daqCodec.h"
+#include "daqContinuous.h"
+#include "daqDeviceInfo.h"
+#include "daqEnvelope.h"
+#include "daqFileWriter.h"
+#include "daqFilter.h"
+#include "daqPublisher.h"
+#include "daqRead.h"
+#include "daqRealtime.h"
+#include "daqResample.h"
+#include "daqScale.h"
+#include "daqSpectrum.h"
+#include "daqStatistics.h"
+#include "daqSync.h"
+#include "daqTaskCache.h"
+#include "daqTiming.h"
+#include "daqTrigger.h"
+#include "daqXCorr.h"
+
+// Positional arguments shared by the blocking call and 'start'
+struct DaqArguments
+{
+    char *lpChannel;
+    char *lpDevice;
+    int32 nAdquisitionType;
+    float64 fMaxVolts;
+    float64 nSamplingPeriod;
+    float64 nSamples;
+};
+
+// Optional name/value pairs following the positional arguments
+struct DaqOptions
+{
+    bool bRaw;
+    char *lpFile;
+    int nDecimate;
+    float64 *lpTaps;
+    int nTaps;
+    bool bCic;
+    int nFilterOrder;
+    int nSpectrum;
+    int nOverlap;
+    int nTrigger;
+    float64 lpLevel[2];
+    int nLevels;
+    int nTriggerChannel;
+    int nPreTrigger;
+    int nPostTrigger;
+    int nHoldOff;
+    int nMaxEvents;
+    bool bAsync;
+    bool bCompress;
+    int nStatistics;
+    int nBins;
+    bool bEnvelope;
+    mxClassID nOutputClass;
+    int nUp;
+    int nDown;
+    int nMaxLag;
+    float64 *lpPairs;
+    int nPairs;
+    int nScale;
+    DaqRealtimeConfig Realtime;
+    bool bRealtime;
+};
+
+// Modes the options select, as bits of a mask. Each mode lists the
+// ones it can be combined with, both ways, and checkModes refuses
+// any other combination.
+#define DAQ_MODE_RAW 0
+#define DAQ_MODE_FILE 1
+#define DAQ_MODE_FILTER 2
+#define DAQ_MODE_SPECTRUM 3
+#define DAQ_MODE_TRIGGER 4
+#define DAQ_MODE_ASYNC 5
+#define DAQ_MODE_COMPRESS 6
+#define DAQ_MODE_STATISTICS 7
+#define DAQ_MODE_ENVELOPE 8
+#define DAQ_MODE_CLASS 9
+#define DAQ_MODE_RESAMPLE 10
+#define DAQ_MODE_XCORR 11
+#define DAQ_MODE_REALTIME 12
+#define DAQ_MODES 13
+
+#define DAQ_MODE_BIT(nMode) (1u << (nMode))
+
+struct DaqMode
+{
+    const char *lpName;
+    unsigned int nCompatible;
+};
+
+static const DaqMode g_Modes[DAQ_MODES] =
+{
+    {"'Raw'", DAQ_MODE_BIT(DAQ_MODE_FILE) | DAQ_MODE_BIT(DAQ_MODE_ASYNC) | DAQ_MODE_BIT(DAQ_MODE_COMPRESS) |
+              DAQ_MODE_BIT(DAQ_MODE_REALTIME)},
+    {"'File'", DAQ_MODE_BIT(DAQ_MODE_RAW)},
+    {"'Decimate' and 'Filter'", 0},
+    {"'Spectrum'", 0},
+    {"'Trigger'", 0},
+    {"'Async'", DAQ_MODE_BIT(DAQ_MODE_RAW)},
+    {"'Compress'", DAQ_MODE_BIT(DAQ_MODE_RAW)},
+    {"'Statistics'", 0},
+    {"'Envelope'", 0},
+    {"'OutputClass'", DAQ_MODE_BIT(DAQ_MODE_REALTIME)},
+    {"'Resample'", 0},
+    {"'XCorr'", 0},
+    {"'CPU' and 'Priority'", DAQ_MODE_BIT(DAQ_MODE_RAW) | DAQ_MODE_BIT(DAQ_MODE_CLASS)}
+};
+
+// Default order of the CIC decimation filter
+#define DAQ_CIC_ORDER 3
+
+// Seconds of samples the driver buffers for the modes that consume
+// the capture as it is read, and the fewest stream reads it holds
+#define DAQ_STREAM_BUFFER_SECONDS 2
+#define DAQ_STREAM_BUFFER_CHUNKS 8
+
+// Samples per channel kept after a trigger when 'PostTrigger' is not given
+#define DAQ_TRIGGER_POST 1000
+
+// Steps of the full range in an int32 output: a quantum of Range/2^30
+// resolves far finer than any ADC and leaves room for overrange
+#define DAQ_FIXED_STEPS 1073741824.0
+
+// Blocks in the ring of 'publish' when 'Blocks' is not given
+#define DAQ_PUBLISH_BLOCKS 64
+
+// Blocks scanned for triggers last about 1/DAQ_TRIGGER_BLOCK_RATE
+// seconds, so a capture stops soon after its last event
+#define DAQ_TRIGGER_BLOCK_RATE 20
+
+// An 'Async' adquisition. Its samples go to persistent MATLAB
+// memory that becomes the data of the output when it is fetched.
+struct DaqAsyncHandle
+{
+    uInt32 nId;
+    void *lpData;
+    float64 *lpScaling;
+    uInt32 nCoeffs;
+};
+
+static DaqContinuous g_Continuous;
+static DaqPublisher g_Publisher;
+static DaqAsync g_Async[DAQ_ASYNC_MAX];
+static DaqAsyncHandle g_AsyncHandles[DAQ_ASYNC_MAX];
+static uInt32 g_nAsyncId = 0;
+static DaqTaskCache g_TaskCache;
+static DaqDeviceCache g_Devices;
+static DaqTimingStats g_Stats;
+static bool g_bStats = false;
+static DaqRealtimeStats g_Realtime;
 
 void outMexError(int nError)
 {
     if (nError != 0)
     {
-        int nSize = DAQmxGetErrorString(nError, NULL, 0);
+        int nSize = daqGetErrorString(nError, NULL, 0);
         char *lpError = (char*) mxMalloc(nSize);
-        DAQmxGetErrorString(nError, lpError, nSize);
+        daqGetErrorString(nError, lpError, nSize);
         char lpOutput[256];
         
         sprintf(lpOutput, "DAQmx Error %d: %s.", nError, lpError);
@@ -76,208 +680,3783 @@ void outMexError(int nError)
     }
 }
 
-void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+// Closes the timing of a call and adds it to the statistics
+void finishCall(DaqCallTiming *pTiming)
 {
-    if (nrhs > 6)
+    daqTimingFinish(pTiming);
+    
+    if (g_bStats)
     {
-        mexErrMsgTxt("Too many input arguments.");
+        daqTimingStatsAdd(&g_Stats, pTiming);
     }
-    else if (nrhs < 6)
+}
+
+// Raises a driver error, counting the call in the statistics first
+void failCall(DaqCallTiming *pTiming, int32 nResult)
+{
+    if (nResult != 0)
     {
-        mexErrMsgTxt("Too few input arguments.");
+        daqTimingError(pTiming, nResult);
+        finishCall(pTiming);
+        outMexError(nResult);
     }
-    else if (nlhs > 1)
+}
+
+// Unreserves the cached tasks on lpDevice, since they may still have
+// the device reserved and a new task could not use it
+void releaseCachedTaskFor(const char *lpDevice)
+{
+    daqTaskCacheRelease(&g_TaskCache, lpDevice, NULL);
+}
+
+// Waits for an 'Async' adquisition to end and frees its slot, with
+// the memory it has not handed over. Returns its result.
+int32 releaseAsync(int nSlot)
+{
+    DaqAsyncHandle *pHandle = g_AsyncHandles + nSlot;
+    int32 nResult = daqAsyncFinish(g_Async + nSlot);
+    
+    mxFree(pHandle->lpData);
+    mxFree(pHandle->lpScaling);
+    
+    pHandle->nId = 0;
+    pHandle->lpData = NULL;
+    pHandle->lpScaling = NULL;
+    
+    return nResult;
+}
+
+void onExit()
+{
+    for (int i = 0; i < DAQ_ASYNC_MAX; i++)
     {
-        mexErrMsgTxt("Too many output arguments.");
+        if (g_AsyncHandles[i].nId != 0)
+        {
+            daqAsyncCancel(g_Async + i);
+            releaseAsync(i);
+        }
+    }
+    
+    daqContinuousStop(&g_Continuous);
+    daqPublisherStop(&g_Publisher);
+    daqTaskCacheClear(&g_TaskCache);
+    daqDeviceCacheClear(&g_Devices);
+}
+
+// Validates and converts the six positional arguments starting at
+// prhs[0]. nFirst is the position of prhs[0] in the MATLAB call,
+// used to keep the error messages meaningful.
+void getArguments(const mxArray *prhs[], int nFirst, DaqArguments *pArgs)
+{
+    char lpOutput[256];
+    
+    if ((mxIsChar(prhs[1]) != 1) || (mxIsChar(prhs[3]) != 1) || (mxIsChar(prhs[5]) != 1))
+    {
+        sprintf(lpOutput, "Input arguments %d, %d and %d must be strings.", nFirst + 1, nFirst + 3, nFirst + 5);
+        mexErrMsgTxt(lpOutput);
+    }
+    else if (mxGetM(prhs[1])!= 1 || mxGetM(prhs[3]) != 1 || mxGetM(prhs[5]) != 1)
+    {
+        sprintf(lpOutput, "Input arguments %d, %d and %d must be row vectors.", nFirst + 1, nFirst + 3, nFirst + 5);
+        mexErrMsgTxt(lpOutput);
+    }
+    else if (mxIsNumeric(prhs[0]) != 1 || mxIsNumeric(prhs[4]) != 1 || mxIsNumeric(prhs[2]) != 1)
+    {
+        sprintf(lpOutput, "Input arguments %d, %d and %d must be numeric values.", nFirst, nFirst + 2, nFirst + 4);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    char *lpType = mxArrayToString(prhs[3]);
+    
+    if (!strcmp(lpType, "Voltage"))
+    {
+        pArgs->nAdquisitionType = DAQmx_Val_Voltage;
+    }
+    else if (!strcmp(lpType, "VoltageRMS"))
+    {
+        pArgs->nAdquisitionType = DAQmx_Val_VoltageRMS;
+    }
+    else if (!strcmp(lpType, "Current"))
+    {
+        pArgs->nAdquisitionType = DAQmx_Val_Current;
+    }
+    else if (!strcmp(lpType, "CurrentRMS"))
+    {
+        pArgs->nAdquisitionType = DAQmx_Val_CurrentRMS;
+    }
+    else if (!strcmp(lpType, "Resistance"))
+    {
+        pArgs->nAdquisitionType = DAQmx_Val_Resistance;
     }
     else
     {
-        if ((mxIsChar(prhs[1]) != 1) || (mxIsChar(prhs[3]) != 1) || (mxIsChar(prhs[5]) != 1))
-        {
-            mexErrMsgTxt("Input arguments 2, 4 and 6 must be strings.");
-        }
-        else if (mxGetM(prhs[1])!= 1 || mxGetM(prhs[3]) != 1 || mxGetM(prhs[5]) != 1)
+        mxFree(lpType);
+        
+        mexPrintf("\n\nAdqusition type is not valid. Use one of the following values:\n");
+        mexPrintf(" - 'Voltage'\n - 'VoltageRMS'\n - 'Current'\n - 'CurrentRMS'\n - 'Resistance'\n");
+        mexErrMsgTxt("Input parameter not valid.");
+    }
+    
+    mxFree(lpType);
+    
+    if (pArgs->nAdquisitionType != DAQmx_Val_Voltage)
+    {
+        mexErrMsgTxt("Only voltage adquisition is implemented.");
+    }
+    
+    pArgs->lpChannel = mxArrayToString(prhs[1]);
+    pArgs->lpDevice = mxArrayToString(prhs[5]);
+    pArgs->nSamplingPeriod = mxGetScalar(prhs[0]);
+    pArgs->fMaxVolts = mxGetScalar(prhs[2]);
+    pArgs->nSamples = mxGetScalar(prhs[4]);
+}
+
+bool getFlag(const mxArray *pValue, const char *lpName)
+{
+    char lpOutput[256];
+    
+    if ((!mxIsLogical(pValue) && !mxIsNumeric(pValue)) || mxGetNumberOfElements(pValue) != 1)
+    {
+        sprintf(lpOutput, "Option '%s' must be true or false.", lpName);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return mxGetScalar(pValue) != 0;
+}
+
+int getCount(const mxArray *pValue, const char *lpName)
+{
+    char lpOutput[256];
+    
+    if (!mxIsNumeric(pValue) || mxGetNumberOfElements(pValue) != 1 ||
+        mxGetScalar(pValue) < 1 || mxGetScalar(pValue) != (int) mxGetScalar(pValue))
+    {
+        sprintf(lpOutput, "Option '%s' must be a positive integer.", lpName);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return (int) mxGetScalar(pValue);
+}
+
+int getLength(const mxArray *pValue, const char *lpName)
+{
+    char lpOutput[256];
+    
+    if (!mxIsNumeric(pValue) || mxGetNumberOfElements(pValue) != 1 ||
+        mxGetScalar(pValue) < 0 || mxGetScalar(pValue) != (int) mxGetScalar(pValue))
+    {
+        sprintf(lpOutput, "Option '%s' must be a non-negative integer.", lpName);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return (int) mxGetScalar(pValue);
+}
+
+// Core the reader thread is pinned to, counted from 0
+int getCpu(const mxArray *pValue)
+{
+    char lpOutput[256];
+    int nCpu = getLength(pValue, "CPU");
+    unsigned int nCores = std::thread::hardware_concurrency();
+    
+    if (nCores > 0 && (unsigned int) nCpu >= nCores)
+    {
+        sprintf(lpOutput, "Option 'CPU' must be below the number of cores, %u.", nCores);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return nCpu;
+}
+
+// Real-time priority of the reader thread, or 0 for normal scheduling
+int getPriority(const mxArray *pValue)
+{
+    char lpOutput[256];
+    int nPriority = getLength(pValue, "Priority");
+    
+    if (nPriority > DAQ_RT_MAX_PRIORITY)
+    {
+        sprintf(lpOutput, "Option 'Priority' must be between 0 and %d.", DAQ_RT_MAX_PRIORITY);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return nPriority;
+}
+
+// Checks the trigger options once they are all parsed and fills in
+// the defaults
+// Modes selected by pOptions, as a mask of DAQ_MODE_BIT
+unsigned int getModes(const DaqOptions *pOptions)
+{
+    bool lpSelected[DAQ_MODES] =
+    {
+        pOptions->bRaw, pOptions->lpFile != NULL, pOptions->nDecimate > 1 || pOptions->lpTaps != NULL,
+        pOptions->nSpectrum > 0, pOptions->nTrigger >= 0, pOptions->bAsync, pOptions->bCompress,
+        pOptions->nStatistics > 0, pOptions->bEnvelope, pOptions->nOutputClass != mxDOUBLE_CLASS, pOptions->nUp > 0,
+        pOptions->nMaxLag >= 0, pOptions->bRealtime
+    };
+    unsigned int nModes = 0;
+    
+    for (int i = 0; i < DAQ_MODES; i++)
+    {
+        if (lpSelected[i])
         {
-            mexErrMsgTxt("Input arguments 2, 4 and 6 must be row vectors.");
+            nModes |= DAQ_MODE_BIT(i);
         }
-        else if (mxIsNumeric(prhs[0]) != 1 || mxIsNumeric(prhs[4]) != 1 || mxIsNumeric(prhs[2]) != 1)
+    }
+    
+    return nModes;
+}
+
+// Refuses the first pair of selected modes that cannot be combined
+void checkModes(const DaqOptions *pOptions)
+{
+    char lpOutput[256];
+    unsigned int nModes = getModes(pOptions);
+    
+    for (int i = 0; i < DAQ_MODES; i++)
+    {
+        if (!(nModes & DAQ_MODE_BIT(i)))
         {
-            mexErrMsgTxt("Input arguments 1, 3 and 5 must be numeric values.");
+            continue;
         }
-        else
+        
+        for (int j = i + 1; j < DAQ_MODES; j++)
         {
-            TaskHandle hTask = NULL;
-            mwSize 
-                    nSizeArg1 = (mxGetM(prhs[1]) * mxGetN(prhs[1])) + 1,
-                    nSizeArg3 = (mxGetM(prhs[3]) * mxGetN(prhs[3])) + 1,
-                    nSizeArg5 = (mxGetM(prhs[5]) * mxGetN(prhs[5])) + 1;
-            char
-                    *lpArg1 = mxArrayToString(prhs[1]),
-                    *lpArg3 = mxArrayToString(prhs[3]),
-                    *lpArg5 = mxArrayToString(prhs[5]),
-                    *lpDevice, *lpChannel, *lpType;
-            
-            float64
-                    *nArg2 = (float64*) mxGetPr(prhs[2]),
-                    *nArg4 = (float64*) mxGetPr(prhs[4]),
-                    *nArg0 = (float64*) mxGetPr(prhs[0]),
-                    fMaxVolts = *nArg2,
-                    nSamplingPeriod = *nArg0,
-                    nSamples = *nArg4;
-            
-            lpDevice = (char*) mxCalloc(strlen(lpArg5) + 1, sizeof(char));
-            lpChannel = (char*) mxCalloc(strlen(lpArg1) + 1, sizeof(char));
-            lpType = (char*) mxCalloc(strlen(lpArg3) + 1, sizeof(char));
-            
-            strcpy(lpChannel, lpArg1); mxFree(lpArg1);
-            strcpy(lpType, lpArg3); mxFree(lpArg3);
-            strcpy(lpDevice, lpArg5); mxFree(lpArg5);
-            
-            int32
-                   nAdquisitionType,
-                   nResult,
-                  *nSamplesRead = (int32*) mxMalloc(sizeof(int32));
-            
-            if (!strcmp(lpType, "Voltage"))
-            {
-                nAdquisitionType = DAQmx_Val_Voltage;
-            }
-            else if (!strcmp(lpType, "VoltageRMS"))
-            {
-                nAdquisitionType = DAQmx_Val_VoltageRMS;
-            }
-            else if (!strcmp(lpType, "Current"))
-            {
-                nAdquisitionType = DAQmx_Val_Current;
-            }
-            else if (!strcmp(lpType, "CurrentRMS"))
-            {
-                nAdquisitionType = DAQmx_Val_CurrentRMS;
-            }
-            else if (!strcmp(lpType, "Resistance"))
-            {
-                nAdquisitionType = DAQmx_Val_Resistance;
-            }
-            else
+            if ((nModes & DAQ_MODE_BIT(j)) &&
+                (!(g_Modes[i].nCompatible & DAQ_MODE_BIT(j)) || !(g_Modes[j].nCompatible & DAQ_MODE_BIT(i))))
             {
-                mxFree(lpDevice);
-                mxFree(lpType);
-                mxFree(lpChannel);
-                mxFree(nSamplesRead);
-                
-                mexPrintf("\n\nAdqusition type is not valid. Use one of the following values:\n");
-                mexPrintf(" - 'Voltage'\n - 'VoltageRMS'\n - 'Current'\n - 'CurrentRMS'\n - 'Resistance'\n");
-                mexErrMsgTxt("Input parameter not valid.");
-            }
-            
-            mxFree(lpType);
-            nResult = DAQmxCreateTask("Task1", &hTask);
-            
-            if (nResult)
-            {
-                mxFree(lpChannel);
-                mxFree(lpDevice);
-                mxFree(nSamplesRead);
-                #ifdef __DAQ_DEBUG
-                        mexPrintf("LINE 169\n");
-                #endif
-                outMexError(nResult);
-            }
-            
-            if (nAdquisitionType == DAQmx_Val_Voltage)
-            {
-                nResult = DAQmxCreateAIVoltageChan(hTask, lpChannel, "", DAQmx_Val_Diff, -fMaxVolts, fMaxVolts, DAQmx_Val_Volts, NULL);
+                sprintf(lpOutput, "%s cannot be combined with %s.", g_Modes[i].lpName, g_Modes[j].lpName);
+                mexErrMsgTxt(lpOutput);
             }
-            else
-            {
-                mxFree(lpChannel);
-                mxFree(lpDevice);
-                mxFree(nSamplesRead);
-                DAQmxClearTask(hTask);
-                
-                mexErrMsgTxt("Only voltage adquisition is implemented.");
+        }
+    }
+}
+
+void getTriggerOptions(DaqOptions *pOptions)
+{
+    if (pOptions->nTrigger < 0)
+    {
+        if (pOptions->nLevels > 0 || pOptions->nTriggerChannel > 0 || pOptions->nPreTrigger > 0 ||
+            pOptions->nPostTrigger > 0 || pOptions->nHoldOff >= 0 || pOptions->nMaxEvents > 0)
+        {
+            mexErrMsgTxt("Options 'Level', 'TriggerChannel', 'PreTrigger', 'PostTrigger', 'HoldOff' and 'MaxEvents' require 'Trigger'.");
+        }
+        
+        return;
+    }
+    
+    if (pOptions->nLevels == 0)
+    {
+        mexErrMsgTxt("Option 'Trigger' requires a 'Level'.");
+    }
+    else if ((pOptions->nTrigger == DAQ_TRIGGER_WINDOW) != (pOptions->nLevels == 2))
+    {
+        mexErrMsgTxt("Option 'Level' must be [Low High] for a 'window' trigger and a single number otherwise.");
+    }
+    else if (pOptions->nTrigger == DAQ_TRIGGER_WINDOW && pOptions->lpLevel[0] >= pOptions->lpLevel[1])
+    {
+        mexErrMsgTxt("The low level of a 'window' trigger must be below the high level.");
+    }
+    else if (pOptions->nTrigger == DAQ_TRIGGER_SLOPE && pOptions->lpLevel[0] == 0)
+    {
+        mexErrMsgTxt("The 'Level' of a 'slope' trigger must not be zero.");
+    }
+    
+    if (pOptions->nTriggerChannel == 0)
+    {
+        pOptions->nTriggerChannel = 1;
+    }
+    
+    if (pOptions->nPostTrigger == 0)
+    {
+        pOptions->nPostTrigger = DAQ_TRIGGER_POST;
+    }
+    
+    // By default an event does not start inside the previous one
+    if (pOptions->nHoldOff < 0)
+    {
+        pOptions->nHoldOff = pOptions->nPostTrigger;
+    }
+    
+    if (pOptions->nMaxEvents == 0)
+    {
+        pOptions->nMaxEvents = 1;
+    }
+}
+
+// Parses the name/value pairs from prhs[nFirst] onwards
+void getOptions(int nrhs, const mxArray *prhs[], int nFirst, DaqOptions *pOptions)
+{
+    char lpOutput[256];
+    
+    pOptions->bRaw = false;
+    pOptions->lpFile = NULL;
+    pOptions->nDecimate = 1;
+    pOptions->lpTaps = NULL;
+    pOptions->nTaps = 0;
+    pOptions->bCic = false;
+    pOptions->nFilterOrder = DAQ_CIC_ORDER;
+    pOptions->nSpectrum = 0;
+    pOptions->nOverlap = -1;
+    pOptions->nTrigger = -1;
+    pOptions->nLevels = 0;
+    pOptions->nTriggerChannel = 0;
+    pOptions->nPreTrigger = 0;
+    pOptions->nPostTrigger = 0;
+    pOptions->nHoldOff = -1;
+    pOptions->nMaxEvents = 0;
+    pOptions->bAsync = false;
+    pOptions->bCompress = false;
+    pOptions->nStatistics = 0;
+    pOptions->nBins = 0;
+    pOptions->bEnvelope = false;
+    pOptions->nOutputClass = mxDOUBLE_CLASS;
+    pOptions->nUp = 0;
+    pOptions->nDown = 0;
+    pOptions->nMaxLag = -1;
+    pOptions->lpPairs = NULL;
+    pOptions->nPairs = 0;
+    pOptions->nScale = -1;
+    pOptions->Realtime.nCpu = -1;
+    pOptions->Realtime.nPriority = -1;
+    pOptions->bRealtime = false;
+    
+    if ((nrhs - nFirst) % 2 != 0)
+    {
+        mexErrMsgTxt("Options must be given as name and value pairs.");
+    }
+    
+    for (int i = nFirst; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mexErrMsgTxt("Option names must be strings.");
+        }
+        
+        char *lpName = mxArrayToString(prhs[i]);
+        
+        if (!strcmp(lpName, "Raw"))
+        {
+            pOptions->bRaw = getFlag(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Statistics"))
+        {
+            pOptions->nStatistics = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Bins"))
+        {
+            pOptions->nBins = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Envelope"))
+        {
+            pOptions->bEnvelope = getFlag(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "OutputClass"))
+        {
+            char *lpClass = (mxIsChar(prhs[i + 1]) == 1) ? mxArrayToString(prhs[i + 1]) : NULL;
+            
+            if (lpClass != NULL && !strcmp(lpClass, "double"))
+            {
+                pOptions->nOutputClass = mxDOUBLE_CLASS;
+            }
+            else if (lpClass != NULL && !strcmp(lpClass, "single"))
+            {
+                pOptions->nOutputClass = mxSINGLE_CLASS;
+            }
+            else if (lpClass != NULL && !strcmp(lpClass, "int32"))
+            {
+                pOptions->nOutputClass = mxINT32_CLASS;
+            }
+            else
+            {
+                mxFree(lpClass);
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'OutputClass' must be 'double', 'single' or 'int32'.");
             }
             
-            if (nResult)
+            mxFree(lpClass);
+        }
+        else if (!strcmp(lpName, "Compress"))
+        {
+            pOptions->bCompress = getFlag(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Async"))
+        {
+            pOptions->bAsync = getFlag(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "File"))
+        {
+            if (mxIsChar(prhs[i + 1]) != 1 || mxGetM(prhs[i + 1]) != 1)
             {
-                mxFree(lpChannel);
-                mxFree(lpDevice);
-                mxFree(nSamplesRead);
-                #ifdef __DAQ_DEBUG
-                        mexPrintf("LINE 182\n");
-                #endif
-                DAQmxClearTask(hTask);
-                outMexError(nResult);
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'File' must be a file name.");
             }
             
-            nResult = DAQmxCfgSampClkTiming(hTask, NULL, nSamplingPeriod, DAQmx_Val_Rising, DAQmx_Val_FiniteSamps, nSamples);
+            mxFree(pOptions->lpFile);
+            pOptions->lpFile = mxArrayToString(prhs[i + 1]);
+        }
+        else if (!strcmp(lpName, "Resample"))
+        {
+            const mxArray *pValue = prhs[i + 1];
+            const double *ptrFactors = (mxIsDouble(pValue) && mxGetNumberOfElements(pValue) == 2) ? mxGetPr(pValue) : NULL;
             
-            if (nResult)
+            if (ptrFactors == NULL || ptrFactors[0] < 1 || ptrFactors[1] < 1 || ptrFactors[0] > DAQ_RESAMPLE_MAX_FACTOR ||
+                ptrFactors[1] > DAQ_RESAMPLE_MAX_FACTOR || ptrFactors[0] != floor(ptrFactors[0]) ||
+                ptrFactors[1] != floor(ptrFactors[1]))
             {
-                mxFree(lpChannel);
-                mxFree(lpDevice);
-                mxFree(nSamplesRead);
-                #ifdef __DAQ_DEBUG
-                        mexPrintf("LINE 195\n");
-                #endif
-                DAQmxClearTask(hTask);
-                outMexError(nResult);
+                sprintf(lpOutput, "Option 'Resample' must be [Up Down], natural values up to %d.", DAQ_RESAMPLE_MAX_FACTOR);
+                mxFree(lpName);
+                mexErrMsgTxt(lpOutput);
             }
             
-            nResult = DAQmxStartTask(hTask);
+            pOptions->nUp = (int) ptrFactors[0];
+            pOptions->nDown = (int) ptrFactors[1];
+        }
+        else if (!strcmp(lpName, "XCorr"))
+        {
+            pOptions->nMaxLag = getLength(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Pairs"))
+        {
+            const mxArray *pValue = prhs[i + 1];
             
-            if (nResult)
+            if (!mxIsDouble(pValue) || mxIsComplex(pValue) || mxGetNumberOfDimensions(pValue) != 2 || mxGetN(pValue) != 2 ||
+                mxGetM(pValue) == 0)
             {
-                mxFree(lpChannel);
-                mxFree(lpDevice);
-                mxFree(nSamplesRead);
-                #ifdef __DAQ_DEBUG
-                        mexPrintf("LINE 208\n");
-                #endif
-                DAQmxClearTask(hTask);
-                outMexError(nResult);
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Pairs' must be a matrix with two columns.");
             }
             
-            float64 *fReadArray = (float64*) mxCalloc(nSamples, sizeof(float64));
+            // The channels are checked once the task tells how many there are
+            pOptions->nPairs = (int) mxGetM(pValue);
+            mxFree(pOptions->lpPairs);
+            pOptions->lpPairs = (float64*) mxMalloc(2 * pOptions->nPairs * sizeof(float64));
+            memcpy(pOptions->lpPairs, mxGetPr(pValue), 2 * pOptions->nPairs * sizeof(float64));
+        }
+        else if (!strcmp(lpName, "Scale"))
+        {
+            char *lpScale = mxIsChar(prhs[i + 1]) ? mxArrayToString(prhs[i + 1]) : NULL;
             
-            nResult = DAQmxReadAnalogF64(hTask, nSamples, 10, DAQmx_Val_GroupByChannel, fReadArray, nSamples, nSamplesRead, NULL);
+            pOptions->nScale = (lpScale == NULL) ? -1 :
+                               !strcmp(lpScale, "none") ? DAQ_XCORR_NONE :
+                               !strcmp(lpScale, "biased") ? DAQ_XCORR_BIASED :
+                               !strcmp(lpScale, "unbiased") ? DAQ_XCORR_UNBIASED :
+                               !strcmp(lpScale, "coeff") ? DAQ_XCORR_COEFF : -1;
+            mxFree(lpScale);
             
-            if (nResult)
+            if (pOptions->nScale < 0)
             {
-                mxFree(lpChannel);
-                mxFree(lpDevice);
-                mxFree(fReadArray);
-                mxFree(nSamplesRead);
-                outMexError(nResult);
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Scale' must be 'none', 'biased', 'unbiased' or 'coeff'.");
             }
+        }
+        else if (!strcmp(lpName, "Decimate"))
+        {
+            pOptions->nDecimate = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "FilterOrder"))
+        {
+            pOptions->nFilterOrder = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Spectrum"))
+        {
+            pOptions->nSpectrum = getCount(prhs[i + 1], lpName);
             
-            DAQmxStopTask(hTask);
+            if (!daqIsPowerOfTwo(pOptions->nSpectrum) || pOptions->nSpectrum < 4)
+            {
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Spectrum' must be a power of two, at least 4.");
+            }
+        }
+        else if (!strcmp(lpName, "Overlap"))
+        {
+            pOptions->nOverlap = getLength(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Trigger"))
+        {
+            char *lpType = mxIsChar(prhs[i + 1]) ? mxArrayToString(prhs[i + 1]) : NULL;
             
-            plhs[0] = mxCreateNumericMatrix(1, *nSamplesRead, mxDOUBLE_CLASS, mxREAL);
+            pOptions->nTrigger = (lpType == NULL) ? -1 :
+                                 !strcmp(lpType, "rising") ? DAQ_TRIGGER_RISING :
+                                 !strcmp(lpType, "falling") ? DAQ_TRIGGER_FALLING :
+                                 !strcmp(lpType, "slope") ? DAQ_TRIGGER_SLOPE :
+                                 !strcmp(lpType, "window") ? DAQ_TRIGGER_WINDOW : -1;
+            mxFree(lpType);
             
-            double *ptrOutput = mxGetPr(plhs[0]);
+            if (pOptions->nTrigger < 0)
+            {
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Trigger' must be 'rising', 'falling', 'slope' or 'window'.");
+            }
+        }
+        else if (!strcmp(lpName, "Level"))
+        {
+            const mxArray *pValue = prhs[i + 1];
+            size_t nLevels = mxGetNumberOfElements(pValue);
             
-            for (int i = 0; i < (int) *nSamplesRead; i++)
+            if (!mxIsDouble(pValue) || mxIsComplex(pValue) || nLevels < 1 || nLevels > 2 ||
+                !mxIsFinite(mxGetPr(pValue)[0]) || !mxIsFinite(mxGetPr(pValue)[nLevels - 1]))
             {
-                ptrOutput[i] = fReadArray[i];
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Level' must be a number, or [Low High] for a window.");
             }
             
-            mxFree(fReadArray);
-            mxFree(lpChannel);
-            mxFree(lpDevice);
-            mxFree(nSamplesRead);
+            pOptions->nLevels = (int) nLevels;
+            pOptions->lpLevel[0] = mxGetPr(pValue)[0];
+            pOptions->lpLevel[1] = mxGetPr(pValue)[nLevels - 1];
+        }
+        else if (!strcmp(lpName, "TriggerChannel"))
+        {
+            pOptions->nTriggerChannel = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "PreTrigger"))
+        {
+            pOptions->nPreTrigger = getLength(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "PostTrigger"))
+        {
+            pOptions->nPostTrigger = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "HoldOff"))
+        {
+            pOptions->nHoldOff = getLength(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "MaxEvents"))
+        {
+            pOptions->nMaxEvents = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Filter"))
+        {
+            const mxArray *pValue = prhs[i + 1];
             
-            DAQmxClearTask(hTask);
+            if (mxIsChar(pValue))
+            {
+                char *lpFilter = mxArrayToString(pValue);
+                
+                pOptions->bCic = !strcmp(lpFilter, "cic");
+                mxFree(lpFilter);
+                
+                if (!pOptions->bCic)
+                {
+                    mxFree(lpName);
+                    mexErrMsgTxt("Option 'Filter' must be 'cic' or a vector of FIR coefficients.");
+                }
+            }
+            else if (mxIsDouble(pValue) && !mxIsComplex(pValue) && mxGetNumberOfElements(pValue) > 0 &&
+                     (mxGetM(pValue) == 1 || mxGetN(pValue) == 1))
+            {
+                pOptions->nTaps = (int) mxGetNumberOfElements(pValue);
+                pOptions->lpTaps = (float64*) mxMalloc(pOptions->nTaps * sizeof(float64));
+                memcpy(pOptions->lpTaps, mxGetPr(pValue), pOptions->nTaps * sizeof(float64));
+            }
+            else
+            {
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Filter' must be 'cic' or a vector of FIR coefficients.");
+            }
+        }
+        else if (!strcmp(lpName, "CPU"))
+        {
+            pOptions->Realtime.nCpu = getCpu(prhs[i + 1]);
+            pOptions->bRealtime = true;
+        }
+        else if (!strcmp(lpName, "Priority"))
+        {
+            pOptions->Realtime.nPriority = getPriority(prhs[i + 1]);
+            pOptions->bRealtime = true;
+        }
+        else
+        {
+            sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+            mxFree(lpName);
+            mexErrMsgTxt(lpOutput);
         }
+        
+        mxFree(lpName);
     }
     
-    return;
+    if (pOptions->bCic)
+    {
+        if (pOptions->nDecimate == 1)
+        {
+            mexErrMsgTxt("A CIC filter requires a decimation factor.");
+        }
+        
+        pOptions->nTaps = daqCicLength(pOptions->nFilterOrder, pOptions->nDecimate);
+        pOptions->lpTaps = (float64*) mxMalloc(pOptions->nTaps * sizeof(float64));
+        daqCicTaps(pOptions->nFilterOrder, pOptions->nDecimate, pOptions->lpTaps);
+    }
+    
+    checkModes(pOptions);
+    getTriggerOptions(pOptions);
+    
+    if (pOptions->nBins > 0 && pOptions->nStatistics == 0)
+    {
+        mexErrMsgTxt("Option 'Bins' requires 'Statistics'.");
+    }
+    
+    if (pOptions->nMaxLag < 0)
+    {
+        if (pOptions->lpPairs != NULL || pOptions->nScale >= 0)
+        {
+            mexErrMsgTxt("Options 'Pairs' and 'Scale' require 'XCorr'.");
+        }
+    }
+    else if (pOptions->nScale < 0)
+    {
+        pOptions->nScale = DAQ_XCORR_NONE;
+    }
+    
+    if (pOptions->nSpectrum == 0)
+    {
+        if (pOptions->nOverlap >= 0)
+        {
+            mexErrMsgTxt("Option 'Overlap' requires 'Spectrum'.");
+        }
+        
+        return;
+    }
+    
+    // Half a segment, as pwelch does by default
+    if (pOptions->nOverlap < 0)
+    {
+        pOptions->nOverlap = pOptions->nSpectrum / 2;
+    }
+    else if (pOptions->nOverlap >= pOptions->nSpectrum)
+    {
+        mexErrMsgTxt("Option 'Overlap' must be smaller than the spectrum length.");
+    }
 }
 
+void freeOptions(DaqOptions *pOptions)
+{
+    mxFree(pOptions->lpFile);
+    mxFree(pOptions->lpTaps);
+    mxFree(pOptions->lpPairs);
+}
 
+void freeArguments(DaqArguments *pArgs)
+{
+    mxFree(pArgs->lpChannel);
+    mxFree(pArgs->lpDevice);
+}
 
+// Maximum per-channel rate the device sustains with nChannels
+// channels on the same task
+float64 getMaxRate(const DaqDeviceInfo *pInfo, uInt32 nChannels)
+{
+    if (nChannels <= 1)
+    {
+        return pInfo->fAIMaxSingleRate;
+    }
+    
+    // Multiplexed devices share the converter between channels
+    return pInfo->bAISimultaneous ? pInfo->fAIMaxMultiRate : pInfo->fAIMaxMultiRate / nChannels;
+}
 
+// Checks the rate and range against what the device can handle for
+// the channels of hTask. Returns a driver error, 1 with a message in
+// lpOutput if a limit is exceeded, or 0. The limits come from the
+// device cache, so only the first task on a device queries them.
+int32 getLimits(TaskHandle hTask, const DaqArguments *pArgs, char *lpOutput)
+{
+    const DaqDeviceInfo *pInfo = NULL;
+    uInt32 nChannels = 1;
+    int32 nResult = daqGetTaskNumChans(hTask, &nChannels);
+    
+    if (nResult >= 0)
+    {
+        nResult = daqDeviceCacheGet(&g_Devices, pArgs->lpDevice, &pInfo);
+    }
+    
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+    
+    float64 fMaxRate = getMaxRate(pInfo, nChannels);
+    float64 fMaxVolts = daqDeviceMaxVolts(pInfo);
+    
+    if (fMaxRate > 0 && pArgs->nSamplingPeriod > fMaxRate)
+    {
+        sprintf(lpOutput, "The sampling rate exceeds the maximum of %f S/s supported by '%s' with %u channel(s).",
+                fMaxRate, pArgs->lpDevice, (unsigned int) nChannels);
+        return 1;
+    }
+    else if (fMaxVolts > 0 && pArgs->fMaxVolts > fMaxVolts)
+    {
+        sprintf(lpOutput, "The input range exceeds the maximum of %f V supported by '%s'.", fMaxVolts, pArgs->lpDevice);
+        return 1;
+    }
+    
+    return 0;
+}
 
+// Rejects rates and ranges the device cannot handle, clearing the
+// task before raising the error
+void checkLimits(TaskHandle hTask, const DaqArguments *pArgs)
+{
+    char lpOutput[256];
+    int32 nResult = getLimits(hTask, pArgs, lpOutput);
+    
+    if (nResult != 0)
+    {
+        daqClearTask(hTask);
+        
+        if (nResult < 0)
+        {
+            outMexError(nResult);
+        }
+        
+        mexErrMsgTxt(lpOutput);
+    }
+}
 
+// Creates and configures a voltage task. The task is cleared if
+// any step fails, so on error there is nothing left to release.
+int32 createVoltageTask(const DaqArguments *pArgs, int32 nSampleMode, uInt64 nSamples, TaskHandle *phTask,
+                        DaqCallTiming *pTiming = NULL)
+{
+    TaskHandle hTask = NULL;
+    double fStart = daqTimingBegin(pTiming);
+    
+    // Unnamed tasks get a unique name from the driver, so a blocking
+    // call may run while a continuous adquisition is active. The
+    // device picks the backend, real or simulated.
+    int32 nResult = daqCreateTask(pArgs->lpDevice, &hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_CREATE, fStart);
+    
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    nResult = daqCreateAIVoltageChan(hTask, pArgs->lpChannel, "", DAQmx_Val_Diff, -pArgs->fMaxVolts, pArgs->fMaxVolts, DAQmx_Val_Volts, NULL);
+    daqTimingEnd(pTiming, DAQ_PHASE_CHANNEL, fStart);
+    
+    if (nResult >= 0)
+    {
+        fStart = daqTimingBegin(pTiming);
+        nResult = daqCfgSampClkTiming(hTask, NULL, pArgs->nSamplingPeriod, DAQmx_Val_Rising, nSampleMode, nSamples);
+        daqTimingEnd(pTiming, DAQ_PHASE_CLOCK, fStart);
+    }
+    
+    if (nResult < 0)
+    {
+        daqClearTask(hTask);
+        return nResult;
+    }
+    
+    *phTask = hTask;
+    
+    return 0;
+}
 
+// Creates an uncached task for the modes that consume the capture
+// as it is read. Continuous timing bounds the driver buffer, which a
+// finite task would size to hold the whole capture, and the buffer
+// holds at least DAQ_STREAM_BUFFER_CHUNKS of the reads that drain it.
+void createStreamTask(const DaqArguments *pArgs, TaskHandle *phTask, uInt32 *pnChannels, DaqCallTiming *pTiming)
+{
+    float64 fBufferScans = pArgs->nSamplingPeriod * DAQ_STREAM_BUFFER_SECONDS;
+    float64 fChunkScans = (float64) DAQ_STREAM_BUFFER_CHUNKS * daqReadStreamChunk(pArgs->nSamplingPeriod);
+    
+    if (fBufferScans < fChunkScans)
+    {
+        fBufferScans = fChunkScans;
+    }
+    
+    int32 nResult = createVoltageTask(pArgs, DAQmx_Val_ContSamps, (uInt64) fBufferScans, phTask, pTiming);
+    failCall(pTiming, nResult);
+    
+    double fStart = daqTimingBegin(pTiming);
+    checkLimits(*phTask, pArgs);
+    daqTimingEnd(pTiming, DAQ_PHASE_LIMITS, fStart);
+    
+    releaseCachedTaskFor(pArgs->lpDevice);
+    
+    nResult = daqGetTaskNumChans(*phTask, pnChannels);
+    
+    if (nResult < 0)
+    {
+        daqClearTask(*phTask);
+        failCall(pTiming, nResult);
+    }
+    
+    if (pTiming != NULL)
+    {
+        pTiming->nChannels = *pnChannels;
+    }
+}
 
+void startContinuous(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 7 || (nrhs - 7) % 2 != 0)
+    {
+        mexErrMsgTxt("'start' requires six input arguments, and options as name and value pairs.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (g_Continuous.bRunning)
+    {
+        mexErrMsgTxt("A continuous adquisition is already running. Use 'stop' first.");
+    }
+    
+    char lpOutput[256];
+    DaqRealtimeConfig Realtime;
+    bool bRealtime = false;
+    
+    Realtime.nCpu = -1;
+    Realtime.nPriority = -1;
+    
+    for (int i = 7; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mexErrMsgTxt("Option names must be strings.");
+        }
+        
+        char *lpName = mxArrayToString(prhs[i]);
+        
+        if (!strcmp(lpName, "CPU"))
+        {
+            Realtime.nCpu = getCpu(prhs[i + 1]);
+        }
+        else if (!strcmp(lpName, "Priority"))
+        {
+            Realtime.nPriority = getPriority(prhs[i + 1]);
+        }
+        else
+        {
+            sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+            mxFree(lpName);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        bRealtime = true;
+        mxFree(lpName);
+    }
+    
+    DaqArguments Args;
+    TaskHandle hTask = NULL;
+    
+    getArguments(prhs + 1, 2, &Args);
+    
+    if (Args.nSamples < 1)
+    {
+        freeArguments(&Args);
+        mexErrMsgTxt("The buffer must hold at least one sample.");
+    }
+    
+    releaseCachedTaskFor(Args.lpDevice);
+    
+    int32 nResult = createVoltageTask(&Args, DAQmx_Val_ContSamps, (uInt64) Args.nSamples, &hTask);
+    outMexError(nResult);
+    
+    checkLimits(hTask, &Args);
+    freeArguments(&Args);
+    
+    nResult = daqContinuousStart(&g_Continuous, hTask, Args.nSamplingPeriod, (size_t) Args.nSamples,
+                                 bRealtime ? &Realtime : NULL, &g_Realtime);
+    
+    if (nResult < 0)
+    {
+        daqClearTask(hTask);
+        outMexError(nResult);
+    }
+    
+    // Keep the reader thread alive even if MATLAB clears the function
+    mexLock();
+}
+
+void readContinuous(int nlhs, mxArray *plhs[], int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (!g_Continuous.bRunning)
+    {
+        mexErrMsgTxt("There is no continuous adquisition running. Use 'start' first.");
+    }
+    
+    size_t nChannels = g_Continuous.nChannels;
+    size_t nAvailable = g_Continuous.Ring.Available() / nChannels;
+    
+    if (nAvailable == 0)
+    {
+        // Only report a failure once every sample before it has
+        // been handed over
+        int32 nError = g_Continuous.nError.load();
+        
+        if (nError < 0)
+        {
+            daqContinuousStop(&g_Continuous);
+            mexUnlock();
+            outMexError(nError);
+        }
+    }
+    
+    if (nChannels == 1)
+    {
+        plhs[0] = mxCreateNumericMatrix(1, nAvailable, mxDOUBLE_CLASS, mxREAL);
+        g_Continuous.Ring.Read(mxGetPr(plhs[0]), nAvailable);
+    }
+    else
+    {
+        plhs[0] = mxCreateNumericMatrix(nAvailable, nChannels, mxDOUBLE_CLASS, mxREAL);
+        g_Continuous.Ring.ReadColumns(mxGetPr(plhs[0]), nAvailable, nChannels);
+    }
+}
+
+void stopContinuous(int nlhs, int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    if (g_Continuous.bRunning)
+    {
+        daqContinuousStop(&g_Continuous);
+        mexUnlock();
+    }
+}
+
+void publishData(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 8 || (nrhs - 8) % 2 != 0)
+    {
+        mexErrMsgTxt("'publish' requires a name and six input arguments, and options as name and value pairs.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (g_Publisher.bRunning)
+    {
+        mexErrMsgTxt("An adquisition is already being published. Use 'unpublish' first.");
+    }
+    else if (mxIsChar(prhs[1]) != 1 || mxGetM(prhs[1]) != 1)
+    {
+        mexErrMsgTxt("Input argument 2 must be a string.");
+    }
+    
+    char lpOutput[256];
+    int nBlocks = DAQ_PUBLISH_BLOCKS;
+    bool bRaw = false;
+    
+    for (int i = 8; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mexErrMsgTxt("Option names must be strings.");
+        }
+        
+        char *lpName = mxArrayToString(prhs[i]);
+        
+        if (!strcmp(lpName, "Blocks"))
+        {
+            nBlocks = getCount(prhs[i + 1], lpName);
+        }
+        else if (!strcmp(lpName, "Raw"))
+        {
+            bRaw = getFlag(prhs[i + 1], lpName);
+        }
+        else
+        {
+            sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+            mxFree(lpName);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        mxFree(lpName);
+    }
+    
+    if (nBlocks < 2)
+    {
+        mexErrMsgTxt("Option 'Blocks' must be at least 2.");
+    }
+    
+    DaqArguments Args;
+    TaskHandle hTask = NULL;
+    
+    getArguments(prhs + 2, 3, &Args);
+    
+    if (Args.nSamples < 1 || Args.nSamples > DAQ_READ_CHUNK)
+    {
+        freeArguments(&Args);
+        sprintf(lpOutput, "Blocks must hold between 1 and %d samples.", DAQ_READ_CHUNK);
+        mexErrMsgTxt(lpOutput);
+    }
+    else if ((uInt64) Args.nSamples * nBlocks > DAQ_PUBLISH_MAX_SCANS)
+    {
+        freeArguments(&Args);
+        mexErrMsgTxt("The ring must hold fewer than 2^32 samples per channel. Use fewer or shorter blocks.");
+    }
+    
+    releaseCachedTaskFor(Args.lpDevice);
+    
+    uInt32 nBlockScans = (uInt32) Args.nSamples;
+    int32 nResult = createVoltageTask(&Args, DAQmx_Val_ContSamps, (uInt64) nBlockScans * nBlocks, &hTask);
+    outMexError(nResult);
+    
+    checkLimits(hTask, &Args);
+    
+    // Readers get the scaling of the codes, and none for volts
+    uInt32 nChannels = 1, nCoeffs = 0;
+    float64 *lpCoeffs = NULL;
+    int32 nLength = daqGetTaskChannels(hTask, NULL, 0);
+    char *lpChannels = (char*) mxCalloc(nLength > 0 ? nLength : 1, sizeof(char));
+    
+    nResult = daqGetTaskNumChans(hTask, &nChannels);
+    
+    if (nResult >= 0 && nLength > 0)
+    {
+        nResult = daqGetTaskChannels(hTask, lpChannels, nLength);
+    }
+    
+    if (nResult >= 0 && bRaw)
+    {
+        lpCoeffs = (float64*) mxMalloc((size_t) DAQ_SCALE_MAX_COEFFS * nChannels * sizeof(float64));
+        nResult = daqGetScaling(hTask, nChannels, lpCoeffs, &nCoeffs);
+        
+        // The coefficients are stored packed, nCoeffs per channel
+        for (uInt32 i = 1; i < nChannels && nResult >= 0; i++)
+        {
+            memmove(lpCoeffs + i * nCoeffs, lpCoeffs + i * DAQ_SCALE_MAX_COEFFS, nCoeffs * sizeof(float64));
+        }
+    }
+    
+    if (nResult >= 0)
+    {
+        char *lpName = mxArrayToString(prhs[1]);
+        
+        nResult = daqPublisherStart(&g_Publisher, lpName, hTask, Args.nSamplingPeriod, Args.fMaxVolts, nBlockScans,
+                                    (uInt32) nBlocks, bRaw, lpCoeffs, nCoeffs, lpChannels);
+        mxFree(lpName);
+    }
+    
+    freeArguments(&Args);
+    mxFree(lpCoeffs);
+    mxFree(lpChannels);
+    
+    if (nResult != 0)
+    {
+        daqClearTask(hTask);
+        outMexError(nResult < 0 ? nResult : 0);
+        
+        if (nResult == DAQ_PUBLISH_IN_USE)
+        {
+            mexErrMsgTxt("Another adquisition is being published under that name.");
+        }
+        
+        mexErrMsgTxt("Could not create the shared memory. Names cannot contain slashes.");
+    }
+    
+    // Keep the writer thread alive even if MATLAB clears the function
+    mexLock();
+}
+
+void unpublishData(int nlhs, int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    if (g_Publisher.bRunning)
+    {
+        daqPublisherStop(&g_Publisher);
+        mexUnlock();
+    }
+}
+
+// Slot of the 'Async' handle in prhs[1]
+int getAsync(int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 2 || !mxIsNumeric(prhs[1]) || mxGetNumberOfElements(prhs[1]) != 1)
+    {
+        mexErrMsgTxt("Input argument 2 must be a handle returned by the 'Async' option.");
+    }
+    
+    double fId = mxGetScalar(prhs[1]);
+    
+    for (int i = 0; i < DAQ_ASYNC_MAX; i++)
+    {
+        if (g_AsyncHandles[i].nId != 0 && g_AsyncHandles[i].nId == fId)
+        {
+            return i;
+        }
+    }
+    
+    mexErrMsgTxt("The handle does not belong to a running adquisition, or it has already been fetched.");
+    
+    return -1;
+}
+
+void isDoneAsync(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs > 2)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    int nSlot = getAsync(nrhs, prhs);
+    
+    plhs[0] = mxCreateLogicalScalar(daqAsyncWait(g_Async + nSlot, 0));
+}
+
+void waitAsync(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs > 3)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    int nSlot = getAsync(nrhs, prhs);
+    float64 fTimeout = -1;
+    
+    if (nrhs > 2)
+    {
+        if (!mxIsNumeric(prhs[2]) || mxGetNumberOfElements(prhs[2]) != 1)
+        {
+            mexErrMsgTxt("Input argument 3 must be a timeout in seconds.");
+        }
+        
+        // Inf waits for as long as it takes
+        fTimeout = mxIsInf(mxGetScalar(prhs[2])) ? -1 : mxGetScalar(prhs[2]);
+        fTimeout = (fTimeout < -1) ? 0 : fTimeout;
+    }
+    
+    bool bDone = daqAsyncWait(g_Async + nSlot, fTimeout);
+    
+    if (nlhs > 0)
+    {
+        plhs[0] = mxCreateLogicalScalar(bDone);
+    }
+}
+
+// Waits for the adquisition and hands the samples over to MATLAB
+// in the memory they were read into, without copying them
+void fetchAsync(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs > 2)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    
+    int nSlot = getAsync(nrhs, prhs);
+    DaqAsync *pAsync = g_Async + nSlot;
+    DaqAsyncHandle *pHandle = g_AsyncHandles + nSlot;
+    
+    if (nlhs > (pAsync->bRaw ? 2 : 1))
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    int32 nResult = daqAsyncFinish(pAsync);
+    
+    if (nResult == 0)
+    {
+        uInt32 nChannels = pAsync->nChannels;
+        
+        // A capture that ended early keeps only the samples read
+        if (pAsync->bRaw)
+        {
+            daqReadCompact((int16*) pHandle->lpData, pAsync->nSamples, pAsync->nRead, nChannels);
+        }
+        else
+        {
+            daqReadCompact((float64*) pHandle->lpData, pAsync->nSamples, pAsync->nRead, nChannels);
+        }
+        
+        plhs[0] = mxCreateNumericMatrix(0, 0, pAsync->bRaw ? mxINT16_CLASS : mxDOUBLE_CLASS, mxREAL);
+        mxSetData(plhs[0], pHandle->lpData);
+        mxSetM(plhs[0], (nChannels == 1) ? 1 : (mwSize) pAsync->nRead);
+        mxSetN(plhs[0], (nChannels == 1) ? (mwSize) pAsync->nRead : nChannels);
+        pHandle->lpData = NULL;
+        
+        if (nlhs > 1)
+        {
+            plhs[1] = mxCreateDoubleMatrix(pHandle->nCoeffs, nChannels, mxREAL);
+            memcpy(mxGetPr(plhs[1]), pHandle->lpScaling, (size_t) pHandle->nCoeffs * nChannels * sizeof(float64));
+        }
+    }
+    
+    releaseAsync(nSlot);
+    mexUnlock();
+    outMexError(nResult);
+}
+
+void cancelAsync(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nrhs > 2)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    int nSlot = getAsync(nrhs, prhs);
+    
+    daqAsyncCancel(g_Async + nSlot);
+    releaseAsync(nSlot);
+    mexUnlock();
+}
+
+void evictTask(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 7)
+    {
+        mexErrMsgTxt("'evict' requires six input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    DaqArguments Args;
+    
+    getArguments(prhs + 1, 2, &Args);
+    
+    DaqCachedTask *pEntry = daqTaskCacheFind(&g_TaskCache, Args.lpDevice, Args.lpChannel, Args.fMaxVolts,
+                                             Args.nSamplingPeriod, (uInt64) Args.nSamples);
+    
+    if (pEntry != NULL)
+    {
+        daqTaskCacheEvict(&g_TaskCache, pEntry);
+    }
+    
+    freeArguments(&Args);
+}
+
+void clearTasks(int nlhs, int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    daqTaskCacheClear(&g_TaskCache);
+}
+
+void refreshDevices(int nlhs, int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    daqDeviceCacheClear(&g_Devices);
+}
+
+// Struct with one field per phase, in seconds
+mxArray *createPhases(const double *lpSeconds)
+{
+    const char **lpNames = daqTimingPhaseNames();
+    mxArray *pPhases = mxCreateStructMatrix(1, 1, DAQ_PHASES, lpNames);
+    
+    for (int i = 0; i < DAQ_PHASES; i++)
+    {
+        mxSetField(pPhases, 0, lpNames[i], mxCreateDoubleScalar(lpSeconds[i]));
+    }
+    
+    return pPhases;
+}
+
+mxArray *createTiming(const DaqCallTiming *pTiming)
+{
+    const char *lpFields[] = {"Seconds", "Cached", "Channels", "SamplesRequested", "SamplesRead", "Bytes", "Reads", "Error"};
+    mxArray *pTimingOut = mxCreateStructMatrix(1, 1, 8, lpFields);
+    
+    mxSetField(pTimingOut, 0, "Seconds", createPhases(pTiming->lpSeconds));
+    mxSetField(pTimingOut, 0, "Cached", mxCreateLogicalScalar(pTiming->bCached));
+    mxSetField(pTimingOut, 0, "Channels", mxCreateDoubleScalar((double) pTiming->nChannels));
+    mxSetField(pTimingOut, 0, "SamplesRequested", mxCreateDoubleScalar((double) pTiming->nRequested));
+    mxSetField(pTimingOut, 0, "SamplesRead", mxCreateDoubleScalar((double) pTiming->nRead));
+    mxSetField(pTimingOut, 0, "Bytes", mxCreateDoubleScalar((double) pTiming->nBytes));
+    mxSetField(pTimingOut, 0, "Reads", mxCreateDoubleScalar((double) pTiming->nReads));
+    mxSetField(pTimingOut, 0, "Error", mxCreateDoubleScalar((double) pTiming->nError));
+    
+    return pTimingOut;
+}
+
+mxArray *createStats(const DaqTimingStats *pStats)
+{
+    const char *lpFields[] = {"Enabled", "Calls", "Errors", "LastError", "Samples", "Bytes", "Reads",
+                              "Seconds", "MaxSeconds", "Histogram", "BinEdges"};
+    const char **lpNames = daqTimingPhaseNames();
+    mxArray *pStatsOut = mxCreateStructMatrix(1, 1, 11, lpFields);
+    mxArray *pHistogram = mxCreateStructMatrix(1, 1, DAQ_PHASES, lpNames);
+    mxArray *pEdges = mxCreateDoubleMatrix(1, DAQ_TIMING_BINS, mxREAL);
+    double *ptrEdges = mxGetPr(pEdges);
+    
+    for (int i = 0; i < DAQ_PHASES; i++)
+    {
+        mxArray *pCounts = mxCreateDoubleMatrix(1, DAQ_TIMING_BINS, mxREAL);
+        double *ptrCounts = mxGetPr(pCounts);
+        
+        for (int k = 0; k < DAQ_TIMING_BINS; k++)
+        {
+            ptrCounts[k] = (double) pStats->lpHistogram[i][k];
+        }
+        
+        mxSetField(pHistogram, 0, lpNames[i], pCounts);
+    }
+    
+    // Upper edge of every bin; the last one has no limit
+    for (int k = 0; k < DAQ_TIMING_BINS; k++)
+    {
+        ptrEdges[k] = (k < DAQ_TIMING_BINS - 1) ? daqTimingBinEdge(k) : mxGetInf();
+    }
+    
+    mxSetField(pStatsOut, 0, "Enabled", mxCreateLogicalScalar(g_bStats));
+    mxSetField(pStatsOut, 0, "Calls", mxCreateDoubleScalar((double) pStats->nCalls));
+    mxSetField(pStatsOut, 0, "Errors", mxCreateDoubleScalar((double) pStats->nErrors));
+    mxSetField(pStatsOut, 0, "LastError", mxCreateDoubleScalar((double) pStats->nLastError));
+    mxSetField(pStatsOut, 0, "Samples", mxCreateDoubleScalar((double) pStats->nSamples));
+    mxSetField(pStatsOut, 0, "Bytes", mxCreateDoubleScalar((double) pStats->nBytes));
+    mxSetField(pStatsOut, 0, "Reads", mxCreateDoubleScalar((double) pStats->nReads));
+    mxSetField(pStatsOut, 0, "Seconds", createPhases(pStats->lpSeconds));
+    mxSetField(pStatsOut, 0, "MaxSeconds", createPhases(pStats->lpMax));
+    mxSetField(pStatsOut, 0, "Histogram", pHistogram);
+    mxSetField(pStatsOut, 0, "BinEdges", pEdges);
+    
+    return pStatsOut;
+}
+
+// Returns the statistics of the blocking calls, or turns collecting
+// them on or off
+void showStats(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs > 2)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 1 || (nrhs == 2 && nlhs > 0))
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    if (nrhs == 2)
+    {
+        g_bStats = getFlag(prhs[1], "stats");
+        return;
+    }
+    
+    plhs[0] = createStats(&g_Stats);
+}
+
+void resetStats(int nlhs, int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    daqTimingStatsClear(&g_Stats);
+    daqRealtimeStatsClear(&g_Realtime);
+}
+
+mxArray *createHistogram(const std::atomic<uInt64> *lpCounts)
+{
+    mxArray *pCounts = mxCreateDoubleMatrix(1, DAQ_TIMING_BINS, mxREAL);
+    double *ptrCounts = mxGetPr(pCounts);
+    
+    for (int k = 0; k < DAQ_TIMING_BINS; k++)
+    {
+        ptrCounts[k] = (double) lpCounts[k].load();
+    }
+    
+    return pCounts;
+}
+
+// Returns the reads of the real-time reader threads since the last
+// reset, including those of a continuous adquisition still running
+void showRealtime(int nlhs, mxArray *plhs[], int nrhs)
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    const char *lpFields[] = {"Reads", "Samples", "Overruns", "Stalls", "MaxLatency", "MaxJitter",
+                              "Latency", "Jitter", "BinEdges", "CPU", "Priority", "Locked"};
+    DaqRealtimeStatus Status;
+    const DaqRealtimeStatus *pStatus = &Status;
+    mxArray *pEdges = mxCreateDoubleMatrix(1, DAQ_TIMING_BINS, mxREAL);
+    double *ptrEdges = mxGetPr(pEdges);
+    
+    for (int k = 0; k < DAQ_TIMING_BINS; k++)
+    {
+        ptrEdges[k] = (k < DAQ_TIMING_BINS - 1) ? daqTimingBinEdge(k) : mxGetInf();
+    }
+    
+    daqRealtimeGetStatus(&g_Realtime, &Status);
+    plhs[0] = mxCreateStructMatrix(1, 1, 12, lpFields);
+    mxSetField(plhs[0], 0, "Reads", mxCreateDoubleScalar((double) g_Realtime.nReads.load()));
+    mxSetField(plhs[0], 0, "Samples", mxCreateDoubleScalar((double) g_Realtime.nScans.load()));
+    mxSetField(plhs[0], 0, "Overruns", mxCreateDoubleScalar((double) g_Realtime.nOverruns.load()));
+    mxSetField(plhs[0], 0, "Stalls", mxCreateDoubleScalar((double) g_Realtime.nStalls.load()));
+    mxSetField(plhs[0], 0, "MaxLatency", mxCreateDoubleScalar(1e-9 * (double) g_Realtime.nMaxLatency.load()));
+    mxSetField(plhs[0], 0, "MaxJitter", mxCreateDoubleScalar(1e-9 * (double) g_Realtime.nMaxJitter.load()));
+    mxSetField(plhs[0], 0, "Latency", createHistogram(g_Realtime.lpLatency));
+    mxSetField(plhs[0], 0, "Jitter", createHistogram(g_Realtime.lpJitter));
+    mxSetField(plhs[0], 0, "BinEdges", pEdges);
+    mxSetField(plhs[0], 0, "CPU", mxCreateDoubleScalar(pStatus->bStarted ? pStatus->nCpu : -1));
+    mxSetField(plhs[0], 0, "Priority", mxCreateDoubleScalar(pStatus->bStarted ? pStatus->nPriority : 0));
+    mxSetField(plhs[0], 0, "Locked", mxCreateLogicalScalar(pStatus->bStarted && pStatus->bLocked));
+}
+
+float64 getNumber(const mxArray *pValue, const char *lpName, bool bNegative)
+{
+    char lpOutput[256];
+    
+    if (!mxIsNumeric(pValue) || mxIsComplex(pValue) || mxGetNumberOfElements(pValue) != 1 ||
+        !mxIsFinite(mxGetScalar(pValue)) || (!bNegative && mxGetScalar(pValue) < 0))
+    {
+        sprintf(lpOutput, bNegative ? "Option '%s' must be a finite number." : "Option '%s' must be a non-negative number.", lpName);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return mxGetScalar(pValue);
+}
+
+// Configures the signal of a simulated device or channel, taking the
+// options not given from its current configuration. Without a target,
+// every simulated device goes back to the defaults.
+void simulateDevice(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    DaqSimBackend *pSimulator = daqSimulator();
+    
+    if (nrhs == 1)
+    {
+        pSimulator->Reset();
+        return;
+    }
+    else if (mxIsChar(prhs[1]) != 1 || mxGetM(prhs[1]) != 1)
+    {
+        mexErrMsgTxt("'simulate' requires a simulated device or channel, such as 'SimDev1' or 'SimDev1/ai0'.");
+    }
+    else if ((nrhs - 2) % 2 != 0)
+    {
+        mexErrMsgTxt("Options must be given as name and value pairs.");
+    }
+    
+    char lpDevice[DAQ_SIM_NAME_LENGTH];
+    char lpOutput[256];
+    char *lpTarget = mxArrayToString(prhs[1]);
+    char *lpSlash = strchr(lpTarget, '/');
+    size_t nDevice = (lpSlash != NULL) ? (size_t) (lpSlash - lpTarget) : strlen(lpTarget);
+    int nIndex = 0;
+    
+    strncpy(lpDevice, lpTarget, sizeof(lpDevice) - 1);
+    lpDevice[(nDevice < sizeof(lpDevice) - 1) ? nDevice : sizeof(lpDevice) - 1] = '\0';
+    
+    bool bValid = nDevice < sizeof(lpDevice) && daqSimIsDevice(lpDevice);
+    
+    if (bValid && lpSlash != NULL)
+    {
+        char *lpEnd = NULL;
+        
+        nIndex = (strncmp(lpSlash, "/ai", 3) == 0 && isdigit((unsigned char) lpSlash[3])) ? (int) strtol(lpSlash + 3, &lpEnd, 10) : -1;
+        bValid = nIndex >= 0 && nIndex < DAQ_SIM_AI_CHANNELS && *lpEnd == '\0';
+    }
+    
+    if (!bValid)
+    {
+        sprintf(lpOutput, "'%.100s' is not a simulated device or channel. Use 'SimDev1' or 'SimDev1/ai0' to 'SimDev1/ai%d'.",
+                lpTarget, DAQ_SIM_AI_CHANNELS - 1);
+        mxFree(lpTarget);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    DaqSimSignal Signal;
+    DaqSimTiming Timing = pSimulator->GetTiming(lpDevice);
+    bool bSignal = false, bTiming = false;
+    
+    // A channel starts from what it outputs now, a device from its
+    // own configuration
+    if (lpSlash != NULL)
+    {
+        Signal = pSimulator->GetSignal(lpDevice, nIndex);
+    }
+    else if (!pSimulator->FindSignal(lpDevice, &Signal))
+    {
+        Signal = DaqSimBackend::DefaultSignal(0);
+    }
+    
+    for (int i = 2; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mxFree(lpTarget);
+            mexErrMsgTxt("Option names must be strings.");
+        }
+        
+        char *lpName = mxArrayToString(prhs[i]);
+        const mxArray *pValue = prhs[i + 1];
+        bool bDevice = false;
+        
+        if (!strcmp(lpName, "Signal"))
+        {
+            char *lpShape = mxIsChar(pValue) ? mxArrayToString(pValue) : NULL;
+            
+            if (lpShape != NULL && !strcmp(lpShape, "sine"))
+            {
+                Signal.nShape = DAQ_SIM_SINE;
+            }
+            else if (lpShape != NULL && !strcmp(lpShape, "noise"))
+            {
+                Signal.nShape = DAQ_SIM_NOISE;
+            }
+            else if (lpShape != NULL && !strcmp(lpShape, "step"))
+            {
+                Signal.nShape = DAQ_SIM_STEP;
+            }
+            else if (lpShape != NULL && !strcmp(lpShape, "output"))
+            {
+                Signal.nShape = DAQ_SIM_OUTPUT;
+            }
+            else
+            {
+                mxFree(lpShape);
+                mxFree(lpName);
+                mxFree(lpTarget);
+                mexErrMsgTxt("Option 'Signal' must be 'sine', 'noise', 'step' or 'output'.");
+            }
+            
+            mxFree(lpShape);
+            bSignal = true;
+        }
+        else if (!strcmp(lpName, "Amplitude"))
+        {
+            Signal.fAmplitude = getNumber(pValue, lpName, true);
+            bSignal = true;
+        }
+        else if (!strcmp(lpName, "Frequency"))
+        {
+            Signal.fFrequency = getNumber(pValue, lpName, false);
+            bSignal = true;
+        }
+        else if (!strcmp(lpName, "Offset"))
+        {
+            Signal.fOffset = getNumber(pValue, lpName, true);
+            bSignal = true;
+        }
+        else if (!strcmp(lpName, "Noise"))
+        {
+            Signal.fNoise = getNumber(pValue, lpName, false);
+            bSignal = true;
+        }
+        else if (!strcmp(lpName, "Delay"))
+        {
+            Signal.fDelay = getNumber(pValue, lpName, false);
+            bSignal = true;
+        }
+        else if (!strcmp(lpName, "Latency"))
+        {
+            Timing.fReadLatency = getNumber(pValue, lpName, false);
+            bDevice = bTiming = true;
+        }
+        else if (!strcmp(lpName, "SetupLatency"))
+        {
+            Timing.fSetupLatency = getNumber(pValue, lpName, false);
+            bDevice = bTiming = true;
+        }
+        else if (!strcmp(lpName, "Realtime"))
+        {
+            Timing.bRealtime = getFlag(pValue, lpName);
+            bDevice = bTiming = true;
+        }
+        else
+        {
+            sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+            mxFree(lpName);
+            mxFree(lpTarget);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        if (bDevice && lpSlash != NULL)
+        {
+            sprintf(lpOutput, "Option '%.200s' applies to a whole device.", lpName);
+            mxFree(lpName);
+            mxFree(lpTarget);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        mxFree(lpName);
+    }
+    
+    bool bStored = (!bSignal || pSimulator->SetSignal(lpTarget, &Signal)) && (!bTiming || pSimulator->SetTiming(lpDevice, &Timing));
+    
+    mxFree(lpTarget);
+    
+    if (!bStored)
+    {
+        mexErrMsgTxt("Too many simulated devices and channels configured. Use daqAdquireData('simulate') to reset them.");
+    }
+}
+
+// Configures how a file is replayed, or resets every replay device
+// to the defaults. Tasks and capabilities cached for the device are
+// dropped, since the layout of a raw file may have changed.
+void replayDevice(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    DaqReplayBackend *pReplay = daqReplay();
+    
+    if (nrhs == 1)
+    {
+        pReplay->Reset();
+        daqTaskCacheClear(&g_TaskCache);
+        daqDeviceCacheClear(&g_Devices);
+        return;
+    }
+    else if (mxIsChar(prhs[1]) != 1 || mxGetM(prhs[1]) != 1)
+    {
+        mexErrMsgTxt("'replay' requires a replay device, such as 'file:/data/capture.bin'.");
+    }
+    else if ((nrhs - 2) % 2 != 0)
+    {
+        mexErrMsgTxt("Options must be given as name and value pairs.");
+    }
+    
+    char lpOutput[256];
+    char *lpDevice = mxArrayToString(prhs[1]);
+    
+    if (!daqReplayIsDevice(lpDevice))
+    {
+        sprintf(lpOutput, "'%.100s' is not a replay device. Use 'file:' followed by the path of the file.", lpDevice);
+        mxFree(lpDevice);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    DaqReplayConfig Config = pReplay->GetConfig(lpDevice);
+    
+    for (int i = 2; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mxFree(lpDevice);
+            mexErrMsgTxt("Option names must be strings.");
+        }
+        
+        char *lpName = mxArrayToString(prhs[i]);
+        const mxArray *pValue = prhs[i + 1];
+        
+        if (!strcmp(lpName, "Speed"))
+        {
+            Config.fSpeed = getNumber(pValue, lpName, false);
+        }
+        else if (!strcmp(lpName, "Loop"))
+        {
+            Config.bLoop = getFlag(pValue, lpName);
+        }
+        else if (!strcmp(lpName, "Format"))
+        {
+            char *lpFormat = mxIsChar(pValue) ? mxArrayToString(pValue) : NULL;
+            
+            if (lpFormat != NULL && !strcmp(lpFormat, "double"))
+            {
+                Config.nSampleType = DAQ_FILE_FLOAT64;
+            }
+            else if (lpFormat != NULL && !strcmp(lpFormat, "single"))
+            {
+                Config.nSampleType = DAQ_REPLAY_FLOAT32;
+            }
+            else if (lpFormat != NULL && !strcmp(lpFormat, "int16"))
+            {
+                Config.nSampleType = DAQ_FILE_INT16;
+            }
+            else
+            {
+                mxFree(lpFormat);
+                mxFree(lpName);
+                mxFree(lpDevice);
+                mexErrMsgTxt("Option 'Format' must be 'double', 'single' or 'int16'.");
+            }
+            
+            mxFree(lpFormat);
+        }
+        else if (!strcmp(lpName, "Channels"))
+        {
+            int nChannels = getCount(pValue, lpName);
+            
+            if (nChannels > DAQ_REPLAY_MAX_CHANNELS)
+            {
+                sprintf(lpOutput, "Option 'Channels' cannot be larger than %d.", DAQ_REPLAY_MAX_CHANNELS);
+                mxFree(lpName);
+                mxFree(lpDevice);
+                mexErrMsgTxt(lpOutput);
+            }
+            
+            Config.nChannels = (uInt32) nChannels;
+        }
+        else
+        {
+            sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+            mxFree(lpName);
+            mxFree(lpDevice);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        mxFree(lpName);
+    }
+    
+    bool bStored = pReplay->SetConfig(lpDevice, &Config);
+    
+    if (bStored)
+    {
+        daqTaskCacheForget(&g_TaskCache, lpDevice);
+        daqDeviceCacheForget(&g_Devices, lpDevice);
+    }
+    
+    mxFree(lpDevice);
+    
+    if (!bStored)
+    {
+        mexErrMsgTxt("Too many replay devices configured. Use daqAdquireData('replay') to reset them.");
+    }
+}
+
+void runCommand(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    char *lpCommand = mxArrayToString(prhs[0]);
+    
+    if (!strcmp(lpCommand, "start"))
+    {
+        mxFree(lpCommand);
+        startContinuous(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "read"))
+    {
+        mxFree(lpCommand);
+        readContinuous(nlhs, plhs, nrhs);
+    }
+    else if (!strcmp(lpCommand, "stop"))
+    {
+        mxFree(lpCommand);
+        stopContinuous(nlhs, nrhs);
+    }
+    else if (!strcmp(lpCommand, "publish"))
+    {
+        mxFree(lpCommand);
+        publishData(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "unpublish"))
+    {
+        mxFree(lpCommand);
+        unpublishData(nlhs, nrhs);
+    }
+    else if (!strcmp(lpCommand, "isdone"))
+    {
+        mxFree(lpCommand);
+        isDoneAsync(nlhs, plhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "wait"))
+    {
+        mxFree(lpCommand);
+        waitAsync(nlhs, plhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "fetch"))
+    {
+        mxFree(lpCommand);
+        fetchAsync(nlhs, plhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "cancel"))
+    {
+        mxFree(lpCommand);
+        cancelAsync(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "evict"))
+    {
+        mxFree(lpCommand);
+        evictTask(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "clear"))
+    {
+        mxFree(lpCommand);
+        clearTasks(nlhs, nrhs);
+    }
+    else if (!strcmp(lpCommand, "refresh"))
+    {
+        mxFree(lpCommand);
+        refreshDevices(nlhs, nrhs);
+    }
+    else if (!strcmp(lpCommand, "simulate"))
+    {
+        mxFree(lpCommand);
+        simulateDevice(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "replay"))
+    {
+        mxFree(lpCommand);
+        replayDevice(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "stats"))
+    {
+        mxFree(lpCommand);
+        showStats(nlhs, plhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "resetstats"))
+    {
+        mxFree(lpCommand);
+        resetStats(nlhs, nrhs);
+    }
+    else if (!strcmp(lpCommand, "rtstats"))
+    {
+        mxFree(lpCommand);
+        showRealtime(nlhs, plhs, nrhs);
+    }
+    else
+    {
+        mxFree(lpCommand);
+        mexErrMsgTxt("Unknown command. Use 'start', 'read', 'stop', 'publish', 'unpublish', 'isdone', 'wait', 'fetch', 'cancel', 'evict', 'clear', 'refresh', 'simulate', 'replay', 'stats', 'resetstats' or 'rtstats'.");
+    }
+}
+
+// Creates the output matrix: a row vector for a single channel,
+// one column per channel otherwise
+mxArray *createOutput(uInt64 nSamples, uInt32 nChannels, mxClassID nClass)
+{
+    if (nChannels == 1)
+    {
+        return mxCreateNumericMatrix(1, (mwSize) nSamples, nClass, mxREAL);
+    }
+    
+    return mxCreateNumericMatrix((mwSize) nSamples, nChannels, nClass, mxREAL);
+}
+
+// Runs Start() and, if it succeeds, Read(pClock) on the calling
+// thread, or with pRealtime on a reader thread set up as it asks.
+// The nData bytes of lpData and the nScratch bytes of lpScratch are
+// touched and locked in memory, and the thread pinned and raised,
+// before Start() starts the task, so the device never samples while
+// the reader is still taking page faults. Every read is measured into
+// g_Realtime. Returns what Start() returned.
+template <typename S, typename F>
+int32 runReader(const DaqRealtimeConfig *pRealtime, float64 fRate, void *lpData, size_t nData, void *lpScratch, size_t nScratch,
+                S &Start, F &Read)
+{
+    int32 nStart = 0;
+    
+    if (pRealtime == NULL)
+    {
+        nStart = Start();
+        
+        if (nStart >= 0)
+        {
+            Read((DaqRealtimeClock*) NULL);
+        }
+        
+        return nStart;
+    }
+    
+    DaqRealtimeClock Clock;
+    daqRealtimeClockInit(&Clock, &g_Realtime, fRate);
+    
+    bool bLocked = daqRealtimeLock(lpData, nData);
+    bLocked = daqRealtimeLock(lpScratch, nScratch) && bLocked;
+    
+    auto Body = [&]()
+    {
+        nStart = Start();
+        
+        if (nStart >= 0)
+        {
+            Read(&Clock);
+        }
+    };
+    
+    daqRealtimeRun(pRealtime, &g_Realtime, bLocked, Body);
+    
+    daqRealtimeUnlock(lpData, nData);
+    daqRealtimeUnlock(lpScratch, nScratch);
+    
+    return nStart;
+}
+
+// Reads a finite capture into plhs[0], calling Start() to start the
+// task once the memory is ready. Grouped by channel, every channel is
+// a contiguous run of samples, which is exactly a column of a MATLAB
+// matrix, so the driver writes the result in place, one chunk at a
+// time. The reads run on a real-time reader thread when pRealtime is
+// given.
+template <typename T, typename S>
+int32 readOutput(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels, mxClassID nClass, mxArray *plhs[],
+                 DaqCallTiming *pTiming, const DaqRealtimeConfig *pRealtime, S &Start)
+{
+    uInt64 nSamplesRead = 0;
+    size_t nScratch = daqReadScratchSize(nSamples, nChannels);
+    double fStart = daqTimingBegin(pTiming);
+    T *lpScratch = (nScratch > 0) ? (T*) mxMalloc(nScratch * sizeof(T)) : NULL;
+    
+    plhs[0] = createOutput(nSamples, nChannels, nClass);
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    T *ptrData = (T*) mxGetData(plhs[0]);
+    int32 nResult = 0;
+    
+    auto Read = [&](DaqRealtimeClock *pClock)
+    {
+        nResult = daqReadChunked(hTask, fRate, nSamples, nChannels, ptrData, lpScratch, &nSamplesRead, pTiming, pClock);
+    };
+    
+    int32 nStart = runReader(pRealtime, fRate, ptrData, (size_t) nSamples * nChannels * sizeof(T), lpScratch, nScratch * sizeof(T),
+                             Start, Read);
+    mxFree(lpScratch);
+    
+    if (nStart < 0)
+    {
+        nResult = nStart;
+    }
+    
+    if (nResult)
+    {
+        mxDestroyArray(plhs[0]);
+    }
+    else if (nChannels == 1 && nSamplesRead < nSamples)
+    {
+        mxSetN(plhs[0], (mwSize) nSamplesRead);
+    }
+    else if (nSamplesRead < nSamples)
+    {
+        daqReadCompact(ptrData, nSamples, nSamplesRead, nChannels);
+        mxSetM(plhs[0], (mwSize) nSamplesRead);
+    }
+    
+    return nResult;
+}
+
+// Reads a capture as S and scales every chunk straight into plhs[0]
+// as T with the nCoeffs coefficients of each channel in lpCoeffs, so
+// no float64 copy of it is ever made. Start() starts the task as in
+// readOutput.
+template <typename T, typename S, typename F>
+int32 readScaledAs(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels, mxClassID nClass,
+                   const float64 *lpCoeffs, uInt32 nCoeffs, mxArray *plhs[], DaqCallTiming *pTiming,
+                   const DaqRealtimeConfig *pRealtime, F &Start)
+{
+    double fStart = daqTimingBegin(pTiming);
+    plhs[0] = createOutput(nSamples, nChannels, nClass);
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    uInt64 nSamplesRead = 0, nDone = 0;
+    int32 nResult = 0;
+    T *ptrData = (T*) mxGetData(plhs[0]);
+    uInt32 nChunk = daqReadChunkSize(nSamples);
+    size_t nScratch = (size_t) nChunk * nChannels;
+    S *lpScratch = (S*) mxMalloc(nScratch * sizeof(S));
+    
+    auto Sink = [&](const S *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            daqScaleCodesTo(lpChunk + (size_t) i * nStride, nRead, lpCoeffs + (size_t) i * DAQ_SCALE_MAX_COEFFS, (int) nCoeffs,
+                            ptrData + (size_t) i * nSamples + nDone);
+        }
+        
+        nDone += nRead;
+    };
+    
+    auto Read = [&](DaqRealtimeClock *pClock)
+    {
+        nResult = daqReadStream(hTask, fRate, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming, pClock);
+    };
+    
+    int32 nStart = runReader(pRealtime, fRate, ptrData, (size_t) nSamples * nChannels * sizeof(T), lpScratch, nScratch * sizeof(S),
+                             Start, Read);
+    mxFree(lpScratch);
+    
+    if (nStart < 0)
+    {
+        nResult = nStart;
+    }
+    
+    if (nResult)
+    {
+        mxDestroyArray(plhs[0]);
+    }
+    else if (nChannels == 1 && nSamplesRead < nSamples)
+    {
+        mxSetN(plhs[0], (mwSize) nSamplesRead);
+    }
+    else if (nSamplesRead < nSamples)
+    {
+        daqReadCompact(ptrData, nSamples, nSamplesRead, nChannels);
+        mxSetM(plhs[0], (mwSize) nSamplesRead);
+    }
+    
+    return nResult;
+}
+
+// Reads a capture into plhs[0] as T. fGain is the inverse of the
+// quantum of a fixed-point output, or 1. Converters of up to 16 bits
+// are read as raw codes and scaled with their polynomial; wider ones
+// do not fit an int16, so the driver scales them and only the gain
+// is applied. The scaling is read before Start() starts the task.
+template <typename T, typename F>
+int32 readScaled(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels, mxClassID nClass, float64 fGain,
+                 mxArray *plhs[], DaqCallTiming *pTiming, const DaqRealtimeConfig *pRealtime, F &Start)
+{
+    float64 *lpCoeffs = (float64*) mxCalloc((size_t) DAQ_SCALE_MAX_COEFFS * nChannels, sizeof(float64));
+    uInt32 nCoeffs = 0, nBits = 0;
+    int32 nResult = daqGetResolution(hTask, nChannels, &nBits);
+    
+    if (nResult >= 0 && nBits <= 16)
+    {
+        nResult = daqGetScaling(hTask, nChannels, lpCoeffs, &nCoeffs);
+    }
+    else if (nResult >= 0)
+    {
+        nCoeffs = 2;
+        
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            lpCoeffs[(size_t) i * DAQ_SCALE_MAX_COEFFS + 1] = 1;
+        }
+    }
+    
+    if (nResult < 0)
+    {
+        mxFree(lpCoeffs);
+        return nResult;
+    }
+    
+    for (size_t k = 0; k < (size_t) DAQ_SCALE_MAX_COEFFS * nChannels; k++)
+    {
+        lpCoeffs[k] *= fGain;
+    }
+    
+    if (nBits <= 16)
+    {
+        nResult = readScaledAs<T, int16>(hTask, fRate, nSamples, nChannels, nClass, lpCoeffs, nCoeffs, plhs, pTiming, pRealtime,
+                                         Start);
+    }
+    else
+    {
+        nResult = readScaledAs<T, float64>(hTask, fRate, nSamples, nChannels, nClass, lpCoeffs, nCoeffs, plhs, pTiming, pRealtime,
+                                           Start);
+    }
+    
+    mxFree(lpCoeffs);
+    
+    return nResult;
+}
+
+// Streams the whole capture to Options.lpFile through the writer
+// thread and returns the writer counters instead of the samples
+void recordData(int nlhs, mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1, nCoeffs = 0;
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    DaqFileHeader Header;
+    float64 *lpCoeffs = (float64*) mxMalloc((size_t) DAQ_SCALE_MAX_COEFFS * nChannels * sizeof(float64));
+    int32 nLength = daqGetTaskChannels(hTask, NULL, 0);
+    char *lpChannels = (char*) mxCalloc(nLength > 0 ? nLength : 1, sizeof(char));
+    int32 nResult = daqGetScaling(hTask, nChannels, lpCoeffs, &nCoeffs);
+    
+    if (nResult >= 0 && nLength > 0)
+    {
+        nResult = daqGetTaskChannels(hTask, lpChannels, nLength);
+    }
+    
+    if (nResult < 0)
+    {
+        daqClearTask(hTask);
+        failCall(pTiming, nResult);
+    }
+    
+    // The coefficients are stored packed, nCoeffs per channel
+    for (uInt32 i = 1; i < nChannels; i++)
+    {
+        memmove(lpCoeffs + i * nCoeffs, lpCoeffs + i * DAQ_SCALE_MAX_COEFFS, nCoeffs * sizeof(float64));
+    }
+    
+    memset(&Header, 0, sizeof(Header));
+    memcpy(Header.lpMagic, DAQ_FILE_MAGIC, 8);
+    Header.nVersion = DAQ_FILE_VERSION;
+    Header.nChannels = nChannels;
+    Header.nSampleType = pOptions->bRaw ? DAQ_FILE_INT16 : DAQ_FILE_FLOAT64;
+    Header.fRate = pArgs->nSamplingPeriod;
+    Header.fRange = pArgs->fMaxVolts;
+    Header.nCoeffs = nCoeffs;
+    Header.nChannelsLength = (uInt32) strlen(lpChannels) + 1;
+    Header.nHeaderSize = daqFileHeaderSize(nChannels, nCoeffs, Header.nChannelsLength);
+    
+    uInt32 nBlockScans = daqReadStreamChunk(pArgs->nSamplingPeriod);
+    
+    DaqFileWriter Writer;
+    
+    if (!Writer.Open(pOptions->lpFile, &Header, lpCoeffs, lpChannels, (size_t) nBlockScans * nChannels * daqFileSampleSize(Header.nSampleType)))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Could not create the recording file.");
+    }
+    
+    mxFree(lpCoeffs);
+    mxFree(lpChannels);
+    
+    uInt64 nWritten = 0;
+    double fStart = daqTimingBegin(pTiming);
+    nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        if (pOptions->bRaw)
+        {
+            nResult = daqRecordBlocks<int16>(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, &Writer, &nWritten, pTiming);
+        }
+        else
+        {
+            nResult = daqRecordBlocks<float64>(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, &Writer, &nWritten, pTiming);
+        }
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    // Waiting for the disk to catch up is part of processing
+    fStart = daqTimingBegin(pTiming);
+    bool bWritten = Writer.Close(&nWritten);
+    daqTimingEnd(pTiming, DAQ_PHASE_PROCESS, fStart);
+    
+    if (nResult < 0)
+    {
+        failCall(pTiming, nResult);
+    }
+    else if (!bWritten)
+    {
+        mexErrMsgTxt("Could not write the recording file.");
+    }
+    
+    if (nlhs > 0)
+    {
+        const char *lpFields[] = {"Samples", "Bytes", "Blocks", "MaxQueueDepth", "Stalls"};
+        
+        plhs[0] = mxCreateStructMatrix(1, 1, 5, lpFields);
+        mxSetField(plhs[0], 0, "Samples", mxCreateDoubleScalar((double) nWritten));
+        mxSetField(plhs[0], 0, "Bytes", mxCreateDoubleScalar((double) Writer.Bytes()));
+        mxSetField(plhs[0], 0, "Blocks", mxCreateDoubleScalar((double) Writer.Blocks()));
+        mxSetField(plhs[0], 0, "MaxQueueDepth", mxCreateDoubleScalar((double) Writer.MaxQueueDepth()));
+        mxSetField(plhs[0], 0, "Stalls", mxCreateDoubleScalar((double) Writer.Stalls()));
+    }
+}
+
+// Creates the matrix of scaling coefficients of the channels of
+// hTask, one column per channel and lowest order first
+int32 createScaling(TaskHandle hTask, uInt32 nChannels, mxArray **ppScaling)
+{
+    float64 *lpCoeffs = (float64*) mxMalloc((size_t) DAQ_SCALE_MAX_COEFFS * nChannels * sizeof(float64));
+    uInt32 nCoeffs = 0;
+    int32 nResult = daqGetScaling(hTask, nChannels, lpCoeffs, &nCoeffs);
+    
+    if (nResult < 0)
+    {
+        mxFree(lpCoeffs);
+        return nResult;
+    }
+    
+    *ppScaling = mxCreateNumericMatrix(nCoeffs, nChannels, mxDOUBLE_CLASS, mxREAL);
+    double *ptrScaling = mxGetPr(*ppScaling);
+    
+    for (uInt32 i = 0; i < nChannels; i++)
+    {
+        for (uInt32 k = 0; k < nCoeffs; k++)
+        {
+            ptrScaling[i * nCoeffs + k] = lpCoeffs[i * DAQ_SCALE_MAX_COEFFS + k];
+        }
+    }
+    
+    mxFree(lpCoeffs);
+    
+    return 0;
+}
+
+// Adquires raw codes and compresses every chunk as it is read, so
+// only the compressed capture is kept. plhs[0] holds it as a uint8
+// column, for daqDecompress, and plhs[1] the scaling.
+void compressData(int nlhs, mxArray *plhs[], DaqArguments *pArgs, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1;
+    DaqCodecEncoder Encoder;
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    // Room for a quarter of the raw size to start with
+    if (!Encoder.Init(nChannels, (size_t) (nSamples * nChannels / 2)))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to compress the adquisition.");
+    }
+    
+    uInt64 nSamplesRead = 0;
+    bool bEncoded = true;
+    uInt32 nChunk = daqReadStreamChunk(pArgs->nSamplingPeriod);
+    int16 *lpScratch = (int16*) mxMalloc((size_t) nChunk * nChannels * sizeof(int16));
+    
+    auto Sink = [&](const int16 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        bEncoded = bEncoded && Encoder.Encode(lpChunk, nRead, nStride);
+    };
+    
+    double fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        nResult = daqReadStream(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    }
+    
+    mxFree(lpScratch);
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    if (nResult >= 0 && nlhs > 1)
+    {
+        nResult = createScaling(hTask, nChannels, &plhs[1]);
+    }
+    
+    daqClearTask(hTask);
+    failCall(pTiming, nResult);
+    
+    if (!bEncoded)
+    {
+        mexErrMsgTxt("Not enough memory to compress the adquisition.");
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    plhs[0] = mxCreateNumericMatrix(Encoder.Size(), 1, mxUINT8_CLASS, mxREAL);
+    memcpy(mxGetData(plhs[0]), Encoder.Data(), Encoder.Size());
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+}
+
+// Reads a capture through the windowed statistics and returns them
+// in a structure in plhs[0]. Only the aggregates are ever stored.
+void statisticsData(mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt64 nWindow = (uInt64) pOptions->nStatistics;
+    uInt32 nChannels = 1;
+    DaqStatistics Statistics;
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    if (!Statistics.Init(nChannels, nWindow, (size_t) ((nSamples + nWindow - 1) / nWindow), pOptions->nBins,
+                         -pArgs->fMaxVolts, pArgs->fMaxVolts))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to process the adquisition.");
+    }
+    
+    uInt64 nSamplesRead = 0;
+    uInt32 nChunk = daqReadStreamChunk(pArgs->nSamplingPeriod);
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nChunk * nChannels * sizeof(float64));
+    
+    auto Sink = [&](const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            Statistics.Process(i, lpChunk + (size_t) i * nStride, nRead);
+        }
+    };
+    
+    double fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        nResult = daqReadStream(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    }
+    
+    mxFree(lpScratch);
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    failCall(pTiming, nResult);
+    
+    fStart = daqTimingBegin(pTiming);
+    
+    const char *lpFields[] = {"Window", "Min", "Max", "Mean", "RMS", "Std", "Histogram", "BinEdges"};
+    size_t nWindows = Statistics.Windows();
+    int nBins = pOptions->nBins;
+    mxArray *lpAggregates[5];
+    
+    for (int i = 0; i < 5; i++)
+    {
+        lpAggregates[i] = createOutput(nWindows, nChannels, mxDOUBLE_CLASS);
+    }
+    
+    Statistics.Result(nWindows, mxGetPr(lpAggregates[0]), mxGetPr(lpAggregates[1]), mxGetPr(lpAggregates[2]),
+                      mxGetPr(lpAggregates[3]), mxGetPr(lpAggregates[4]));
+    
+    plhs[0] = mxCreateStructMatrix(1, 1, 8, lpFields);
+    mxSetField(plhs[0], 0, "Window", mxCreateDoubleScalar((double) nWindow));
+    
+    for (int i = 0; i < 5; i++)
+    {
+        mxSetField(plhs[0], 0, lpFields[i + 1], lpAggregates[i]);
+    }
+    
+    mxArray *pHistogram = mxCreateDoubleMatrix(nBins, nChannels, mxREAL);
+    mxArray *pEdges = mxCreateDoubleMatrix(nBins > 0 ? nBins + 1 : 0, 1, mxREAL);
+    double *ptrHistogram = mxGetPr(pHistogram), *ptrEdges = mxGetPr(pEdges);
+    
+    for (size_t i = 0; i < (size_t) nBins * nChannels; i++)
+    {
+        ptrHistogram[i] = (double) Statistics.Histogram()[i];
+    }
+    
+    for (int i = 0; i <= nBins && nBins > 0; i++)
+    {
+        ptrEdges[i] = -pArgs->fMaxVolts + 2 * pArgs->fMaxVolts * i / nBins;
+    }
+    
+    mxSetField(plhs[0], 0, "Histogram", pHistogram);
+    mxSetField(plhs[0], 0, "BinEdges", pEdges);
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+}
+
+// Creates the envelope structure returned by 'Envelope', the same
+// one "daqEnvelope" builds, with its levels left in lpMin and lpMax
+mxArray *createEnvelope(uInt64 nSamples, uInt32 nChannels, float64 **lpMin, float64 **lpMax)
+{
+    const char *lpFields[] = {"Length", "Channels", "Factor", "Min", "Max"};
+    int nLevels = daqEnvelopeLevels(nSamples);
+    mxArray *pEnvelope = mxCreateStructMatrix(1, 1, 5, lpFields);
+    mxArray *pMin = mxCreateCellMatrix(nLevels, 1);
+    mxArray *pMax = mxCreateCellMatrix(nLevels, 1);
+    
+    for (int k = 0; k < nLevels; k++)
+    {
+        mwSize nBuckets = (mwSize) daqEnvelopeBuckets(nSamples, k);
+        mxArray *pLevelMin = mxCreateDoubleMatrix(nBuckets, nChannels, mxREAL);
+        mxArray *pLevelMax = mxCreateDoubleMatrix(nBuckets, nChannels, mxREAL);
+        
+        lpMin[k] = mxGetPr(pLevelMin);
+        lpMax[k] = mxGetPr(pLevelMax);
+        mxSetCell(pMin, k, pLevelMin);
+        mxSetCell(pMax, k, pLevelMax);
+    }
+    
+    mxSetField(pEnvelope, 0, "Length", mxCreateDoubleScalar((double) nSamples));
+    mxSetField(pEnvelope, 0, "Channels", mxCreateDoubleScalar(nChannels));
+    mxSetField(pEnvelope, 0, "Factor", mxCreateDoubleScalar(DAQ_ENVELOPE_FACTOR));
+    mxSetField(pEnvelope, 0, "Min", pMin);
+    mxSetField(pEnvelope, 0, "Max", pMax);
+    
+    return pEnvelope;
+}
+
+// Reads a capture into plhs[0] and builds its envelope in plhs[1]
+// from every block while the next one is being adquired
+void envelopeData(int nlhs, mxArray *plhs[], DaqArguments *pArgs, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1;
+    float64 *lpMin[DAQ_ENVELOPE_MAX_LEVELS], *lpMax[DAQ_ENVELOPE_MAX_LEVELS];
+    DaqEnvelope<float64> Envelope;
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    double fStart = daqTimingBegin(pTiming);
+    plhs[0] = createOutput(nSamples, nChannels, mxDOUBLE_CLASS);
+    mxArray *pEnvelope = createEnvelope(nSamples, nChannels, lpMin, lpMax);
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    if (!Envelope.Init(nChannels, nSamples, lpMin, lpMax))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to process the adquisition.");
+    }
+    
+    uInt64 nSamplesRead = 0, nDone = 0;
+    float64 *ptrData = mxGetPr(plhs[0]);
+    uInt32 nChunk = daqReadStreamChunk(pArgs->nSamplingPeriod);
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nChunk * nChannels * sizeof(float64));
+    
+    auto Sink = [&](const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            memcpy(ptrData + (size_t) i * nSamples + nDone, lpChunk + (size_t) i * nStride, nRead * sizeof(float64));
+            Envelope.Process(i, lpChunk + (size_t) i * nStride, nRead);
+        }
+        
+        nDone += nRead;
+    };
+    
+    fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        nResult = daqReadStream(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    }
+    
+    mxFree(lpScratch);
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    if (nResult < 0)
+    {
+        mxDestroyArray(pEnvelope);
+    }
+    
+    failCall(pTiming, nResult);
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = pEnvelope;
+    }
+    else
+    {
+        mxDestroyArray(pEnvelope);
+    }
+}
+
+// Reads a capture through the decimation filter, so only the
+// decimated samples are ever stored in plhs[0]
+int32 readDecimated(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels,
+                    DaqDecimator *pDecimator, mxArray *plhs[], DaqCallTiming *pTiming)
+{
+    uInt64 nSamplesRead = 0;
+    size_t nOut = pDecimator->OutputLength(nSamples), nWritten = 0;
+    uInt32 nChunk = daqReadStreamChunk(fRate);
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nChunk * nChannels * sizeof(float64));
+    
+    plhs[0] = createOutput(nOut, nChannels, mxDOUBLE_CLASS);
+    
+    double *lpOut = mxGetPr(plhs[0]);
+    
+    auto Sink = [&](const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        size_t nProduced = 0;
+        
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            nProduced = pDecimator->Process(i, lpChunk + (size_t) i * nStride, nRead, lpOut + i * nOut + nWritten);
+        }
+        
+        nWritten += nProduced;
+    };
+    
+    int32 nResult = daqReadStream(hTask, fRate, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    mxFree(lpScratch);
+    
+    if (nResult)
+    {
+        mxDestroyArray(plhs[0]);
+    }
+    else if (nChannels == 1 && nWritten < nOut)
+    {
+        mxSetN(plhs[0], nWritten);
+    }
+    
+    return nResult;
+}
+
+// Reads a capture through the resampler, so only the resampled
+// samples are ever stored in plhs[0]
+void resampleData(mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1;
+    DaqResampler Resampler;
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    if (!Resampler.Init(pOptions->nUp, pOptions->nDown, NULL, nChannels, DAQ_READ_CHUNK))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to process the adquisition.");
+    }
+    
+    double fStart = daqTimingBegin(pTiming);
+    size_t nOut = (size_t) Resampler.OutputLength(0, nSamples), nWritten = 0;
+    plhs[0] = createOutput(nOut, nChannels, mxDOUBLE_CLASS);
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    uInt64 nSamplesRead = 0;
+    double *lpOut = mxGetPr(plhs[0]);
+    uInt32 nChunk = daqReadStreamChunk(pArgs->nSamplingPeriod);
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nChunk * nChannels * sizeof(float64));
+    
+    auto Sink = [&](const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        size_t nProduced = 0;
+        
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            nProduced = Resampler.Process(i, lpChunk + (size_t) i * nStride, nRead, lpOut + i * nOut + nWritten, nOut - nWritten);
+        }
+        
+        nWritten += nProduced;
+    };
+    
+    fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        nResult = daqReadStream(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    }
+    
+    mxFree(lpScratch);
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    if (nResult < 0)
+    {
+        mxDestroyArray(plhs[0]);
+        failCall(pTiming, nResult);
+    }
+    
+    // The last outputs need the half length of the filter past the end
+    size_t nProduced = 0;
+    
+    for (uInt32 i = 0; i < nChannels; i++)
+    {
+        nProduced = Resampler.Flush(i, lpOut + i * nOut + nWritten, nOut - nWritten);
+    }
+    
+    nWritten += nProduced;
+    
+    if (nChannels == 1 && nWritten < nOut)
+    {
+        mxSetN(plhs[0], nWritten);
+    }
+}
+
+// Reads a capture through the correlator, so only the correlation
+// of every pair is ever stored. Returns the lag and value of the
+// peak of every pair, and the whole correlation if it is requested.
+void xcorrData(int nlhs, mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1;
+    char lpOutput[128];
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    size_t nPairs = (pOptions->lpPairs != NULL) ? pOptions->nPairs : daqXCorrPairs(nChannels);
+    uInt32 *lpPairs = (uInt32*) mxMalloc(2 * nPairs * sizeof(uInt32));
+    
+    if (pOptions->lpPairs == NULL)
+    {
+        daqXCorrAllPairs(nChannels, lpPairs);
+    }
+    
+    // The option holds a Pairs-by-2 matrix of channels
+    for (size_t i = 0; i < 2 * nPairs && pOptions->lpPairs != NULL; i++)
+    {
+        float64 fChannel = pOptions->lpPairs[(i % 2) * nPairs + i / 2];
+        
+        if (fChannel < 1 || fChannel > nChannels || fChannel != floor(fChannel))
+        {
+            daqClearTask(hTask);
+            sprintf(lpOutput, "Option 'Pairs' must hold channels between 1 and %d.", (int) nChannels);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        lpPairs[i] = (uInt32) fChannel - 1;
+    }
+    
+    double fStart = daqTimingBegin(pTiming);
+    plhs[0] = mxCreateDoubleMatrix(nPairs, 1, mxREAL);
+    mxArray *pPeaks = mxCreateDoubleMatrix(nPairs, 1, mxREAL);
+    mxArray *pCorrelation = (nlhs > 2) ? mxCreateDoubleMatrix(2 * (size_t) pOptions->nMaxLag + 1, nPairs, mxREAL) : NULL;
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    uInt64 nSamplesRead = 0;
+    uInt32 nChunk = daqReadStreamChunk(pArgs->nSamplingPeriod);
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nChunk * nChannels * sizeof(float64));
+    
+    // The correlator owns native memory and threads, so nothing may
+    // fail from here until it is freed
+    DaqCorrelator Correlator;
+    
+    if (!Correlator.Init(nChannels, lpPairs, nPairs, pOptions->nMaxLag, nSamples, pOptions->nScale,
+                         (pCorrelation != NULL) ? mxGetPr(pCorrelation) : NULL, 0))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to process the adquisition.");
+    }
+    
+    mxFree(lpPairs);
+    
+    auto Sink = [&](const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        Correlator.Process(lpChunk, nRead, nStride);
+    };
+    
+    fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        nResult = daqReadStream(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    }
+    
+    mxFree(lpScratch);
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    if (nResult < 0)
+    {
+        Correlator.Free();
+        mxDestroyArray(plhs[0]);
+        mxDestroyArray(pPeaks);
+        mxDestroyArray(pCorrelation);
+        failCall(pTiming, nResult);
+    }
+    
+    // The last block needs the MaxLag samples past the end, which are zeros
+    fStart = daqTimingBegin(pTiming);
+    Correlator.Finish();
+    Correlator.Peaks(mxGetPr(plhs[0]), mxGetPr(pPeaks));
+    Correlator.Free();
+    daqTimingEnd(pTiming, DAQ_PHASE_PROCESS, fStart);
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = pPeaks;
+    }
+    else
+    {
+        mxDestroyArray(pPeaks);
+    }
+    
+    if (nlhs > 2)
+    {
+        plhs[2] = pCorrelation;
+    }
+}
+
+// Reads a capture through the spectrum estimator. Returns the
+// averaged density in plhs[0], one column per channel, and the
+// frequency of every bin in plhs[1] if it is requested.
+int32 readSpectrum(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels,
+                   DaqSpectrum *pSpectrum, int nlhs, mxArray *plhs[], DaqCallTiming *pTiming)
+{
+    uInt64 nSamplesRead = 0;
+    uInt32 nChunk = daqReadStreamChunk(fRate);
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nChunk * nChannels * sizeof(float64));
+    
+    auto Sink = [&](const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            pSpectrum->Process(i, lpChunk + (size_t) i * nStride, nRead);
+        }
+    };
+    
+    int32 nResult = daqReadStream(hTask, fRate, nSamples, nChannels, nChunk, lpScratch, Sink, &nSamplesRead, pTiming);
+    mxFree(lpScratch);
+    
+    if (nResult)
+    {
+        return nResult;
+    }
+    
+    size_t nBins = pSpectrum->Bins();
+    double fStart = daqTimingBegin(pTiming);
+    
+    plhs[0] = mxCreateDoubleMatrix(nBins, nChannels, mxREAL);
+    pSpectrum->Result(fRate, mxGetPr(plhs[0]));
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleMatrix(nBins, 1, mxREAL);
+        double *ptrFrequency = mxGetPr(plhs[1]);
+        
+        for (size_t k = 0; k < nBins; k++)
+        {
+            ptrFrequency[k] = k * fRate / (2 * (nBins - 1));
+        }
+    }
+    
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    return 0;
+}
+
+// Adquires through the decimation filter or the spectrum estimator,
+// whose memory does not grow with the number of samples, on a task
+// that does not buffer the whole capture either
+void streamData(int nlhs, mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1;
+    DaqDecimator Decimator;
+    DaqSpectrum Spectrum;
+    bool bReady;
+    
+    if (pOptions->nSpectrum > 0 && nSamples < (uInt64) pOptions->nSpectrum)
+    {
+        mexErrMsgTxt("At least as many samples as the spectrum length must be adquired.");
+    }
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    if (pOptions->nSpectrum > 0)
+    {
+        bReady = Spectrum.Init(pOptions->nSpectrum, pOptions->nOverlap, nChannels);
+    }
+    else if (pOptions->lpTaps != NULL)
+    {
+        bReady = Decimator.Init(pOptions->lpTaps, pOptions->nTaps, pOptions->nDecimate, nChannels, DAQ_READ_CHUNK);
+    }
+    else
+    {
+        float64 fUnit = 1;
+        bReady = Decimator.Init(&fUnit, 1, pOptions->nDecimate, nChannels, DAQ_READ_CHUNK);
+    }
+    
+    if (!bReady)
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to process the adquisition.");
+    }
+    
+    double fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        if (pOptions->nSpectrum > 0)
+        {
+            nResult = readSpectrum(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, &Spectrum, nlhs, plhs, pTiming);
+        }
+        else
+        {
+            nResult = readDecimated(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, &Decimator, plhs, pTiming);
+        }
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    failCall(pTiming, nResult);
+}
+
+// Scans up to nSamples samples per channel for events, in blocks of
+// nBlock samples, stopping as soon as the last event is complete
+int32 readTriggered(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels, uInt32 nBlock,
+                    DaqTrigger *pTrigger, DaqCallTiming *pTiming)
+{
+    float64 *lpScratch = (float64*) mxMalloc((size_t) nBlock * nChannels * sizeof(float64));
+    uInt64 nDone = 0;
+    int32 nResult = 0;
+    
+    while (nDone < nSamples && !pTrigger->Done())
+    {
+        uInt32 nChunk = (nSamples - nDone < nBlock) ? (uInt32) (nSamples - nDone) : nBlock;
+        int32 nRead = 0;
+        
+        double fStart = daqTimingBegin(pTiming);
+        
+        nResult = daqReadSamples(hTask, (int32) nChunk, daqReadTimeout(nChunk, fRate), DAQmx_Val_GroupByChannel,
+                                 lpScratch, nChunk * nChannels, &nRead);
+        
+        daqTimingEnd(pTiming, DAQ_PHASE_READ, fStart);
+        daqTimingRead(pTiming, nRead, nChannels, sizeof(float64));
+        daqTimingError(pTiming, nResult);
+        
+        if (nRead > 0)
+        {
+            fStart = daqTimingBegin(pTiming);
+            pTrigger->Process(lpScratch, (uInt32) nRead, nChunk);
+            daqTimingEnd(pTiming, DAQ_PHASE_PROCESS, fStart);
+            nDone += nRead;
+        }
+        
+        if (nResult < 0 || nRead < (int32) nChunk || pTrigger->Failed())
+        {
+            break;
+        }
+    }
+    
+    mxFree(lpScratch);
+    
+    return nResult;
+}
+
+// Captures the events of a trigger. plhs[0] holds one column of
+// pre- and post-trigger samples per event, or a page per event with
+// one column per channel, and plhs[1] the time of every trigger.
+void triggerData(int nlhs, mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions, DaqCallTiming *pTiming)
+{
+    TaskHandle hTask = NULL;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    uInt32 nChannels = 1;
+    DaqTrigger Trigger;
+    DaqTriggerCondition Condition;
+    char lpOutput[256];
+    
+    createStreamTask(pArgs, &hTask, &nChannels, pTiming);
+    
+    if ((uInt32) pOptions->nTriggerChannel > nChannels)
+    {
+        daqClearTask(hTask);
+        sprintf(lpOutput, "Option 'TriggerChannel' must not exceed the %u channel(s) adquired.", (unsigned int) nChannels);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    // Short blocks so the capture ends soon after the last event
+    float64 fBlockScans = pArgs->nSamplingPeriod / DAQ_TRIGGER_BLOCK_RATE;
+    uInt32 nBlock = (fBlockScans < 1024) ? 1024 : (fBlockScans > DAQ_READ_CHUNK) ? DAQ_READ_CHUNK : (uInt32) fBlockScans;
+    
+    if (nBlock > nSamples)
+    {
+        nBlock = (uInt32) nSamples;
+    }
+    
+    Condition.nType = pOptions->nTrigger;
+    Condition.fLow = pOptions->lpLevel[0];
+    Condition.fHigh = pOptions->lpLevel[1];
+    
+    if (!Trigger.Init(&Condition, nChannels, pOptions->nTriggerChannel - 1, pOptions->nPreTrigger, pOptions->nPostTrigger,
+                      pOptions->nHoldOff, pOptions->nMaxEvents, nBlock))
+    {
+        daqClearTask(hTask);
+        mexErrMsgTxt("Not enough memory to process the adquisition.");
+    }
+    
+    double fStart = daqTimingBegin(pTiming);
+    int32 nResult = daqStartTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        nResult = readTriggered(hTask, pArgs->nSamplingPeriod, nSamples, nChannels, nBlock, &Trigger, pTiming);
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqClearTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    failCall(pTiming, nResult);
+    
+    if (Trigger.Failed())
+    {
+        mexErrMsgTxt("Not enough memory to keep the events.");
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    
+    uInt32 nEvents = Trigger.Events();
+    mwSize lpDims[3] = {(mwSize) Trigger.Length(), nChannels, nEvents};
+    
+    // Event by event, channel by channel is the column-major layout
+    // of either output shape
+    if (nChannels == 1)
+    {
+        plhs[0] = mxCreateDoubleMatrix(lpDims[0], nEvents, mxREAL);
+    }
+    else
+    {
+        plhs[0] = mxCreateNumericArray(3, lpDims, mxDOUBLE_CLASS, mxREAL);
+    }
+    
+    if (nEvents > 0)
+    {
+        memcpy(mxGetPr(plhs[0]), Trigger.Event(0, 0), (size_t) nEvents * nChannels * Trigger.Length() * sizeof(float64));
+    }
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleMatrix(1, nEvents, mxREAL);
+        double *ptrTimes = mxGetPr(plhs[1]);
+        
+        for (uInt32 k = 0; k < nEvents; k++)
+        {
+            ptrTimes[k] = (double) Trigger.Position(k) / pArgs->nSamplingPeriod;
+        }
+    }
+    
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+}
+
+// Releases the tasks of a synchronized adquisition
+void clearSync(DaqSyncDevice *lpDevices, int nDevices)
+{
+    for (int i = 0; i < nDevices; i++)
+    {
+        daqClearTask(lpDevices[i].hTask);
+        lpDevices[i].hTask = NULL;
+    }
+}
+
+// Adquires from every device of the cell array prhs[5] at once, with
+// the channels of each device in the matching cell of prhs[1]. The
+// result has the columns of every device side by side.
+void syncData(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    DaqArguments lpArgs[DAQ_SYNC_MAX_DEVICES];
+    DaqSyncDevice lpDevices[DAQ_SYNC_MAX_DEVICES];
+    DaqCallTiming lpTimings[DAQ_SYNC_MAX_DEVICES];
+    DaqCallTiming Timing;
+    char lpOutput[256];
+    size_t nDevices = mxGetNumberOfElements(prhs[5]);
+    
+    if (nrhs > 6)
+    {
+        mexErrMsgTxt("Options cannot be combined with several devices.");
+    }
+    else if (nlhs > 2)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (nDevices < 1 || nDevices > DAQ_SYNC_MAX_DEVICES)
+    {
+        sprintf(lpOutput, "Between 1 and %d devices can be adquired at once.", DAQ_SYNC_MAX_DEVICES);
+        mexErrMsgTxt(lpOutput);
+    }
+    else if (!mxIsCell(prhs[1]) || mxGetNumberOfElements(prhs[1]) != nDevices)
+    {
+        mexErrMsgTxt("With several devices, the channel names must be a cell array with the channels of each device.");
+    }
+    
+    memset(lpArgs, 0, sizeof(lpArgs));
+    
+    for (size_t i = 0; i < nDevices; i++)
+    {
+        const mxArray *lpInputs[6] = {prhs[0], mxGetCell(prhs[1], i), prhs[2], prhs[3], prhs[4], mxGetCell(prhs[5], i)};
+        
+        if (lpInputs[1] == NULL || lpInputs[5] == NULL)
+        {
+            mexErrMsgTxt("Every device must have its channel names.");
+        }
+        
+        getArguments(lpInputs, 1, lpArgs + i);
+    }
+    
+    uInt64 nSamples = (uInt64) lpArgs[0].nSamples;
+    float64 fRate = lpArgs[0].nSamplingPeriod;
+    
+    if (lpArgs[0].nSamples < 1)
+    {
+        mexErrMsgTxt("At least one sample must be adquired.");
+    }
+    
+    DaqCallTiming *pTiming = (nlhs > 1 || g_bStats) ? &Timing : NULL;
+    daqTimingInit(pTiming, nSamples);
+    memset(lpDevices, 0, sizeof(lpDevices));
+    
+    // The first device is the master the others follow
+    uInt32 nTotal = 0;
+    int32 nResult = 0, nLimits = 0;
+    
+    for (size_t i = 0; i < nDevices && nResult >= 0 && nLimits == 0; i++)
+    {
+        TaskHandle hTask = NULL;
+        
+        nResult = createVoltageTask(lpArgs + i, DAQmx_Val_FiniteSamps, nSamples, &hTask, pTiming);
+        
+        if (nResult < 0)
+        {
+            break;
+        }
+        
+        lpDevices[i].hTask = hTask;
+        
+        if (i > 0)
+        {
+            double fStart = daqTimingBegin(pTiming);
+            nResult = daqSyncFollow(hTask, lpArgs[0].lpDevice, fRate, nSamples);
+            daqTimingEnd(pTiming, DAQ_PHASE_CLOCK, fStart);
+        }
+        
+        // Every device is read in place as the capture goes, so none
+        // needs a driver buffer the size of the whole capture
+        if (nResult >= 0)
+        {
+            nResult = daqReadBoundBuffer(hTask, nSamples, fRate);
+        }
+        
+        if (nResult >= 0)
+        {
+            double fStart = daqTimingBegin(pTiming);
+            nLimits = getLimits(hTask, lpArgs + i, lpOutput);
+            nResult = (nLimits < 0) ? nLimits : nResult;
+            daqTimingEnd(pTiming, DAQ_PHASE_LIMITS, fStart);
+        }
+        
+        if (nResult >= 0)
+        {
+            nResult = daqGetTaskNumChans(hTask, &lpDevices[i].nChannels);
+        }
+        
+        releaseCachedTaskFor(lpArgs[i].lpDevice);
+        nTotal += lpDevices[i].nChannels;
+    }
+    
+    for (size_t i = 0; i < nDevices; i++)
+    {
+        freeArguments(lpArgs + i);
+    }
+    
+    if (nResult < 0 || nLimits != 0)
+    {
+        clearSync(lpDevices, (int) nDevices);
+        failCall(pTiming, (nResult < 0) ? nResult : 0);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    double fStart = daqTimingBegin(pTiming);
+    
+    plhs[0] = createOutput(nSamples, nTotal, mxDOUBLE_CLASS);
+    
+    double *ptrData = mxGetPr(plhs[0]);
+    
+    for (size_t i = 0; i < nDevices; i++)
+    {
+        size_t nScratch = daqReadScratchSize(nSamples, lpDevices[i].nChannels);
+        
+        lpDevices[i].lpData = ptrData;
+        lpDevices[i].lpScratch = (nScratch > 0) ? (float64*) mxMalloc(nScratch * sizeof(float64)) : NULL;
+        lpDevices[i].pTiming = (pTiming != NULL) ? lpTimings + i : NULL;
+        daqTimingInit(lpDevices[i].pTiming, nSamples);
+        ptrData += (size_t) nSamples * lpDevices[i].nChannels;
+    }
+    
+    daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    
+    fStart = daqTimingBegin(pTiming);
+    nResult = daqSyncStart(lpDevices, (int) nDevices);
+    daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+    
+    if (nResult >= 0)
+    {
+        fStart = daqTimingBegin(pTiming);
+        nResult = daqSyncRead(lpDevices, (int) nDevices, fRate, nSamples);
+        daqTimingEnd(pTiming, DAQ_PHASE_READ, fStart);
+    }
+    
+    fStart = daqTimingBegin(pTiming);
+    
+    for (size_t i = 0; i < nDevices; i++)
+    {
+        daqStopTask(lpDevices[i].hTask);
+        mxFree(lpDevices[i].lpScratch);
+    }
+    
+    clearSync(lpDevices, (int) nDevices);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    // The reads ran in parallel, so only their counters add up
+    if (pTiming != NULL)
+    {
+        pTiming->nChannels = nTotal;
+        pTiming->nRead = nSamples;
+        
+        for (size_t i = 0; i < nDevices; i++)
+        {
+            pTiming->nBytes += lpTimings[i].nBytes;
+            pTiming->nReads += lpTimings[i].nReads;
+            pTiming->lpSeconds[DAQ_PHASE_COPY] += lpTimings[i].lpSeconds[DAQ_PHASE_COPY];
+            
+            if (lpTimings[i].nRead < pTiming->nRead)
+            {
+                pTiming->nRead = lpTimings[i].nRead;
+            }
+        }
+    }
+    
+    if (nResult < 0)
+    {
+        mxDestroyArray(plhs[0]);
+        failCall(pTiming, nResult);
+    }
+    
+    finishCall(pTiming);
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = createTiming(&Timing);
+    }
+}
+
+// Starts an adquisition on a reader thread and returns its handle in
+// plhs[0]. The samples are read into persistent memory that 'fetch'
+// turns into the output. The task is not cached, since it may still
+// be running when the next call comes.
+void startAsync(mxArray *plhs[], DaqArguments *pArgs, DaqOptions *pOptions)
+{
+    int nSlot = 0;
+    
+    while (nSlot < DAQ_ASYNC_MAX && g_AsyncHandles[nSlot].nId != 0)
+    {
+        nSlot++;
+    }
+    
+    if (nSlot == DAQ_ASYNC_MAX)
+    {
+        freeArguments(pArgs);
+        mexErrMsgTxt("Too many asynchronous adquisitions outstanding. Fetch or cancel some first.");
+    }
+    
+    TaskHandle hTask = NULL;
+    uInt32 nChannels = 1;
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    
+    releaseCachedTaskFor(pArgs->lpDevice);
+    
+    int32 nResult = createVoltageTask(pArgs, DAQmx_Val_FiniteSamps, nSamples, &hTask);
+    
+    if (nResult < 0)
+    {
+        freeArguments(pArgs);
+        outMexError(nResult);
+    }
+    
+    checkLimits(hTask, pArgs);
+    nResult = daqGetTaskNumChans(hTask, &nChannels);
+    
+    DaqAsyncHandle *pHandle = g_AsyncHandles + nSlot;
+    size_t nSize = pOptions->bRaw ? sizeof(int16) : sizeof(float64);
+    
+    pHandle->lpData = mxCalloc((size_t) nSamples * nChannels, nSize);
+    pHandle->lpScaling = NULL;
+    pHandle->nCoeffs = 0;
+    
+    if (nResult >= 0 && pOptions->bRaw)
+    {
+        pHandle->lpScaling = (float64*) mxMalloc((size_t) DAQ_SCALE_MAX_COEFFS * nChannels * sizeof(float64));
+        nResult = daqGetScaling(hTask, nChannels, pHandle->lpScaling, &pHandle->nCoeffs);
+        
+        // Packed, nCoeffs per channel, as 'fetch' returns them
+        for (uInt32 i = 1; i < nChannels && nResult >= 0; i++)
+        {
+            memmove(pHandle->lpScaling + i * pHandle->nCoeffs, pHandle->lpScaling + i * DAQ_SCALE_MAX_COEFFS,
+                    pHandle->nCoeffs * sizeof(float64));
+        }
+    }
+    
+    if (nResult >= 0)
+    {
+        nResult = daqAsyncStart(g_Async + nSlot, hTask, pArgs->nSamplingPeriod, nSamples, nChannels, pOptions->bRaw,
+                                pHandle->lpData);
+    }
+    
+    freeArguments(pArgs);
+    
+    if (nResult < 0)
+    {
+        daqClearTask(hTask);
+        releaseAsync(nSlot);
+        outMexError(nResult);
+    }
+    
+    // The reader thread writes to this memory after the call returns
+    mexMakeMemoryPersistent(pHandle->lpData);
+    
+    if (pHandle->lpScaling != NULL)
+    {
+        mexMakeMemoryPersistent(pHandle->lpScaling);
+    }
+    
+    pHandle->nId = ++g_nAsyncId;
+    plhs[0] = mxCreateDoubleScalar((double) pHandle->nId);
+    
+    // Keep the reader thread alive even if MATLAB clears the function
+    mexLock();
+}
+
+void adquireData(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    DaqArguments Args;
+    DaqOptions Options;
+    DaqCallTiming Timing;
+    TaskHandle hTask = NULL;
+    int32 nResult;
+    
+    getOptions(nrhs, prhs, 6, &Options);
+    
+    // The timing of the call follows the regular outputs
+    int nOutputs = (Options.nMaxLag >= 0) ? 3 :
+                   ((Options.bRaw && Options.lpFile == NULL) || Options.bCompress || Options.nSpectrum > 0 ||
+                    Options.nTrigger >= 0 || Options.bEnvelope || Options.nOutputClass == mxINT32_CLASS) ? 2 : 1;
+    
+    // 'Async' only returns the handle
+    if (nlhs > (Options.bAsync ? 1 : nOutputs + 1))
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    getArguments(prhs, 1, &Args);
+    
+    if (Args.nSamples < 1)
+    {
+        freeArguments(&Args);
+        mexErrMsgTxt("At least one sample must be adquired.");
+    }
+    
+    if (Options.bAsync)
+    {
+        startAsync(plhs, &Args, &Options);
+        freeOptions(&Options);
+        return;
+    }
+    
+    DaqCallTiming *pTiming = (nlhs > nOutputs || g_bStats) ? &Timing : NULL;
+    daqTimingInit(pTiming, (uInt64) Args.nSamples);
+    
+    if (Options.lpFile != NULL || Options.nSpectrum > 0 || Options.nDecimate > 1 || Options.lpTaps != NULL ||
+        Options.nTrigger >= 0 || Options.bCompress || Options.nStatistics > 0 || Options.bEnvelope || Options.nUp > 0 ||
+        Options.nMaxLag >= 0)
+    {
+        if (Options.lpFile != NULL)
+        {
+            recordData(nlhs, plhs, &Args, &Options, pTiming);
+        }
+        else if (Options.bCompress)
+        {
+            compressData(nlhs, plhs, &Args, pTiming);
+        }
+        else if (Options.nStatistics > 0)
+        {
+            statisticsData(plhs, &Args, &Options, pTiming);
+        }
+        else if (Options.bEnvelope)
+        {
+            envelopeData(nlhs, plhs, &Args, pTiming);
+        }
+        else if (Options.nUp > 0)
+        {
+            resampleData(plhs, &Args, &Options, pTiming);
+        }
+        else if (Options.nMaxLag >= 0)
+        {
+            xcorrData(nlhs, plhs, &Args, &Options, pTiming);
+        }
+        else if (Options.nTrigger >= 0)
+        {
+            triggerData(nlhs, plhs, &Args, &Options, pTiming);
+        }
+        else
+        {
+            streamData(nlhs, plhs, &Args, &Options, pTiming);
+        }
+        
+        freeArguments(&Args);
+        freeOptions(&Options);
+        finishCall(pTiming);
+        
+        if (nlhs > nOutputs)
+        {
+            plhs[nOutputs] = createTiming(&Timing);
+        }
+        
+        return;
+    }
+    
+    DaqCachedTask *pEntry = daqTaskCacheFind(&g_TaskCache, Args.lpDevice, Args.lpChannel, Args.fMaxVolts,
+                                             Args.nSamplingPeriod, (uInt64) Args.nSamples);
+    
+    if (pTiming != NULL)
+    {
+        pTiming->bCached = pEntry != NULL;
+    }
+    
+    if (pEntry == NULL)
+    {
+        nResult = createVoltageTask(&Args, DAQmx_Val_FiniteSamps, (uInt64) Args.nSamples, &hTask, pTiming);
+        
+        if (nResult == 0)
+        {
+            nResult = daqReadBoundBuffer(hTask, (uInt64) Args.nSamples, Args.nSamplingPeriod);
+            
+            if (nResult < 0)
+            {
+                daqClearTask(hTask);
+            }
+        }
+        
+        if (nResult)
+        {
+            freeArguments(&Args);
+            failCall(pTiming, nResult);
+        }
+        
+        double fStart = daqTimingBegin(pTiming);
+        checkLimits(hTask, &Args);
+        daqTimingEnd(pTiming, DAQ_PHASE_LIMITS, fStart);
+        
+        pEntry = daqTaskCacheInsert(&g_TaskCache, Args.lpDevice, Args.lpChannel, Args.fMaxVolts,
+                                    Args.nSamplingPeriod, (uInt64) Args.nSamples, hTask);
+        
+        if (pEntry == NULL)
+        {
+            freeArguments(&Args);
+            mexErrMsgTxt("Not enough memory to keep the task.");
+        }
+    }
+    
+    freeArguments(&Args);
+    
+    hTask = pEntry->hTask;
+    
+    // Called by the read once the output is allocated and locked, so
+    // none of that happens while the device is already sampling
+    auto Start = [&]() -> int32
+    {
+        double fStart = daqTimingBegin(pTiming);
+        int32 nStart = daqTaskCacheCommit(&g_TaskCache, pEntry);
+        daqTimingEnd(pTiming, DAQ_PHASE_COMMIT, fStart);
+        
+        if (nStart >= 0)
+        {
+            fStart = daqTimingBegin(pTiming);
+            nStart = daqStartTask(hTask);
+            daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+        }
+        
+        return nStart;
+    };
+    
+    uInt32 nChannels = pEntry->nChannels;
+    uInt64 nSamples = (uInt64) Args.nSamples;
+    
+    if (pTiming != NULL)
+    {
+        pTiming->nChannels = nChannels;
+    }
+    
+    const DaqRealtimeConfig *pRealtime = Options.bRealtime ? &Options.Realtime : NULL;
+    
+    if (Options.bRaw)
+    {
+        nResult = readOutput<int16>(hTask, Args.nSamplingPeriod, nSamples, nChannels, mxINT16_CLASS, plhs, pTiming, pRealtime,
+                                    Start);
+    }
+    else if (Options.nOutputClass == mxSINGLE_CLASS)
+    {
+        nResult = readScaled<float32>(hTask, Args.nSamplingPeriod, nSamples, nChannels, mxSINGLE_CLASS, 1.0, plhs, pTiming,
+                                      pRealtime, Start);
+    }
+    else if (Options.nOutputClass == mxINT32_CLASS)
+    {
+        nResult = readScaled<int32>(hTask, Args.nSamplingPeriod, nSamples, nChannels, mxINT32_CLASS,
+                                    DAQ_FIXED_STEPS / Args.fMaxVolts, plhs, pTiming, pRealtime, Start);
+    }
+    else
+    {
+        nResult = readOutput<float64>(hTask, Args.nSamplingPeriod, nSamples, nChannels, mxDOUBLE_CLASS, plhs, pTiming,
+                                      pRealtime, Start);
+    }
+    
+    double fStart = daqTimingBegin(pTiming);
+    daqStopTask(hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    freeOptions(&Options);
+    
+    if (nResult)
+    {
+        daqTaskCacheEvict(&g_TaskCache, pEntry);
+        failCall(pTiming, nResult);
+    }
+    
+    if (Options.bRaw && nlhs > 1)
+    {
+        fStart = daqTimingBegin(pTiming);
+        failCall(pTiming, createScaling(hTask, nChannels, &plhs[1]));
+        daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+    }
+    else if (Options.nOutputClass == mxINT32_CLASS && nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleScalar(Args.fMaxVolts / DAQ_FIXED_STEPS);
+    }
+    
+    finishCall(pTiming);
+    
+    if (nlhs > nOutputs)
+    {
+        plhs[nOutputs] = createTiming(&Timing);
+    }
+}
+
+// A task of a sweep. Rows sharing device, channels and range share
+// it, and only its sample clock is changed between them.
+struct DaqSweepTask
+{
+    const DaqArguments *pArgs;
+    TaskHandle hTask;
+    uInt32 nChannels;
+    float64 fRate;
+    uInt64 nSamples;
+    bool bCommitted;
+    bool bUsed;
+};
+
+void clearSweep(DaqSweepTask *lpTasks, int nTasks, DaqArguments *lpArgs, int nArgs)
+{
+    for (int i = 0; i < nTasks; i++)
+    {
+        daqClearTask(lpTasks[i].hTask);
+    }
+    
+    for (int i = 0; i < nArgs; i++)
+    {
+        freeArguments(&lpArgs[i]);
+    }
+}
+
+// Validates every row of a sweep before anything is adquired and
+// creates one task per device, channels and range
+int getSweep(const mxArray *pConfigs, DaqArguments *lpArgs, DaqSweepTask *lpTasks, int *lpRowTask)
+{
+    char lpOutput[256];
+    int nRows = (int) mxGetM(pConfigs), nTasks = 0;
+    
+    // Arguments first, so a bad row raises no error with tasks open
+    for (int i = 0; i < nRows; i++)
+    {
+        const mxArray *lpRow[6];
+        bool bValid = true;
+        
+        for (int j = 0; j < 6; j++)
+        {
+            lpRow[j] = mxGetCell(pConfigs, (mwIndex) j * nRows + i);
+            bValid = bValid && lpRow[j] != NULL && (((j % 2) == 1) ? mxIsChar(lpRow[j]) && mxGetM(lpRow[j]) == 1 :
+                                                    mxIsNumeric(lpRow[j]) && mxGetNumberOfElements(lpRow[j]) == 1);
+        }
+        
+        if (!bValid)
+        {
+            sprintf(lpOutput, "Row %d of the sweep must hold the six arguments of an adquisition.", i + 1);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        getArguments(lpRow, 1, &lpArgs[i]);
+        
+        if (lpArgs[i].nSamples < 1)
+        {
+            sprintf(lpOutput, "Row %d of the sweep must adquire at least one sample.", i + 1);
+            mexErrMsgTxt(lpOutput);
+        }
+    }
+    
+    for (int i = 0; i < nRows; i++)
+    {
+        int nTask = 0;
+        
+        while (nTask < nTasks && (lpTasks[nTask].pArgs->fMaxVolts != lpArgs[i].fMaxVolts ||
+                                  strcmp(lpTasks[nTask].pArgs->lpChannel, lpArgs[i].lpChannel) ||
+                                  strcmp(lpTasks[nTask].pArgs->lpDevice, lpArgs[i].lpDevice)))
+        {
+            nTask++;
+        }
+        
+        if (nTask == nTasks)
+        {
+            DaqSweepTask *pTask = &lpTasks[nTasks];
+            int32 nResult = createVoltageTask(&lpArgs[i], DAQmx_Val_FiniteSamps, (uInt64) lpArgs[i].nSamples, &pTask->hTask);
+            
+            if (nResult >= 0)
+            {
+                nTasks++;
+                nResult = daqReadBoundBuffer(pTask->hTask, (uInt64) lpArgs[i].nSamples, lpArgs[i].nSamplingPeriod);
+            }
+            
+            if (nResult >= 0)
+            {
+                nResult = daqGetTaskNumChans(pTask->hTask, &pTask->nChannels);
+            }
+            
+            if (nResult < 0)
+            {
+                clearSweep(lpTasks, nTasks, lpArgs, nRows);
+                outMexError(nResult);
+            }
+            
+            pTask->pArgs = &lpArgs[i];
+            pTask->fRate = lpArgs[i].nSamplingPeriod;
+            pTask->nSamples = (uInt64) lpArgs[i].nSamples;
+            pTask->bCommitted = false;
+            pTask->bUsed = false;
+        }
+        
+        // Rates are checked against the channels of the shared task
+        int32 nResult = getLimits(lpTasks[nTask].hTask, &lpArgs[i], lpOutput);
+        
+        if (nResult != 0)
+        {
+            clearSweep(lpTasks, nTasks, lpArgs, nRows);
+            
+            if (nResult < 0)
+            {
+                outMexError(nResult);
+            }
+            
+            char lpRowOutput[300];
+            
+            sprintf(lpRowOutput, "Row %d of the sweep: %s", i + 1, lpOutput);
+            mexErrMsgTxt(lpRowOutput);
+        }
+        
+        lpRowTask[i] = nTask;
+    }
+    
+    return nTasks;
+}
+
+// Runs one row of a sweep on its task, reconfiguring the sample
+// clock only if the previous row on the task used another one
+int32 runSweep(DaqSweepTask *lpTasks, int nTasks, int nTask, const DaqArguments *pArgs, mxArray **ppData,
+               DaqCallTiming *pTiming)
+{
+    DaqSweepTask *pTask = &lpTasks[nTask];
+    uInt64 nSamples = (uInt64) pArgs->nSamples;
+    int32 nResult = 0;
+    
+    if (pTiming != NULL)
+    {
+        pTiming->bCached = pTask->bUsed;
+        pTiming->nChannels = pTask->nChannels;
+    }
+    
+    if (pTask->fRate != pArgs->nSamplingPeriod || pTask->nSamples != nSamples)
+    {
+        double fStart = daqTimingBegin(pTiming);
+        nResult = daqCfgSampClkTiming(pTask->hTask, NULL, pArgs->nSamplingPeriod, DAQmx_Val_Rising, DAQmx_Val_FiniteSamps, nSamples);
+        
+        if (nResult >= 0)
+        {
+            nResult = daqReadBoundBuffer(pTask->hTask, nSamples, pArgs->nSamplingPeriod);
+        }
+        
+        daqTimingEnd(pTiming, DAQ_PHASE_CLOCK, fStart);
+        
+        pTask->fRate = pArgs->nSamplingPeriod;
+        pTask->nSamples = nSamples;
+        pTask->bCommitted = false;
+    }
+    
+    // As in the task cache, one committed task per device
+    if (nResult >= 0 && !pTask->bCommitted)
+    {
+        double fStart = daqTimingBegin(pTiming);
+        
+        for (int i = 0; i < nTasks; i++)
+        {
+            if (i != nTask && lpTasks[i].bCommitted && !strcmp(lpTasks[i].pArgs->lpDevice, pArgs->lpDevice))
+            {
+                daqTaskControl(lpTasks[i].hTask, DAQmx_Val_Task_Unreserve);
+                lpTasks[i].bCommitted = false;
+            }
+        }
+        
+        nResult = daqTaskControl(pTask->hTask, DAQmx_Val_Task_Commit);
+        pTask->bCommitted = nResult >= 0;
+        daqTimingEnd(pTiming, DAQ_PHASE_COMMIT, fStart);
+    }
+    
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+    
+    auto Start = [&]() -> int32
+    {
+        double fStart = daqTimingBegin(pTiming);
+        int32 nStart = daqStartTask(pTask->hTask);
+        daqTimingEnd(pTiming, DAQ_PHASE_START, fStart);
+        
+        return nStart;
+    };
+    
+    pTask->bUsed = true;
+    nResult = readOutput<float64>(pTask->hTask, pArgs->nSamplingPeriod, nSamples, pTask->nChannels, mxDOUBLE_CLASS, ppData, pTiming,
+                                  NULL, Start);
+    
+    double fStart = daqTimingBegin(pTiming);
+    daqStopTask(pTask->hTask);
+    daqTimingEnd(pTiming, DAQ_PHASE_STOP, fStart);
+    
+    return nResult;
+}
+
+// Adquires every row of a cell array of arguments in one call. All
+// rows are validated and their tasks created before the first
+// capture, so a sweep either fails at once or only pays for starting,
+// reading and stopping each capture.
+void sweepData(int nlhs, mxArray *plhs[], const mxArray *pConfigs)
+{
+    if (nlhs > 2)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxGetN(pConfigs) != 6 || mxGetM(pConfigs) < 1)
+    {
+        mexErrMsgTxt("A sweep must be a cell array with a row of six arguments per adquisition.");
+    }
+    
+    int nRows = (int) mxGetM(pConfigs);
+    DaqArguments *lpArgs = (DaqArguments*) mxCalloc(nRows, sizeof(DaqArguments));
+    DaqSweepTask *lpTasks = (DaqSweepTask*) mxCalloc(nRows, sizeof(DaqSweepTask));
+    int *lpRowTask = (int*) mxCalloc(nRows, sizeof(int));
+    int nTasks = getSweep(pConfigs, lpArgs, lpTasks, lpRowTask);
+    
+    for (int i = 0; i < nTasks; i++)
+    {
+        releaseCachedTaskFor(lpTasks[i].pArgs->lpDevice);
+    }
+    
+    DaqCallTiming Timing;
+    DaqCallTiming *pTiming = (nlhs > 1 || g_bStats) ? &Timing : NULL;
+    
+    plhs[0] = mxCreateCellMatrix(nRows, 1);
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateCellMatrix(nRows, 1);
+    }
+    
+    for (int i = 0; i < nRows; i++)
+    {
+        mxArray *pData = NULL;
+        
+        daqTimingInit(pTiming, (uInt64) lpArgs[i].nSamples);
+        
+        int32 nResult = runSweep(lpTasks, nTasks, lpRowTask[i], &lpArgs[i], &pData, pTiming);
+        
+        if (nResult)
+        {
+            clearSweep(lpTasks, nTasks, lpArgs, nRows);
+            failCall(pTiming, nResult);
+        }
+        
+        finishCall(pTiming);
+        mxSetCell(plhs[0], i, pData);
+        
+        if (nlhs > 1)
+        {
+            mxSetCell(plhs[1], i, createTiming(&Timing));
+        }
+    }
+    
+    clearSweep(lpTasks, nTasks, lpArgs, nRows);
+    mxFree(lpArgs);
+    mxFree(lpTasks);
+    mxFree(lpRowTask);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    mexAtExit(onExit);
+    
+    if (nrhs > 0 && mxIsChar(prhs[0]))
+    {
+        runCommand(nlhs, plhs, nrhs, prhs);
+    }
+    else if (nrhs == 1 && mxIsCell(prhs[0]))
+    {
+        sweepData(nlhs, plhs, prhs[0]);
+    }
+    else if (nrhs < 6)
+    {
+        mexErrMsgTxt("Too few input arguments.");
+    }
+    else if (mxIsCell(prhs[5]))
+    {
+        syncData(nlhs, plhs, nrhs, prhs);
+    }
+    else
+    {
+        adquireData(nlhs, plhs, nrhs, prhs);
+    }
+    
+    return;
+}
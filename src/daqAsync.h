@@ -0,0 +1,249 @@
+/*************************************************************/
+// daqAsync.h
+//
+// Non-blocking finite adquisitions used by the 'Async' option of
+// daqAdquireData. Each one reads its task on a native thread
+// straight into the output matrix, which the MATLAB thread
+// created beforehand, so fetching the result copies nothing.
+// Several adquisitions may run at once, each on its own task.
+//
+// Reads are short enough for a cancellation to be noticed within
+// a fraction of a second.
+//
+// Nothing in this file may call the MEX API: the reader threads
+// are not MATLAB threads.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQASYNC_H
+#define DAQASYNC_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdlib.h>
+#include <string.h>
+#include "daqRead.h"
+
+// Most adquisitions outstanding at the same time
+#define DAQ_ASYNC_MAX 32
+
+// Driver reads are sized to this fraction of a second, which bounds
+// how long a cancellation takes
+#define DAQ_ASYNC_READS_PER_SECOND 10
+
+struct DaqAsync
+{
+    TaskHandle hTask;
+    std::thread hReader;
+    std::atomic<bool> bCancel;
+    bool bDone;
+    std::mutex Mutex;
+    std::condition_variable Finished;
+
+    // lpData is owned by the caller, lpScratch by the adquisition
+    void *lpData;
+    void *lpScratch;
+    bool bRaw;
+    uInt32 nChannels;
+    uInt64 nSamples;
+    uInt64 nRead;
+    float64 fRate;
+    int32 nResult;
+    bool bRunning;
+
+    DaqAsync() : hTask(NULL), bCancel(false), bDone(false), lpData(NULL), lpScratch(NULL), bRaw(false), nChannels(1),
+                 nSamples(0), nRead(0), fRate(1000), nResult(0), bRunning(false)
+    {
+    }
+};
+
+// Scans per driver read
+static inline uInt32 daqAsyncChunk(const DaqAsync *pAsync)
+{
+    float64 fChunk = pAsync->fRate / DAQ_ASYNC_READS_PER_SECOND;
+    uInt32 nChunk = (fChunk < 1.0) ? 1 : (fChunk > DAQ_READ_CHUNK) ? DAQ_READ_CHUNK : (uInt32) fChunk;
+
+    return (pAsync->nSamples < nChunk) ? (uInt32) pAsync->nSamples : nChunk;
+}
+
+// Fills the columns of lpData chunk by chunk. A single channel is
+// read in place; several go through lpScratch, since a partial read
+// grouped by channel does not match the columns of the whole matrix.
+template <typename T>
+static inline int32 daqAsyncRead(DaqAsync *pAsync)
+{
+    T *lpData = (T*) pAsync->lpData;
+    T *lpScratch = (T*) pAsync->lpScratch;
+    uInt32 nChannels = pAsync->nChannels;
+    uInt64 nSamples = pAsync->nSamples;
+    uInt64 nDone = 0;
+    int32 nResult = 0;
+
+    while (nDone < nSamples && !pAsync->bCancel.load(std::memory_order_relaxed))
+    {
+        uInt32 nChunk = daqAsyncChunk(pAsync);
+        int32 nRead = 0;
+
+        if (nChunk > nSamples - nDone)
+        {
+            nChunk = (uInt32) (nSamples - nDone);
+        }
+
+        if (lpScratch == NULL)
+        {
+            nResult = daqReadSamples(pAsync->hTask, (int32) nChunk, daqReadTimeout(nChunk, pAsync->fRate), DAQmx_Val_GroupByChannel,
+                                     lpData + nDone, nChunk, &nRead);
+        }
+        else
+        {
+            nResult = daqReadSamples(pAsync->hTask, (int32) nChunk, daqReadTimeout(nChunk, pAsync->fRate), DAQmx_Val_GroupByChannel,
+                                     lpScratch, nChunk * nChannels, &nRead);
+
+            for (uInt32 i = 0; i < nChannels && nRead > 0; i++)
+            {
+                memcpy(lpData + (size_t) i * nSamples + nDone, lpScratch + (size_t) i * nChunk, nRead * sizeof(T));
+            }
+        }
+
+        if (nRead > 0)
+        {
+            nDone += nRead;
+        }
+
+        if (nResult < 0 || nRead < (int32) nChunk)
+        {
+            break;
+        }
+    }
+
+    pAsync->nRead = nDone;
+
+    return nResult;
+}
+
+static inline void daqAsyncReader(DaqAsync *pAsync)
+{
+    int32 nResult = pAsync->bRaw ? daqAsyncRead<int16>(pAsync) : daqAsyncRead<float64>(pAsync);
+
+    daqStopTask(pAsync->hTask);
+
+    std::lock_guard<std::mutex> Lock(pAsync->Mutex);
+
+    pAsync->nResult = nResult;
+    pAsync->bDone = true;
+    pAsync->Finished.notify_all();
+}
+
+// Starts a configured finite task and reads nSamples samples per
+// channel of it into lpData, a column-major nSamples by nChannels
+// matrix of float64, or int16 if bRaw is set. The driver buffer of
+// the task is bounded, since the samples go straight into lpData.
+// The adquisition takes ownership of hTask once it succeeds; on
+// failure the caller still has to clear it.
+static inline int32 daqAsyncStart(DaqAsync *pAsync, TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels,
+                                  bool bRaw, void *lpData)
+{
+    size_t nSize = bRaw ? sizeof(int16) : sizeof(float64);
+
+    pAsync->fRate = fRate;
+    pAsync->nSamples = nSamples;
+    pAsync->nChannels = nChannels;
+    pAsync->lpScratch = NULL;
+
+    int32 nResult = daqReadBoundBuffer(hTask, nSamples, fRate);
+
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+
+    if (nChannels > 1 && nSamples > 0)
+    {
+        pAsync->lpScratch = malloc((size_t) daqAsyncChunk(pAsync) * nChannels * nSize);
+
+        if (pAsync->lpScratch == NULL)
+        {
+            return DAQmxErrorPALMemoryFull;
+        }
+    }
+
+    nResult = daqStartTask(hTask);
+
+    if (nResult < 0)
+    {
+        free(pAsync->lpScratch);
+        pAsync->lpScratch = NULL;
+        return nResult;
+    }
+
+    pAsync->hTask = hTask;
+    pAsync->lpData = lpData;
+    pAsync->bRaw = bRaw;
+    pAsync->nRead = 0;
+    pAsync->nResult = 0;
+    pAsync->bDone = false;
+    pAsync->bCancel.store(false);
+    pAsync->hReader = std::thread(daqAsyncReader, pAsync);
+    pAsync->bRunning = true;
+
+    return 0;
+}
+
+// Waits up to fTimeout seconds, or forever if it is negative, for
+// the adquisition to end. Returns whether it has.
+static inline bool daqAsyncWait(DaqAsync *pAsync, float64 fTimeout)
+{
+    std::unique_lock<std::mutex> Lock(pAsync->Mutex);
+
+    if (fTimeout < 0)
+    {
+        pAsync->Finished.wait(Lock, [pAsync] { return pAsync->bDone; });
+        return true;
+    }
+
+    return pAsync->Finished.wait_for(Lock, std::chrono::duration<double>(fTimeout), [pAsync] { return pAsync->bDone; });
+}
+
+// Asks the reader to stop after its current read
+static inline void daqAsyncCancel(DaqAsync *pAsync)
+{
+    pAsync->bCancel.store(true);
+}
+
+// Waits for the reader and releases the task. Returns the result of
+// the adquisition; lpData then holds nRead samples per channel.
+static inline int32 daqAsyncFinish(DaqAsync *pAsync)
+{
+    if (!pAsync->bRunning)
+    {
+        return 0;
+    }
+
+    pAsync->hReader.join();
+    daqClearTask(pAsync->hTask);
+    free(pAsync->lpScratch);
+
+    pAsync->hTask = NULL;
+    pAsync->lpScratch = NULL;
+    pAsync->lpData = NULL;
+    pAsync->bRunning = false;
+
+    return pAsync->nResult;
+}
+
+#endif
@@ -0,0 +1,440 @@
+/*************************************************************/
+// daqCodec.h
+//
+// Lossless codec for raw ADC codes. The samples of each channel
+// are cut into frames; every frame is predicted with the best of
+// three fixed predictors (none, the previous sample or a linear
+// extrapolation of the previous two), and the residuals are
+// packed in groups of DAQ_CODEC_GROUP with the fewest bits that
+// hold the largest of the group. Slow or smooth signals then take
+// a few bits per sample instead of sixteen.
+//
+// Compressed data starts with a DaqCodecHeader followed by the
+// frames, each holding its number of samples per channel and then
+// every channel in turn:
+//
+//     uInt32 nCount
+//     for every channel:
+//         uInt8 nOrder
+//         for every group: uInt8 nWidth, then the packed residuals
+//
+// Frames are independent, so data can be compressed as it arrives
+// and appended.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQCODEC_H
+#define DAQCODEC_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DAQ_CODEC_MAGIC "DAQZ"
+#define DAQ_CODEC_VERSION 1
+
+// Samples per channel in a frame, and per group sharing a bit width
+#define DAQ_CODEC_FRAME 4096
+#define DAQ_CODEC_GROUP 64
+
+// Highest predictor order, and most bits a residual of it takes
+#define DAQ_CODEC_MAX_ORDER 2
+#define DAQ_CODEC_MAX_WIDTH 18
+
+struct DaqCodecHeader
+{
+    char lpMagic[4];
+    uInt32 nVersion;
+    uInt32 nChannels;
+    uInt32 nFrame;
+    uInt64 nSamples;
+};
+
+// Residual of sample i of x for a predictor of nOrder. The first
+// samples of a frame use the highest order they have history for.
+static inline int32 daqCodecResidual(const int16 *x, size_t i, int nOrder)
+{
+    if (nOrder == 0 || i == 0)
+    {
+        return x[i];
+    }
+    else if (nOrder == 1 || i == 1)
+    {
+        return (int32) x[i] - x[i - 1];
+    }
+
+    return (int32) x[i] - 2 * (int32) x[i - 1] + x[i - 2];
+}
+
+// Maps signed residuals to unsigned ones, small magnitudes first
+static inline uInt32 daqCodecZigZag(int32 n)
+{
+    return ((uInt32) n << 1) ^ (uInt32) (n >> 31);
+}
+
+static inline int32 daqCodecUnZigZag(uInt32 n)
+{
+    return (int32) (n >> 1) ^ -(int32) (n & 1);
+}
+
+static inline int daqCodecWidth(uInt32 n)
+{
+    int nWidth = 0;
+
+    while (n != 0)
+    {
+        nWidth++;
+        n >>= 1;
+    }
+
+    return nWidth;
+}
+
+// Most bytes n samples per channel of nChannels channels can take
+static inline size_t daqCodecBound(unsigned long long n, uInt32 nChannels)
+{
+    unsigned long long nFrames = (n + DAQ_CODEC_FRAME - 1) / DAQ_CODEC_FRAME;
+    unsigned long long nGroups = nFrames * (DAQ_CODEC_FRAME / DAQ_CODEC_GROUP);
+    unsigned long long nPerChannel = nFrames + nGroups + (n * DAQ_CODEC_MAX_WIDTH + 7) / 8 + nGroups;
+
+    return (size_t) (sizeof(DaqCodecHeader) + nFrames * sizeof(uInt32) + nPerChannel * nChannels);
+}
+
+// Encodes n samples of one channel of a frame into lpOut and returns
+// the end of what was written
+static inline uInt8 *daqCodecEncodeChannel(const int16 *x, size_t n, uInt8 *lpOut)
+{
+    unsigned long long lpCost[DAQ_CODEC_MAX_ORDER + 1] = {0, 0, 0};
+    int nOrder = 0;
+
+    // The order with the smallest residuals over the whole frame
+    for (size_t i = 0; i < n; i++)
+    {
+        for (int k = 0; k <= DAQ_CODEC_MAX_ORDER; k++)
+        {
+            lpCost[k] += daqCodecZigZag(daqCodecResidual(x, i, k));
+        }
+    }
+
+    for (int k = 1; k <= DAQ_CODEC_MAX_ORDER; k++)
+    {
+        nOrder = (lpCost[k] < lpCost[nOrder]) ? k : nOrder;
+    }
+
+    *lpOut++ = (uInt8) nOrder;
+
+    for (size_t nGroup = 0; nGroup < n; nGroup += DAQ_CODEC_GROUP)
+    {
+        size_t nCount = (n - nGroup < DAQ_CODEC_GROUP) ? n - nGroup : DAQ_CODEC_GROUP;
+        uInt32 lpZ[DAQ_CODEC_GROUP];
+        uInt32 nAll = 0;
+
+        for (size_t i = 0; i < nCount; i++)
+        {
+            lpZ[i] = daqCodecZigZag(daqCodecResidual(x, nGroup + i, nOrder));
+            nAll |= lpZ[i];
+        }
+
+        int nWidth = daqCodecWidth(nAll);
+        unsigned long long nBuffer = 0;
+        int nBits = 0;
+
+        *lpOut++ = (uInt8) nWidth;
+
+        for (size_t i = 0; i < nCount; i++)
+        {
+            nBuffer |= (unsigned long long) lpZ[i] << nBits;
+            nBits += nWidth;
+
+            while (nBits >= 8)
+            {
+                *lpOut++ = (uInt8) nBuffer;
+                nBuffer >>= 8;
+                nBits -= 8;
+            }
+        }
+
+        if (nBits > 0)
+        {
+            *lpOut++ = (uInt8) nBuffer;
+        }
+    }
+
+    return lpOut;
+}
+
+// Decodes n samples of one channel of a frame from lpIn, which ends
+// at lpEnd. Returns the end of what was read, or NULL if the data is
+// corrupt.
+static inline const uInt8 *daqCodecDecodeChannel(const uInt8 *lpIn, const uInt8 *lpEnd, size_t n, int16 *x)
+{
+    if (lpIn >= lpEnd || *lpIn > DAQ_CODEC_MAX_ORDER)
+    {
+        return NULL;
+    }
+
+    int nOrder = *lpIn++;
+
+    for (size_t nGroup = 0; nGroup < n; nGroup += DAQ_CODEC_GROUP)
+    {
+        size_t nCount = (n - nGroup < DAQ_CODEC_GROUP) ? n - nGroup : DAQ_CODEC_GROUP;
+
+        if (lpIn >= lpEnd || *lpIn > DAQ_CODEC_MAX_WIDTH)
+        {
+            return NULL;
+        }
+
+        int nWidth = *lpIn++;
+        uInt32 nMask = (1u << nWidth) - 1;
+        unsigned long long nBuffer = 0;
+        int nBits = 0;
+
+        if ((size_t) (lpEnd - lpIn) < (nCount * nWidth + 7) / 8)
+        {
+            return NULL;
+        }
+
+        for (size_t i = nGroup; i < nGroup + nCount; i++)
+        {
+            while (nBits < nWidth)
+            {
+                nBuffer |= (unsigned long long) *lpIn++ << nBits;
+                nBits += 8;
+            }
+
+            int32 nResidual = daqCodecUnZigZag((uInt32) nBuffer & nMask);
+            int32 nPrediction = (nOrder == 0 || i == 0) ? 0 :
+                                (nOrder == 1 || i == 1) ? x[i - 1] : 2 * (int32) x[i - 1] - x[i - 2];
+            int32 nValue = nPrediction + nResidual;
+
+            nBuffer >>= nWidth;
+            nBits -= nWidth;
+
+            if (nValue < -32768 || nValue > 32767)
+            {
+                return NULL;
+            }
+
+            x[i] = (int16) nValue;
+        }
+    }
+
+    return lpIn;
+}
+
+// Reads the header of compressed data. Returns false if it is not
+// data this codec wrote.
+static inline bool daqCodecInfo(const uInt8 *lpIn, size_t nSize, uInt32 *pnChannels, unsigned long long *pnSamples)
+{
+    DaqCodecHeader Header;
+
+    if (nSize < sizeof(Header))
+    {
+        return false;
+    }
+
+    memcpy(&Header, lpIn, sizeof(Header));
+
+    if (memcmp(Header.lpMagic, DAQ_CODEC_MAGIC, 4) != 0 || Header.nVersion != DAQ_CODEC_VERSION || Header.nChannels == 0)
+    {
+        return false;
+    }
+
+    *pnChannels = Header.nChannels;
+    *pnSamples = Header.nSamples;
+
+    return true;
+}
+
+// Decodes compressed data into lpOut, a column-major matrix with one
+// column of nSamples samples per channel, as given by daqCodecInfo.
+// Returns false if the data is corrupt.
+static inline bool daqCodecDecode(const uInt8 *lpIn, size_t nSize, int16 *lpOut)
+{
+    uInt32 nChannels;
+    unsigned long long nSamples, nDone = 0;
+
+    if (!daqCodecInfo(lpIn, nSize, &nChannels, &nSamples))
+    {
+        return false;
+    }
+
+    const uInt8 *lpEnd = lpIn + nSize;
+
+    lpIn += sizeof(DaqCodecHeader);
+
+    while (nDone < nSamples)
+    {
+        uInt32 nCount;
+
+        if ((size_t) (lpEnd - lpIn) < sizeof(nCount))
+        {
+            return false;
+        }
+
+        memcpy(&nCount, lpIn, sizeof(nCount));
+        lpIn += sizeof(nCount);
+
+        if (nCount == 0 || nCount > nSamples - nDone)
+        {
+            return false;
+        }
+
+        for (uInt32 c = 0; c < nChannels && lpIn != NULL; c++)
+        {
+            lpIn = daqCodecDecodeChannel(lpIn, lpEnd, nCount, lpOut + (size_t) c * nSamples + nDone);
+        }
+
+        if (lpIn == NULL)
+        {
+            return false;
+        }
+
+        nDone += nCount;
+    }
+
+    return lpIn == lpEnd;
+}
+
+// Compresses samples as they come, in a buffer that grows as needed
+class DaqCodecEncoder
+{
+public:
+    DaqCodecEncoder() : m_lpData(NULL), m_nSize(0), m_nCapacity(0), m_nChannels(0), m_nSamples(0)
+    {
+    }
+
+    ~DaqCodecEncoder()
+    {
+        Free();
+    }
+
+    // Starts new compressed data for nChannels channels, reserving
+    // room for about nExpected bytes
+    bool Init(uInt32 nChannels, size_t nExpected)
+    {
+        Free();
+
+        m_nChannels = nChannels;
+
+        if (!Reserve(sizeof(DaqCodecHeader) + nExpected))
+        {
+            return false;
+        }
+
+        m_nSize = sizeof(DaqCodecHeader);
+        WriteHeader();
+
+        return true;
+    }
+
+    // Appends n samples per channel, channel i starting at
+    // lpData + i * nStride
+    bool Encode(const int16 *lpData, size_t n, size_t nStride)
+    {
+        for (size_t nFrame = 0; nFrame < n; nFrame += DAQ_CODEC_FRAME)
+        {
+            uInt32 nCount = (uInt32) ((n - nFrame < DAQ_CODEC_FRAME) ? n - nFrame : DAQ_CODEC_FRAME);
+
+            if (!Reserve(daqCodecBound(nCount, m_nChannels) - sizeof(DaqCodecHeader)))
+            {
+                return false;
+            }
+
+            uInt8 *lpOut = m_lpData + m_nSize;
+
+            memcpy(lpOut, &nCount, sizeof(nCount));
+            lpOut += sizeof(nCount);
+
+            for (uInt32 c = 0; c < m_nChannels; c++)
+            {
+                lpOut = daqCodecEncodeChannel(lpData + c * nStride + nFrame, nCount, lpOut);
+            }
+
+            m_nSize = lpOut - m_lpData;
+            m_nSamples += nCount;
+        }
+
+        WriteHeader();
+
+        return true;
+    }
+
+    const uInt8 *Data() const
+    {
+        return m_lpData;
+    }
+
+    size_t Size() const
+    {
+        return m_nSize;
+    }
+
+    unsigned long long Samples() const
+    {
+        return m_nSamples;
+    }
+
+    void Free()
+    {
+        free(m_lpData);
+
+        m_lpData = NULL;
+        m_nSize = 0;
+        m_nCapacity = 0;
+        m_nSamples = 0;
+    }
+
+private:
+    bool Reserve(size_t nExtra)
+    {
+        if (m_nSize + nExtra <= m_nCapacity)
+        {
+            return true;
+        }
+
+        size_t nCapacity = (m_nCapacity * 2 > m_nSize + nExtra) ? m_nCapacity * 2 : m_nSize + nExtra;
+        uInt8 *lpData = (uInt8*) realloc(m_lpData, nCapacity);
+
+        if (lpData == NULL)
+        {
+            return false;
+        }
+
+        m_lpData = lpData;
+        m_nCapacity = nCapacity;
+
+        return true;
+    }
+
+    void WriteHeader()
+    {
+        DaqCodecHeader Header;
+
+        memcpy(Header.lpMagic, DAQ_CODEC_MAGIC, 4);
+        Header.nVersion = DAQ_CODEC_VERSION;
+        Header.nChannels = m_nChannels;
+        Header.nFrame = DAQ_CODEC_FRAME;
+        Header.nSamples = m_nSamples;
+        memcpy(m_lpData, &Header, sizeof(Header));
+    }
+
+    uInt8 *m_lpData;
+    size_t m_nSize;
+    size_t m_nCapacity;
+    uInt32 m_nChannels;
+    unsigned long long m_nSamples;
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*************************************************************/
+// daqCompress.cpp
+//
+// Compresses raw ADC codes without losing any information
+//
+//                       ------ ARGUMENTS ------
+//
+// [Compressed (u)] = daqCompress(Codes (i))
+//
+// - i denotes an int16 matrix
+// - u denotes a uint8 column vector
+//
+//           - Codes: raw codes, as returned by daqAdquireData with the
+//                    'Raw' option. A row vector for a single channel or
+//                    a matrix with one column per channel
+//
+//      - Compressed: the codes of every channel predicted from the
+//                    previous ones and bit-packed. Slow or smooth signals
+//                    take a fraction of their size; white noise at full
+//                    scale does not compress. Use "daqDecompress" to get
+//                    the codes back
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqCodec.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("One input required.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxGetClassID(prhs[0]) != mxINT16_CLASS || mxIsComplex(prhs[0]))
+    {
+        mexErrMsgTxt("Input argument 1 must be an int16 matrix. Adquire it with the 'Raw' option.");
+    }
+    else
+    {
+        size_t nRows = mxGetM(prhs[0]), nCols = mxGetN(prhs[0]);
+        
+        // A single channel comes as a row vector
+        size_t nChannels = (nRows == 1) ? 1 : nCols;
+        size_t nSamples = (nRows == 1) ? nCols : nRows;
+        DaqCodecEncoder Encoder;
+        
+        if (!Encoder.Init((uInt32) nChannels, daqCodecBound(nSamples, (uInt32) nChannels)) ||
+            !Encoder.Encode((const int16*) mxGetData(prhs[0]), nSamples, nSamples))
+        {
+            mexErrMsgTxt("Not enough memory to compress the codes.");
+        }
+        
+        plhs[0] = mxCreateNumericMatrix(Encoder.Size(), 1, mxUINT8_CLASS, mxREAL);
+        memcpy(mxGetData(plhs[0]), Encoder.Data(), Encoder.Size());
+    }
+    
+    return;
+}
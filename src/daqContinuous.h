@@ -0,0 +1,246 @@
+/*************************************************************/
+// daqContinuous.h
+//
+// Background acquisition session used by the continuous mode
+// of daqAdquireData. A native reader thread drains the driver
+// into a DaqRingBuffer while the task runs in DAQmx_Val_ContSamps
+// mode, and the MATLAB thread collects whatever has accumulated.
+// The reader may run pinned at a real-time priority, with the ring
+// locked in memory, as daqRealtime.h describes.
+//
+// Nothing in this file may call the MEX API: the reader thread
+// is not a MATLAB thread.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQCONTINUOUS_H
+#define DAQCONTINUOUS_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "daqRealtime.h"
+#include "daqRingBuffer.h"
+
+// Driver reads are sized to this fraction of a second, which sets
+// how often the reader thread wakes up
+#define DAQ_CONT_READS_PER_SECOND 100
+
+struct DaqContinuous
+{
+    TaskHandle hTask;
+    std::thread hReader;
+    std::atomic<bool> bStop;
+    std::atomic<int32> nError;
+    std::atomic<bool> bReady;
+    DaqRingBuffer Ring;
+    DaqRealtimeConfig Realtime;
+    DaqRealtimeStats *pStats;
+    uInt32 nChannels;
+    uInt32 nChunk;
+    float64 fTimeout;
+    float64 fRate;
+    bool bLocked;
+    bool bRunning;
+
+    DaqContinuous() : hTask(NULL), bStop(false), nError(0), bReady(false), pStats(NULL), nChannels(1), nChunk(1),
+                      fTimeout(1.0), fRate(1.0), bLocked(false), bRunning(false)
+    {
+    }
+};
+
+// Sets itself up, starts the task and drains it until stopped. The
+// task is only started once the reader is pinned and raised, so the
+// first driver buffers are read as promptly as the rest; a failed
+// start is left in nError when bReady is set.
+static inline void daqContinuousReader(DaqContinuous *pSession)
+{
+    DaqRealtimeClock Clock;
+    DaqRealtimeClock *pClock = NULL;
+
+    if (pSession->pStats != NULL)
+    {
+        daqRealtimeEnter(&pSession->Realtime, pSession->pStats, pSession->bLocked);
+        daqRealtimeClockInit(&Clock, pSession->pStats, pSession->fRate);
+        pClock = &Clock;
+    }
+
+    int32 nStart = daqStartTask(pSession->hTask);
+
+    if (nStart < 0)
+    {
+        pSession->nError.store(nStart);
+        pSession->bReady.store(true);
+        return;
+    }
+
+    pSession->bReady.store(true);
+
+    while (!pSession->bStop.load(std::memory_order_relaxed))
+    {
+        size_t nFree;
+        float64 *lpDest = pSession->Ring.WriteRegion(&nFree);
+        uInt32 nScans = (uInt32) (nFree / pSession->nChannels);
+
+        if (nScans > pSession->nChunk)
+        {
+            nScans = pSession->nChunk;
+        }
+
+        if (nScans == 0)
+        {
+            // MATLAB is behind; the driver buffer keeps the samples
+            // until there is room again
+            daqRealtimeStall(pClock);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        int32 nRead = 0;
+        double fStart = daqRealtimeBegin(pClock);
+        int32 nResult = daqReadAnalogF64(pSession->hTask, (int32) nScans, pSession->fTimeout, DAQmx_Val_GroupByScanNumber,
+                                           lpDest, nScans * pSession->nChannels, &nRead, NULL);
+
+        daqRealtimeRead(pClock, fStart, nRead, nResult);
+
+        if (nRead > 0)
+        {
+            pSession->Ring.CommitWrite((size_t) nRead * pSession->nChannels);
+        }
+
+        if (nResult < 0 && nResult != DAQmxErrorSamplesNotYetAvailable)
+        {
+            pSession->nError.store(nResult);
+            break;
+        }
+    }
+}
+
+// Starts the reader thread on an already configured continuous
+// task, which the reader starts. The session takes ownership of
+// hTask once it succeeds;
+// on failure the caller still has to clear it. With pRealtime, the
+// reader is set up as it asks, the ring is locked in memory and
+// the reads are measured into pStats.
+static inline int32 daqContinuousStart(DaqContinuous *pSession, TaskHandle hTask, float64 fRate, size_t nBufferScans,
+                                       const DaqRealtimeConfig *pRealtime = NULL, DaqRealtimeStats *pStats = NULL)
+{
+    uInt32 nChannels = 1;
+    int32 nResult = daqGetTaskNumChans(hTask, &nChannels);
+
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+
+    float64 fChunk = fRate / DAQ_CONT_READS_PER_SECOND;
+
+    pSession->hTask = hTask;
+    pSession->nChannels = nChannels;
+    pSession->nChunk = (fChunk < 1.0) ? 1 : (uInt32) fChunk;
+    pSession->fTimeout = 2.0 * pSession->nChunk / fRate + 0.1;
+    pSession->fRate = fRate;
+
+    if (nBufferScans < 2 * (size_t) pSession->nChunk)
+    {
+        nBufferScans = 2 * (size_t) pSession->nChunk;
+    }
+
+    if (!pSession->Ring.Allocate(nBufferScans * nChannels))
+    {
+        pSession->hTask = NULL;
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    // The ring is brought in before the task starts, so the first
+    // pass of the reader over it takes no page faults
+    pSession->bLocked = false;
+    pSession->pStats = (pRealtime != NULL) ? pStats : NULL;
+
+    if (pSession->pStats != NULL)
+    {
+        pSession->Realtime = *pRealtime;
+        pSession->bLocked = daqRealtimeLock(pSession->Ring.Data(), pSession->Ring.Capacity() * sizeof(float64));
+    }
+
+    // Let the driver hold as much as the ring does, so a slow
+    // MATLAB loop has twice the buffer before samples are lost
+    nResult = daqCfgInputBuffer(hTask, (uInt32) nBufferScans);
+
+    if (nResult >= 0)
+    {
+        pSession->bStop.store(false);
+        pSession->nError.store(0);
+        pSession->bReady.store(false);
+        pSession->hReader = std::thread(daqContinuousReader, pSession);
+
+        // The reader has set itself up and started the task, or
+        // failed to, once it is ready
+        while (!pSession->bReady.load())
+        {
+            std::this_thread::yield();
+        }
+
+        nResult = pSession->nError.load();
+
+        if (nResult < 0)
+        {
+            pSession->hReader.join();
+        }
+    }
+
+    if (nResult < 0)
+    {
+        if (pSession->bLocked)
+        {
+            daqRealtimeUnlock(pSession->Ring.Data(), pSession->Ring.Capacity() * sizeof(float64));
+            pSession->bLocked = false;
+        }
+
+        pSession->hTask = NULL;
+        pSession->Ring.Free();
+        return nResult;
+    }
+
+    pSession->bRunning = true;
+
+    return 0;
+}
+
+static inline void daqContinuousStop(DaqContinuous *pSession)
+{
+    if (!pSession->bRunning)
+    {
+        return;
+    }
+
+    pSession->bStop.store(true);
+    pSession->hReader.join();
+
+    daqStopTask(pSession->hTask);
+    daqClearTask(pSession->hTask);
+
+    if (pSession->bLocked)
+    {
+        daqRealtimeUnlock(pSession->Ring.Data(), pSession->Ring.Capacity() * sizeof(float64));
+        pSession->bLocked = false;
+    }
+
+    pSession->hTask = NULL;
+    pSession->Ring.Free();
+    pSession->bRunning = false;
+}
+
+#endif
@@ -0,0 +1,390 @@
+/*************************************************************/
+// daqControl.h
+//
+// Closed-loop control session used by daqControlLoop. A native
+// thread waits for every tick of a hardware-timed single-point
+// input task, reads the input, runs the controller and writes the
+// output task, which is clocked by the input's sample clock, so
+// the loop runs at the hardware rate with no MATLAB in the way.
+//
+// The controllers are a PID with output clamping, an IIR filter
+// and a discrete state-space system, all acting on the error
+// Setpoint - Input. New parameters are handed over between two
+// cycles, without stopping the loop.
+//
+// Nothing in this file may call the MEX API: the loop thread is
+// not a MATLAB thread.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQCONTROL_H
+#define DAQCONTROL_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <math.h>
+#include <string.h>
+#include "daqTiming.h"
+
+#define DAQ_CONTROL_PID 0
+#define DAQ_CONTROL_IIR 1
+#define DAQ_CONTROL_SS 2
+
+// Most IIR coefficients and state-space states
+#define DAQ_CONTROL_MAX_ORDER 16
+
+struct DaqController
+{
+    int nType;
+    float64 fSetpoint;
+    float64 fMin;
+    float64 fMax;
+
+    float64 fKp;
+    float64 fKi;
+    float64 fKd;
+
+    // Numerator and denominator, normalized so lpDen[0] is 1
+    int nTaps;
+    float64 lpNum[DAQ_CONTROL_MAX_ORDER];
+    float64 lpDen[DAQ_CONTROL_MAX_ORDER];
+
+    // x[k+1] = A x[k] + B e[k], u[k] = C x[k] + D e[k], A row-major
+    int nStates;
+    float64 lpA[DAQ_CONTROL_MAX_ORDER * DAQ_CONTROL_MAX_ORDER];
+    float64 lpB[DAQ_CONTROL_MAX_ORDER];
+    float64 lpC[DAQ_CONTROL_MAX_ORDER];
+    float64 fD;
+};
+
+struct DaqControllerState
+{
+    float64 fIntegral;
+    float64 fError;
+    bool bStarted;
+    float64 lpState[DAQ_CONTROL_MAX_ORDER];
+};
+
+struct DaqControlStats
+{
+    uInt64 nCycles;
+    uInt64 nLate;
+    double fPeriodSum;
+    double fJitterSum2;
+    double fMaxJitter;
+    double fMaxCompute;
+    float64 fInput;
+    float64 fOutput;
+};
+
+static inline void daqControllerReset(DaqControllerState *pState)
+{
+    memset(pState, 0, sizeof(DaqControllerState));
+}
+
+// Whether the state of one controller can carry on with the other
+static inline bool daqControllerCompatible(const DaqController *pOld, const DaqController *pNew)
+{
+    return pOld->nType == pNew->nType && pOld->nTaps == pNew->nTaps && pOld->nStates == pNew->nStates;
+}
+
+static inline float64 daqControllerClamp(const DaqController *pController, float64 fOutput)
+{
+    return (fOutput > pController->fMax) ? pController->fMax : (fOutput < pController->fMin) ? pController->fMin : fOutput;
+}
+
+// One cycle of the controller for a new input, fPeriod seconds after
+// the previous one. Returns the output, within the limits.
+static inline float64 daqControllerStep(const DaqController *pController, DaqControllerState *pState, float64 fInput, float64 fPeriod)
+{
+    float64 fError = pController->fSetpoint - fInput;
+    float64 fOutput = 0;
+
+    switch (pController->nType)
+    {
+        case DAQ_CONTROL_PID:
+        {
+            float64 fIntegral = pState->fIntegral + pController->fKi * fError * fPeriod;
+            float64 fDerivative = pState->bStarted ? pController->fKd * (fError - pState->fError) / fPeriod : 0;
+            float64 fRaw = pController->fKp * fError + fIntegral + fDerivative;
+
+            fOutput = daqControllerClamp(pController, fRaw);
+
+            // The integral only grows while the output is not clamped,
+            // or when it pulls the output back into the limits
+            if (fOutput == fRaw || (fRaw > fOutput) != (fError > 0))
+            {
+                pState->fIntegral = fIntegral;
+            }
+
+            break;
+        }
+        case DAQ_CONTROL_IIR:
+        {
+            // Direct form II transposed
+            const float64 *lpNum = pController->lpNum, *lpDen = pController->lpDen;
+            float64 *lpZ = pState->lpState;
+            int nLast = pController->nTaps - 1;
+
+            fOutput = lpNum[0] * fError + ((nLast > 0) ? lpZ[0] : 0);
+
+            for (int i = 0; i < nLast - 1; i++)
+            {
+                lpZ[i] = lpNum[i + 1] * fError + lpZ[i + 1] - lpDen[i + 1] * fOutput;
+            }
+
+            if (nLast > 0)
+            {
+                lpZ[nLast - 1] = lpNum[nLast] * fError - lpDen[nLast] * fOutput;
+            }
+
+            fOutput = daqControllerClamp(pController, fOutput);
+            break;
+        }
+        default:
+        {
+            int n = pController->nStates;
+            float64 lpNext[DAQ_CONTROL_MAX_ORDER];
+
+            fOutput = pController->fD * fError;
+
+            for (int i = 0; i < n; i++)
+            {
+                fOutput += pController->lpC[i] * pState->lpState[i];
+
+                float64 fNext = pController->lpB[i] * fError;
+
+                for (int k = 0; k < n; k++)
+                {
+                    fNext += pController->lpA[i * n + k] * pState->lpState[k];
+                }
+
+                lpNext[i] = fNext;
+            }
+
+            memcpy(pState->lpState, lpNext, n * sizeof(float64));
+            fOutput = daqControllerClamp(pController, fOutput);
+            break;
+        }
+    }
+
+    pState->fError = fError;
+    pState->bStarted = true;
+
+    return fOutput;
+}
+
+struct DaqControlLoop
+{
+    TaskHandle hInput;
+    TaskHandle hOutput;
+    std::thread hWorker;
+    std::atomic<bool> bStop;
+    std::atomic<bool> bPending;
+    std::atomic<int32> nError;
+    float64 fRate;
+    bool bRunning;
+
+    // Only the loop thread uses Controller and State. Pending and
+    // Stats are shared with MATLAB under Mutex, which the loop thread
+    // only ever tries to take, so it never waits for MATLAB.
+    DaqController Controller;
+    DaqControllerState State;
+    std::mutex Mutex;
+    DaqController Pending;
+    DaqControlStats Stats;
+
+    DaqControlLoop() : hInput(NULL), hOutput(NULL), bStop(false), bPending(false), nError(0), fRate(1000), bRunning(false)
+    {
+    }
+};
+
+static inline void daqControlWorker(DaqControlLoop *pLoop)
+{
+    double fPeriod = 1.0 / pLoop->fRate;
+    double fTimeout = 10 * fPeriod + 1.0;
+    double fLastWake = 0;
+    DaqControlStats Stats;
+
+    memset(&Stats, 0, sizeof(DaqControlStats));
+
+    while (!pLoop->bStop.load(std::memory_order_relaxed))
+    {
+        bool32 bLate = 0;
+        float64 fInput = 0;
+        int32 nRead = 0, nWritten = 0;
+        int32 nResult = daqWaitForNextSampleClock(pLoop->hInput, fTimeout, &bLate);
+        double fWake = daqTimingNow();
+
+        if (nResult >= 0)
+        {
+            nResult = daqReadAnalogF64(pLoop->hInput, 1, fTimeout, DAQmx_Val_GroupByScanNumber, &fInput, 1, &nRead, NULL);
+        }
+
+        if (nResult < 0)
+        {
+            pLoop->nError.store(nResult);
+            break;
+        }
+
+        // New parameters are taken between cycles, never waiting for
+        // MATLAB to let go of them
+        if (pLoop->bPending.load(std::memory_order_acquire) && pLoop->Mutex.try_lock())
+        {
+            if (!daqControllerCompatible(&pLoop->Controller, &pLoop->Pending))
+            {
+                daqControllerReset(&pLoop->State);
+            }
+
+            pLoop->Controller = pLoop->Pending;
+            pLoop->bPending.store(false);
+            pLoop->Mutex.unlock();
+        }
+
+        // The real time between ticks, so a late cycle integrates over
+        // the ticks it missed
+        double fElapsed = (fLastWake > 0 && bLate) ? fWake - fLastWake : fPeriod;
+        float64 fOutput = daqControllerStep(&pLoop->Controller, &pLoop->State, fInput, fElapsed);
+
+        nResult = daqWriteAnalogF64(pLoop->hOutput, 1, 0, fTimeout, DAQmx_Val_GroupByScanNumber, &fOutput, &nWritten, NULL);
+
+        if (nResult < 0)
+        {
+            pLoop->nError.store(nResult);
+            break;
+        }
+
+        double fDone = daqTimingNow();
+
+        if (fLastWake > 0)
+        {
+            double fJitter = fabs(fWake - fLastWake - fPeriod);
+
+            Stats.fPeriodSum += fWake - fLastWake;
+            Stats.fJitterSum2 += fJitter * fJitter;
+            Stats.fMaxJitter = (fJitter > Stats.fMaxJitter) ? fJitter : Stats.fMaxJitter;
+        }
+
+        Stats.nCycles++;
+        Stats.nLate += bLate ? 1 : 0;
+        Stats.fMaxCompute = (fDone - fWake > Stats.fMaxCompute) ? fDone - fWake : Stats.fMaxCompute;
+        Stats.fInput = fInput;
+        Stats.fOutput = fOutput;
+        fLastWake = fWake;
+
+        // The totals are kept here and published as the parameters are
+        // taken; a cycle that finds MATLAB reading them leaves them to
+        // the next one
+        if (pLoop->Mutex.try_lock())
+        {
+            pLoop->Stats = Stats;
+            pLoop->Mutex.unlock();
+        }
+    }
+
+    // The loop is over, so waiting costs nothing now
+    std::lock_guard<std::mutex> Lock(pLoop->Mutex);
+
+    pLoop->Stats = Stats;
+}
+
+// Starts the loop on an input task and an output task, both already
+// configured for single-point timing. The session takes ownership of
+// the tasks once it succeeds; on failure the caller still has to
+// clear them.
+static inline int32 daqControlStart(DaqControlLoop *pLoop, TaskHandle hInput, TaskHandle hOutput, float64 fRate,
+                                    const DaqController *pController)
+{
+    // The output follows the input clock, so it has to be running
+    // before the first tick
+    int32 nResult = daqStartTask(hOutput);
+
+    if (nResult >= 0)
+    {
+        nResult = daqStartTask(hInput);
+
+        if (nResult < 0)
+        {
+            daqStopTask(hOutput);
+        }
+    }
+
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+
+    pLoop->hInput = hInput;
+    pLoop->hOutput = hOutput;
+    pLoop->fRate = fRate;
+    pLoop->Controller = *pController;
+    pLoop->Pending = *pController;
+    daqControllerReset(&pLoop->State);
+    memset(&pLoop->Stats, 0, sizeof(DaqControlStats));
+
+    pLoop->bStop.store(false);
+    pLoop->bPending.store(false);
+    pLoop->nError.store(0);
+    pLoop->hWorker = std::thread(daqControlWorker, pLoop);
+    pLoop->bRunning = true;
+
+    return 0;
+}
+
+// Hands new parameters to the loop, which takes them on its next cycle
+static inline void daqControlUpdate(DaqControlLoop *pLoop, const DaqController *pController)
+{
+    std::lock_guard<std::mutex> Lock(pLoop->Mutex);
+
+    pLoop->Pending = *pController;
+    pLoop->bPending.store(true, std::memory_order_release);
+}
+
+static inline void daqControlStats(DaqControlLoop *pLoop, DaqControlStats *pStats)
+{
+    std::lock_guard<std::mutex> Lock(pLoop->Mutex);
+
+    *pStats = pLoop->Stats;
+}
+
+// Stops the loop and leaves the output at the value closest to zero
+// within the limits
+static inline void daqControlStop(DaqControlLoop *pLoop)
+{
+    if (!pLoop->bRunning)
+    {
+        return;
+    }
+
+    pLoop->bStop.store(true);
+    pLoop->hWorker.join();
+
+    float64 fSafe = daqControllerClamp(&pLoop->Controller, 0);
+    int32 nWritten = 0;
+
+    daqWriteAnalogF64(pLoop->hOutput, 1, 0, 1.0, DAQmx_Val_GroupByScanNumber, &fSafe, &nWritten, NULL);
+
+    daqStopTask(pLoop->hInput);
+    daqStopTask(pLoop->hOutput);
+    daqClearTask(pLoop->hInput);
+    daqClearTask(pLoop->hOutput);
+
+    pLoop->hInput = NULL;
+    pLoop->hOutput = NULL;
+    pLoop->bRunning = false;
+}
+
+#endif
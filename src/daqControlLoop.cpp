@@ -0,0 +1,581 @@
+/*************************************************************/
+// daqControlLoop.cpp
+//
+// Runs a closed control loop between an analog input and an
+// analog output of a device, in a native thread timed by the
+// device's sample clock
+//
+// daqControlLoop('start', SamplingRate (n), InputChannel (s), InputRange (f),
+//     OutputChannel (s), OutputRange (f), Device (s), Options...)
+// daqControlLoop('update', Options...)
+// [Status] = daqControlLoop('status')
+// [Status] = daqControlLoop('stop')
+//
+//         - 'start': starts the loop. On every tick of the sample clock
+//                    InputChannel is read, the controller computes the
+//                    output from the error Setpoint - Input and it is
+//                    written to OutputChannel, all without MATLAB, so
+//                    the loop keeps the hardware rate. Both channels
+//                    are single channels of the same device, which must
+//                    support hardware-timed single-point sampling. Only
+//                    one loop may be running at the same time
+//
+//        - 'update': changes any option but 'Controller' while the loop
+//                    runs. The new values are taken between two cycles;
+//                    the controller keeps its state unless its order
+//                    changes
+//
+//        - 'status': returns the Cycles run, the LateCycles in which the
+//                    loop missed one or more ticks, the mean Period, the
+//                    RMS and maximum Jitter of the period in seconds, the
+//                    longest Compute time from a tick to the output
+//                    being written, the last Input and Output, whether
+//                    the loop is Running and the driver Error that
+//                    stopped it, or 0
+//
+//          - 'stop': stops the loop, leaving the output at the value
+//                    closest to 0 V within the limits, and returns the
+//                    final status
+//
+//                    ------ OPTIONS ------
+//
+//    - 'Controller': 'pid' (the default), 'iir' or 'ss'
+//
+//      - 'Setpoint': value the input is driven to. Defaults to 0
+//
+//  - 'OutputLimits': [Min Max] the output is clamped to. Defaults to
+//                    the output range
+//
+// - 'Kp', 'Ki', 'Kd': gains of the 'pid' controller, 1, 0 and 0 by
+//                    default. The integral stops growing while the
+//                    output is clamped
+//
+//     - 'Numerator': coefficients of the 'iir' controller, so the
+//   'Denominator'    output is filter(Numerator, Denominator, Error).
+//                    Denominator defaults to 1
+//
+// - 'A', 'B', 'C', 'D': matrices of the 'ss' controller, with x(k+1) =
+//                    A x(k) + B e(k) and u(k) = C x(k) + D e(k). B is a
+//                    column, C a row and D, 0 by default, a scalar
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqControl.h"
+
+static DaqControlLoop g_Loop;
+
+void outMexError(int nError)
+{
+    if (nError != 0)
+    {
+        int nSize = daqGetErrorString(nError, NULL, 0);
+        char *lpError = (char*) mxMalloc(nSize);
+        daqGetErrorString(nError, lpError, nSize);
+        char lpOutput[256];
+    
+        sprintf(lpOutput, "DAQmx Error %d: %s.", nError, lpError);
+        mxFree(lpError);
+    
+        mexErrMsgTxt(lpOutput);
+    }
+}
+
+void onExit()
+{
+    daqControlStop(&g_Loop);
+}
+
+// Real matrix option of nRows by nCols, or any size if 0
+const double *getMatrix(const mxArray *pValue, const char *lpName, size_t nRows, size_t nCols)
+{
+    char lpOutput[256];
+    
+    if (!mxIsDouble(pValue) || mxIsComplex(pValue) || mxGetNumberOfElements(pValue) == 0 ||
+        (nRows > 0 && mxGetM(pValue) != nRows) || (nCols > 0 && mxGetN(pValue) != nCols))
+    {
+        if (nRows > 0 && nCols > 0)
+        {
+            sprintf(lpOutput, "Option '%s' must be a %u by %u real matrix.", lpName, (unsigned int) nRows, (unsigned int) nCols);
+        }
+        else
+        {
+            sprintf(lpOutput, "Option '%s' must be a real vector.", lpName);
+        }
+    
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    const double *ptrValue = mxGetPr(pValue);
+    
+    for (size_t i = 0; i < mxGetNumberOfElements(pValue); i++)
+    {
+        if (!mxIsFinite(ptrValue[i]))
+        {
+            sprintf(lpOutput, "Option '%s' must be finite.", lpName);
+            mexErrMsgTxt(lpOutput);
+        }
+    }
+    
+    return ptrValue;
+}
+
+double getScalar(const mxArray *pValue, const char *lpName)
+{
+    return getMatrix(pValue, lpName, 1, 1)[0];
+}
+
+// Parses the name/value pairs from prhs[nFirst] onwards into a
+// controller already holding the defaults or the current values.
+// 'Controller' is only accepted when bStart is set.
+void getController(int nrhs, const mxArray *prhs[], int nFirst, bool bStart, DaqController *pController)
+{
+    char lpOutput[256];
+    const mxArray *pA = NULL, *pB = NULL, *pC = NULL;
+    const mxArray *pNum = NULL, *pDen = NULL;
+    bool bGains = false;
+    
+    if ((nrhs - nFirst) % 2 != 0)
+    {
+        mexErrMsgTxt("Options must be given as name and value pairs.");
+    }
+    
+    for (int i = nFirst; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mexErrMsgTxt("Option names must be strings.");
+        }
+    
+        char *lpName = mxArrayToString(prhs[i]);
+        const mxArray *pValue = prhs[i + 1];
+    
+        sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+    
+        if (!strcmp(lpName, "Controller") && bStart)
+        {
+            char *lpType = mxIsChar(pValue) ? mxArrayToString(pValue) : NULL;
+    
+            pController->nType = (lpType == NULL) ? -1 :
+                                 !strcmp(lpType, "pid") ? DAQ_CONTROL_PID :
+                                 !strcmp(lpType, "iir") ? DAQ_CONTROL_IIR :
+                                 !strcmp(lpType, "ss") ? DAQ_CONTROL_SS : -1;
+            mxFree(lpType);
+    
+            if (pController->nType < 0)
+            {
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'Controller' must be 'pid', 'iir' or 'ss'.");
+            }
+        }
+        else if (!strcmp(lpName, "Setpoint"))
+        {
+            pController->fSetpoint = getScalar(pValue, lpName);
+        }
+        else if (!strcmp(lpName, "OutputLimits"))
+        {
+            const double *ptrLimits = getMatrix(pValue, lpName, 1, 2);
+    
+            if (ptrLimits[0] >= ptrLimits[1])
+            {
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'OutputLimits' must be [Min Max] with Min below Max.");
+            }
+    
+            pController->fMin = ptrLimits[0];
+            pController->fMax = ptrLimits[1];
+        }
+        else if (!strcmp(lpName, "Kp"))
+        {
+            pController->fKp = getScalar(pValue, lpName);
+            bGains = true;
+        }
+        else if (!strcmp(lpName, "Ki"))
+        {
+            pController->fKi = getScalar(pValue, lpName);
+            bGains = true;
+        }
+        else if (!strcmp(lpName, "Kd"))
+        {
+            pController->fKd = getScalar(pValue, lpName);
+            bGains = true;
+        }
+        else if (!strcmp(lpName, "Numerator"))
+        {
+            pNum = pValue;
+        }
+        else if (!strcmp(lpName, "Denominator"))
+        {
+            pDen = pValue;
+        }
+        else if (!strcmp(lpName, "A"))
+        {
+            pA = pValue;
+        }
+        else if (!strcmp(lpName, "B"))
+        {
+            pB = pValue;
+        }
+        else if (!strcmp(lpName, "C"))
+        {
+            pC = pValue;
+        }
+        else if (!strcmp(lpName, "D"))
+        {
+            pController->fD = getScalar(pValue, lpName);
+    
+            if (pController->nType != DAQ_CONTROL_SS)
+            {
+                mxFree(lpName);
+                mexErrMsgTxt("Option 'D' only applies to 'ss' controllers.");
+            }
+        }
+        else
+        {
+            mxFree(lpName);
+            mexErrMsgTxt(lpOutput);
+        }
+    
+        mxFree(lpName);
+    }
+    
+    int nType = pController->nType;
+    
+    if ((bGains && nType != DAQ_CONTROL_PID) || ((pNum != NULL || pDen != NULL) && nType != DAQ_CONTROL_IIR) ||
+        ((pA != NULL || pB != NULL || pC != NULL) && nType != DAQ_CONTROL_SS))
+    {
+        mexErrMsgTxt("'Kp', 'Ki' and 'Kd' only apply to 'pid', 'Numerator' and 'Denominator' to 'iir', and 'A' to 'D' to 'ss' controllers.");
+    }
+    
+    if (pNum != NULL || pDen != NULL)
+    {
+        float64 lpNum[DAQ_CONTROL_MAX_ORDER], lpDen[DAQ_CONTROL_MAX_ORDER];
+        size_t nNum = (pNum != NULL) ? mxGetNumberOfElements(pNum) : (size_t) pController->nTaps;
+        size_t nDen = (pDen != NULL) ? mxGetNumberOfElements(pDen) : (size_t) pController->nTaps;
+    
+        if (nNum > DAQ_CONTROL_MAX_ORDER || nDen > DAQ_CONTROL_MAX_ORDER)
+        {
+            sprintf(lpOutput, "IIR controllers have at most %d coefficients.", DAQ_CONTROL_MAX_ORDER);
+            mexErrMsgTxt(lpOutput);
+        }
+    
+        // What is not given is kept, padded with zeros
+        memcpy(lpNum, (pNum != NULL) ? getMatrix(pNum, "Numerator", 0, 0) : pController->lpNum, nNum * sizeof(float64));
+        memcpy(lpDen, (pDen != NULL) ? getMatrix(pDen, "Denominator", 0, 0) : pController->lpDen, nDen * sizeof(float64));
+    
+        if (lpDen[0] == 0)
+        {
+            mexErrMsgTxt("The first 'Denominator' coefficient must not be zero.");
+        }
+    
+        int nTaps = (int) ((nNum > nDen) ? nNum : nDen);
+        float64 fScale = lpDen[0];
+    
+        for (int i = 0; i < nTaps; i++)
+        {
+            pController->lpNum[i] = ((size_t) i < nNum) ? lpNum[i] / fScale : 0;
+            pController->lpDen[i] = ((size_t) i < nDen) ? lpDen[i] / fScale : 0;
+        }
+    
+        pController->nTaps = nTaps;
+    }
+    
+    if (pA != NULL || pB != NULL || pC != NULL)
+    {
+        size_t n = (pA != NULL) ? mxGetM(pA) : (size_t) pController->nStates;
+    
+        if (n == 0 || n > DAQ_CONTROL_MAX_ORDER)
+        {
+            sprintf(lpOutput, "State-space controllers have between 1 and %d states.", DAQ_CONTROL_MAX_ORDER);
+            mexErrMsgTxt(lpOutput);
+        }
+        else if ((size_t) pController->nStates != n && (pB == NULL || pC == NULL))
+        {
+            mexErrMsgTxt("A new number of states requires 'A', 'B' and 'C'.");
+        }
+    
+        if (pA != NULL)
+        {
+            const double *ptrA = getMatrix(pA, "A", n, n);
+    
+            // MATLAB is column-major, the loop row-major
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t k = 0; k < n; k++)
+                {
+                    pController->lpA[i * n + k] = ptrA[k * n + i];
+                }
+            }
+        }
+    
+        if (pB != NULL)
+        {
+            memcpy(pController->lpB, getMatrix(pB, "B", n, 1), n * sizeof(float64));
+        }
+    
+        if (pC != NULL)
+        {
+            memcpy(pController->lpC, getMatrix(pC, "C", 1, n), n * sizeof(float64));
+        }
+    
+        pController->nStates = (int) n;
+    }
+    
+    if (nType == DAQ_CONTROL_IIR && pController->nTaps == 0)
+    {
+        mexErrMsgTxt("An 'iir' controller requires a 'Numerator'.");
+    }
+    else if (nType == DAQ_CONTROL_SS && pController->nStates == 0)
+    {
+        mexErrMsgTxt("An 'ss' controller requires 'A', 'B' and 'C'.");
+    }
+}
+
+// Creates a single-point task with one channel, clearing it if any
+// step fails. Returns 1 if the channel is not a single one.
+int32 createLoopTask(const char *lpDevice, const char *lpChannel, float64 fRange, bool bOutput, float64 fRate, TaskHandle *phTask)
+{
+    TaskHandle hTask = NULL;
+    char lpClock[256];
+    uInt32 nChannels = 0;
+    int32 nResult = daqCreateTask(lpDevice, &hTask);
+    
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+    
+    // The output is updated on the input's clock
+    sprintf(lpClock, "/%.200s/ai/SampleClock", lpDevice);
+    
+    if (bOutput)
+    {
+        nResult = daqCreateAOVoltageChan(hTask, lpChannel, "", -fRange, fRange, DAQmx_Val_Volts, NULL);
+    }
+    else
+    {
+        nResult = daqCreateAIVoltageChan(hTask, lpChannel, "", DAQmx_Val_Diff, -fRange, fRange, DAQmx_Val_Volts, NULL);
+    }
+    
+    if (nResult >= 0)
+    {
+        nResult = daqCfgSampClkTiming(hTask, bOutput ? lpClock : NULL, fRate, DAQmx_Val_Rising, DAQmx_Val_HWTimedSinglePoint, 1);
+    }
+    
+    if (nResult >= 0)
+    {
+        nResult = daqGetTaskNumChans(hTask, &nChannels);
+    }
+    
+    if (nResult >= 0 && nChannels != 1)
+    {
+        nResult = 1;
+    }
+    
+    if (nResult != 0)
+    {
+        daqClearTask(hTask);
+        return nResult;
+    }
+    
+    *phTask = hTask;
+    
+    return 0;
+}
+
+void startLoop(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 7)
+    {
+        mexErrMsgTxt("'start' requires six input arguments.");
+    }
+    else if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (g_Loop.bRunning)
+    {
+        mexErrMsgTxt("A control loop is already running. Use 'stop' first.");
+    }
+    else if (!mxIsNumeric(prhs[1]) || !mxIsNumeric(prhs[3]) || !mxIsNumeric(prhs[5]) ||
+             !mxIsChar(prhs[2]) || !mxIsChar(prhs[4]) || !mxIsChar(prhs[6]))
+    {
+        mexErrMsgTxt("Input arguments 2, 4 and 6 must be numeric values and 3, 5 and 7 strings.");
+    }
+    
+    float64 fRate = mxGetScalar(prhs[1]);
+    float64 fInputRange = mxGetScalar(prhs[3]);
+    float64 fOutputRange = mxGetScalar(prhs[5]);
+    
+    if (fRate <= 0 || fInputRange <= 0 || fOutputRange <= 0)
+    {
+        mexErrMsgTxt("The sampling rate and the ranges must be positive.");
+    }
+    
+    DaqController Controller;
+    
+    memset(&Controller, 0, sizeof(Controller));
+    Controller.nType = DAQ_CONTROL_PID;
+    Controller.fKp = 1;
+    Controller.fMin = -fOutputRange;
+    Controller.fMax = fOutputRange;
+    
+    getController(nrhs, prhs, 7, true, &Controller);
+    
+    char *lpInput = mxArrayToString(prhs[2]);
+    char *lpOutput = mxArrayToString(prhs[4]);
+    char *lpDevice = mxArrayToString(prhs[6]);
+    TaskHandle hInput = NULL, hOutput = NULL;
+    
+    int32 nResult = createLoopTask(lpDevice, lpInput, fInputRange, false, fRate, &hInput);
+    
+    if (nResult == 0)
+    {
+        nResult = createLoopTask(lpDevice, lpOutput, fOutputRange, true, fRate, &hOutput);
+    }
+    
+    mxFree(lpInput);
+    mxFree(lpOutput);
+    mxFree(lpDevice);
+    
+    if (nResult == 0)
+    {
+        nResult = daqControlStart(&g_Loop, hInput, hOutput, fRate, &Controller);
+    }
+    
+    if (nResult != 0)
+    {
+        daqClearTask(hInput);
+        daqClearTask(hOutput);
+    }
+    
+    if (nResult > 0)
+    {
+        mexErrMsgTxt("The input and the output must be a single channel each.");
+    }
+    
+    outMexError(nResult);
+    
+    // Keep the loop thread alive even if MATLAB clears the function
+    mexLock();
+}
+
+void updateLoop(int nlhs, int nrhs, const mxArray *prhs[])
+{
+    if (nlhs > 0)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (!g_Loop.bRunning)
+    {
+        mexErrMsgTxt("There is no control loop running. Use 'start' first.");
+    }
+    
+    // Starting from the last parameters handed to the loop
+    DaqController Controller;
+    
+    {
+        std::lock_guard<std::mutex> Lock(g_Loop.Mutex);
+        Controller = g_Loop.Pending;
+    }
+    
+    getController(nrhs, prhs, 1, false, &Controller);
+    daqControlUpdate(&g_Loop, &Controller);
+}
+
+mxArray *createStatus()
+{
+    const char *lpFields[] = {"Running", "Cycles", "LateCycles", "Period", "Jitter", "MaxJitter", "MaxCompute",
+                              "Input", "Output", "Error"};
+    mxArray *pStatus = mxCreateStructMatrix(1, 1, 10, lpFields);
+    DaqControlStats Stats;
+    int32 nError = g_Loop.nError.load();
+    
+    daqControlStats(&g_Loop, &Stats);
+    
+    // The first cycle has no period
+    double fIntervals = (Stats.nCycles > 1) ? (double) (Stats.nCycles - 1) : 1;
+    
+    mxSetField(pStatus, 0, "Running", mxCreateLogicalScalar(g_Loop.bRunning && nError == 0));
+    mxSetField(pStatus, 0, "Cycles", mxCreateDoubleScalar((double) Stats.nCycles));
+    mxSetField(pStatus, 0, "LateCycles", mxCreateDoubleScalar((double) Stats.nLate));
+    mxSetField(pStatus, 0, "Period", mxCreateDoubleScalar(Stats.fPeriodSum / fIntervals));
+    mxSetField(pStatus, 0, "Jitter", mxCreateDoubleScalar(sqrt(Stats.fJitterSum2 / fIntervals)));
+    mxSetField(pStatus, 0, "MaxJitter", mxCreateDoubleScalar(Stats.fMaxJitter));
+    mxSetField(pStatus, 0, "MaxCompute", mxCreateDoubleScalar(Stats.fMaxCompute));
+    mxSetField(pStatus, 0, "Input", mxCreateDoubleScalar(Stats.fInput));
+    mxSetField(pStatus, 0, "Output", mxCreateDoubleScalar(Stats.fOutput));
+    mxSetField(pStatus, 0, "Error", mxCreateDoubleScalar((double) nError));
+    
+    return pStatus;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    mexAtExit(onExit);
+    
+    if (nrhs < 1 || !mxIsChar(prhs[0]))
+    {
+        mexErrMsgTxt("The first input must be 'start', 'update', 'status' or 'stop'.");
+    }
+    
+    char *lpCommand = mxArrayToString(prhs[0]);
+    
+    if (!strcmp(lpCommand, "start"))
+    {
+        mxFree(lpCommand);
+        startLoop(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "update"))
+    {
+        mxFree(lpCommand);
+        updateLoop(nlhs, nrhs, prhs);
+    }
+    else if (!strcmp(lpCommand, "status") || !strcmp(lpCommand, "stop"))
+    {
+        bool bStop = !strcmp(lpCommand, "stop");
+    
+        mxFree(lpCommand);
+    
+        if (nrhs > 1)
+        {
+            mexErrMsgTxt("Too many input arguments.");
+        }
+        else if (nlhs > 1)
+        {
+            mexErrMsgTxt("Too many output arguments.");
+        }
+    
+        if (bStop && g_Loop.bRunning)
+        {
+            daqControlStop(&g_Loop);
+            mexUnlock();
+        }
+    
+        if (nlhs > 0 || !bStop)
+        {
+            plhs[0] = createStatus();
+        }
+    }
+    else
+    {
+        mxFree(lpCommand);
+        mexErrMsgTxt("The first input must be 'start', 'update', 'status' or 'stop'.");
+    }
+    
+    return;
+}
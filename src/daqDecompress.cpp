@@ -0,0 +1,89 @@
+/*************************************************************/
+// daqDecompress.cpp
+//
+// Restores raw ADC codes compressed by daqCompress or by
+// daqAdquireData with the 'Compress' option
+//
+//                       ------ ARGUMENTS ------
+//
+// [Codes (i)] = daqDecompress(Compressed (u))
+//
+// - i denotes an int16 matrix
+// - u denotes a uint8 vector
+//
+//      - Compressed: the compressed codes
+//
+//           - Codes: the original codes, a row vector for a single
+//                    channel or a matrix with one column per channel.
+//                    Use "daqScaleData" to turn them into volts
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "daqCodec.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 1)
+    {
+        mexErrMsgTxt("One input required.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxGetClassID(prhs[0]) != mxUINT8_CLASS || mxIsComplex(prhs[0]))
+    {
+        mexErrMsgTxt("Input argument 1 must be a uint8 vector.");
+    }
+    else
+    {
+        const uInt8 *lpIn = (const uInt8*) mxGetData(prhs[0]);
+        size_t nSize = mxGetNumberOfElements(prhs[0]);
+        uInt32 nChannels = 0;
+        unsigned long long nSamples = 0;
+        
+        if (!daqCodecInfo(lpIn, nSize, &nChannels, &nSamples))
+        {
+            mexErrMsgTxt("Input argument 1 is not compressed data.");
+        }
+        
+        // Every channel of every group of samples takes at least a
+        // byte, so a size the data cannot hold is rejected before
+        // allocating it
+        if (nChannels > nSize || nSamples / DAQ_CODEC_GROUP > nSize / nChannels)
+        {
+            mexErrMsgTxt("The compressed data is corrupt.");
+        }
+        
+        if (nChannels == 1)
+        {
+            plhs[0] = mxCreateNumericMatrix(1, (mwSize) nSamples, mxINT16_CLASS, mxREAL);
+        }
+        else
+        {
+            plhs[0] = mxCreateNumericMatrix((mwSize) nSamples, nChannels, mxINT16_CLASS, mxREAL);
+        }
+        
+        if (!daqCodecDecode(lpIn, nSize, (int16*) mxGetData(plhs[0])))
+        {
+            mxDestroyArray(plhs[0]);
+            mexErrMsgTxt("The compressed data is corrupt.");
+        }
+    }
+    
+    return;
+}
@@ -0,0 +1,381 @@
+/*************************************************************/
+// daqDeviceInfo.h
+//
+// Capabilities of the installed devices, queried from the driver
+// the first time a device is used and kept until they are
+// refreshed. Every MEX file keeps its own cache, since each one is
+// a separate library.
+//
+// The validation done before each adquisition reads the cached
+// values instead of asking the driver again.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQDEVICEINFO_H
+#define DAQDEVICEINFO_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DAQ_DEVICE_CACHE_SIZE 16
+
+// Strings are first read into a buffer of this size, which fits
+// the properties of nearly every device, so the size is only asked
+// to the driver when it does not
+#define DAQ_DEVICE_STRING_GUESS 1024
+
+struct DaqDeviceInfo
+{
+    char *lpName;
+    char *lpProductType;
+    char *lpAIChannels;
+    int32 *lpAIMeasTypes;
+    uInt32 nAIMeasTypes;
+    int32 *lpAISampleModes;
+    uInt32 nAISampleModes;
+    float64 fAIMaxSingleRate;
+    float64 fAIMaxMultiRate;
+    float64 fAIMinRate;
+    bool32 bAISimultaneous;
+    float64 *lpAIRanges;
+    uInt32 nAIRanges;
+    char *lpAOChannels;
+    int32 *lpAOOutputTypes;
+    uInt32 nAOOutputTypes;
+    int32 *lpAOSampleModes;
+    uInt32 nAOSampleModes;
+    bool32 bAOSampleClock;
+    float64 fAOMaxRate;
+    float64 fAOMinRate;
+    float64 *lpAORanges;
+    uInt32 nAORanges;
+};
+
+struct DaqDeviceCache
+{
+    DaqDeviceInfo *lpDevices[DAQ_DEVICE_CACHE_SIZE];
+    int nDevices;
+    char *lpNames;
+};
+
+// Reads a string property, given as a callable taking the buffer
+// and its size. The string is malloc'ed and stored in *plpValue.
+template <typename Q>
+static inline int32 daqQueryString(Q Query, char **plpValue)
+{
+    uInt32 nSize = DAQ_DEVICE_STRING_GUESS;
+    char *lpValue = (char*) malloc(nSize);
+
+    if (lpValue == NULL)
+    {
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    int32 nResult = Query(lpValue, nSize);
+
+    // Too small: the driver either returns the size needed or an error
+    if (nResult > 0 || nResult == DAQmxErrorBufferTooSmallForString)
+    {
+        nResult = Query(NULL, 0);
+
+        if (nResult > 0)
+        {
+            free(lpValue);
+            nSize = (uInt32) nResult;
+            lpValue = (char*) malloc(nSize);
+
+            if (lpValue == NULL)
+            {
+                return DAQmxErrorPALMemoryFull;
+            }
+
+            nResult = Query(lpValue, nSize);
+        }
+    }
+
+    if (nResult < 0)
+    {
+        free(lpValue);
+        return nResult;
+    }
+
+    *plpValue = lpValue;
+
+    return 0;
+}
+
+// Reads an array property. Arrays are not terminated, so the
+// number of elements has to be asked first.
+template <typename T, typename Q>
+static inline int32 daqQueryArray(Q Query, T **plpValue, uInt32 *pnCount)
+{
+    int32 nResult = Query(NULL, 0);
+
+    *plpValue = NULL;
+    *pnCount = 0;
+
+    if (nResult <= 0)
+    {
+        return nResult;
+    }
+
+    T *lpValue = (T*) malloc(nResult * sizeof(T));
+
+    if (lpValue == NULL)
+    {
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    uInt32 nCount = (uInt32) nResult;
+    nResult = Query(lpValue, nCount);
+
+    if (nResult < 0)
+    {
+        free(lpValue);
+        return nResult;
+    }
+
+    *plpValue = lpValue;
+    *pnCount = nCount;
+
+    return 0;
+}
+
+static inline void daqDeviceInfoFree(DaqDeviceInfo *pInfo)
+{
+    free(pInfo->lpName);
+    free(pInfo->lpProductType);
+    free(pInfo->lpAIChannels);
+    free(pInfo->lpAIMeasTypes);
+    free(pInfo->lpAISampleModes);
+    free(pInfo->lpAIRanges);
+    free(pInfo->lpAOChannels);
+    free(pInfo->lpAOOutputTypes);
+    free(pInfo->lpAOSampleModes);
+    free(pInfo->lpAORanges);
+    free(pInfo);
+}
+
+// Queries every capability of a device. Only the product type and
+// the input channels are required; properties a device does not
+// have are left empty or zero.
+static inline int32 daqDeviceInfoLoad(const char *lpDevice, DaqDeviceInfo **ppInfo)
+{
+    DaqDeviceInfo *pInfo = (DaqDeviceInfo*) calloc(1, sizeof(DaqDeviceInfo));
+
+    if (pInfo == NULL || (pInfo->lpName = (char*) malloc(strlen(lpDevice) + 1)) == NULL)
+    {
+        free(pInfo);
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    strcpy(pInfo->lpName, lpDevice);
+
+    int32 nResult = daqQueryString([&](char *lpData, uInt32 nSize) { return daqGetDevProductType(lpDevice, lpData, nSize); },
+                                   &pInfo->lpProductType);
+
+    if (nResult >= 0)
+    {
+        nResult = daqQueryString([&](char *lpData, uInt32 nSize) { return daqGetDevAIPhysicalChans(lpDevice, lpData, nSize); },
+                                 &pInfo->lpAIChannels);
+    }
+
+    if (nResult < 0)
+    {
+        daqDeviceInfoFree(pInfo);
+        return nResult;
+    }
+
+    daqQueryArray([&](int32 *lpData, uInt32 nSize) { return daqGetDevAISupportedMeasTypes(lpDevice, lpData, nSize); },
+                  &pInfo->lpAIMeasTypes, &pInfo->nAIMeasTypes);
+    daqQueryArray([&](int32 *lpData, uInt32 nSize) { return daqGetDevAISampModes(lpDevice, lpData, nSize); },
+                  &pInfo->lpAISampleModes, &pInfo->nAISampleModes);
+    daqQueryArray([&](float64 *lpData, uInt32 nSize) { return daqGetDevAIVoltageRngs(lpDevice, lpData, nSize); },
+                  &pInfo->lpAIRanges, &pInfo->nAIRanges);
+
+    daqGetDevAIMaxSingleChanRate(lpDevice, &pInfo->fAIMaxSingleRate);
+    daqGetDevAIMaxMultiChanRate(lpDevice, &pInfo->fAIMaxMultiRate);
+    daqGetDevAIMinRate(lpDevice, &pInfo->fAIMinRate);
+    daqGetDevAISimultaneousSamplingSupported(lpDevice, &pInfo->bAISimultaneous);
+
+    if (daqQueryString([&](char *lpData, uInt32 nSize) { return daqGetDevAOPhysicalChans(lpDevice, lpData, nSize); },
+                       &pInfo->lpAOChannels) < 0)
+    {
+        pInfo->lpAOChannels = NULL;
+    }
+
+    daqQueryArray([&](int32 *lpData, uInt32 nSize) { return daqGetDevAOSupportedOutputTypes(lpDevice, lpData, nSize); },
+                  &pInfo->lpAOOutputTypes, &pInfo->nAOOutputTypes);
+    daqQueryArray([&](int32 *lpData, uInt32 nSize) { return daqGetDevAOSampModes(lpDevice, lpData, nSize); },
+                  &pInfo->lpAOSampleModes, &pInfo->nAOSampleModes);
+    daqQueryArray([&](float64 *lpData, uInt32 nSize) { return daqGetDevAOVoltageRngs(lpDevice, lpData, nSize); },
+                  &pInfo->lpAORanges, &pInfo->nAORanges);
+
+    daqGetDevAOSampClkSupported(lpDevice, &pInfo->bAOSampleClock);
+    daqGetDevAOMaxRate(lpDevice, &pInfo->fAOMaxRate);
+    daqGetDevAOMinRate(lpDevice, &pInfo->fAOMinRate);
+
+    // Ranges are returned as pairs of minimum and maximum
+    pInfo->nAIRanges /= 2;
+    pInfo->nAORanges /= 2;
+
+    *ppInfo = pInfo;
+
+    return 0;
+}
+
+// Largest input voltage the device measures, or 0 if unknown
+static inline float64 daqDeviceMaxVolts(const DaqDeviceInfo *pInfo)
+{
+    float64 fMax = 0;
+
+    for (uInt32 i = 0; i < pInfo->nAIRanges; i++)
+    {
+        if (pInfo->lpAIRanges[2 * i + 1] > fMax)
+        {
+            fMax = pInfo->lpAIRanges[2 * i + 1];
+        }
+    }
+
+    return fMax;
+}
+
+// Returns the capabilities of a device, querying the driver only if
+// they are not cached yet. The oldest device is dropped when the
+// cache is full.
+static inline int32 daqDeviceCacheGet(DaqDeviceCache *pCache, const char *lpDevice, const DaqDeviceInfo **ppInfo)
+{
+    for (int i = 0; i < pCache->nDevices; i++)
+    {
+        if (!strcmp(pCache->lpDevices[i]->lpName, lpDevice))
+        {
+            *ppInfo = pCache->lpDevices[i];
+            return 0;
+        }
+    }
+
+    DaqDeviceInfo *pInfo = NULL;
+    int32 nResult = daqDeviceInfoLoad(lpDevice, &pInfo);
+
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+
+    if (pCache->nDevices == DAQ_DEVICE_CACHE_SIZE)
+    {
+        daqDeviceInfoFree(pCache->lpDevices[0]);
+        memmove(pCache->lpDevices, pCache->lpDevices + 1, (DAQ_DEVICE_CACHE_SIZE - 1) * sizeof(DaqDeviceInfo*));
+        pCache->nDevices--;
+    }
+
+    pCache->lpDevices[pCache->nDevices++] = pInfo;
+    *ppInfo = pInfo;
+
+    return 0;
+}
+
+// Returns the comma separated names of the installed devices
+static inline int32 daqDeviceCacheNames(DaqDeviceCache *pCache, const char **plpNames)
+{
+    if (pCache->lpNames == NULL)
+    {
+        int32 nResult = daqQueryString([](char *lpData, uInt32 nSize) { return daqGetSysDevNames(lpData, nSize); },
+                                       &pCache->lpNames);
+
+        if (nResult < 0)
+        {
+            return nResult;
+        }
+    }
+
+    *plpNames = pCache->lpNames;
+
+    return 0;
+}
+
+// Drops a device, so it is queried again on its next use
+static inline void daqDeviceCacheForget(DaqDeviceCache *pCache, const char *lpDevice)
+{
+    for (int i = 0; i < pCache->nDevices; i++)
+    {
+        if (!strcmp(pCache->lpDevices[i]->lpName, lpDevice))
+        {
+            daqDeviceInfoFree(pCache->lpDevices[i]);
+            memmove(pCache->lpDevices + i, pCache->lpDevices + i + 1, (pCache->nDevices - i - 1) * sizeof(DaqDeviceInfo*));
+            pCache->nDevices--;
+            return;
+        }
+    }
+}
+
+static inline void daqDeviceCacheClear(DaqDeviceCache *pCache)
+{
+    for (int i = 0; i < pCache->nDevices; i++)
+    {
+        daqDeviceInfoFree(pCache->lpDevices[i]);
+    }
+
+    free(pCache->lpNames);
+
+    pCache->nDevices = 0;
+    pCache->lpNames = NULL;
+}
+
+// Copies the next item of a comma separated list to lpItem, without
+// the surrounding blanks, and advances *plpList past it. Returns
+// false at the end of the list.
+static inline bool daqNextListItem(const char **plpList, char *lpItem, size_t nSize)
+{
+    const char *lpStart = *plpList;
+
+    while (*lpStart == ' ' || *lpStart == ',')
+    {
+        lpStart++;
+    }
+
+    if (*lpStart == '\0')
+    {
+        return false;
+    }
+
+    const char *lpEnd = lpStart;
+
+    while (*lpEnd != '\0' && *lpEnd != ',')
+    {
+        lpEnd++;
+    }
+
+    *plpList = lpEnd;
+
+    while (lpEnd > lpStart && lpEnd[-1] == ' ')
+    {
+        lpEnd--;
+    }
+
+    size_t nLength = (size_t) (lpEnd - lpStart);
+
+    if (nLength >= nSize)
+    {
+        nLength = nSize - 1;
+    }
+
+    memcpy(lpItem, lpStart, nLength);
+    lpItem[nLength] = '\0';
+
+    return true;
+}
+
+#endif
@@ -2,6 +2,17 @@
 // deviceinfo.cpp
 //
 // Outputs the information for every installed DAQmx adapter
+//
+// [Devices] = daqDeviceList()
+// daqDeviceList('refresh')
+//
+//         - Devices: cell array with the name of every installed device.
+//                    When no output is requested they are printed instead
+//
+//       - 'refresh': queries the installed devices again. They are read
+//                    from the driver only on the first call and kept for
+//                    the rest of the session
+//
 // Created 15/5/2012
 // Cesar Gonzalez Segura
 /*************************************************************/
@@ -19,35 +30,91 @@
 // You should have received a copy of the GNU Lesser General Public
 // License along with this library.
 
-#include "NIDAQmx.h"
+#include "daqDriver.h"
 #include "mex.h"
-#pragma comment(lib, "NIDAQmx.lib")
+#include "string.h"
+#include "daqDeviceInfo.h"
+
+static DaqDeviceCache g_Devices;
+
+void outMexError(int nError)
+{
+    if (nError != 0)
+    {
+        int nSize = daqGetErrorString(nError, NULL, 0);
+        char *lpError = (char*) mxMalloc(nSize);
+        daqGetErrorString(nError, lpError, nSize);
+        char lpOutput[256];
+
+        sprintf(lpOutput, "DAQmx Error %d: %s.", nError, lpError);
+        mxFree(lpError);
+
+        mexErrMsgTxt(lpOutput);
+    }
+}
+
+void onExit()
+{
+    daqDeviceCacheClear(&g_Devices);
+}
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
-   if ( nrhs > 0)
+   mexAtExit(onExit);
+
+   if (nrhs > 1)
    {
        mexErrMsgTxt("Too many input arguments.");
    }
-   else
+   else if (nlhs > 1)
    {
-       mexPrintf("\n\n");
-       int nSize = DAQmxGetSysDevNames(NULL, 0);
-       char *lpTemp = (char*) mxMalloc(nSize);
-       DAQmxGetSysDevNames(lpTemp, nSize);
-       
-       if (lpTemp == NULL)
-       {
-           mexErrMsgTxt("There are no installed devices.");
-       }
-       else
+       mexErrMsgTxt("Too many output arguments.");
+   }
+
+   if (nrhs == 1)
+   {
+       char *lpCommand = mxIsChar(prhs[0]) ? mxArrayToString(prhs[0]) : NULL;
+       bool bRefresh = lpCommand != NULL && !strcmp(lpCommand, "refresh");
+
+       mxFree(lpCommand);
+
+       if (!bRefresh)
        {
-           mexPrintf("  - InstalledDevices: '%s'\n", lpTemp);
+           mexErrMsgTxt("The only input accepted is 'refresh'.");
        }
-       
-       mxFree(lpTemp);
+
+       daqDeviceCacheClear(&g_Devices);
+   }
+
+   const char *lpNames = NULL;
+
+   outMexError(daqDeviceCacheNames(&g_Devices, &lpNames));
+
+   if (nlhs == 0)
+   {
+       mexPrintf("\n\n");
+       mexPrintf("  - InstalledDevices: '%s'\n", lpNames);
        mexPrintf("\n\n");
+       return;
    }
-   
+
+   char lpItem[256];
+   const char *lpNext = lpNames;
+   mwSize nDevices = 0;
+
+   while (daqNextListItem(&lpNext, lpItem, sizeof(lpItem)))
+   {
+       nDevices++;
+   }
+
+   plhs[0] = mxCreateCellMatrix(1, nDevices);
+   lpNext = lpNames;
+
+   for (mwSize i = 0; i < nDevices; i++)
+   {
+       daqNextListItem(&lpNext, lpItem, sizeof(lpItem));
+       mxSetCell(plhs[0], i, mxCreateString(lpItem));
+   }
+
    return;
-}
\ No newline at end of file
+}
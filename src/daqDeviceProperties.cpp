@@ -2,6 +2,20 @@
 // deviceproperties.cpp
 //
 // Outputs the information for the specified DAQmx device
+//
+// [Properties] = daqDeviceProperties(Device (s))
+// daqDeviceProperties(Device (s), 'refresh')
+//
+//      - Properties: structure with the capabilities of the device.
+//                    Channel lists, measurement types and sample modes
+//                    are cell arrays of strings; voltage ranges are
+//                    matrices with one [Min Max] row per range. When no
+//                    output is requested they are printed instead
+//
+//       - 'refresh': queries the device again. The capabilities are
+//                    read from the driver only the first time a device
+//                    is used and kept for the rest of the session
+//
 // Created 15/5/2012
 // Cesar Gonzalez Segura
 /*************************************************************/
@@ -18,282 +32,352 @@
 // You should have received a copy of the GNU Lesser General Public
 // License along with this library.
 
-#include "NIDAQmx.h"
+#include "daqDriver.h"
 #include "mex.h"
 #include "string.h"
-#pragma comment(lib, "NIDAQmx.lib")
+#include "daqDeviceInfo.h"
+
+static DaqDeviceCache g_Devices;
 
 void outMexError(int nError)
 {
     if (nError != 0)
     {
-        int nSize = DAQmxGetErrorString(nError, NULL, 0);
+        int nSize = daqGetErrorString(nError, NULL, 0);
         char *lpError = (char*) mxMalloc(nSize);
-        DAQmxGetErrorString(nError, lpError, nSize);
+        daqGetErrorString(nError, lpError, nSize);
         char lpOutput[256];
-        
+
         sprintf(lpOutput, "DAQmx Error %d: %s.", nError, lpError);
         mxFree(lpError);
-        
+
         mexErrMsgTxt(lpOutput);
     }
 }
 
-void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+void onExit()
 {
-    if (nrhs != 1)
+    daqDeviceCacheClear(&g_Devices);
+}
+
+// Names used for the measurement and output types, the same ones
+// daqAdquireData takes. Types without a name are left out.
+const char *getTypeName(int32 nType)
+{
+    switch (nType)
     {
-        mexErrMsgTxt("One input required.");
+        case DAQmx_Val_Voltage:
+            return "Voltage";
+        case DAQmx_Val_VoltageRMS:
+            return "VoltageRMS";
+        case DAQmx_Val_Current:
+            return "Current";
+        case DAQmx_Val_CurrentRMS:
+            return "CurrentRMS";
+        case DAQmx_Val_Resistance:
+            return "Resistance";
+        case DAQmx_Val_FuncGen:
+            return "FuncGen";
     }
-    else if (nlhs > 1)
+
+    return NULL;
+}
+
+const char *getModeName(int32 nMode)
+{
+    switch (nMode)
     {
-        mexErrMsgTxt("Too many output arguments.");
+        case DAQmx_Val_FiniteSamps:
+            return "Finite";
+        case DAQmx_Val_ContSamps:
+            return "Continuous";
+        case DAQmx_Val_HWTimedSinglePoint:
+            return "HWTimedSinglePoint";
     }
-    else
+
+    return NULL;
+}
+
+// Cell row with the items of a comma separated list
+mxArray *createList(const char *lpList)
+{
+    char lpItem[256];
+    const char *lpNext = lpList;
+    mwSize nItems = 0;
+
+    while (lpList != NULL && daqNextListItem(&lpNext, lpItem, sizeof(lpItem)))
+    {
+        nItems++;
+    }
+
+    mxArray *pList = mxCreateCellMatrix(1, nItems);
+
+    lpNext = lpList;
+
+    for (mwSize i = 0; i < nItems; i++)
     {
-        if (mxIsChar(prhs[0]) != 1)
+        daqNextListItem(&lpNext, lpItem, sizeof(lpItem));
+        mxSetCell(pList, i, mxCreateString(lpItem));
+    }
+
+    return pList;
+}
+
+// Cell row with the names of the known values of an enumeration
+mxArray *createNames(const int32 *lpValues, uInt32 nValues, const char *(*getName)(int32))
+{
+    mwSize nItems = 0;
+
+    for (uInt32 i = 0; i < nValues; i++)
+    {
+        nItems += (getName(lpValues[i]) != NULL);
+    }
+
+    mxArray *pNames = mxCreateCellMatrix(1, nItems);
+    mwSize nItem = 0;
+
+    for (uInt32 i = 0; i < nValues; i++)
+    {
+        if (getName(lpValues[i]) != NULL)
         {
-            mexErrMsgTxt("Input must be a string.");
+            mxSetCell(pNames, nItem++, mxCreateString(getName(lpValues[i])));
         }
-        else if (mxGetM(prhs[0]) !=1)
+    }
+
+    return pNames;
+}
+
+// One [Min Max] row per range
+mxArray *createRanges(const float64 *lpRanges, uInt32 nRanges)
+{
+    mxArray *pRanges = mxCreateDoubleMatrix(nRanges, 2, mxREAL);
+    double *ptrRanges = mxGetPr(pRanges);
+
+    for (uInt32 i = 0; i < nRanges; i++)
+    {
+        ptrRanges[i] = lpRanges[2 * i];
+        ptrRanges[nRanges + i] = lpRanges[2 * i + 1];
+    }
+
+    return pRanges;
+}
+
+mxArray *createProperties(const DaqDeviceInfo *pInfo)
+{
+    const char *lpFields[] = {"Name", "ProductType",
+                              "AIChannels", "AIMeasurementTypes", "AISampleModes", "AIMaxSingleChannelRate",
+                              "AIMaxMultiChannelRate", "AIMinRate", "AISimultaneousSampling", "AIVoltageRanges",
+                              "AOChannels", "AOOutputTypes", "AOSampleModes", "AOSampleClock",
+                              "AOMaxRate", "AOMinRate", "AOVoltageRanges"};
+
+    mxArray *pProperties = mxCreateStructMatrix(1, 1, sizeof(lpFields) / sizeof(lpFields[0]), lpFields);
+
+    mxSetField(pProperties, 0, "Name", mxCreateString(pInfo->lpName));
+    mxSetField(pProperties, 0, "ProductType", mxCreateString(pInfo->lpProductType));
+
+    mxSetField(pProperties, 0, "AIChannels", createList(pInfo->lpAIChannels));
+    mxSetField(pProperties, 0, "AIMeasurementTypes", createNames(pInfo->lpAIMeasTypes, pInfo->nAIMeasTypes, getTypeName));
+    mxSetField(pProperties, 0, "AISampleModes", createNames(pInfo->lpAISampleModes, pInfo->nAISampleModes, getModeName));
+    mxSetField(pProperties, 0, "AIMaxSingleChannelRate", mxCreateDoubleScalar(pInfo->fAIMaxSingleRate));
+    mxSetField(pProperties, 0, "AIMaxMultiChannelRate", mxCreateDoubleScalar(pInfo->fAIMaxMultiRate));
+    mxSetField(pProperties, 0, "AIMinRate", mxCreateDoubleScalar(pInfo->fAIMinRate));
+    mxSetField(pProperties, 0, "AISimultaneousSampling", mxCreateLogicalScalar(pInfo->bAISimultaneous != 0));
+    mxSetField(pProperties, 0, "AIVoltageRanges", createRanges(pInfo->lpAIRanges, pInfo->nAIRanges));
+
+    mxSetField(pProperties, 0, "AOChannels", createList(pInfo->lpAOChannels));
+    mxSetField(pProperties, 0, "AOOutputTypes", createNames(pInfo->lpAOOutputTypes, pInfo->nAOOutputTypes, getTypeName));
+    mxSetField(pProperties, 0, "AOSampleModes", createNames(pInfo->lpAOSampleModes, pInfo->nAOSampleModes, getModeName));
+    mxSetField(pProperties, 0, "AOSampleClock", mxCreateLogicalScalar(pInfo->bAOSampleClock != 0));
+    mxSetField(pProperties, 0, "AOMaxRate", mxCreateDoubleScalar(pInfo->fAOMaxRate));
+    mxSetField(pProperties, 0, "AOMinRate", mxCreateDoubleScalar(pInfo->fAOMinRate));
+    mxSetField(pProperties, 0, "AOVoltageRanges", createRanges(pInfo->lpAORanges, pInfo->nAORanges));
+
+    return pProperties;
+}
+
+void printList(const char *lpList)
+{
+    char lpItem[256];
+    const char *lpNext = lpList;
+
+    while (lpList != NULL && daqNextListItem(&lpNext, lpItem, sizeof(lpItem)))
+    {
+        mexPrintf(" %s\n", lpItem);
+    }
+}
+
+void printProperties(const DaqDeviceInfo *pInfo)
+{
+    mexPrintf("\n\n");
+    mexPrintf("\nDevice '%s':\n", pInfo->lpName);
+    mexPrintf(" - ProductName: '%s'\n", pInfo->lpProductType);
+
+    /************************************************/
+    /***            INPUT PROPERTIES              ***/
+    /************************************************/
+
+    mexPrintf("\n  --- INPUT PROPERTIES ---\n\n");
+
+    mexPrintf(" - Analog input physical channels: \n");
+    printList(pInfo->lpAIChannels);
+
+    mexPrintf(" - Supported input modes:\n");
+
+    for (uInt32 i = 0; i < pInfo->nAIMeasTypes; i++)
+    {
+        switch (pInfo->lpAIMeasTypes[i])
         {
-            mexErrMsgTxt("Input must be a row vector.");
+            case DAQmx_Val_Voltage:
+                mexPrintf("Voltage measurement\n");
+                break;
+            case DAQmx_Val_VoltageRMS:
+                mexPrintf("RMS Voltage measurement\n");
+                break;
+            case DAQmx_Val_Current:
+                mexPrintf("Current measurement\n");
+                break;
+            case DAQmx_Val_CurrentRMS:
+                mexPrintf("RMS Current measurement\n");
+                break;
+            case DAQmx_Val_Resistance:
+                mexPrintf("Resistance measurement\n");
+                break;
         }
-        else
+    }
+
+    mexPrintf(" - Maximum single-channel sample rate: %f S/s\n", pInfo->fAIMaxSingleRate);
+    mexPrintf(" - Maximum multiple-channel sample rate: %f S/s\n", pInfo->fAIMaxMultiRate);
+    mexPrintf(" - Input sampling supported properties:\n");
+
+    for (uInt32 i = 0; i < pInfo->nAISampleModes; i++)
+    {
+        switch (pInfo->lpAISampleModes[i])
         {
-            mexPrintf("\n\n");
-            
-            /************************************************/
-            /************************************************/
-            /************************************************/
-            mwSize nInLen = (mxGetM(prhs[0]) * mxGetN(prhs[0])) + 1;
-            char *lpDevName, *lpChannelsIn, *lpChannelsOut, *lpInput, *lpDevice, *lpHard;
-            
-            lpInput = mxArrayToString(prhs[0]);
-            lpDevice = (char*) mxCalloc(strlen(lpInput) + 1, sizeof(char));
-            strcpy(lpDevice, lpInput);
-            
-            mexPrintf("\nDevice '%s':\n", lpDevice);
-            mxFree(lpInput);
-            
-            /************************************************/
-            /***            DEVICE PROPERTIES             ***/
-            /************************************************/
-            
-            // Device hardware name
-            nInLen = DAQmxGetDevProductType(lpDevice, NULL, 0);
-            lpHard = (char*) mxCalloc(nInLen, sizeof(char));
-            DAQmxGetDevProductType(lpDevice, lpHard, nInLen);
-            
-            mexPrintf(" - ProductName: '%s'\n", lpHard);
-            mxFree(lpHard);
-            
-            /************************************************/
-            /***            INPUT PROPERTIES              ***/
-            /************************************************/
-            
-            mexPrintf("\n  --- INPUT PROPERTIES ---\n\n");
-            
-            // Avaible analog input channels
-            nInLen = DAQmxGetDevAIPhysicalChans(lpDevice, NULL, 0);
-            lpChannelsIn = (char*) mxCalloc(nInLen, sizeof(char));
-            DAQmxGetDevAIPhysicalChans(lpDevice, lpChannelsIn, nInLen);
-            
-            for (int i = 0; i < strlen(lpChannelsIn); i++)
-            {
-                if (lpChannelsIn[i] == ',')
-                {
-                    lpChannelsIn[i] = '\n';
-                }
-            }
-            
-            mexPrintf(" - Analog input physical channels: \n %s\n", lpChannelsIn);
-            mxFree(lpChannelsIn);
-            
-            // Avaible input modes
-            nInLen = (int) DAQmxGetDevAISupportedMeasTypes(lpDevice, NULL, 0);
-            int32 *nSupportedMeasureIn = (int32*) mxCalloc(nInLen, sizeof(int32));
-            DAQmxGetDevAISupportedMeasTypes(lpDevice, nSupportedMeasureIn, nInLen);
-            
-            mexPrintf(" - Supported input modes:\n");
-            
-            for (int i = 0; i < nInLen; i++)
-            {
-                switch (nSupportedMeasureIn[i])
-                {
-                    case DAQmx_Val_Voltage:
-                        mexPrintf("Voltage measurement\n");
-                        break;
-                    case DAQmx_Val_VoltageRMS:
-                        mexPrintf("RMS Voltage measurement\n");
-                        break;
-                    case DAQmx_Val_Current:
-                        mexPrintf("Current measurement\n");
-                        break;
-                    case DAQmx_Val_CurrentRMS:
-                        mexPrintf("RMS Current measurement\n");
-                        break;
-                    case DAQmx_Val_Resistance:
-                        mexPrintf("Resistance measurement\n");
-                        break;
-                }
-            }
-            
-            mxFree(nSupportedMeasureIn);
-            
-            // Maximum sample rate in single channel mode
-            
-            float64 *fMaxSChanRate = (float64*) mxMalloc(sizeof(float64));
-            DAQmxGetDevAIMaxSingleChanRate(lpDevice, fMaxSChanRate);
-            mexPrintf(" - Maximum single-channel sample rate: %f kS/s\n", *fMaxSChanRate);
-            mxFree(fMaxSChanRate);
-            
-            // Maximum sample rate in multi channel mode
-            
-            float64 *fMaxMChanRate = (float64*) mxMalloc(sizeof(float64));
-            DAQmxGetDevAIMaxMultiChanRate(lpDevice, fMaxMChanRate);
-            mexPrintf(" - Maximum multiple-channel sample rate: %f kS/s\n", *fMaxMChanRate);
-            mxFree(fMaxMChanRate);
-            
-            // Sampling modes supported
-            
-            mexPrintf(" - Input sampling supported properties:\n");
-            
-            nInLen = DAQmxGetDevAISampModes(lpDevice, NULL, 0);
-            int32 *nSampleModesIn = (int32*) mxCalloc(nInLen, sizeof(int32));
-            DAQmxGetDevAISampModes(lpDevice, nSampleModesIn, nInLen);
-            
-            for (int i = 0; i < nInLen; i++)
-            {
-                switch (nSampleModesIn[i])
-                {
-                    case DAQmx_Val_FiniteSamps:
-                        mexPrintf("Adquiring a finite number of samples\n");
-                        break;
-                    case DAQmx_Val_ContSamps:
-                        mexPrintf("Adquiring samples continiously until stop\n");
-                        break;
-                }
-            }
-            
-            mxFree(nSampleModesIn);
-            
-            bool32 *bMultiInSupport = (bool32*) mxMalloc(sizeof(bool32));
-            DAQmxGetDevAISimultaneousSamplingSupported(lpDevice, bMultiInSupport);
-            
-            if (*bMultiInSupport > 0)
-            {
-                mexPrintf("Adquiring samples from multiple channels simultaneously supported\n");
-            }
-            
-            mxFree(bMultiInSupport);
-            
-            /************************************************/
-            /***            OUTPUT PROPERTIES             ***/
-            /************************************************/
-            
-            mexPrintf("\n  --- OUTPUT PROPERTIES ---\n\n");
-            
-            // Avaible analog output channels
-            nInLen = DAQmxGetDevAOPhysicalChans(lpDevice, NULL, 0);
-            lpChannelsOut = (char*) mxCalloc(nInLen, sizeof(char));
-            DAQmxGetDevAOPhysicalChans(lpDevice, lpChannelsOut, nInLen);
-            
-            for (int i = 0; i < strlen(lpChannelsOut); i++)
-            {
-                if (lpChannelsOut[i] == ',')
-                {
-                    lpChannelsOut[i] = '\n';
-                }
-            }
-            
-            mexPrintf(" - Analog output physical channels: \n %s\n", lpChannelsOut);
-            mxFree(lpChannelsOut);
-            
-            // Avaible output modes
-            nInLen = (int) DAQmxGetDevAOSupportedOutputTypes(lpDevice, NULL, 0);
-            int32 *nSupportedMeasureOut = (int32*) mxCalloc(nInLen, sizeof(int32));
-            DAQmxGetDevAOSupportedOutputTypes(lpDevice, nSupportedMeasureOut, nInLen);
-            
-            mexPrintf(" - Supported output modes:\n");
-            
-            for (int i = 0; i < nInLen; i++)
-            {
-                switch (nSupportedMeasureOut[i])
-                {
-                    case DAQmx_Val_Voltage:
-                        mexPrintf("Voltage output\n");
-                        break;
-                    case DAQmx_Val_Current:
-                        mexPrintf("Current output\n");
-                        break;
-                    case DAQmx_Val_FuncGen:
-                        mexPrintf("In-device function generation output\n");
-                        break;
-                }
-            }
-            
-            mxFree(nSupportedMeasureOut);
-            
-            // Device supports using a sample clock
-            bool32* bSampleClk = (bool32*) mxMalloc(sizeof(bool32));
-            DAQmxGetDevAOSampClkSupported(lpDevice, bSampleClk);
-            
-            if (*bSampleClk > 0)
-            {
-                mexPrintf(" - Device supports using an output sample clock\n");
-            }
-            
-            mxFree(bSampleClk);
-            
-            // Supported output sampling modes
-            nInLen = DAQmxGetDevAOSampModes(lpDevice, NULL, 0);
-            int32 *nSampleModesOut = (int32*) mxCalloc(nInLen, sizeof(int32));
-            DAQmxGetDevAOSampModes(lpDevice, nSampleModesOut, nInLen);
-            
-            mexPrintf(" - Device supported output sampling modes:\n");
-            
-            for (int i = 0; i < nInLen; i++)
-            {
-                switch (nSampleModesOut[i])
-                {
-                    case DAQmx_Val_FiniteSamps:
-                        mexPrintf("Outputting a finite number of samples\n");
-                        break;
-                    case DAQmx_Val_ContSamps:
-                        mexPrintf("Outputting continiously samples until stop\n");
-                        break;
-                }
-            }
-            
-            mxFree(nSampleModesOut);
-            
-            // Maximum output sample rate
-            
-            float64 *fMaxOutRate = (float64*) mxMalloc(sizeof(float64));
-            DAQmxGetDevAOMaxRate(lpDevice, fMaxOutRate);
-            
-            mexPrintf(" - Maximum output sample rate: %f kS/s\n", *fMaxOutRate);
-            mxFree(fMaxOutRate);
-            
-            /************************************************/
-            /************************************************/
-            /************************************************/
-            
-            // Cleaning out
-            mxFree(lpDevice);
-            mexPrintf("\n\n");
+            case DAQmx_Val_FiniteSamps:
+                mexPrintf("Adquiring a finite number of samples\n");
+                break;
+            case DAQmx_Val_ContSamps:
+                mexPrintf("Adquiring samples continiously until stop\n");
+                break;
         }
     }
-    
-    return;
+
+    if (pInfo->bAISimultaneous > 0)
+    {
+        mexPrintf("Adquiring samples from multiple channels simultaneously supported\n");
+    }
+
+    /************************************************/
+    /***            OUTPUT PROPERTIES             ***/
+    /************************************************/
+
+    mexPrintf("\n  --- OUTPUT PROPERTIES ---\n\n");
+
+    mexPrintf(" - Analog output physical channels: \n");
+    printList(pInfo->lpAOChannels);
+
+    mexPrintf(" - Supported output modes:\n");
+
+    for (uInt32 i = 0; i < pInfo->nAOOutputTypes; i++)
+    {
+        switch (pInfo->lpAOOutputTypes[i])
+        {
+            case DAQmx_Val_Voltage:
+                mexPrintf("Voltage output\n");
+                break;
+            case DAQmx_Val_Current:
+                mexPrintf("Current output\n");
+                break;
+            case DAQmx_Val_FuncGen:
+                mexPrintf("In-device function generation output\n");
+                break;
+        }
+    }
+
+    if (pInfo->bAOSampleClock > 0)
+    {
+        mexPrintf(" - Device supports using an output sample clock\n");
+    }
+
+    mexPrintf(" - Device supported output sampling modes:\n");
+
+    for (uInt32 i = 0; i < pInfo->nAOSampleModes; i++)
+    {
+        switch (pInfo->lpAOSampleModes[i])
+        {
+            case DAQmx_Val_FiniteSamps:
+                mexPrintf("Outputting a finite number of samples\n");
+                break;
+            case DAQmx_Val_ContSamps:
+                mexPrintf("Outputting continiously samples until stop\n");
+                break;
+        }
+    }
+
+    mexPrintf(" - Maximum output sample rate: %f S/s\n", pInfo->fAOMaxRate);
+    mexPrintf("\n\n");
 }
 
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    mexAtExit(onExit);
+
+    if (nrhs < 1)
+    {
+        mexErrMsgTxt("One input required.");
+    }
+    else if (nrhs > 2)
+    {
+        mexErrMsgTxt("Too many input arguments.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxIsChar(prhs[0]) != 1)
+    {
+        mexErrMsgTxt("Input must be a string.");
+    }
+    else if (mxGetM(prhs[0]) !=1)
+    {
+        mexErrMsgTxt("Input must be a row vector.");
+    }
+
+    bool bRefresh = false;
 
+    if (nrhs == 2)
+    {
+        char *lpCommand = mxIsChar(prhs[1]) ? mxArrayToString(prhs[1]) : NULL;
 
+        bRefresh = lpCommand != NULL && !strcmp(lpCommand, "refresh");
+        mxFree(lpCommand);
 
+        if (!bRefresh)
+        {
+            mexErrMsgTxt("The second input must be 'refresh'.");
+        }
+    }
 
+    char *lpDevice = mxArrayToString(prhs[0]);
+    const DaqDeviceInfo *pInfo = NULL;
 
+    if (bRefresh)
+    {
+        daqDeviceCacheForget(&g_Devices, lpDevice);
+    }
 
+    int32 nResult = daqDeviceCacheGet(&g_Devices, lpDevice, &pInfo);
+    mxFree(lpDevice);
+    outMexError(nResult);
 
+    if (nlhs > 0)
+    {
+        plhs[0] = createProperties(pInfo);
+    }
+    else
+    {
+        printProperties(pInfo);
+    }
 
+    return;
+}
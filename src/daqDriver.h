@@ -0,0 +1,504 @@
+/*************************************************************/
+// daqDriver.h
+//
+// Thin layer between the MEX files and the driver. Every driver
+// call goes through one of the daq* functions below, which have
+// the same arguments and return codes as the DAQmx function of the
+// same name and forward it to a backend:
+//
+//  - DaqNiBackend calls NI-DAQmx.
+//  - DaqSimBackend (daqSimulator.h) generates signals in software
+//    for the devices named SimDev1, SimDev2...
+//  - DaqReplayBackend (daqReplay.h) plays back the capture stored in
+//    a file for the devices named "file:" followed by its path.
+//
+// The backend is chosen by device name when a task is created, and
+// task handles remember it, so the rest of the code never needs to
+// know which one it is talking to.
+//
+// Define DAQ_NO_NIDAQMX to build without NI-DAQmx, for instance on
+// Linux. Only the simulated and replay devices are available then.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQDRIVER_H
+#define DAQDRIVER_H
+
+#ifndef DAQ_NO_NIDAQMX
+
+#include "NIDAQmx.h"
+#pragma comment(lib, "NIDAQmx.lib")
+
+#else
+
+// The subset of NIDAQmx.h the library uses, with the same values
+typedef signed char int8;
+typedef unsigned char uInt8;
+typedef signed short int16;
+typedef unsigned short uInt16;
+typedef signed int int32;
+typedef unsigned int uInt32;
+typedef float float32;
+typedef double float64;
+typedef signed long long int64;
+typedef unsigned long long uInt64;
+typedef uInt32 bool32;
+typedef void *TaskHandle;
+
+#define DAQmx_Val_Voltage 10322
+#define DAQmx_Val_VoltageRMS 10350
+#define DAQmx_Val_Current 10134
+#define DAQmx_Val_CurrentRMS 10351
+#define DAQmx_Val_Resistance 10278
+#define DAQmx_Val_FuncGen 14750
+#define DAQmx_Val_Diff 10106
+#define DAQmx_Val_Volts 10348
+#define DAQmx_Val_Rising 10280
+#define DAQmx_Val_Falling 10171
+#define DAQmx_Val_FiniteSamps 10178
+#define DAQmx_Val_ContSamps 10123
+#define DAQmx_Val_HWTimedSinglePoint 12522
+#define DAQmx_Val_GroupByChannel 0
+#define DAQmx_Val_GroupByScanNumber 1
+#define DAQmx_Val_Task_Start 0
+#define DAQmx_Val_Task_Stop 1
+#define DAQmx_Val_Task_Verify 2
+#define DAQmx_Val_Task_Commit 3
+#define DAQmx_Val_Task_Reserve 4
+#define DAQmx_Val_Task_Unreserve 5
+#define DAQmx_Val_Task_Abort 6
+
+#define DAQmxErrorInvalidAttributeValue (-200077)
+#define DAQmxErrorInvalidTask (-200088)
+#define DAQmxErrorPhysicalChanDoesNotExist (-200170)
+#define DAQmxErrorInvalidDeviceID (-200220)
+#define DAQmxErrorBufferTooSmallForString (-200228)
+#define DAQmxErrorSamplesNoLongerAvailable (-200279)
+#define DAQmxErrorSamplesNotYetAvailable (-200284)
+#define DAQmxErrorPALMemoryFull (-50352)
+
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The DAQmx functions the library uses. Device properties follow
+// the driver convention: called with a NULL buffer, string and
+// array getters return the size needed.
+class DaqBackend
+{
+public:
+    virtual ~DaqBackend() {}
+
+    virtual int32 CreateTask(const char *lpDevice, TaskHandle *phTask) = 0;
+    virtual int32 CreateAIVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName, int32 nTerminal,
+                                      float64 fMin, float64 fMax, int32 nUnits, const char *lpScale) = 0;
+    virtual int32 CreateAOVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName,
+                                      float64 fMin, float64 fMax, int32 nUnits, const char *lpScale) = 0;
+    virtual int32 CfgSampClkTiming(TaskHandle hTask, const char *lpSource, float64 fRate, int32 nEdge,
+                                   int32 nSampleMode, uInt64 nSamples) = 0;
+    virtual int32 CfgInputBuffer(TaskHandle hTask, uInt32 nSamples) = 0;
+    virtual int32 CfgDigEdgeStartTrig(TaskHandle hTask, const char *lpSource, int32 nEdge) = 0;
+    virtual int32 TaskControl(TaskHandle hTask, int32 nAction) = 0;
+    virtual int32 StartTask(TaskHandle hTask) = 0;
+    virtual int32 StopTask(TaskHandle hTask) = 0;
+    virtual int32 ClearTask(TaskHandle hTask) = 0;
+    virtual int32 GetTaskNumChans(TaskHandle hTask, uInt32 *pnChannels) = 0;
+    virtual int32 GetTaskChannels(TaskHandle hTask, char *lpData, uInt32 nSize) = 0;
+    virtual int32 GetNthTaskChannel(TaskHandle hTask, uInt32 nIndex, char *lpData, int32 nSize) = 0;
+    virtual int32 ReadAnalogF64(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode,
+                                float64 *lpData, uInt32 nSize, int32 *pnRead) = 0;
+    virtual int32 ReadBinaryI16(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode,
+                                int16 *lpData, uInt32 nSize, int32 *pnRead) = 0;
+    virtual int32 WriteAnalogF64(TaskHandle hTask, int32 nSamples, bool32 bAutoStart, float64 fTimeout, bool32 nLayout,
+                                 const float64 *lpData, int32 *pnWritten) = 0;
+    virtual int32 WaitForNextSampleClock(TaskHandle hTask, float64 fTimeout, bool32 *pbLate) = 0;
+    virtual int32 GetAIDevScalingCoeff(TaskHandle hTask, const char *lpChannel, float64 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetAIResolution(TaskHandle hTask, const char *lpChannel, float64 *pfBits) = 0;
+
+    virtual int32 GetDevProductType(const char *lpDevice, char *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAIPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAOPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAISupportedMeasTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAOSupportedOutputTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAISampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAOSampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAIVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAOVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) = 0;
+    virtual int32 GetDevAIMaxSingleChanRate(const char *lpDevice, float64 *pfRate) = 0;
+    virtual int32 GetDevAIMaxMultiChanRate(const char *lpDevice, float64 *pfRate) = 0;
+    virtual int32 GetDevAIMinRate(const char *lpDevice, float64 *pfRate) = 0;
+    virtual int32 GetDevAISimultaneousSamplingSupported(const char *lpDevice, bool32 *pbValue) = 0;
+    virtual int32 GetDevAOSampClkSupported(const char *lpDevice, bool32 *pbValue) = 0;
+    virtual int32 GetDevAOMaxRate(const char *lpDevice, float64 *pfRate) = 0;
+    virtual int32 GetDevAOMinRate(const char *lpDevice, float64 *pfRate) = 0;
+};
+
+#include "daqSimulator.h"
+#include "daqReplay.h"
+
+#ifndef DAQ_NO_NIDAQMX
+
+class DaqNiBackend : public DaqBackend
+{
+public:
+    int32 CreateTask(const char *lpDevice, TaskHandle *phTask)
+    {
+        // Unnamed tasks get a unique name from the driver
+        return DAQmxCreateTask("", phTask);
+    }
+
+    int32 CreateAIVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName, int32 nTerminal,
+                              float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+    {
+        return DAQmxCreateAIVoltageChan(hTask, lpChannel, lpName, nTerminal, fMin, fMax, nUnits, lpScale);
+    }
+
+    int32 CreateAOVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName,
+                              float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+    {
+        return DAQmxCreateAOVoltageChan(hTask, lpChannel, lpName, fMin, fMax, nUnits, lpScale);
+    }
+
+    int32 CfgSampClkTiming(TaskHandle hTask, const char *lpSource, float64 fRate, int32 nEdge, int32 nSampleMode, uInt64 nSamples)
+    {
+        return DAQmxCfgSampClkTiming(hTask, lpSource, fRate, nEdge, nSampleMode, nSamples);
+    }
+
+    int32 CfgInputBuffer(TaskHandle hTask, uInt32 nSamples) { return DAQmxCfgInputBuffer(hTask, nSamples); }
+    int32 CfgDigEdgeStartTrig(TaskHandle hTask, const char *lpSource, int32 nEdge) { return DAQmxCfgDigEdgeStartTrig(hTask, lpSource, nEdge); }
+    int32 TaskControl(TaskHandle hTask, int32 nAction) { return DAQmxTaskControl(hTask, nAction); }
+    int32 StartTask(TaskHandle hTask) { return DAQmxStartTask(hTask); }
+    int32 StopTask(TaskHandle hTask) { return DAQmxStopTask(hTask); }
+    int32 ClearTask(TaskHandle hTask) { return DAQmxClearTask(hTask); }
+    int32 GetTaskNumChans(TaskHandle hTask, uInt32 *pnChannels) { return DAQmxGetTaskNumChans(hTask, pnChannels); }
+    int32 GetTaskChannels(TaskHandle hTask, char *lpData, uInt32 nSize) { return DAQmxGetTaskChannels(hTask, lpData, nSize); }
+
+    int32 GetNthTaskChannel(TaskHandle hTask, uInt32 nIndex, char *lpData, int32 nSize)
+    {
+        return DAQmxGetNthTaskChannel(hTask, nIndex, lpData, nSize);
+    }
+
+    int32 ReadAnalogF64(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, float64 *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        return DAQmxReadAnalogF64(hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead, NULL);
+    }
+
+    int32 ReadBinaryI16(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, int16 *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        return DAQmxReadBinaryI16(hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead, NULL);
+    }
+
+    int32 WriteAnalogF64(TaskHandle hTask, int32 nSamples, bool32 bAutoStart, float64 fTimeout, bool32 nLayout,
+                         const float64 *lpData, int32 *pnWritten)
+    {
+        return DAQmxWriteAnalogF64(hTask, nSamples, bAutoStart, fTimeout, nLayout, lpData, pnWritten, NULL);
+    }
+
+    int32 WaitForNextSampleClock(TaskHandle hTask, float64 fTimeout, bool32 *pbLate)
+    {
+        return DAQmxWaitForNextSampleClock(hTask, fTimeout, pbLate);
+    }
+
+    int32 GetAIDevScalingCoeff(TaskHandle hTask, const char *lpChannel, float64 *lpData, uInt32 nSize)
+    {
+        return DAQmxGetAIDevScalingCoeff(hTask, lpChannel, lpData, nSize);
+    }
+
+    int32 GetAIResolution(TaskHandle hTask, const char *lpChannel, float64 *pfBits) { return DAQmxGetAIResolution(hTask, lpChannel, pfBits); }
+
+    int32 GetDevProductType(const char *lpDevice, char *lpData, uInt32 nSize) { return DAQmxGetDevProductType(lpDevice, lpData, nSize); }
+    int32 GetDevAIPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) { return DAQmxGetDevAIPhysicalChans(lpDevice, lpData, nSize); }
+    int32 GetDevAOPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) { return DAQmxGetDevAOPhysicalChans(lpDevice, lpData, nSize); }
+    int32 GetDevAISupportedMeasTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return DAQmxGetDevAISupportedMeasTypes(lpDevice, lpData, nSize); }
+    int32 GetDevAOSupportedOutputTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return DAQmxGetDevAOSupportedOutputTypes(lpDevice, lpData, nSize); }
+    int32 GetDevAISampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return DAQmxGetDevAISampModes(lpDevice, lpData, nSize); }
+    int32 GetDevAOSampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return DAQmxGetDevAOSampModes(lpDevice, lpData, nSize); }
+    int32 GetDevAIVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) { return DAQmxGetDevAIVoltageRngs(lpDevice, lpData, nSize); }
+    int32 GetDevAOVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) { return DAQmxGetDevAOVoltageRngs(lpDevice, lpData, nSize); }
+    int32 GetDevAIMaxSingleChanRate(const char *lpDevice, float64 *pfRate) { return DAQmxGetDevAIMaxSingleChanRate(lpDevice, pfRate); }
+    int32 GetDevAIMaxMultiChanRate(const char *lpDevice, float64 *pfRate) { return DAQmxGetDevAIMaxMultiChanRate(lpDevice, pfRate); }
+    int32 GetDevAIMinRate(const char *lpDevice, float64 *pfRate) { return DAQmxGetDevAIMinRate(lpDevice, pfRate); }
+    int32 GetDevAISimultaneousSamplingSupported(const char *lpDevice, bool32 *pbValue) { return DAQmxGetDevAISimultaneousSamplingSupported(lpDevice, pbValue); }
+    int32 GetDevAOSampClkSupported(const char *lpDevice, bool32 *pbValue) { return DAQmxGetDevAOSampClkSupported(lpDevice, pbValue); }
+    int32 GetDevAOMaxRate(const char *lpDevice, float64 *pfRate) { return DAQmxGetDevAOMaxRate(lpDevice, pfRate); }
+    int32 GetDevAOMinRate(const char *lpDevice, float64 *pfRate) { return DAQmxGetDevAOMinRate(lpDevice, pfRate); }
+};
+
+#endif
+
+// A task handle as the rest of the library sees it: the backend
+// that created the task and the backend's own handle
+struct DaqTaskRef
+{
+    DaqBackend *pBackend;
+    TaskHandle hTask;
+};
+
+static DaqSimBackend g_SimBackend;
+static DaqReplayBackend g_ReplayBackend;
+
+#ifndef DAQ_NO_NIDAQMX
+static DaqNiBackend g_NiBackend;
+#endif
+
+// Backend serving a device, or NULL if no backend does
+static inline DaqBackend *daqBackendFor(const char *lpDevice)
+{
+    if (daqSimIsDevice(lpDevice))
+    {
+        return &g_SimBackend;
+    }
+    else if (daqReplayIsDevice(lpDevice))
+    {
+        return &g_ReplayBackend;
+    }
+
+#ifndef DAQ_NO_NIDAQMX
+    return &g_NiBackend;
+#else
+    return NULL;
+#endif
+}
+
+static inline DaqSimBackend *daqSimulator()
+{
+    return &g_SimBackend;
+}
+
+static inline DaqReplayBackend *daqReplay()
+{
+    return &g_ReplayBackend;
+}
+
+// Creates a task on the backend serving lpDevice. Every channel
+// added to it must belong to that device.
+static inline int32 daqCreateTask(const char *lpDevice, TaskHandle *phTask)
+{
+    DaqBackend *pBackend = daqBackendFor(lpDevice);
+
+    if (pBackend == NULL)
+    {
+        return DAQmxErrorInvalidDeviceID;
+    }
+
+    DaqTaskRef *pRef = (DaqTaskRef*) malloc(sizeof(DaqTaskRef));
+
+    if (pRef == NULL)
+    {
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    int32 nResult = pBackend->CreateTask(lpDevice, &pRef->hTask);
+
+    if (nResult < 0)
+    {
+        free(pRef);
+        return nResult;
+    }
+
+    pRef->pBackend = pBackend;
+    *phTask = (TaskHandle) pRef;
+
+    return nResult;
+}
+
+#define DAQ_TASK(hTask) ((DaqTaskRef*) (hTask))
+
+static inline int32 daqCreateAIVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName, int32 nTerminal,
+                                           float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+{
+    return DAQ_TASK(hTask)->pBackend->CreateAIVoltageChan(DAQ_TASK(hTask)->hTask, lpChannel, lpName, nTerminal, fMin, fMax, nUnits, lpScale);
+}
+
+static inline int32 daqCreateAOVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName,
+                                           float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+{
+    return DAQ_TASK(hTask)->pBackend->CreateAOVoltageChan(DAQ_TASK(hTask)->hTask, lpChannel, lpName, fMin, fMax, nUnits, lpScale);
+}
+
+static inline int32 daqCfgSampClkTiming(TaskHandle hTask, const char *lpSource, float64 fRate, int32 nEdge, int32 nSampleMode, uInt64 nSamples)
+{
+    return DAQ_TASK(hTask)->pBackend->CfgSampClkTiming(DAQ_TASK(hTask)->hTask, lpSource, fRate, nEdge, nSampleMode, nSamples);
+}
+
+static inline int32 daqCfgInputBuffer(TaskHandle hTask, uInt32 nSamples)
+{
+    return DAQ_TASK(hTask)->pBackend->CfgInputBuffer(DAQ_TASK(hTask)->hTask, nSamples);
+}
+
+static inline int32 daqCfgDigEdgeStartTrig(TaskHandle hTask, const char *lpSource, int32 nEdge)
+{
+    return DAQ_TASK(hTask)->pBackend->CfgDigEdgeStartTrig(DAQ_TASK(hTask)->hTask, lpSource, nEdge);
+}
+
+static inline int32 daqTaskControl(TaskHandle hTask, int32 nAction)
+{
+    return DAQ_TASK(hTask)->pBackend->TaskControl(DAQ_TASK(hTask)->hTask, nAction);
+}
+
+static inline int32 daqStartTask(TaskHandle hTask)
+{
+    return DAQ_TASK(hTask)->pBackend->StartTask(DAQ_TASK(hTask)->hTask);
+}
+
+static inline int32 daqStopTask(TaskHandle hTask)
+{
+    return DAQ_TASK(hTask)->pBackend->StopTask(DAQ_TASK(hTask)->hTask);
+}
+
+// Clears the task and releases the handle, which must not be used
+// afterwards
+static inline int32 daqClearTask(TaskHandle hTask)
+{
+    if (hTask == NULL)
+    {
+        return 0;
+    }
+
+    int32 nResult = DAQ_TASK(hTask)->pBackend->ClearTask(DAQ_TASK(hTask)->hTask);
+    free(DAQ_TASK(hTask));
+
+    return nResult;
+}
+
+static inline int32 daqGetTaskNumChans(TaskHandle hTask, uInt32 *pnChannels)
+{
+    return DAQ_TASK(hTask)->pBackend->GetTaskNumChans(DAQ_TASK(hTask)->hTask, pnChannels);
+}
+
+static inline int32 daqGetTaskChannels(TaskHandle hTask, char *lpData, uInt32 nSize)
+{
+    return DAQ_TASK(hTask)->pBackend->GetTaskChannels(DAQ_TASK(hTask)->hTask, lpData, nSize);
+}
+
+static inline int32 daqGetNthTaskChannel(TaskHandle hTask, uInt32 nIndex, char *lpData, int32 nSize)
+{
+    return DAQ_TASK(hTask)->pBackend->GetNthTaskChannel(DAQ_TASK(hTask)->hTask, nIndex, lpData, nSize);
+}
+
+static inline int32 daqReadAnalogF64(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode,
+                                     float64 *lpData, uInt32 nSize, int32 *pnRead, bool32 *pReserved)
+{
+    return DAQ_TASK(hTask)->pBackend->ReadAnalogF64(DAQ_TASK(hTask)->hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead);
+}
+
+static inline int32 daqReadBinaryI16(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode,
+                                     int16 *lpData, uInt32 nSize, int32 *pnRead, bool32 *pReserved)
+{
+    return DAQ_TASK(hTask)->pBackend->ReadBinaryI16(DAQ_TASK(hTask)->hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead);
+}
+
+static inline int32 daqWriteAnalogF64(TaskHandle hTask, int32 nSamples, bool32 bAutoStart, float64 fTimeout, bool32 nLayout,
+                                      const float64 *lpData, int32 *pnWritten, bool32 *pReserved)
+{
+    return DAQ_TASK(hTask)->pBackend->WriteAnalogF64(DAQ_TASK(hTask)->hTask, nSamples, bAutoStart, fTimeout, nLayout, lpData, pnWritten);
+}
+
+// Waits for the next tick of a hardware-timed single-point task.
+// *pbLate is set when one or more ticks were missed.
+static inline int32 daqWaitForNextSampleClock(TaskHandle hTask, float64 fTimeout, bool32 *pbLate)
+{
+    return DAQ_TASK(hTask)->pBackend->WaitForNextSampleClock(DAQ_TASK(hTask)->hTask, fTimeout, pbLate);
+}
+
+static inline int32 daqGetAIDevScalingCoeff(TaskHandle hTask, const char *lpChannel, float64 *lpData, uInt32 nSize)
+{
+    return DAQ_TASK(hTask)->pBackend->GetAIDevScalingCoeff(DAQ_TASK(hTask)->hTask, lpChannel, lpData, nSize);
+}
+
+// Bits of the converter behind a channel of a task
+static inline int32 daqGetAIResolution(TaskHandle hTask, const char *lpChannel, float64 *pfBits)
+{
+    return DAQ_TASK(hTask)->pBackend->GetAIResolution(DAQ_TASK(hTask)->hTask, lpChannel, pfBits);
+}
+
+// Device properties are routed by device name
+#define DAQ_DEVICE_CALL(lpDevice, Call) \
+    DaqBackend *pBackend = daqBackendFor(lpDevice); \
+    return (pBackend == NULL) ? DAQmxErrorInvalidDeviceID : pBackend->Call
+
+static inline int32 daqGetDevProductType(const char *lpDevice, char *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevProductType(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAIPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAIPhysicalChans(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAOPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAOPhysicalChans(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAISupportedMeasTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAISupportedMeasTypes(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAOSupportedOutputTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAOSupportedOutputTypes(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAISampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAISampModes(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAOSampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAOSampModes(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAIVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAIVoltageRngs(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAOVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) { DAQ_DEVICE_CALL(lpDevice, GetDevAOVoltageRngs(lpDevice, lpData, nSize)); }
+static inline int32 daqGetDevAIMaxSingleChanRate(const char *lpDevice, float64 *pfRate) { DAQ_DEVICE_CALL(lpDevice, GetDevAIMaxSingleChanRate(lpDevice, pfRate)); }
+static inline int32 daqGetDevAIMaxMultiChanRate(const char *lpDevice, float64 *pfRate) { DAQ_DEVICE_CALL(lpDevice, GetDevAIMaxMultiChanRate(lpDevice, pfRate)); }
+static inline int32 daqGetDevAIMinRate(const char *lpDevice, float64 *pfRate) { DAQ_DEVICE_CALL(lpDevice, GetDevAIMinRate(lpDevice, pfRate)); }
+static inline int32 daqGetDevAISimultaneousSamplingSupported(const char *lpDevice, bool32 *pbValue) { DAQ_DEVICE_CALL(lpDevice, GetDevAISimultaneousSamplingSupported(lpDevice, pbValue)); }
+static inline int32 daqGetDevAOSampClkSupported(const char *lpDevice, bool32 *pbValue) { DAQ_DEVICE_CALL(lpDevice, GetDevAOSampClkSupported(lpDevice, pbValue)); }
+static inline int32 daqGetDevAOMaxRate(const char *lpDevice, float64 *pfRate) { DAQ_DEVICE_CALL(lpDevice, GetDevAOMaxRate(lpDevice, pfRate)); }
+static inline int32 daqGetDevAOMinRate(const char *lpDevice, float64 *pfRate) { DAQ_DEVICE_CALL(lpDevice, GetDevAOMinRate(lpDevice, pfRate)); }
+
+// Names of the installed devices. The simulated devices are not
+// listed when the real driver is available.
+static inline int32 daqGetSysDevNames(char *lpData, uInt32 nSize)
+{
+#ifndef DAQ_NO_NIDAQMX
+    return DAQmxGetSysDevNames(lpData, nSize);
+#else
+    return daqSimCopyString(DAQ_SIM_DEVICE_NAMES, lpData, nSize);
+#endif
+}
+
+static inline int32 daqGetErrorString(int32 nError, char *lpData, uInt32 nSize)
+{
+#ifndef DAQ_NO_NIDAQMX
+    return DAQmxGetErrorString(nError, lpData, nSize);
+#else
+    const char *lpMessage;
+
+    switch (nError)
+    {
+        case DAQmxErrorInvalidAttributeValue:
+            lpMessage = "Requested value is not a supported value for this property";
+            break;
+        case DAQmxErrorInvalidTask:
+            lpMessage = "Task specified is invalid or does not exist";
+            break;
+        case DAQmxErrorPhysicalChanDoesNotExist:
+            lpMessage = "Physical channel specified does not exist on this device";
+            break;
+        case DAQmxErrorInvalidDeviceID:
+            lpMessage = "Device identifier is invalid";
+            break;
+        case DAQmxErrorBufferTooSmallForString:
+            lpMessage = "Buffer is too small to fit the string";
+            break;
+        case DAQmxErrorSamplesNoLongerAvailable:
+            lpMessage = "The application is not able to keep up with the hardware acquisition";
+            break;
+        case DAQmxErrorSamplesNotYetAvailable:
+            lpMessage = "Some or all of the samples requested have not yet been acquired";
+            break;
+        case DAQmxErrorPALMemoryFull:
+            lpMessage = "Not enough memory to complete the operation";
+            break;
+        default:
+            lpMessage = "Unknown error";
+            break;
+    }
+
+    return daqSimCopyString(lpMessage, lpData, nSize);
+#endif
+}
+
+#endif
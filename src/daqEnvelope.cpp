@@ -0,0 +1,274 @@
+/*************************************************************/
+// daqEnvelope.cpp
+//
+// Builds and queries the min/max envelope of a long capture, to plot
+// any range of it with a cost that depends on the width of the plot
+// instead of the number of samples
+//
+//                       ------ ARGUMENTS ------
+//
+// [Envelope (e)] = daqEnvelope(Data (f))
+// [X (f), Y (f)] = daqEnvelope(Envelope (e), Data (f), First (n), Last (n), Pixels (n))
+//
+// - e denotes an envelope structure
+// - f denotes a real matrix, double or int16
+// - n denotes a natural value
+//
+//            - Data: the capture, as returned by daqAdquireData. A row
+//                    vector for a single channel or a matrix with one
+//                    column per channel
+//
+//        - Envelope: the minimum and maximum of every bucket of 16, 256,
+//                    4096... samples of each channel. Min{k} and Max{k}
+//                    hold the level of 16^k samples per bucket, one row
+//                    per bucket and one column per channel. Length and
+//                    Channels describe the capture it was built from.
+//                    daqAdquireData also returns it with the 'Envelope'
+//                    option, built while adquiring
+//
+//     - First, Last: range of samples to draw, from 1
+//
+//          - Pixels: width of the plot. When the range holds fewer than
+//                    16 samples per pixel, the samples themselves are
+//                    returned
+//
+//            - X, Y: two points per pixel, at its first sample, with the
+//                    minimum and the maximum of the samples it covers.
+//                    Y has one column per channel. plot(X, Y) draws the
+//                    same picture as plotting every sample of the range
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqEnvelope.h"
+
+// Creates an envelope structure of nSamples samples of nChannels
+// channels, with the levels left in lpMin and lpMax for the builder
+mxArray *createEnvelope(uInt64 nSamples, uInt32 nChannels, mxClassID nClass, void **lpMin, void **lpMax)
+{
+    const char *lpFields[] = {"Length", "Channels", "Factor", "Min", "Max"};
+    int nLevels = daqEnvelopeLevels(nSamples);
+    mxArray *pEnvelope = mxCreateStructMatrix(1, 1, 5, lpFields);
+    mxArray *pMin = mxCreateCellMatrix(nLevels, 1);
+    mxArray *pMax = mxCreateCellMatrix(nLevels, 1);
+    
+    for (int k = 0; k < nLevels; k++)
+    {
+        mwSize nBuckets = (mwSize) daqEnvelopeBuckets(nSamples, k);
+        mxArray *pLevelMin = mxCreateNumericMatrix(nBuckets, nChannels, nClass, mxREAL);
+        mxArray *pLevelMax = mxCreateNumericMatrix(nBuckets, nChannels, nClass, mxREAL);
+        
+        lpMin[k] = mxGetData(pLevelMin);
+        lpMax[k] = mxGetData(pLevelMax);
+        mxSetCell(pMin, k, pLevelMin);
+        mxSetCell(pMax, k, pLevelMax);
+    }
+    
+    mxSetField(pEnvelope, 0, "Length", mxCreateDoubleScalar((double) nSamples));
+    mxSetField(pEnvelope, 0, "Channels", mxCreateDoubleScalar(nChannels));
+    mxSetField(pEnvelope, 0, "Factor", mxCreateDoubleScalar(DAQ_ENVELOPE_FACTOR));
+    mxSetField(pEnvelope, 0, "Min", pMin);
+    mxSetField(pEnvelope, 0, "Max", pMax);
+    
+    return pEnvelope;
+}
+
+template <typename T>
+mxArray *buildEnvelope(const mxArray *pData, uInt64 nSamples, uInt32 nChannels)
+{
+    void *lpMin[DAQ_ENVELOPE_MAX_LEVELS], *lpMax[DAQ_ENVELOPE_MAX_LEVELS];
+    mxArray *pEnvelope = createEnvelope(nSamples, nChannels, mxGetClassID(pData), lpMin, lpMax);
+    const T *lpData = (const T*) mxGetData(pData);
+    DaqEnvelope<T> Envelope;
+    
+    if (!Envelope.Init(nChannels, nSamples, (T**) lpMin, (T**) lpMax))
+    {
+        mxDestroyArray(pEnvelope);
+        mexErrMsgTxt("Not enough memory to build the envelope.");
+    }
+    
+    for (uInt32 i = 0; i < nChannels; i++)
+    {
+        Envelope.Process(i, lpData + (size_t) i * nSamples, (size_t) nSamples);
+    }
+    
+    return pEnvelope;
+}
+
+// Returns the value of a field of the envelope, checking it exists
+const mxArray *getField(const mxArray *pEnvelope, const char *lpName)
+{
+    const mxArray *pField = mxGetField(pEnvelope, 0, lpName);
+    
+    if (pField == NULL)
+    {
+        mexErrMsgTxt("Input argument 1 must be an envelope built by daqEnvelope or daqAdquireData.");
+    }
+    
+    return pField;
+}
+
+// Returns a natural scalar argument
+uInt64 getNatural(const mxArray *pValue, int nArgument)
+{
+    char lpOutput[64];
+    
+    if (!mxIsNumeric(pValue) || mxGetNumberOfElements(pValue) != 1 || mxGetScalar(pValue) < 1 ||
+        mxGetScalar(pValue) != (double) (uInt64) mxGetScalar(pValue))
+    {
+        sprintf(lpOutput, "Input argument %d must be a natural value.", nArgument);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return (uInt64) mxGetScalar(pValue);
+}
+
+template <typename T>
+void drawEnvelope(mxArray *plhs[], const mxArray *pEnvelope, const mxArray *pData, uInt64 nSamples, uInt32 nChannels,
+                  uInt64 nFirst, uInt64 nSpan, size_t nPixels)
+{
+    const mxArray *pMin = getField(pEnvelope, "Min");
+    const mxArray *pMax = getField(pEnvelope, "Max");
+    int nLevels = daqEnvelopeLevels(nSamples);
+    int nLevel = daqEnvelopeLevel(nSpan, nPixels, nLevels);
+    const T *lpData = (const T*) mxGetData(pData);
+    
+    // Zoomed in: every sample is a point of its own
+    if (nLevel < 0)
+    {
+        plhs[0] = mxCreateDoubleMatrix((mwSize) nSpan, 1, mxREAL);
+        plhs[1] = mxCreateNumericMatrix((mwSize) nSpan, nChannels, mxGetClassID(pData), mxREAL);
+        
+        double *ptrX = mxGetPr(plhs[0]);
+        T *ptrY = (T*) mxGetData(plhs[1]);
+        
+        for (uInt64 i = 0; i < nSpan; i++)
+        {
+            ptrX[i] = (double) (nFirst + i + 1);
+        }
+        
+        for (uInt32 c = 0; c < nChannels; c++)
+        {
+            memcpy(ptrY + (size_t) c * nSpan, lpData + (size_t) c * nSamples + nFirst, (size_t) nSpan * sizeof(T));
+        }
+        
+        return;
+    }
+    
+    const mxArray *pLevelMin = mxIsCell(pMin) && mxGetNumberOfElements(pMin) == (size_t) nLevels ? mxGetCell(pMin, nLevel) : NULL;
+    const mxArray *pLevelMax = mxIsCell(pMax) && mxGetNumberOfElements(pMax) == (size_t) nLevels ? mxGetCell(pMax, nLevel) : NULL;
+    size_t nBuckets = (size_t) daqEnvelopeBuckets(nSamples, nLevel);
+    
+    if (pLevelMin == NULL || pLevelMax == NULL || mxGetClassID(pLevelMin) != mxGetClassID(pData) ||
+        mxGetClassID(pLevelMax) != mxGetClassID(pData) || mxGetM(pLevelMin) != nBuckets || mxGetM(pLevelMax) != nBuckets ||
+        mxGetN(pLevelMin) != nChannels || mxGetN(pLevelMax) != nChannels)
+    {
+        mexErrMsgTxt("The envelope does not match the data.");
+    }
+    
+    const T *lpMin = (const T*) mxGetData(pLevelMin);
+    const T *lpMax = (const T*) mxGetData(pLevelMax);
+    
+    plhs[0] = mxCreateDoubleMatrix(2 * nPixels, 1, mxREAL);
+    plhs[1] = mxCreateNumericMatrix(2 * nPixels, nChannels, mxGetClassID(pData), mxREAL);
+    
+    double *ptrX = mxGetPr(plhs[0]);
+    T *ptrY = (T*) mxGetData(plhs[1]);
+    
+    for (uInt32 c = 0; c < nChannels; c++)
+    {
+        daqEnvelopeDraw(lpMin + c * nBuckets, lpMax + c * nBuckets, nLevel, nFirst, nSpan, nPixels,
+                        (c == 0) ? ptrX : NULL, ptrY + 2 * nPixels * c);
+    }
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    const mxArray *pData = (nrhs == 1) ? prhs[0] : (nrhs == 5) ? prhs[1] : NULL;
+    int nData = (nrhs == 1) ? 1 : 2;
+    char lpOutput[64];
+    
+    if (pData == NULL)
+    {
+        mexErrMsgTxt("One or five inputs required.");
+    }
+    else if (nlhs > ((nrhs == 1) ? 1 : 2))
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if ((!mxIsDouble(pData) && mxGetClassID(pData) != mxINT16_CLASS) || mxIsComplex(pData) || mxIsEmpty(pData))
+    {
+        sprintf(lpOutput, "Input argument %d must be a real double or int16 matrix.", nData);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    size_t nRows = mxGetM(pData), nCols = mxGetN(pData);
+    
+    // A single channel comes as a row vector
+    uInt32 nChannels = (uInt32) ((nRows == 1) ? 1 : nCols);
+    uInt64 nSamples = (nRows == 1) ? nCols : nRows;
+    
+    if (nrhs == 1)
+    {
+        if (mxIsDouble(pData))
+        {
+            plhs[0] = buildEnvelope<float64>(pData, nSamples, nChannels);
+        }
+        else
+        {
+            plhs[0] = buildEnvelope<int16>(pData, nSamples, nChannels);
+        }
+        
+        return;
+    }
+    
+    if (!mxIsStruct(prhs[0]) || mxGetNumberOfElements(prhs[0]) != 1)
+    {
+        mexErrMsgTxt("Input argument 1 must be an envelope built by daqEnvelope or daqAdquireData.");
+    }
+    
+    if (mxGetScalar(getField(prhs[0], "Length")) != (double) nSamples ||
+        mxGetScalar(getField(prhs[0], "Channels")) != (double) nChannels ||
+        mxGetScalar(getField(prhs[0], "Factor")) != DAQ_ENVELOPE_FACTOR)
+    {
+        mexErrMsgTxt("The envelope does not match the data.");
+    }
+    
+    uInt64 nFirst = getNatural(prhs[2], 3);
+    uInt64 nLast = getNatural(prhs[3], 4);
+    size_t nPixels = (size_t) getNatural(prhs[4], 5);
+    
+    if (nFirst > nLast || nLast > nSamples)
+    {
+        mexErrMsgTxt("The range must be within the data.");
+    }
+    
+    // Never more pixels than samples to draw
+    uInt64 nSpan = nLast - nFirst + 1;
+    nPixels = (nPixels > nSpan) ? (size_t) nSpan : nPixels;
+    
+    if (mxIsDouble(pData))
+    {
+        drawEnvelope<float64>(plhs, prhs[0], pData, nSamples, nChannels, nFirst - 1, nSpan, nPixels);
+    }
+    else
+    {
+        drawEnvelope<int16>(plhs, prhs[0], pData, nSamples, nChannels, nFirst - 1, nSpan, nPixels);
+    }
+    
+    return;
+}
@@ -0,0 +1,243 @@
+/*************************************************************/
+// daqEnvelope.h
+//
+// Min/max envelope pyramid of a capture, used to plot long
+// records. Level k holds the minimum and maximum of every bucket
+// of DAQ_ENVELOPE_FACTOR^(k+1) samples, so drawing a range of a
+// record on a given number of pixels only reads the level whose
+// buckets are just smaller than a pixel: the cost depends on the
+// width of the plot, not on the length of the record.
+//
+// The pyramid is built as the samples come, in chunks of any size.
+// A bucket cut by a chunk is updated again by the next one, which
+// min and max allow.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQENVELOPE_H
+#define DAQENVELOPE_H
+
+#include <stdlib.h>
+
+// Samples in a bucket of the first level, and buckets of a level in
+// one of the next
+#define DAQ_ENVELOPE_FACTOR 16
+
+// Most levels a pyramid has, enough for 16^16 samples
+#define DAQ_ENVELOPE_MAX_LEVELS 16
+
+// Samples in a bucket of level nLevel
+static inline unsigned long long daqEnvelopeBucket(int nLevel)
+{
+    unsigned long long nBucket = DAQ_ENVELOPE_FACTOR;
+
+    for (int i = 0; i < nLevel; i++)
+    {
+        nBucket *= DAQ_ENVELOPE_FACTOR;
+    }
+
+    return nBucket;
+}
+
+// Buckets of level nLevel for nSamples samples
+static inline unsigned long long daqEnvelopeBuckets(unsigned long long nSamples, int nLevel)
+{
+    unsigned long long nBucket = daqEnvelopeBucket(nLevel);
+
+    return (nSamples + nBucket - 1) / nBucket;
+}
+
+// Levels of the pyramid of nSamples samples: up to the first with a
+// single bucket
+static inline int daqEnvelopeLevels(unsigned long long nSamples)
+{
+    int nLevels = 1;
+
+    while (nLevels < DAQ_ENVELOPE_MAX_LEVELS && daqEnvelopeBuckets(nSamples, nLevels - 1) > 1)
+    {
+        nLevels++;
+    }
+
+    return nLevels;
+}
+
+// Level that draws nSpan samples on nPixels pixels: the coarsest one
+// whose buckets fit in a pixel, or -1 if the samples themselves
+// should be drawn
+static inline int daqEnvelopeLevel(unsigned long long nSpan, size_t nPixels, int nLevels)
+{
+    int nLevel = -1;
+
+    while (nLevel + 1 < nLevels && daqEnvelopeBucket(nLevel + 1) * nPixels <= nSpan)
+    {
+        nLevel++;
+    }
+
+    return nLevel;
+}
+
+// Minimum and maximum of the n > 0 elements of lpMin and lpMax
+template <typename T>
+static inline void daqEnvelopeReduce(const T *lpMin, const T *lpMax, size_t n, T *pMin, T *pMax)
+{
+    T nMin = lpMin[0], nMax = lpMax[0];
+
+    for (size_t i = 1; i < n; i++)
+    {
+        nMin = (lpMin[i] < nMin) ? lpMin[i] : nMin;
+        nMax = (lpMax[i] > nMax) ? lpMax[i] : nMax;
+    }
+
+    *pMin = nMin;
+    *pMax = nMax;
+}
+
+template <typename T>
+class DaqEnvelope
+{
+public:
+    DaqEnvelope() : m_lpPosition(NULL), m_nChannels(0), m_nSamples(0), m_nLevels(0)
+    {
+    }
+
+    ~DaqEnvelope()
+    {
+        Free();
+    }
+
+    // Prepares the pyramid of nSamples samples of nChannels channels.
+    // Level k is written to lpMin[k] and lpMax[k], column-major
+    // matrices of daqEnvelopeBuckets(nSamples, k) rows and one column
+    // per channel, which the caller owns.
+    bool Init(uInt32 nChannels, unsigned long long nSamples, T **lpMin, T **lpMax)
+    {
+        Free();
+
+        m_nChannels = nChannels;
+        m_nSamples = nSamples;
+        m_nLevels = daqEnvelopeLevels(nSamples);
+        m_lpPosition = (unsigned long long*) calloc(nChannels, sizeof(unsigned long long));
+
+        for (int k = 0; k < m_nLevels; k++)
+        {
+            m_lpMin[k] = lpMin[k];
+            m_lpMax[k] = lpMax[k];
+        }
+
+        return m_lpPosition != NULL;
+    }
+
+    // Adds the next n samples of a channel
+    void Process(uInt32 nChannel, const T *lpIn, size_t n)
+    {
+        unsigned long long nFirst = m_lpPosition[nChannel];
+
+        if (n > m_nSamples - nFirst)
+        {
+            n = (size_t) (m_nSamples - nFirst);
+        }
+
+        if (n == 0)
+        {
+            return;
+        }
+
+        unsigned long long nLast = nFirst + n - 1;
+        unsigned long long nBelow = 1;
+
+        for (int k = 0; k < m_nLevels; k++)
+        {
+            unsigned long long nBucket = nBelow * DAQ_ENVELOPE_FACTOR;
+            unsigned long long nRows = daqEnvelopeBuckets(m_nSamples, k);
+            T *lpMin = m_lpMin[k] + nChannel * nRows;
+            T *lpMax = m_lpMax[k] + nChannel * nRows;
+
+            // The elements of the level below touched by this chunk:
+            // samples for the first level, buckets for the others. The
+            // chunk itself starts at nLow, the levels at 0.
+            unsigned long long nLow = nFirst / nBelow, nHigh = nLast / nBelow;
+            unsigned long long nBase = (k == 0) ? nLow : 0;
+            const T *lpBelowMin = (k == 0) ? lpIn : m_lpMin[k - 1] + nChannel * daqEnvelopeBuckets(m_nSamples, k - 1);
+            const T *lpBelowMax = (k == 0) ? lpIn : m_lpMax[k - 1] + nChannel * daqEnvelopeBuckets(m_nSamples, k - 1);
+
+            for (unsigned long long b = nFirst / nBucket; b <= nLast / nBucket; b++)
+            {
+                unsigned long long nFrom = b * DAQ_ENVELOPE_FACTOR, nTo = nFrom + DAQ_ENVELOPE_FACTOR;
+                T nMin, nMax;
+
+                nFrom = (nFrom < nLow) ? nLow : nFrom;
+                nTo = (nTo > nHigh + 1) ? nHigh + 1 : nTo;
+                daqEnvelopeReduce(lpBelowMin + (nFrom - nBase), lpBelowMax + (nFrom - nBase), (size_t) (nTo - nFrom), &nMin, &nMax);
+
+                // A bucket starting before the chunk already has a value
+                if (b * nBucket < nFirst)
+                {
+                    nMin = (lpMin[b] < nMin) ? lpMin[b] : nMin;
+                    nMax = (lpMax[b] > nMax) ? lpMax[b] : nMax;
+                }
+
+                lpMin[b] = nMin;
+                lpMax[b] = nMax;
+            }
+
+            nBelow = nBucket;
+        }
+
+        m_lpPosition[nChannel] = nLast + 1;
+    }
+
+    void Free()
+    {
+        free(m_lpPosition);
+        m_lpPosition = NULL;
+    }
+
+private:
+    T *m_lpMin[DAQ_ENVELOPE_MAX_LEVELS];
+    T *m_lpMax[DAQ_ENVELOPE_MAX_LEVELS];
+    unsigned long long *m_lpPosition;
+    uInt32 m_nChannels;
+    unsigned long long m_nSamples;
+    int m_nLevels;
+};
+
+// Draws samples nFirst to nFirst + nSpan - 1 (from 0) of one channel
+// on nPixels pixels from level nLevel, whose buckets are lpMin and
+// lpMax. Pixel p gets the minimum and maximum of the buckets it
+// overlaps in lpY[2p] and lpY[2p + 1], and its first sample, from 1,
+// in lpX[2p] and lpX[2p + 1].
+template <typename T>
+static inline void daqEnvelopeDraw(const T *lpMin, const T *lpMax, int nLevel, unsigned long long nFirst,
+                                   unsigned long long nSpan, size_t nPixels, double *lpX, T *lpY)
+{
+    unsigned long long nBucket = daqEnvelopeBucket(nLevel);
+
+    for (size_t p = 0; p < nPixels; p++)
+    {
+        unsigned long long nFrom = nFirst + nSpan * p / nPixels;
+        unsigned long long nTo = nFirst + nSpan * (p + 1) / nPixels;
+        unsigned long long nLow = nFrom / nBucket, nHigh = (nTo - 1) / nBucket;
+
+        daqEnvelopeReduce(lpMin + nLow, lpMax + nLow, (size_t) (nHigh - nLow + 1), lpY + 2 * p, lpY + 2 * p + 1);
+
+        if (lpX != NULL)
+        {
+            lpX[2 * p] = (double) (nFrom + 1);
+            lpX[2 * p + 1] = (double) (nFrom + 1);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,364 @@
+/*************************************************************/
+// daqFft.h
+//
+// Self-contained radix-2 FFT used by the native spectrum and
+// correlation stages. Data is kept as separate real and imaginary
+// arrays and every stage has its twiddle factors stored
+// contiguously, so the butterflies of a stage are unit-stride loops
+// that run four at a time with AVX and two at a time with SSE2. The
+// first two stages, which need no multiplications, are done together
+// as one radix-4 pass.
+//
+// Real signals of N samples are transformed with one complex FFT
+// of N/2 points, which halves the work.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQFFT_H
+#define DAQFFT_H
+
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#define DAQ_PI 3.14159265358979323846
+
+static inline bool daqIsPowerOfTwo(size_t n)
+{
+    return n >= 2 && (n & (n - 1)) == 0;
+}
+
+// Butterflies between the nSpan points at lpRe0, lpIm0 and the nSpan
+// points at lpRe1, lpIm1, the latter turned by the twiddle factors
+// in lpCos and lpSin
+static inline void daqFftButterflies(double *lpRe0, double *lpIm0, double *lpRe1, double *lpIm1, const double *lpCos,
+                                     const double *lpSin, size_t nSpan)
+{
+    size_t j = 0;
+
+#if defined(__AVX__)
+    for (; j + 4 <= nSpan; j += 4)
+    {
+        __m256d fCos = _mm256_loadu_pd(lpCos + j), fSin = _mm256_loadu_pd(lpSin + j);
+        __m256d fRe1 = _mm256_loadu_pd(lpRe1 + j), fIm1 = _mm256_loadu_pd(lpIm1 + j);
+        __m256d fRe0 = _mm256_loadu_pd(lpRe0 + j), fIm0 = _mm256_loadu_pd(lpIm0 + j);
+        __m256d fRe = _mm256_sub_pd(_mm256_mul_pd(fRe1, fCos), _mm256_mul_pd(fIm1, fSin));
+        __m256d fIm = _mm256_add_pd(_mm256_mul_pd(fRe1, fSin), _mm256_mul_pd(fIm1, fCos));
+
+        _mm256_storeu_pd(lpRe1 + j, _mm256_sub_pd(fRe0, fRe));
+        _mm256_storeu_pd(lpIm1 + j, _mm256_sub_pd(fIm0, fIm));
+        _mm256_storeu_pd(lpRe0 + j, _mm256_add_pd(fRe0, fRe));
+        _mm256_storeu_pd(lpIm0 + j, _mm256_add_pd(fIm0, fIm));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; j + 2 <= nSpan; j += 2)
+    {
+        __m128d fCos = _mm_loadu_pd(lpCos + j), fSin = _mm_loadu_pd(lpSin + j);
+        __m128d fRe1 = _mm_loadu_pd(lpRe1 + j), fIm1 = _mm_loadu_pd(lpIm1 + j);
+        __m128d fRe0 = _mm_loadu_pd(lpRe0 + j), fIm0 = _mm_loadu_pd(lpIm0 + j);
+        __m128d fRe = _mm_sub_pd(_mm_mul_pd(fRe1, fCos), _mm_mul_pd(fIm1, fSin));
+        __m128d fIm = _mm_add_pd(_mm_mul_pd(fRe1, fSin), _mm_mul_pd(fIm1, fCos));
+
+        _mm_storeu_pd(lpRe1 + j, _mm_sub_pd(fRe0, fRe));
+        _mm_storeu_pd(lpIm1 + j, _mm_sub_pd(fIm0, fIm));
+        _mm_storeu_pd(lpRe0 + j, _mm_add_pd(fRe0, fRe));
+        _mm_storeu_pd(lpIm0 + j, _mm_add_pd(fIm0, fIm));
+    }
+#endif
+
+    for (; j < nSpan; j++)
+    {
+        double fRe = lpRe1[j] * lpCos[j] - lpIm1[j] * lpSin[j];
+        double fIm = lpRe1[j] * lpSin[j] + lpIm1[j] * lpCos[j];
+
+        lpRe1[j] = lpRe0[j] - fRe;
+        lpIm1[j] = lpIm0[j] - fIm;
+        lpRe0[j] += fRe;
+        lpIm0[j] += fIm;
+    }
+}
+
+class DaqFft
+{
+public:
+    DaqFft() : m_nSize(0), m_nHalf(0), m_lpReverse(NULL), m_lpStageCos(NULL), m_lpStageSin(NULL),
+               m_lpRealCos(NULL), m_lpRealSin(NULL)
+    {
+    }
+
+    ~DaqFft()
+    {
+        Free();
+    }
+
+    // Prepares transforms of nSize real points, or nSize / 2
+    // complex points. nSize must be a power of two, at least 4.
+    bool Init(size_t nSize)
+    {
+        Free();
+
+        if (!daqIsPowerOfTwo(nSize) || nSize < 4)
+        {
+            return false;
+        }
+
+        m_nSize = nSize;
+        m_nHalf = nSize / 2;
+
+        m_lpReverse = (size_t*) malloc(m_nHalf * sizeof(size_t));
+        m_lpStageCos = (double*) malloc(m_nHalf * sizeof(double));
+        m_lpStageSin = (double*) malloc(m_nHalf * sizeof(double));
+        m_lpRealCos = (double*) malloc((m_nHalf + 1) * sizeof(double));
+        m_lpRealSin = (double*) malloc((m_nHalf + 1) * sizeof(double));
+
+        if (m_lpReverse == NULL || m_lpStageCos == NULL || m_lpStageSin == NULL || m_lpRealCos == NULL || m_lpRealSin == NULL)
+        {
+            Free();
+            return false;
+        }
+
+        int nBits = 0;
+
+        while (((size_t) 1 << nBits) < m_nHalf)
+        {
+            nBits++;
+        }
+
+        for (size_t i = 0; i < m_nHalf; i++)
+        {
+            size_t nReversed = 0;
+
+            for (int b = 0; b < nBits; b++)
+            {
+                nReversed |= ((i >> b) & 1) << (nBits - 1 - b);
+            }
+
+            m_lpReverse[i] = nReversed;
+        }
+
+        // Stage with butterflies of span nSpan uses the factors at
+        // [nSpan - 1, 2 * nSpan - 1)
+        for (size_t nSpan = 1; nSpan < m_nHalf; nSpan *= 2)
+        {
+            for (size_t j = 0; j < nSpan; j++)
+            {
+                m_lpStageCos[nSpan - 1 + j] = cos(DAQ_PI * j / nSpan);
+                m_lpStageSin[nSpan - 1 + j] = -sin(DAQ_PI * j / nSpan);
+            }
+        }
+
+        for (size_t k = 0; k <= m_nHalf; k++)
+        {
+            m_lpRealCos[k] = cos(2 * DAQ_PI * k / nSize);
+            m_lpRealSin[k] = -sin(2 * DAQ_PI * k / nSize);
+        }
+
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return m_nSize;
+    }
+
+    // Forward transform of Size() / 2 complex points, in place
+    void Complex(double *lpRe, double *lpIm) const
+    {
+        size_t n = m_nHalf;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t j = m_lpReverse[i];
+
+            if (j > i)
+            {
+                double fRe = lpRe[i], fIm = lpIm[i];
+
+                lpRe[i] = lpRe[j];
+                lpIm[i] = lpIm[j];
+                lpRe[j] = fRe;
+                lpIm[j] = fIm;
+            }
+        }
+
+        size_t nSpan = 1;
+
+        // Spans 1 and 2 have the twiddle factors 1 and -i, and are too
+        // short for the vector loops
+        if (n >= 4)
+        {
+            for (size_t nBase = 0; nBase < n; nBase += 4)
+            {
+                double *lpRe4 = lpRe + nBase, *lpIm4 = lpIm + nBase;
+                double fRe0 = lpRe4[0] + lpRe4[1], fIm0 = lpIm4[0] + lpIm4[1];
+                double fRe1 = lpRe4[0] - lpRe4[1], fIm1 = lpIm4[0] - lpIm4[1];
+                double fRe2 = lpRe4[2] + lpRe4[3], fIm2 = lpIm4[2] + lpIm4[3];
+                double fRe3 = lpRe4[2] - lpRe4[3], fIm3 = lpIm4[2] - lpIm4[3];
+
+                lpRe4[0] = fRe0 + fRe2;
+                lpIm4[0] = fIm0 + fIm2;
+                lpRe4[2] = fRe0 - fRe2;
+                lpIm4[2] = fIm0 - fIm2;
+
+                // Point 3 turned by -i
+                lpRe4[1] = fRe1 + fIm3;
+                lpIm4[1] = fIm1 - fRe3;
+                lpRe4[3] = fRe1 - fIm3;
+                lpIm4[3] = fIm1 + fRe3;
+            }
+
+            nSpan = 4;
+        }
+
+        for (; nSpan < n; nSpan *= 2)
+        {
+            const double *lpCos = m_lpStageCos + nSpan - 1;
+            const double *lpSin = m_lpStageSin + nSpan - 1;
+
+            for (size_t nBase = 0; nBase < n; nBase += 2 * nSpan)
+            {
+                daqFftButterflies(lpRe + nBase, lpIm + nBase, lpRe + nBase + nSpan, lpIm + nBase + nSpan, lpCos, lpSin, nSpan);
+            }
+        }
+    }
+
+    // Forward transform of Size() real points. lpRe and lpIm receive
+    // the Size() / 2 + 1 non-negative frequency bins and must hold
+    // that many elements.
+    void Real(const double *lpIn, double *lpRe, double *lpIm) const
+    {
+        size_t n = m_nHalf;
+
+        // Even samples as the real part, odd ones as the imaginary part
+        for (size_t i = 0; i < n; i++)
+        {
+            lpRe[i] = lpIn[2 * i];
+            lpIm[i] = lpIn[2 * i + 1];
+        }
+
+        Complex(lpRe, lpIm);
+
+        // Split the packed spectrum into the one of the real signal,
+        // working from both ends towards the middle
+        double fRe0 = lpRe[0], fIm0 = lpIm[0];
+
+        lpRe[0] = fRe0 + fIm0;
+        lpIm[0] = 0;
+        lpRe[n] = fRe0 - fIm0;
+        lpIm[n] = 0;
+
+        for (size_t k = 1; k <= n / 2; k++)
+        {
+            size_t m = n - k;
+            double fReK = lpRe[k], fImK = lpIm[k], fReM = lpRe[m], fImM = lpIm[m];
+
+            // Even part E = (Z[k] + conj(Z[m])) / 2, odd part O = (Z[k] - conj(Z[m])) / 2i
+            double fEvenRe = 0.5 * (fReK + fReM), fEvenIm = 0.5 * (fImK - fImM);
+            double fOddRe = 0.5 * (fImK + fImM), fOddIm = -0.5 * (fReK - fReM);
+
+            double fTwRe = fOddRe * m_lpRealCos[k] - fOddIm * m_lpRealSin[k];
+            double fTwIm = fOddRe * m_lpRealSin[k] + fOddIm * m_lpRealCos[k];
+
+            lpRe[k] = fEvenRe + fTwRe;
+            lpIm[k] = fEvenIm + fTwIm;
+
+            // Bin m uses the conjugate relations with k and m swapped
+            double fTwReM = fOddRe * m_lpRealCos[m] + fOddIm * m_lpRealSin[m];
+            double fTwImM = fOddRe * m_lpRealSin[m] - fOddIm * m_lpRealCos[m];
+
+            lpRe[m] = fEvenRe + fTwReM;
+            lpIm[m] = -fEvenIm + fTwImM;
+        }
+    }
+
+    // Inverse of Real: turns the Size() / 2 + 1 bins in lpRe and lpIm,
+    // which are overwritten, back into Size() real samples in lpOut
+    void InverseReal(double *lpRe, double *lpIm, double *lpOut) const
+    {
+        size_t n = m_nHalf;
+
+        // Rebuild the packed spectrum Z[k] = E[k] + i O[k] from both
+        // ends, conjugated so the forward transform inverts it
+        for (size_t k = 0; k <= n / 2; k++)
+        {
+            size_t m = n - k;
+            double fReK = lpRe[k], fImK = lpIm[k], fReM = lpRe[m], fImM = lpIm[m];
+
+            // E = (X[k] + conj(X[m])) / 2, D = (X[k] - conj(X[m])) / 2 and O = D / W^k
+            double fEvenRe = 0.5 * (fReK + fReM), fEvenIm = 0.5 * (fImK - fImM);
+            double fDiffRe = 0.5 * (fReK - fReM), fDiffIm = 0.5 * (fImK + fImM);
+
+            double fOddRe = fDiffRe * m_lpRealCos[k] + fDiffIm * m_lpRealSin[k];
+            double fOddIm = fDiffIm * m_lpRealCos[k] - fDiffRe * m_lpRealSin[k];
+
+            lpRe[k] = fEvenRe - fOddIm;
+            lpIm[k] = -(fEvenIm + fOddRe);
+
+            // Bin m has the conjugate even part and the opposite of
+            // the conjugate difference; bin n is not part of Z
+            if (k > 0 && m > k)
+            {
+                fOddRe = -fDiffRe * m_lpRealCos[m] + fDiffIm * m_lpRealSin[m];
+                fOddIm = fDiffIm * m_lpRealCos[m] + fDiffRe * m_lpRealSin[m];
+
+                lpRe[m] = fEvenRe - fOddIm;
+                lpIm[m] = -(-fEvenIm + fOddRe);
+            }
+        }
+
+        Complex(lpRe, lpIm);
+
+        // z = conj(FFT(conj(Z))) / n holds the even samples in its real
+        // part and the odd ones in its imaginary part
+        double fScale = 1.0 / n;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            lpOut[2 * i] = lpRe[i] * fScale;
+            lpOut[2 * i + 1] = -lpIm[i] * fScale;
+        }
+    }
+
+    void Free()
+    {
+        free(m_lpReverse);
+        free(m_lpStageCos);
+        free(m_lpStageSin);
+        free(m_lpRealCos);
+        free(m_lpRealSin);
+
+        m_lpReverse = NULL;
+        m_lpStageCos = NULL;
+        m_lpStageSin = NULL;
+        m_lpRealCos = NULL;
+        m_lpRealSin = NULL;
+    }
+
+private:
+    size_t m_nSize;
+    size_t m_nHalf;
+    size_t *m_lpReverse;
+    double *m_lpStageCos;
+    double *m_lpStageSin;
+    double *m_lpRealCos;
+    double *m_lpRealSin;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*************************************************************/
+// daqFile.h
+//
+// Recording file format shared by daqAdquireData, which writes
+// it, and daqReadFile, which maps it back into MATLAB.
+//
+// A recording is a header followed by the samples, interleaved
+// by scan (every channel of sample 0, then every channel of
+// sample 1...) in little-endian order. The header is padded to
+// DAQ_FILE_ALIGN bytes so the samples start on a page boundary
+// and any range of scans is one contiguous region of the file.
+//
+//     DaqFileHeader
+//     float64 Scaling[nChannels][nCoeffs]   (lowest order first)
+//     char    Channels[nChannelsLength]     (DAQmx channel list)
+//     padding up to nHeaderSize
+//     samples: float64 volts or int16 raw codes
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQFILE_H
+#define DAQFILE_H
+
+#include <string.h>
+
+#define DAQ_FILE_MAGIC "NIDAQLAB"
+#define DAQ_FILE_VERSION 1
+#define DAQ_FILE_ALIGN 65536
+
+#define DAQ_FILE_FLOAT64 0
+#define DAQ_FILE_INT16 1
+
+struct DaqFileHeader
+{
+    char lpMagic[8];
+    uInt32 nVersion;
+    uInt32 nHeaderSize;
+    uInt32 nChannels;
+    uInt32 nSampleType;
+    uInt64 nSamples;
+    float64 fRate;
+    float64 fRange;
+    uInt32 nCoeffs;
+    uInt32 nChannelsLength;
+};
+
+static inline size_t daqFileSampleSize(uInt32 nSampleType)
+{
+    return (nSampleType == DAQ_FILE_INT16) ? sizeof(int16) : sizeof(float64);
+}
+
+// Size of the header once the scaling and the channel names are
+// appended, rounded up so the samples stay aligned
+static inline uInt32 daqFileHeaderSize(uInt32 nChannels, uInt32 nCoeffs, uInt32 nChannelsLength)
+{
+    size_t nSize = sizeof(DaqFileHeader) + (size_t) nChannels * nCoeffs * sizeof(float64) + nChannelsLength;
+
+    return (uInt32) ((nSize + DAQ_FILE_ALIGN - 1) / DAQ_FILE_ALIGN * DAQ_FILE_ALIGN);
+}
+
+// Checks a header read from disk. nFileSize is used to make sure
+// the variable part fits in the header.
+static inline bool daqFileCheckHeader(const DaqFileHeader *pHeader, unsigned long long nFileSize)
+{
+    if (memcmp(pHeader->lpMagic, DAQ_FILE_MAGIC, 8) != 0 || pHeader->nVersion != DAQ_FILE_VERSION)
+    {
+        return false;
+    }
+
+    if (pHeader->nChannels == 0 || pHeader->nSampleType > DAQ_FILE_INT16 || pHeader->nHeaderSize > nFileSize)
+    {
+        return false;
+    }
+
+    unsigned long long nVariable = (unsigned long long) pHeader->nChannels * pHeader->nCoeffs * sizeof(float64) + pHeader->nChannelsLength;
+
+    return sizeof(DaqFileHeader) + nVariable <= pHeader->nHeaderSize;
+}
+
+// Complete scans held by a recording of nFileSize bytes with a
+// checked header. The count in the header is only written when the
+// recording is closed, so it is 0 in one cut short by a crash, whose
+// scans are then counted from the size of the file.
+static inline uInt64 daqFileScans(const DaqFileHeader *pHeader, unsigned long long nFileSize)
+{
+    uInt64 nScans = (nFileSize - pHeader->nHeaderSize) / (pHeader->nChannels * daqFileSampleSize(pHeader->nSampleType));
+
+    return (pHeader->nSamples != 0 && pHeader->nSamples < nScans) ? pHeader->nSamples : nScans;
+}
+
+#endif
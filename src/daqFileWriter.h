@@ -0,0 +1,353 @@
+/*************************************************************/
+// daqFileWriter.h
+//
+// Asynchronous writer used to record adquisitions to disk. The
+// adquisition side fills fixed-size blocks from a small pool of
+// buffers and queues them; a writer thread stores them in order
+// and hands the buffers back. With three buffers, one is being
+// filled, one written and one is spare to absorb disk hiccups.
+//
+// Nothing in this file may call the MEX API, since the writer
+// runs on its own thread.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQFILEWRITER_H
+#define DAQFILEWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include "daqFile.h"
+#include "daqRead.h"
+
+#define DAQ_WRITER_BUFFERS 3
+
+struct DaqWriterBlock
+{
+    char *lpData;
+    size_t nBytes;
+};
+
+class DaqFileWriter
+{
+public:
+    DaqFileWriter() : m_pFile(NULL), m_nBlockBytes(0), m_bStop(false), m_bFailed(false),
+                      m_nBlocks(0), m_nBytes(0), m_nMaxQueueDepth(0), m_nStalls(0)
+    {
+    }
+
+    ~DaqFileWriter()
+    {
+        Close(NULL);
+    }
+
+    // Creates the file, writes the header and starts the writer
+    // thread. pHeader must already hold everything but the number
+    // of samples, which is written by Close.
+    bool Open(const char *lpPath, const DaqFileHeader *pHeader, const float64 *lpCoeffs, const char *lpChannels,
+              size_t nBlockBytes)
+    {
+        m_pFile = fopen(lpPath, "wb");
+
+        if (m_pFile == NULL)
+        {
+            return false;
+        }
+
+        // Blocks are already large; stdio buffering would only add a copy
+        setvbuf(m_pFile, NULL, _IONBF, 0);
+
+        m_Header = *pHeader;
+
+        char *lpHeader = (char*) calloc(pHeader->nHeaderSize, 1);
+        size_t nCoeffBytes = (size_t) pHeader->nChannels * pHeader->nCoeffs * sizeof(float64);
+
+        if (lpHeader == NULL)
+        {
+            Abort();
+            return false;
+        }
+
+        memcpy(lpHeader, pHeader, sizeof(DaqFileHeader));
+        memcpy(lpHeader + sizeof(DaqFileHeader), lpCoeffs, nCoeffBytes);
+        memcpy(lpHeader + sizeof(DaqFileHeader) + nCoeffBytes, lpChannels, pHeader->nChannelsLength);
+
+        bool bWritten = fwrite(lpHeader, 1, pHeader->nHeaderSize, m_pFile) == pHeader->nHeaderSize;
+        free(lpHeader);
+
+        if (!bWritten)
+        {
+            Abort();
+            return false;
+        }
+
+        m_nBlockBytes = nBlockBytes;
+
+        for (int i = 0; i < DAQ_WRITER_BUFFERS; i++)
+        {
+            DaqWriterBlock Block;
+
+            Block.lpData = (char*) malloc(nBlockBytes);
+            Block.nBytes = 0;
+
+            if (Block.lpData == NULL)
+            {
+                Abort();
+                return false;
+            }
+
+            m_Free.push_back(Block);
+        }
+
+        m_bStop = false;
+        m_bFailed = false;
+        m_hThread = std::thread(&DaqFileWriter::Run, this);
+
+        return true;
+    }
+
+    size_t BlockBytes() const
+    {
+        return m_nBlockBytes;
+    }
+
+    // Takes a free buffer, waiting for the writer if every buffer
+    // is queued. Each wait is counted as a stall. Returns NULL if
+    // writing has failed.
+    char *GetBuffer()
+    {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+
+        if (m_Free.empty() && !m_bFailed)
+        {
+            m_nStalls++;
+            m_Changed.wait(Lock, [this] { return !m_Free.empty() || m_bFailed; });
+        }
+
+        if (m_bFailed)
+        {
+            return NULL;
+        }
+
+        char *lpData = m_Free.front().lpData;
+        m_Free.pop_front();
+
+        return lpData;
+    }
+
+    // Queues nBytes of a buffer obtained from GetBuffer
+    void Submit(char *lpData, size_t nBytes)
+    {
+        DaqWriterBlock Block;
+
+        Block.lpData = lpData;
+        Block.nBytes = nBytes;
+
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+
+        m_Queue.push_back(Block);
+
+        if (m_Queue.size() > m_nMaxQueueDepth)
+        {
+            m_nMaxQueueDepth = m_Queue.size();
+        }
+
+        m_Changed.notify_all();
+    }
+
+    // Writes every queued block, stores the number of samples in
+    // the header and closes the file. Returns false if anything
+    // could not be written. With pnSamples set to NULL the header
+    // keeps a count of zero.
+    bool Close(const uInt64 *pnSamples)
+    {
+        if (m_pFile == NULL)
+        {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+            m_bStop = true;
+            m_Changed.notify_all();
+        }
+
+        if (m_hThread.joinable())
+        {
+            m_hThread.join();
+        }
+
+        bool bResult = !m_bFailed;
+
+        if (bResult && pnSamples != NULL)
+        {
+            m_Header.nSamples = *pnSamples;
+            bResult = fseek(m_pFile, 0, SEEK_SET) == 0 && fwrite(&m_Header, sizeof(DaqFileHeader), 1, m_pFile) == 1;
+        }
+
+        Abort();
+
+        return bResult;
+    }
+
+    unsigned long long Blocks() const { return m_nBlocks; }
+    unsigned long long Bytes() const { return m_nBytes; }
+    size_t MaxQueueDepth() const { return m_nMaxQueueDepth; }
+    unsigned long long Stalls() const { return m_nStalls; }
+
+private:
+    void Run()
+    {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+
+        while (true)
+        {
+            m_Changed.wait(Lock, [this] { return !m_Queue.empty() || m_bStop; });
+
+            if (m_Queue.empty())
+            {
+                break;
+            }
+
+            DaqWriterBlock Block = m_Queue.front();
+            m_Queue.pop_front();
+
+            Lock.unlock();
+            bool bWritten = fwrite(Block.lpData, 1, Block.nBytes, m_pFile) == Block.nBytes;
+            Lock.lock();
+
+            // Only what reached the file is counted
+            if (bWritten)
+            {
+                m_nBlocks++;
+                m_nBytes += Block.nBytes;
+            }
+            else
+            {
+                m_bFailed = true;
+            }
+
+            m_Free.push_back(Block);
+            m_Changed.notify_all();
+
+            if (m_bFailed)
+            {
+                break;
+            }
+        }
+    }
+
+    // Releases everything without touching the header
+    void Abort()
+    {
+        if (m_pFile != NULL)
+        {
+            fclose(m_pFile);
+            m_pFile = NULL;
+        }
+
+        while (!m_Free.empty())
+        {
+            free(m_Free.front().lpData);
+            m_Free.pop_front();
+        }
+
+        while (!m_Queue.empty())
+        {
+            free(m_Queue.front().lpData);
+            m_Queue.pop_front();
+        }
+    }
+
+    FILE *m_pFile;
+    DaqFileHeader m_Header;
+    size_t m_nBlockBytes;
+    std::thread m_hThread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    std::deque<DaqWriterBlock> m_Free;
+    std::deque<DaqWriterBlock> m_Queue;
+    bool m_bStop;
+    bool m_bFailed;
+    unsigned long long m_nBlocks;
+    unsigned long long m_nBytes;
+    size_t m_nMaxQueueDepth;
+    unsigned long long m_nStalls;
+};
+
+// Reads nSamples scans from a started task straight into the
+// writer's blocks, interleaved by scan as the file stores them,
+// and queues them. The number of scans queued is stored in
+// *pnWritten. Stops early if the writer fails, which Close reports.
+// Waiting for a free block and queueing it is the processing phase
+// of pTiming.
+template <typename T>
+static inline int32 daqRecordBlocks(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels,
+                                    DaqFileWriter *pWriter, uInt64 *pnWritten, DaqCallTiming *pTiming = NULL)
+{
+    uInt32 nBlockScans = (uInt32) (pWriter->BlockBytes() / (nChannels * sizeof(T)));
+    uInt64 nDone = 0;
+    int32 nResult = 0;
+
+    while (nDone < nSamples)
+    {
+        double fStart = daqTimingBegin(pTiming);
+        T *lpBlock = (T*) pWriter->GetBuffer();
+
+        daqTimingEnd(pTiming, DAQ_PHASE_PROCESS, fStart);
+
+        if (lpBlock == NULL)
+        {
+            break;
+        }
+
+        uInt32 nScans = (nSamples - nDone < nBlockScans) ? (uInt32) (nSamples - nDone) : nBlockScans;
+        int32 nRead = 0;
+
+        fStart = daqTimingBegin(pTiming);
+        nResult = daqReadSamples(hTask, (int32) nScans, daqReadTimeout(nScans, fRate), DAQmx_Val_GroupByScanNumber,
+                                 lpBlock, nScans * nChannels, &nRead);
+
+        daqTimingEnd(pTiming, DAQ_PHASE_READ, fStart);
+        daqTimingRead(pTiming, nRead, nChannels, sizeof(T));
+        daqTimingError(pTiming, nResult);
+
+        if (nRead < 0)
+        {
+            nRead = 0;
+        }
+
+        // Whatever arrived before an error is still worth keeping
+        fStart = daqTimingBegin(pTiming);
+        pWriter->Submit((char*) lpBlock, (size_t) nRead * nChannels * sizeof(T));
+        daqTimingEnd(pTiming, DAQ_PHASE_PROCESS, fStart);
+        nDone += nRead;
+
+        if (nResult < 0 || nRead < (int32) nScans)
+        {
+            break;
+        }
+    }
+
+    *pnWritten = nDone;
+
+    return nResult;
+}
+
+#endif
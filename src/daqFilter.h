@@ -0,0 +1,234 @@
+/*************************************************************/
+// daqFilter.h
+//
+// FIR filtering and decimation applied to every block as it is
+// read, so only the decimated samples are ever kept. For each
+// channel
+//
+//     y = filter(Taps, 1, x);  y = y(1:Factor:end);
+//
+// is computed in MATLAB terms, but only the outputs that are
+// kept are evaluated, which is what a polyphase decomposition
+// saves. The filter state is carried from one block to the next,
+// so the result does not depend on how the capture was split.
+//
+// The inner product uses AVX2 on processors that have it, chosen at
+// run time as in daqScale.h.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQFILTER_H
+#define DAQFILTER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "daqScale.h"
+
+#ifdef DAQ_SCALE_AVX2
+// Inner product of the first n elements, n a multiple of 8
+DAQ_SCALE_TARGET static inline float64 daqDotAvx2(const float64 *lpA, const float64 *lpB, size_t n)
+{
+    __m256d fAcc0 = _mm256_setzero_pd();
+    __m256d fAcc1 = _mm256_setzero_pd();
+
+    for (size_t i = 0; i < n; i += 8)
+    {
+        fAcc0 = _mm256_add_pd(fAcc0, _mm256_mul_pd(_mm256_loadu_pd(lpA + i), _mm256_loadu_pd(lpB + i)));
+        fAcc1 = _mm256_add_pd(fAcc1, _mm256_mul_pd(_mm256_loadu_pd(lpA + i + 4), _mm256_loadu_pd(lpB + i + 4)));
+    }
+
+    float64 fLanes[4];
+
+    _mm256_storeu_pd(fLanes, _mm256_add_pd(fAcc0, fAcc1));
+
+    return (fLanes[0] + fLanes[1]) + (fLanes[2] + fLanes[3]);
+}
+#endif
+
+// Inner product of n elements
+static inline float64 daqDot(const float64 *lpA, const float64 *lpB, size_t n)
+{
+    size_t i = 0;
+    float64 fSum = 0;
+
+#ifdef DAQ_SCALE_AVX2
+    if (n >= 8 && daqScaleHasAvx2())
+    {
+        i = n - n % 8;
+        fSum = daqDotAvx2(lpA, lpB, i);
+    }
+#endif
+
+    float64 fAcc[4] = {0, 0, 0, 0};
+
+    for (; i + 4 <= n; i += 4)
+    {
+        fAcc[0] += lpA[i] * lpB[i];
+        fAcc[1] += lpA[i + 1] * lpB[i + 1];
+        fAcc[2] += lpA[i + 2] * lpB[i + 2];
+        fAcc[3] += lpA[i + 3] * lpB[i + 3];
+    }
+
+    fSum += (fAcc[0] + fAcc[1]) + (fAcc[2] + fAcc[3]);
+
+    for (; i < n; i++)
+    {
+        fSum += lpA[i] * lpB[i];
+    }
+
+    return fSum;
+}
+
+// Number of taps of a CIC decimator of the given order
+static inline int daqCicLength(int nOrder, int nFactor)
+{
+    return nOrder * (nFactor - 1) + 1;
+}
+
+// Impulse response of a CIC decimator: nOrder cascaded moving
+// averages of nFactor samples, normalized to unit DC gain.
+// lpTaps must hold daqCicLength elements.
+static inline void daqCicTaps(int nOrder, int nFactor, float64 *lpTaps)
+{
+    int nLength = 1;
+
+    lpTaps[0] = 1;
+
+    for (int k = 0; k < nOrder; k++)
+    {
+        // Convolve with a boxcar of nFactor samples, in place from
+        // the end so every input is read before it is overwritten
+        int nNew = nLength + nFactor - 1;
+
+        for (int i = nNew - 1; i >= 0; i--)
+        {
+            float64 fSum = 0;
+
+            for (int j = 0; j < nFactor; j++)
+            {
+                if (i - j >= 0 && i - j < nLength)
+                {
+                    fSum += lpTaps[i - j];
+                }
+            }
+
+            lpTaps[i] = fSum / nFactor;
+        }
+
+        nLength = nNew;
+    }
+}
+
+class DaqDecimator
+{
+public:
+    DaqDecimator() : m_lpTaps(NULL), m_lpHistory(NULL), m_lpWork(NULL), m_lpSkip(NULL),
+                     m_nTaps(0), m_nFactor(1), m_nChannels(0), m_nMaxBlock(0)
+    {
+    }
+
+    ~DaqDecimator()
+    {
+        Free();
+    }
+
+    // Prepares the filter for nChannels channels processed in blocks
+    // of at most nMaxBlock samples. A single tap of 1 decimates
+    // without filtering.
+    bool Init(const float64 *lpTaps, int nTaps, int nFactor, uInt32 nChannels, size_t nMaxBlock)
+    {
+        Free();
+
+        m_nTaps = nTaps;
+        m_nFactor = nFactor;
+        m_nChannels = nChannels;
+        m_nMaxBlock = nMaxBlock;
+
+        size_t nHistory = (size_t) (nTaps - 1);
+
+        m_lpTaps = (float64*) malloc(nTaps * sizeof(float64));
+        m_lpHistory = (float64*) calloc(nHistory * nChannels + 1, sizeof(float64));
+        m_lpWork = (float64*) malloc((nHistory + nMaxBlock) * sizeof(float64));
+        m_lpSkip = (size_t*) calloc(nChannels, sizeof(size_t));
+
+        if (m_lpTaps == NULL || m_lpHistory == NULL || m_lpWork == NULL || m_lpSkip == NULL)
+        {
+            Free();
+            return false;
+        }
+
+        // Stored reversed, so every output is a plain inner product
+        // with the most recent nTaps inputs
+        for (int i = 0; i < nTaps; i++)
+        {
+            m_lpTaps[i] = lpTaps[nTaps - 1 - i];
+        }
+
+        return true;
+    }
+
+    // Number of outputs produced by nSamples inputs from the start
+    size_t OutputLength(unsigned long long nSamples) const
+    {
+        return (size_t) ((nSamples + m_nFactor - 1) / m_nFactor);
+    }
+
+    // Filters n new samples of a channel and writes the outputs that
+    // are kept to lpOut. Returns how many were written.
+    size_t Process(uInt32 nChannel, const float64 *lpIn, size_t n, float64 *lpOut)
+    {
+        size_t nHistory = (size_t) (m_nTaps - 1);
+        float64 *lpHistory = m_lpHistory + nChannel * nHistory;
+        size_t nOut = 0, i;
+
+        memcpy(m_lpWork, lpHistory, nHistory * sizeof(float64));
+        memcpy(m_lpWork + nHistory, lpIn, n * sizeof(float64));
+
+        for (i = m_lpSkip[nChannel]; i < n; i += m_nFactor)
+        {
+            lpOut[nOut++] = daqDot(m_lpTaps, m_lpWork + i, m_nTaps);
+        }
+
+        m_lpSkip[nChannel] = i - n;
+        memcpy(lpHistory, m_lpWork + n, nHistory * sizeof(float64));
+
+        return nOut;
+    }
+
+    void Free()
+    {
+        free(m_lpTaps);
+        free(m_lpHistory);
+        free(m_lpWork);
+        free(m_lpSkip);
+
+        m_lpTaps = NULL;
+        m_lpHistory = NULL;
+        m_lpWork = NULL;
+        m_lpSkip = NULL;
+    }
+
+private:
+    float64 *m_lpTaps;
+    float64 *m_lpHistory;
+    float64 *m_lpWork;
+    size_t *m_lpSkip;
+    int m_nTaps;
+    int m_nFactor;
+    uInt32 m_nChannels;
+    size_t m_nMaxBlock;
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*************************************************************/
+// daqMappedFile.h
+//
+// Read-only memory mapping of a region of a file, so recordings
+// far larger than the available memory can be read piece by
+// piece without loading them. Only the pages that are touched
+// are brought in by the operating system, unless they are
+// prefetched ahead of a reader.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQMAPPEDFILE_H
+#define DAQMAPPEDFILE_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Mapping offsets must be multiples of this, which is the Windows
+// allocation granularity and a multiple of the page size elsewhere
+#define DAQ_MAP_GRANULARITY 65536
+
+class DaqMappedFile
+{
+public:
+    DaqMappedFile() : m_pView(NULL), m_nViewSize(0), m_nSize(0)
+    {
+#ifdef _WIN32
+        m_hFile = INVALID_HANDLE_VALUE;
+        m_hMapping = NULL;
+#else
+        m_nFile = -1;
+#endif
+    }
+
+    ~DaqMappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const char *lpPath)
+    {
+        Close();
+
+#ifdef _WIN32
+        LARGE_INTEGER nSize;
+
+        m_hFile = CreateFileA(lpPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+        if (m_hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_hFile, &nSize))
+        {
+            Close();
+            return false;
+        }
+
+        m_nSize = (unsigned long long) nSize.QuadPart;
+
+        if (m_nSize > 0)
+        {
+            m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+            if (m_hMapping == NULL)
+            {
+                Close();
+                return false;
+            }
+        }
+#else
+        struct stat Stat;
+
+        m_nFile = open(lpPath, O_RDONLY);
+
+        if (m_nFile < 0 || fstat(m_nFile, &Stat) != 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_nSize = (unsigned long long) Stat.st_size;
+#endif
+
+        return true;
+    }
+
+    unsigned long long Size() const
+    {
+        return m_nSize;
+    }
+
+    // Maps nBytes starting at nOffset and returns a pointer to the
+    // first of them. Any previous view is released.
+    const char *Map(unsigned long long nOffset, size_t nBytes)
+    {
+        Unmap();
+
+        if (nBytes == 0 || nOffset + nBytes > m_nSize)
+        {
+            return NULL;
+        }
+
+        unsigned long long nStart = nOffset / DAQ_MAP_GRANULARITY * DAQ_MAP_GRANULARITY;
+        size_t nSkip = (size_t) (nOffset - nStart);
+
+        m_nViewSize = nBytes + nSkip;
+
+#ifdef _WIN32
+        m_pView = MapViewOfFile(m_hMapping, FILE_MAP_READ, (DWORD) (nStart >> 32), (DWORD) nStart, m_nViewSize);
+#else
+        m_pView = mmap(NULL, m_nViewSize, PROT_READ, MAP_SHARED, m_nFile, (off_t) nStart);
+
+        if (m_pView == MAP_FAILED)
+        {
+            m_pView = NULL;
+        }
+        else
+        {
+            // Regions are read front to back
+            madvise(m_pView, m_nViewSize, MADV_SEQUENTIAL);
+        }
+#endif
+
+        return (m_pView == NULL) ? NULL : (const char*) m_pView + nSkip;
+    }
+
+    // Asks the system to start reading nBytes of the view from lpFirst
+    // on, so they are in memory by the time they are used. Windows
+    // relies on the read-ahead of sequential views instead.
+    void Prefetch(const char *lpFirst, size_t nBytes)
+    {
+        const char *lpView = (const char*) m_pView;
+
+        if (lpView == NULL || lpFirst < lpView || lpFirst >= lpView + m_nViewSize)
+        {
+            return;
+        }
+
+#ifndef _WIN32
+        size_t nPage = (size_t) sysconf(_SC_PAGESIZE);
+        size_t nStart = (size_t) (lpFirst - lpView) / nPage * nPage;
+        size_t nEnd = (size_t) (lpFirst - lpView) + nBytes;
+
+        if (nEnd > m_nViewSize)
+        {
+            nEnd = m_nViewSize;
+        }
+
+        madvise((char*) m_pView + nStart, nEnd - nStart, MADV_WILLNEED);
+#endif
+    }
+
+    void Unmap()
+    {
+        if (m_pView != NULL)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_pView);
+#else
+            munmap(m_pView, m_nViewSize);
+#endif
+            m_pView = NULL;
+        }
+    }
+
+    void Close()
+    {
+        Unmap();
+
+#ifdef _WIN32
+        if (m_hMapping != NULL)
+        {
+            CloseHandle(m_hMapping);
+            m_hMapping = NULL;
+        }
+
+        if (m_hFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_hFile);
+            m_hFile = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_nFile >= 0)
+        {
+            close(m_nFile);
+            m_nFile = -1;
+        }
+#endif
+
+        m_nSize = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+#else
+    int m_nFile;
+#endif
+    void *m_pView;
+    size_t m_nViewSize;
+    unsigned long long m_nSize;
+};
+
+#endif
@@ -0,0 +1,271 @@
+/*************************************************************/
+// daqParallel.h
+//
+// Runs independent pieces of work, such as the channels of a
+// capture, on as many threads as the machine has. Threads take the
+// next piece from a shared counter, so a slow piece does not hold
+// up the others, and the calling thread takes its share too.
+//
+// Stages that hand out work many times, such as once for every block
+// read, keep a DaqThreadPool instead, whose threads wait between runs.
+// Each of them starts a run with an equal range of the work and,
+// once it is through, steals half of what is left of another's.
+//
+// The work may not call the MEX API: only the calling thread is a
+// MATLAB thread.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQPARALLEL_H
+#define DAQPARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Most threads daqParallelFor starts
+#define DAQ_PARALLEL_MAX_THREADS 64
+
+// Threads worth using for nItems pieces of work
+static inline unsigned int daqParallelThreads(size_t nItems)
+{
+    unsigned int nThreads = std::thread::hardware_concurrency();
+
+    nThreads = (nThreads == 0) ? 1 : (nThreads > DAQ_PARALLEL_MAX_THREADS) ? DAQ_PARALLEL_MAX_THREADS : nThreads;
+
+    return (nItems < nThreads) ? (unsigned int) nItems : nThreads;
+}
+
+// Calls Work(i) once for every i in [0, nItems), spread over
+// daqParallelThreads(nItems) threads, and returns once all calls have
+// returned.
+template <typename F>
+static inline void daqParallelFor(size_t nItems, F &Work)
+{
+    std::atomic<size_t> nNext(0);
+    std::thread lpThreads[DAQ_PARALLEL_MAX_THREADS];
+    unsigned int nThreads = daqParallelThreads(nItems), nStarted = 0;
+
+    auto Run = [&]()
+    {
+        for (size_t i = nNext++; i < nItems; i = nNext++)
+        {
+            Work(i);
+        }
+    };
+
+    for (; nStarted + 1 < nThreads; nStarted++)
+    {
+        lpThreads[nStarted] = std::thread(Run);
+    }
+
+    Run();
+
+    for (unsigned int i = 0; i < nStarted; i++)
+    {
+        lpThreads[i].join();
+    }
+}
+
+class DaqThreadPool
+{
+public:
+    DaqThreadPool() : m_nThreads(1), m_nGeneration(0), m_nBusy(0), m_bStop(false), m_pWork(NULL), m_pInvoke(NULL)
+    {
+    }
+
+    ~DaqThreadPool()
+    {
+        Stop();
+    }
+
+    // Starts nThreads - 1 threads; the one calling Run is the last
+    void Start(unsigned int nThreads)
+    {
+        Stop();
+
+        m_nThreads = (nThreads < 1) ? 1 : (nThreads > DAQ_PARALLEL_MAX_THREADS) ? DAQ_PARALLEL_MAX_THREADS : nThreads;
+        m_nGeneration = 0;
+        m_bStop = false;
+
+        for (unsigned int i = 1; i < m_nThreads; i++)
+        {
+            m_lpThreads[i] = std::thread(&DaqThreadPool::Worker, this, i);
+        }
+    }
+
+    unsigned int Threads() const
+    {
+        return m_nThreads;
+    }
+
+    // Calls Work(i, nThread) once for every i in [0, nItems), fewer
+    // than 2^32, and returns once all calls have returned. nThread,
+    // below Threads(), tells which thread makes the call, so the work
+    // can keep scratch memory per thread.
+    template <typename F>
+    void Run(size_t nItems, F &Work)
+    {
+        for (unsigned int i = 0; i < m_nThreads; i++)
+        {
+            m_lpRanges[i] = Pack(nItems * i / m_nThreads, nItems * (i + 1) / m_nThreads);
+        }
+
+        {
+            std::lock_guard<std::mutex> Lock(m_Lock);
+
+            m_pWork = &Work;
+            m_pInvoke = &Invoke<F>;
+            m_nBusy = m_nThreads - 1;
+            m_nGeneration++;
+        }
+
+        m_Wake.notify_all();
+
+        Drain(0);
+
+        std::unique_lock<std::mutex> Lock(m_Lock);
+        m_Done.wait(Lock, [this]() { return m_nBusy == 0; });
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> Lock(m_Lock);
+            m_bStop = true;
+        }
+
+        m_Wake.notify_all();
+
+        for (unsigned int i = 1; i < m_nThreads; i++)
+        {
+            m_lpThreads[i].join();
+        }
+
+        m_nThreads = 1;
+    }
+
+private:
+    // A range of items is kept as its first and end items in a single
+    // word, so taking from either end is one compare-and-swap
+    static unsigned long long Pack(size_t nFirst, size_t nEnd)
+    {
+        return ((unsigned long long) nFirst << 32) | (unsigned long long) nEnd;
+    }
+
+    template <typename F>
+    static void Invoke(void *pWork, size_t nItem, unsigned int nThread)
+    {
+        (*(F*) pWork)(nItem, nThread);
+    }
+
+    // Takes the first item of the own range
+    bool Take(unsigned int nThread, size_t *pnItem)
+    {
+        unsigned long long nRange = m_lpRanges[nThread];
+
+        while ((nRange >> 32) < (nRange & 0xFFFFFFFF))
+        {
+            if (m_lpRanges[nThread].compare_exchange_weak(nRange, nRange + (1ULL << 32)))
+            {
+                *pnItem = (size_t) (nRange >> 32);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Moves the last half of another thread's range to the own one,
+    // which is empty. Returns false once every range is.
+    bool Steal(unsigned int nThread)
+    {
+        for (unsigned int i = 1; i < m_nThreads; i++)
+        {
+            unsigned int nVictim = (nThread + i) % m_nThreads;
+            unsigned long long nRange = m_lpRanges[nVictim];
+
+            while ((nRange >> 32) < (nRange & 0xFFFFFFFF))
+            {
+                size_t nFirst = (size_t) (nRange >> 32), nEnd = (size_t) (nRange & 0xFFFFFFFF);
+                size_t nSplit = nEnd - (nEnd - nFirst + 1) / 2;
+
+                if (m_lpRanges[nVictim].compare_exchange_weak(nRange, Pack(nFirst, nSplit)))
+                {
+                    m_lpRanges[nThread] = Pack(nSplit, nEnd);
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void Drain(unsigned int nThread)
+    {
+        size_t nItem;
+
+        do
+        {
+            while (Take(nThread, &nItem))
+            {
+                m_pInvoke(m_pWork, nItem, nThread);
+            }
+        }
+        while (Steal(nThread));
+    }
+
+    void Worker(unsigned int nThread)
+    {
+        unsigned long long nSeen = 0;
+        std::unique_lock<std::mutex> Lock(m_Lock);
+
+        while (true)
+        {
+            m_Wake.wait(Lock, [&]() { return m_bStop || m_nGeneration != nSeen; });
+
+            if (m_bStop)
+            {
+                return;
+            }
+
+            nSeen = m_nGeneration;
+
+            Lock.unlock();
+            Drain(nThread);
+            Lock.lock();
+
+            if (--m_nBusy == 0)
+            {
+                m_Done.notify_one();
+            }
+        }
+    }
+
+    std::thread m_lpThreads[DAQ_PARALLEL_MAX_THREADS];
+    std::atomic<unsigned long long> m_lpRanges[DAQ_PARALLEL_MAX_THREADS];
+    std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Done;
+    unsigned int m_nThreads;
+    unsigned long long m_nGeneration;
+    unsigned int m_nBusy;
+    bool m_bStop;
+    void *m_pWork;
+    void (*m_pInvoke)(void*, size_t, unsigned int);
+};
+
+#endif
@@ -0,0 +1,261 @@
+/*************************************************************/
+// daqPublisher.h
+//
+// Writer of the shared-memory ring of daqShared.h, used by the
+// 'publish' command of daqAdquireData. A native thread reads the
+// driver block by block straight into the slots of the ring, so
+// publishing copies nothing, and never waits for the readers.
+//
+// Nothing in this file may call the MEX API: the writer thread is
+// not a MATLAB thread.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQPUBLISHER_H
+#define DAQPUBLISHER_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "daqRead.h"
+#include "daqShared.h"
+
+// Results of daqPublisherStart besides driver errors
+#define DAQ_PUBLISH_IN_USE 1
+#define DAQ_PUBLISH_NO_MEMORY 2
+
+// The driver buffer holds the whole ring, and its size is 32 bits
+#define DAQ_PUBLISH_MAX_SCANS 0xFFFFFFFFULL
+
+// A writer fills in the header right after creating the ring, so a
+// ring without a valid header is only taken for one left behind once
+// it has stayed that way for DAQ_PUBLISH_SETUP_WAIT milliseconds
+#define DAQ_PUBLISH_SETUP_WAIT 500
+#define DAQ_PUBLISH_SETUP_POLL 10
+
+struct DaqPublisher
+{
+    TaskHandle hTask;
+    std::thread hWriter;
+    std::atomic<bool> bStop;
+    DaqSharedMemory Memory;
+    DaqSharedHeader *pHeader;
+    float64 fTimeout;
+    bool bRunning;
+
+    DaqPublisher() : hTask(NULL), bStop(false), pHeader(NULL), fTimeout(1.0), bRunning(false)
+    {
+    }
+};
+
+template <typename T>
+static inline void daqPublisherWrite(DaqPublisher *pPublisher)
+{
+    DaqSharedHeader *pHeader = pPublisher->pHeader;
+    uInt32 nBlockScans = pHeader->nBlockScans;
+
+    while (!pPublisher->bStop.load(std::memory_order_relaxed))
+    {
+        uInt64 nSequence = pHeader->nPublished.load(std::memory_order_relaxed);
+        DaqSharedSlot *pSlot = daqSharedSlot(pHeader, nSequence);
+        int32 nRead = 0;
+
+        // Readers still copying the old block of the slot must see it
+        // change before any of its samples do
+        pSlot->nSequence.store(DAQ_SHARED_WRITING, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        int32 nResult = daqReadSamples(pPublisher->hTask, (int32) nBlockScans, pPublisher->fTimeout, DAQmx_Val_GroupByChannel,
+                                       (T*) (pSlot + 1), nBlockScans * pHeader->nChannels, &nRead);
+
+        if (nRead > 0)
+        {
+            pSlot->nScans = (uInt32) nRead;
+            pSlot->nStride = nBlockScans;
+            pSlot->nSequence.store(nSequence, std::memory_order_release);
+            pHeader->nPublished.store(nSequence + 1, std::memory_order_release);
+        }
+
+        if (nResult < 0 && nResult != DAQmxErrorSamplesNotYetAvailable)
+        {
+            pHeader->nError.store(nResult);
+            break;
+        }
+    }
+}
+
+// Creates the ring, replacing one left behind by a writer that is
+// no longer running. A ring whose writer is still filling in the
+// header is waited for rather than taken.
+static inline int32 daqPublisherCreate(DaqPublisher *pPublisher, const char *lpName, size_t nSize)
+{
+    for (int nWaited = 0; ; nWaited += DAQ_PUBLISH_SETUP_POLL)
+    {
+        if (pPublisher->Memory.Create(lpName, nSize))
+        {
+            return 0;
+        }
+
+        bool bComplete = false, bAlive = false;
+
+        if (pPublisher->Memory.Open(lpName))
+        {
+            const DaqSharedHeader *pHeader = (const DaqSharedHeader*) pPublisher->Memory.Data();
+
+            bComplete = daqSharedCheckHeader(pHeader, pPublisher->Memory.Size());
+            bAlive = bComplete && daqSharedWriterAlive(pHeader);
+            pPublisher->Memory.Close();
+        }
+
+        if (bAlive)
+        {
+            return DAQ_PUBLISH_IN_USE;
+        }
+        else if (bComplete || nWaited >= DAQ_PUBLISH_SETUP_WAIT)
+        {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(DAQ_PUBLISH_SETUP_POLL));
+    }
+
+    pPublisher->Memory.Remove(lpName);
+
+    return pPublisher->Memory.Create(lpName, nSize) ? 0 : DAQ_PUBLISH_NO_MEMORY;
+}
+
+// Publishes a configured continuous task under lpName in a ring of
+// nBlocks blocks of nBlockScans scans, at most DAQ_PUBLISH_MAX_SCANS
+// in all, as int16 codes if bRaw is set or float64 volts otherwise.
+// lpScaling holds nCoeffs coefficients per channel and lpChannels
+// the channel names. Returns a driver error, DAQ_PUBLISH_IN_USE,
+// DAQ_PUBLISH_NO_MEMORY or 0. The publisher takes ownership of hTask
+// once it succeeds; on failure the caller still has to clear it.
+static inline int32 daqPublisherStart(DaqPublisher *pPublisher, const char *lpName, TaskHandle hTask, float64 fRate, float64 fRange,
+                                      uInt32 nBlockScans, uInt32 nBlocks, bool bRaw, const float64 *lpScaling, uInt32 nCoeffs,
+                                      const char *lpChannels)
+{
+    uInt32 nChannels = 1;
+    int32 nResult = daqGetTaskNumChans(hTask, &nChannels);
+
+    if (nResult < 0)
+    {
+        return nResult;
+    }
+
+    if ((uInt64) nBlockScans * nBlocks > DAQ_PUBLISH_MAX_SCANS)
+    {
+        return DAQ_PUBLISH_NO_MEMORY;
+    }
+
+    uInt32 nSampleType = bRaw ? DAQ_FILE_INT16 : DAQ_FILE_FLOAT64;
+    uInt32 nChannelsLength = (uInt32) strlen(lpChannels);
+    uInt32 nHeaderSize = daqSharedHeaderSize(nChannels, nCoeffs, nChannelsLength);
+    uInt32 nSlotSize = daqSharedSlotSize(nChannels, nBlockScans, nSampleType);
+    size_t nSize = nHeaderSize + (size_t) nBlocks * nSlotSize;
+
+    nResult = daqPublisherCreate(pPublisher, lpName, nSize);
+
+    if (nResult != 0)
+    {
+        return nResult;
+    }
+
+    DaqSharedHeader *pHeader = (DaqSharedHeader*) pPublisher->Memory.Data();
+
+    // Readers check the magic last, so they never take a header that
+    // is being filled in for a valid one
+    memset((void*) pHeader, 0, nHeaderSize);
+    pHeader->nVersion = DAQ_SHARED_VERSION;
+    pHeader->nHeaderSize = nHeaderSize;
+    pHeader->nChannels = nChannels;
+    pHeader->nSampleType = nSampleType;
+    pHeader->nBlockScans = nBlockScans;
+    pHeader->nBlocks = nBlocks;
+    pHeader->nSlotSize = nSlotSize;
+    pHeader->nCoeffs = nCoeffs;
+    pHeader->nChannelsLength = nChannelsLength;
+#ifdef _WIN32
+    pHeader->nProcess = (uInt32) GetCurrentProcessId();
+#else
+    pHeader->nProcess = (uInt32) getpid();
+#endif
+    pHeader->fRate = fRate;
+    pHeader->fRange = fRange;
+    pHeader->nTotalSize = nSize;
+    pHeader->nPublished.store(0);
+    pHeader->nState.store(DAQ_SHARED_RUNNING);
+    pHeader->nError.store(0);
+
+    memcpy((float64*) daqSharedScaling(pHeader), lpScaling, (size_t) nChannels * nCoeffs * sizeof(float64));
+    memcpy((char*) daqSharedChannels(pHeader), lpChannels, nChannelsLength);
+
+    for (uInt32 i = 0; i < nBlocks; i++)
+    {
+        daqSharedSlot(pHeader, i)->nSequence.store(DAQ_SHARED_WRITING);
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(pHeader->lpMagic, DAQ_SHARED_MAGIC, 8);
+
+    // The driver holds as much as the ring, so a late writer thread
+    // loses nothing
+    nResult = daqCfgInputBuffer(hTask, nBlockScans * nBlocks);
+
+    if (nResult >= 0)
+    {
+        nResult = daqStartTask(hTask);
+    }
+
+    if (nResult < 0)
+    {
+        pPublisher->Memory.Close();
+        return nResult;
+    }
+
+    pPublisher->hTask = hTask;
+    pPublisher->pHeader = pHeader;
+    pPublisher->fTimeout = daqReadTimeout(nBlockScans, fRate);
+    pPublisher->bStop.store(false);
+    pPublisher->hWriter = bRaw ? std::thread(daqPublisherWrite<int16>, pPublisher) : std::thread(daqPublisherWrite<float64>, pPublisher);
+    pPublisher->bRunning = true;
+
+    return 0;
+}
+
+// Stops publishing. Readers see the ring stopped, and a new writer
+// may take its name while they finish reading it.
+static inline void daqPublisherStop(DaqPublisher *pPublisher)
+{
+    if (!pPublisher->bRunning)
+    {
+        return;
+    }
+
+    pPublisher->bStop.store(true);
+    pPublisher->hWriter.join();
+
+    daqStopTask(pPublisher->hTask);
+    daqClearTask(pPublisher->hTask);
+
+    pPublisher->pHeader->nState.store(DAQ_SHARED_STOPPED);
+    pPublisher->Memory.Close();
+
+    pPublisher->hTask = NULL;
+    pPublisher->pHeader = NULL;
+    pPublisher->bRunning = false;
+}
+
+#endif
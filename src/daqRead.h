@@ -0,0 +1,252 @@
+/*************************************************************/
+// daqRead.h
+//
+// Chunked reads of finite adquisitions straight into the memory
+// that is handed back to MATLAB, so a capture of any length
+// needs about as much memory as its result and every driver
+// call stays within the 32-bit sizes DAQmx accepts.
+//
+// Nothing in this file may call the MEX API, so it can be used
+// from worker threads.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQREAD_H
+#define DAQREAD_H
+
+#include <string.h>
+#include "daqRealtime.h"
+#include "daqTiming.h"
+
+// Samples per channel read by a single driver call
+#define DAQ_READ_CHUNK 262144
+
+// The driver buffer of a finite capture holds this many chunks, or
+// DAQ_READ_BUFFER_SECONDS of samples if that is more, instead of the
+// whole capture, so reading it in place needs about the memory of
+// the result alone
+#define DAQ_READ_BUFFER_CHUNKS 4
+#define DAQ_READ_BUFFER_SECONDS 2
+
+// Stream reads ask for 1/DAQ_STREAM_CHUNK_RATE seconds of samples,
+// and never fewer than DAQ_STREAM_CHUNK_MIN
+#define DAQ_STREAM_CHUNK_RATE 10
+#define DAQ_STREAM_CHUNK_MIN 1024
+
+// Extra time allowed on top of the adquisition time of a chunk,
+// which covers the task start and the transfer latency
+#define DAQ_READ_TIMEOUT_MARGIN 2.0
+
+static inline uInt32 daqReadChunkSize(uInt64 nSamples)
+{
+    return (nSamples < DAQ_READ_CHUNK) ? (uInt32) nSamples : DAQ_READ_CHUNK;
+}
+
+// Samples per channel asked for by each read of a stream at fRate,
+// a small part of the driver buffer of a continuous task
+static inline uInt32 daqReadStreamChunk(float64 fRate)
+{
+    float64 fChunk = fRate / DAQ_STREAM_CHUNK_RATE;
+
+    if (fChunk < DAQ_STREAM_CHUNK_MIN)
+    {
+        return DAQ_STREAM_CHUNK_MIN;
+    }
+
+    return (fChunk > DAQ_READ_CHUNK) ? DAQ_READ_CHUNK : (uInt32) fChunk;
+}
+
+// Number of elements of scratch memory daqReadChunked needs.
+// Only multi-channel captures longer than one chunk need it: a
+// read grouped by channel lays the chunk of every channel one after
+// the other, which only matches the columns of the result when the
+// chunk is the whole capture. It is one chunk per channel however
+// long the capture is.
+static inline size_t daqReadScratchSize(uInt64 nSamples, uInt32 nChannels)
+{
+    if (nChannels == 1 || nSamples <= DAQ_READ_CHUNK)
+    {
+        return 0;
+    }
+
+    return (size_t) DAQ_READ_CHUNK * nChannels;
+}
+
+// Bounds the driver buffer of a finite task of nSamples samples per
+// channel at fRate, which the driver would otherwise size to hold
+// the whole capture next to the memory it is read into. Captures
+// shorter than the bound keep the buffer the driver chooses.
+static inline int32 daqReadBoundBuffer(TaskHandle hTask, uInt64 nSamples, float64 fRate)
+{
+    uInt64 nBuffer = (uInt64) DAQ_READ_BUFFER_CHUNKS * DAQ_READ_CHUNK;
+
+    if (fRate * DAQ_READ_BUFFER_SECONDS > (float64) nBuffer)
+    {
+        nBuffer = (uInt64) (fRate * DAQ_READ_BUFFER_SECONDS);
+    }
+
+    return (nBuffer < nSamples) ? daqCfgInputBuffer(hTask, (uInt32) nBuffer) : 0;
+}
+
+// Moves the columns of an nSamples-row capture that ended after
+// nRead samples per channel next to each other, so they form an
+// nRead-row matrix
+template <typename T>
+static inline void daqReadCompact(T *lpData, uInt64 nSamples, uInt64 nRead, uInt32 nChannels)
+{
+    for (uInt32 i = 1; i < nChannels && nRead < nSamples; i++)
+    {
+        memmove(lpData + (size_t) i * nRead, lpData + (size_t) i * nSamples, (size_t) nRead * sizeof(T));
+    }
+}
+
+// Timeout for reading nSamples samples per channel at fRate
+static inline float64 daqReadTimeout(uInt64 nSamples, float64 fRate)
+{
+    return DAQ_READ_TIMEOUT_MARGIN + 1.5 * (float64) nSamples / fRate;
+}
+
+// One driver read scaled to volts. nFillMode is DAQmx_Val_GroupByChannel
+// or DAQmx_Val_GroupByScanNumber.
+static inline int32 daqReadSamples(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, float64 *lpData, uInt32 nSize, int32 *pnRead)
+{
+    return daqReadAnalogF64(hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead, NULL);
+}
+
+// One driver read as raw ADC codes
+static inline int32 daqReadSamples(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, int16 *lpData, uInt32 nSize, int32 *pnRead)
+{
+    return daqReadBinaryI16(hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead, NULL);
+}
+
+// Reads nSamples samples per channel from a started task into
+// lpData, laid out as a column-major nSamples-by-nChannels matrix.
+// lpScratch must hold daqReadScratchSize elements. The number of
+// samples per channel actually read is stored in *pnRead. Reads and
+// copies are timed into pTiming, and every read is measured against
+// the sample clock into pClock, if given.
+template <typename T>
+static inline int32 daqReadChunked(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels,
+                                   T *lpData, T *lpScratch, uInt64 *pnRead, DaqCallTiming *pTiming = NULL,
+                                   DaqRealtimeClock *pClock = NULL)
+{
+    uInt64 nDone = 0;
+    int32 nResult = 0;
+
+    while (nDone < nSamples)
+    {
+        uInt32 nChunk = daqReadChunkSize(nSamples - nDone);
+        int32 nRead = 0;
+        double fStart = daqTimingBegin(pTiming);
+        double fRead = daqRealtimeBegin(pClock);
+
+        if (lpScratch == NULL)
+        {
+            // Either a single column, or the whole matrix fits in one
+            // read: the driver writes the final layout directly
+            nResult = daqReadSamples(hTask, (int32) nChunk, daqReadTimeout(nChunk, fRate), DAQmx_Val_GroupByChannel, lpData + nDone, nChunk * nChannels, &nRead);
+            daqTimingEnd(pTiming, DAQ_PHASE_READ, fStart);
+            daqRealtimeRead(pClock, fRead, nRead, nResult);
+        }
+        else
+        {
+            nResult = daqReadSamples(hTask, (int32) nChunk, daqReadTimeout(nChunk, fRate), DAQmx_Val_GroupByChannel, lpScratch, nChunk * nChannels, &nRead);
+            daqTimingEnd(pTiming, DAQ_PHASE_READ, fStart);
+            daqRealtimeRead(pClock, fRead, nRead, nResult);
+            fStart = daqTimingBegin(pTiming);
+
+            for (uInt32 i = 0; i < nChannels && nRead > 0; i++)
+            {
+                memcpy(lpData + (size_t) i * nSamples + nDone, lpScratch + (size_t) i * nChunk, nRead * sizeof(T));
+            }
+
+            daqTimingEnd(pTiming, DAQ_PHASE_COPY, fStart);
+        }
+
+        daqTimingRead(pTiming, nRead, nChannels, sizeof(T));
+        daqTimingError(pTiming, nResult);
+
+        if (nRead > 0)
+        {
+            nDone += nRead;
+        }
+
+        // A short read without an error only happens once the driver
+        // has nothing more to give
+        if (nResult < 0 || nRead < (int32) nChunk)
+        {
+            break;
+        }
+    }
+
+    *pnRead = nDone;
+
+    return nResult;
+}
+
+// Reads nSamples samples per channel from a started task in chunks
+// of at most nMaxChunk samples per channel into lpScratch, which
+// must hold that many per channel, and hands every chunk to Sink as
+//
+//     Sink(const T *lpChunk, uInt32 nRead, uInt32 nStride)
+//
+// with channel i starting at lpChunk + i * nStride. This is how
+// native processing stages see the data before MATLAB does. The
+// time spent in Sink is the processing phase of pTiming, and the
+// reads are measured into pClock as daqReadChunked does.
+template <typename T, typename S>
+static inline int32 daqReadStream(TaskHandle hTask, float64 fRate, uInt64 nSamples, uInt32 nChannels, uInt32 nMaxChunk,
+                                  T *lpScratch, S &Sink, uInt64 *pnRead, DaqCallTiming *pTiming = NULL,
+                                  DaqRealtimeClock *pClock = NULL)
+{
+    uInt64 nDone = 0;
+    int32 nResult = 0;
+
+    while (nDone < nSamples)
+    {
+        uInt32 nChunk = (nSamples - nDone < nMaxChunk) ? (uInt32) (nSamples - nDone) : nMaxChunk;
+        int32 nRead = 0;
+
+        double fStart = daqTimingBegin(pTiming);
+        double fRead = daqRealtimeBegin(pClock);
+
+        nResult = daqReadSamples(hTask, (int32) nChunk, daqReadTimeout(nChunk, fRate), DAQmx_Val_GroupByChannel,
+                                 lpScratch, nChunk * nChannels, &nRead);
+
+        daqTimingEnd(pTiming, DAQ_PHASE_READ, fStart);
+        daqRealtimeRead(pClock, fRead, nRead, nResult);
+        daqTimingRead(pTiming, nRead, nChannels, sizeof(T));
+        daqTimingError(pTiming, nResult);
+
+        if (nRead > 0)
+        {
+            fStart = daqTimingBegin(pTiming);
+            Sink((const T*) lpScratch, (uInt32) nRead, nChunk);
+            daqTimingEnd(pTiming, DAQ_PHASE_PROCESS, fStart);
+            nDone += nRead;
+        }
+
+        if (nResult < 0 || nRead < (int32) nChunk)
+        {
+            break;
+        }
+    }
+
+    *pnRead = nDone;
+
+    return nResult;
+}
+
+#endif
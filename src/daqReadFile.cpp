@@ -0,0 +1,237 @@
+/*************************************************************/
+// daqReadFile.cpp
+//
+// Reads back a region of a recording made by daqAdquireData with
+// the 'File' option. Only the requested region is mapped into
+// memory, so recordings larger than the available memory can be
+// processed piece by piece.
+//
+//                       ------ ARGUMENTS ------
+//
+// [Data (f), Info (t)] = daqReadFile(FileName (s), FirstSample (n), NumberOfSamples (n))
+// [Info (t)] = daqReadFile(FileName (s))
+//
+// - n denotes a natural value
+// - f denotes a real matrix
+// - s denotes a string
+// - t denotes a structure
+//
+//        - FileName: name of the recording
+//
+//     - FirstSample: first sample to read, starting at 1
+//
+// - NumberOfSamples: number of samples to read from every channel. Fewer
+//                    are returned if the recording ends before
+//
+//            - Data: the samples in volts, laid out as daqAdquireData returns
+//                    them: a row vector for a single channel or a matrix with
+//                    one column per channel. Raw recordings are scaled using
+//                    the polynomial stored in the file
+//
+//            - Info: structure with the Rate, Range, Channels, number of
+//                    Samples per channel, SampleType ('double' or 'int16')
+//                    and Scaling coefficients of the recording. Samples
+//                    of a recording cut short by a crash are the complete
+//                    scans found in the file
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqFile.h"
+#include "daqMappedFile.h"
+#include "daqScale.h"
+
+// Scans converted at a time from raw recordings
+#define DAQ_SCALE_BLOCK 4096
+
+mxArray *createInfo(const DaqFileHeader *pHeader, const char *lpHeader, uInt64 nSamples)
+{
+    const char *lpFields[] = {"Rate", "Range", "Channels", "Samples", "SampleType", "Scaling"};
+    mxArray *pInfo = mxCreateStructMatrix(1, 1, 6, lpFields);
+    const float64 *lpCoeffs = (const float64*) (lpHeader + sizeof(DaqFileHeader));
+    const char *lpChannels = lpHeader + sizeof(DaqFileHeader) + (size_t) pHeader->nChannels * pHeader->nCoeffs * sizeof(float64);
+    char *lpNames = (char*) mxCalloc(pHeader->nChannelsLength + 1, sizeof(char));
+    
+    memcpy(lpNames, lpChannels, pHeader->nChannelsLength);
+    
+    mxArray *pScaling = mxCreateNumericMatrix(pHeader->nCoeffs, pHeader->nChannels, mxDOUBLE_CLASS, mxREAL);
+    memcpy(mxGetPr(pScaling), lpCoeffs, (size_t) pHeader->nChannels * pHeader->nCoeffs * sizeof(float64));
+    
+    mxSetField(pInfo, 0, "Rate", mxCreateDoubleScalar(pHeader->fRate));
+    mxSetField(pInfo, 0, "Range", mxCreateDoubleScalar(pHeader->fRange));
+    mxSetField(pInfo, 0, "Channels", mxCreateString(lpNames));
+    mxSetField(pInfo, 0, "Samples", mxCreateDoubleScalar((double) nSamples));
+    mxSetField(pInfo, 0, "SampleType", mxCreateString(pHeader->nSampleType == DAQ_FILE_INT16 ? "int16" : "double"));
+    mxSetField(pInfo, 0, "Scaling", pScaling);
+    
+    mxFree(lpNames);
+    
+    return pInfo;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 1 && nrhs != 3)
+    {
+        mexErrMsgTxt("One or three inputs required.");
+    }
+    else if (nlhs > ((nrhs == 1) ? 1 : 2))
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxIsChar(prhs[0]) != 1 || mxGetM(prhs[0]) != 1)
+    {
+        mexErrMsgTxt("Input argument 1 must be a string.");
+    }
+    else if (nrhs == 3 && (mxIsNumeric(prhs[1]) != 1 || mxIsNumeric(prhs[2]) != 1))
+    {
+        mexErrMsgTxt("Input arguments 2 and 3 must be numeric values.");
+    }
+    
+    DaqMappedFile File;
+    char *lpFileName = mxArrayToString(prhs[0]);
+    bool bOpened = File.Open(lpFileName);
+    
+    mxFree(lpFileName);
+    
+    if (!bOpened)
+    {
+        mexErrMsgTxt("Could not open the file.");
+    }
+    
+    // The header size is only known once its fixed part is read
+    DaqFileHeader Header;
+    const char *lpView = File.Map(0, sizeof(DaqFileHeader));
+    
+    if (lpView == NULL)
+    {
+        mexErrMsgTxt("The file is not a NIDaqLab recording.");
+    }
+    
+    memcpy(&Header, lpView, sizeof(DaqFileHeader));
+    
+    if (!daqFileCheckHeader(&Header, File.Size()))
+    {
+        mexErrMsgTxt("The file is not a NIDaqLab recording.");
+    }
+    
+    // Recordings that were cut short still hold every complete scan
+    unsigned long long nAvailable = daqFileScans(&Header, File.Size());
+    mxArray *pInfo = createInfo(&Header, File.Map(0, Header.nHeaderSize), nAvailable);
+    
+    if (nrhs == 1)
+    {
+        plhs[0] = pInfo;
+        return;
+    }
+    
+    double fFirst = mxGetScalar(prhs[1]), fCount = mxGetScalar(prhs[2]);
+    
+    if (fFirst < 1 || fCount < 0)
+    {
+        mexErrMsgTxt("FirstSample must be at least 1 and NumberOfSamples must not be negative.");
+    }
+    
+    size_t nSampleSize = daqFileSampleSize(Header.nSampleType);
+    size_t nScanSize = nSampleSize * Header.nChannels;
+    unsigned long long nFirst = (unsigned long long) fFirst - 1;
+    unsigned long long nCount = (unsigned long long) fCount;
+    
+    if (nFirst >= nAvailable)
+    {
+        nCount = 0;
+    }
+    else if (nCount > nAvailable - nFirst)
+    {
+        nCount = nAvailable - nFirst;
+    }
+    
+    size_t nChannels = Header.nChannels;
+    
+    if (nChannels == 1)
+    {
+        plhs[0] = mxCreateNumericMatrix(1, (mwSize) nCount, mxDOUBLE_CLASS, mxREAL);
+    }
+    else
+    {
+        plhs[0] = mxCreateNumericMatrix((mwSize) nCount, nChannels, mxDOUBLE_CLASS, mxREAL);
+    }
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = pInfo;
+    }
+    else
+    {
+        mxDestroyArray(pInfo);
+    }
+    
+    if (nCount == 0)
+    {
+        return;
+    }
+    
+    // The header view is no longer needed once the scaling is copied
+    float64 *lpCoeffs = (float64*) mxMalloc((size_t) nChannels * (Header.nCoeffs + 1) * sizeof(float64));
+    memcpy(lpCoeffs, File.Map(0, Header.nHeaderSize) + sizeof(DaqFileHeader), nChannels * Header.nCoeffs * sizeof(float64));
+    
+    lpView = File.Map(Header.nHeaderSize + nFirst * nScanSize, (size_t) (nCount * nScanSize));
+    
+    if (lpView == NULL)
+    {
+        mexErrMsgTxt("Could not map the requested region of the file.");
+    }
+    
+    double *lpData = mxGetPr(plhs[0]);
+    
+    if (Header.nSampleType == DAQ_FILE_FLOAT64)
+    {
+        const float64 *lpSamples = (const float64*) lpView;
+        
+        for (size_t i = 0; i < (size_t) nCount; i++)
+        {
+            for (size_t j = 0; j < nChannels; j++)
+            {
+                lpData[j * nCount + i] = lpSamples[i * nChannels + j];
+            }
+        }
+    }
+    else
+    {
+        const int16 *lpSamples = (const int16*) lpView;
+        int16 nCodes[DAQ_SCALE_BLOCK];
+        
+        for (size_t j = 0; j < nChannels; j++)
+        {
+            for (size_t i = 0; i < (size_t) nCount; i += DAQ_SCALE_BLOCK)
+            {
+                size_t nBlock = ((size_t) nCount - i < DAQ_SCALE_BLOCK) ? (size_t) nCount - i : DAQ_SCALE_BLOCK;
+                
+                for (size_t k = 0; k < nBlock; k++)
+                {
+                    nCodes[k] = lpSamples[(i + k) * nChannels + j];
+                }
+                
+                daqScaleCodes(nCodes, nBlock, lpCoeffs + j * Header.nCoeffs, (int) Header.nCoeffs, lpData + j * nCount + i);
+            }
+        }
+    }
+    
+    mxFree(lpCoeffs);
+    
+    return;
+}
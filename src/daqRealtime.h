@@ -0,0 +1,335 @@
+/*************************************************************/
+// daqRealtime.h
+//
+// Reader threads for captures that must not overrun. The thread
+// can be pinned to a core and run at a real-time priority, the
+// memory it reads into is touched and locked beforehand so no
+// read waits on a page fault, and every read is measured against
+// the schedule of the sample clock to show how late it woke up.
+//
+// Nothing in this file may call the MEX API, so it can be used
+// from worker threads.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQREALTIME_H
+#define DAQREALTIME_H
+
+#include <atomic>
+#include <math.h>
+#include <mutex>
+#include <thread>
+#include "daqTiming.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#endif
+
+// Highest priority accepted, the top of SCHED_FIFO on Linux
+#define DAQ_RT_MAX_PRIORITY 99
+
+// Priorities from this one up map to THREAD_PRIORITY_TIME_CRITICAL
+// on Windows, and the ones below to THREAD_PRIORITY_HIGHEST
+#define DAQ_RT_WIN_CRITICAL 50
+
+// Stride of the writes that bring in every page of a buffer. No
+// supported system has smaller pages.
+#define DAQ_RT_PAGE 4096
+
+// How the reader thread should run. A field is -1 when not asked
+// for; a priority of 0 keeps the normal scheduling.
+struct DaqRealtimeConfig
+{
+    int nCpu;
+    int nPriority;
+};
+
+// What the system granted to the last reader thread, since pinning,
+// real-time priorities and locked memory may need privileges the
+// process lacks. nCpu is -1 and nPriority 0 for what was refused.
+struct DaqRealtimeStatus
+{
+    bool bStarted;
+    int nCpu;
+    int nPriority;
+    bool bLocked;
+};
+
+// Reads of every reader thread since the last reset. The counters
+// are updated by the readers while MATLAB may be reading them, so
+// they are atomic, and Status is only copied in or out under
+// StatusMutex. Zero as a static, which is how it is used.
+struct DaqRealtimeStats
+{
+    std::atomic<uInt64> nReads;
+    std::atomic<uInt64> nScans;
+    std::atomic<uInt64> nOverruns;
+    std::atomic<uInt64> nStalls;
+    std::atomic<uInt64> nMaxLatency;
+    std::atomic<uInt64> nMaxJitter;
+    std::atomic<uInt64> lpLatency[DAQ_TIMING_BINS];
+    std::atomic<uInt64> lpJitter[DAQ_TIMING_BINS];
+    std::mutex StatusMutex;
+    DaqRealtimeStatus Status;
+};
+
+// Schedule of the reads of one capture. Scan n is due 1/fRate after
+// scan n - 1, counted from the end of the first read, so the start
+// latency of the task does not show up as jitter.
+struct DaqRealtimeClock
+{
+    DaqRealtimeStats *pStats;
+    double fRate;
+    double fFirst;
+    uInt64 nFirst;
+    uInt64 nScans;
+    bool bStarted;
+};
+
+static inline void daqRealtimeStatsClear(DaqRealtimeStats *pStats)
+{
+    pStats->nReads.store(0);
+    pStats->nScans.store(0);
+    pStats->nOverruns.store(0);
+    pStats->nStalls.store(0);
+    pStats->nMaxLatency.store(0);
+    pStats->nMaxJitter.store(0);
+
+    for (int k = 0; k < DAQ_TIMING_BINS; k++)
+    {
+        pStats->lpLatency[k].store(0);
+        pStats->lpJitter[k].store(0);
+    }
+}
+
+// Publishes what a reader thread was granted
+static inline void daqRealtimeSetStatus(DaqRealtimeStats *pStats, const DaqRealtimeStatus *pStatus)
+{
+    std::lock_guard<std::mutex> Lock(pStats->StatusMutex);
+    pStats->Status = *pStatus;
+}
+
+// Copies what the last reader thread was granted
+static inline void daqRealtimeGetStatus(DaqRealtimeStats *pStats, DaqRealtimeStatus *pStatus)
+{
+    std::lock_guard<std::mutex> Lock(pStats->StatusMutex);
+    *pStatus = pStats->Status;
+}
+
+// Times are kept in nanoseconds so the maxima can be atomic integers
+static inline void daqRealtimeMax(std::atomic<uInt64> *pMax, double fSeconds)
+{
+    uInt64 nValue = (uInt64) (fSeconds * 1e9);
+    uInt64 nMax = pMax->load(std::memory_order_relaxed);
+
+    while (nValue > nMax && !pMax->compare_exchange_weak(nMax, nValue, std::memory_order_relaxed))
+    {
+    }
+}
+
+static inline void daqRealtimeClockInit(DaqRealtimeClock *pClock, DaqRealtimeStats *pStats, double fRate)
+{
+    pClock->pStats = pStats;
+    pClock->fRate = fRate;
+    pClock->fFirst = 0;
+    pClock->nFirst = 0;
+    pClock->nScans = 0;
+    pClock->bStarted = false;
+}
+
+// Start of a read, to be passed to daqRealtimeRead
+static inline double daqRealtimeBegin(const DaqRealtimeClock *pClock)
+{
+    return (pClock != NULL) ? daqTimingNow() : 0;
+}
+
+// Counts a driver read that started at fStart and returned nRead
+// scans with nResult. Its latency is how long the call took, and
+// its jitter how far from the schedule it returned: a reader that
+// wakes up late finds the samples waiting and returns at once, well
+// after they were due.
+static inline void daqRealtimeRead(DaqRealtimeClock *pClock, double fStart, int32 nRead, int32 nResult)
+{
+    if (pClock == NULL)
+    {
+        return;
+    }
+
+    double fEnd = daqTimingNow();
+    DaqRealtimeStats *pStats = pClock->pStats;
+
+    pStats->nReads.fetch_add(1, std::memory_order_relaxed);
+    pStats->lpLatency[daqTimingBin(fEnd - fStart)].fetch_add(1, std::memory_order_relaxed);
+    daqRealtimeMax(&pStats->nMaxLatency, fEnd - fStart);
+
+    if (nResult == DAQmxErrorSamplesNoLongerAvailable)
+    {
+        pStats->nOverruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (nRead <= 0)
+    {
+        return;
+    }
+
+    pClock->nScans += nRead;
+    pStats->nScans.fetch_add(nRead, std::memory_order_relaxed);
+
+    if (!pClock->bStarted)
+    {
+        pClock->fFirst = fEnd;
+        pClock->nFirst = pClock->nScans;
+        pClock->bStarted = true;
+        return;
+    }
+
+    double fJitter = fabs(fEnd - pClock->fFirst - (double) (pClock->nScans - pClock->nFirst) / pClock->fRate);
+
+    pStats->lpJitter[daqTimingBin(fJitter)].fetch_add(1, std::memory_order_relaxed);
+    daqRealtimeMax(&pStats->nMaxJitter, fJitter);
+}
+
+// Counts a wait of the reader for room to read into
+static inline void daqRealtimeStall(DaqRealtimeClock *pClock)
+{
+    if (pClock != NULL)
+    {
+        pClock->pStats->nStalls.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Writes to every page of a buffer, so the system backs it now
+// instead of on the first read into it, and locks it in memory.
+// Returns whether it could be locked; touching it already keeps
+// the reads free of page faults unless memory runs short.
+static inline bool daqRealtimeLock(void *lpData, size_t nBytes)
+{
+    if (lpData == NULL || nBytes == 0)
+    {
+        return true;
+    }
+
+    volatile char *ptrData = (volatile char*) lpData;
+
+    for (size_t i = 0; i < nBytes; i += DAQ_RT_PAGE)
+    {
+        ptrData[i] = ptrData[i];
+    }
+
+    ptrData[nBytes - 1] = ptrData[nBytes - 1];
+
+#ifdef _WIN32
+    return VirtualLock(lpData, nBytes) != 0;
+#else
+    return mlock(lpData, nBytes) == 0;
+#endif
+}
+
+static inline void daqRealtimeUnlock(void *lpData, size_t nBytes)
+{
+    if (lpData == NULL || nBytes == 0)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    VirtualUnlock(lpData, nBytes);
+#else
+    munlock(lpData, nBytes);
+#endif
+}
+
+// Pins the calling thread and raises its priority as pConfig asks,
+// and publishes what was granted to pStats along with bLocked, the
+// state of the memory the thread reads into
+static inline void daqRealtimeEnter(const DaqRealtimeConfig *pConfig, DaqRealtimeStats *pStats, bool bLocked)
+{
+    DaqRealtimeStatus Status;
+
+    Status.bStarted = true;
+    Status.nCpu = -1;
+    Status.nPriority = 0;
+
+#ifdef _WIN32
+    HANDLE hThread = GetCurrentThread();
+
+    if (pConfig->nCpu >= 0 && pConfig->nCpu < (int) (8 * sizeof(DWORD_PTR)) &&
+        SetThreadAffinityMask(hThread, (DWORD_PTR) 1 << pConfig->nCpu) != 0)
+    {
+        Status.nCpu = pConfig->nCpu;
+    }
+
+    if (pConfig->nPriority > 0 &&
+        SetThreadPriority(hThread, (pConfig->nPriority >= DAQ_RT_WIN_CRITICAL) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST))
+    {
+        Status.nPriority = pConfig->nPriority;
+    }
+#else
+    pthread_t hThread = pthread_self();
+
+#ifdef __linux__
+    if (pConfig->nCpu >= 0 && pConfig->nCpu < CPU_SETSIZE)
+    {
+        cpu_set_t Set;
+        CPU_ZERO(&Set);
+        CPU_SET(pConfig->nCpu, &Set);
+
+        if (pthread_setaffinity_np(hThread, sizeof(Set), &Set) == 0)
+        {
+            Status.nCpu = pConfig->nCpu;
+        }
+    }
+#endif
+
+    if (pConfig->nPriority > 0)
+    {
+        sched_param Param;
+        int nMax = sched_get_priority_max(SCHED_FIFO);
+
+        memset(&Param, 0, sizeof(Param));
+        Param.sched_priority = (pConfig->nPriority < nMax) ? pConfig->nPriority : nMax;
+
+        if (pthread_setschedparam(hThread, SCHED_FIFO, &Param) == 0)
+        {
+            Status.nPriority = Param.sched_priority;
+        }
+    }
+#endif
+
+    Status.bLocked = bLocked;
+    daqRealtimeSetStatus(pStats, &Status);
+}
+
+// Runs Body on a reader thread set up as pConfig asks and waits for
+// it. The calling thread only sleeps meanwhile, so Body has a core
+// and a priority of its own while MATLAB waits for the capture.
+template <typename F>
+static inline void daqRealtimeRun(const DaqRealtimeConfig *pConfig, DaqRealtimeStats *pStats, bool bLocked, F &Body)
+{
+    std::thread hReader([&]()
+    {
+        daqRealtimeEnter(pConfig, pStats, bLocked);
+        Body();
+    });
+
+    hReader.join();
+}
+
+#endif
@@ -0,0 +1,1167 @@
+/*************************************************************/
+// daqReplay.h
+//
+// Replay devices, which feed a capture stored in a file through
+// the same calls as the real driver, so the processing chain can
+// be tested and benchmarked on real signals without hardware. The
+// device named "file:" followed by a path replays that file, and
+// its channels are the columns of the capture: "file:/data/run.bin"
+// has channels "file:/data/run.bin/ai0" and on.
+//
+// Three kinds of files are understood:
+//
+//  - Recordings made with daqAdquireData(..., 'File', Path), in
+//    float64 volts or int16 codes with their scaling.
+//  - Files ending in .csv or .txt, with one scan per line and the
+//    values of every channel separated by commas, semicolons or
+//    blanks. A first line that is not numeric is skipped. They are
+//    decoded once, when a task is created.
+//  - Any other file holds raw samples interleaved by scan, of the
+//    type and number of channels configured for the device.
+//
+// Recordings and raw files are mapped rather than loaded, and the
+// region ahead of the reader is prefetched, so files larger than
+// the memory stream at the speed of the disk.
+//
+// Samples are delivered one per tick of the task sample clock,
+// whatever the rate of the recording, at Speed times real time: a
+// read waits until its samples would have been converted and a
+// continuous task overflows if it is not read fast enough. At a
+// Speed of zero, samples are delivered as fast as they are read,
+// which measures the throughput of the processing alone. Past the
+// end of the file the replay starts over if it loops; otherwise a
+// finite task cannot be longer than the file, and a continuous one
+// runs dry.
+//
+// Included by daqDriver.h after daqSimulator.h, whose helpers and
+// ranges it shares.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQREPLAY_H
+#define DAQREPLAY_H
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daqFile.h"
+#include "daqMappedFile.h"
+
+#define DAQ_REPLAY_PREFIX "file:"
+#define DAQ_REPLAY_MAX_CHANNELS 64
+#define DAQ_REPLAY_MAX_RATE 100e6
+#define DAQ_REPLAY_TASKS 32
+#define DAQ_REPLAY_TARGETS 16
+#define DAQ_REPLAY_NAME_LENGTH 512
+#define DAQ_REPLAY_LINE_LENGTH 4096
+
+// Bytes of a mapped file asked for ahead of the reader
+#define DAQ_REPLAY_PREFETCH (8 << 20)
+
+// Sample type of raw files besides those of daqFile.h
+#define DAQ_REPLAY_FLOAT32 2
+
+#define DAQ_REPLAY_RECORDING 0
+#define DAQ_REPLAY_BINARY 1
+#define DAQ_REPLAY_TEXT 2
+
+static const char *g_ReplayProducts[] = {"Replay of a recording", "Replay of raw samples", "Replay of a text capture"};
+
+struct DaqReplayConfig
+{
+    // Times real time, or zero for as fast as possible
+    float64 fSpeed;
+    bool bLoop;
+
+    // Layout of raw files
+    uInt32 nSampleType;
+    uInt32 nChannels;
+};
+
+// What a file holds and where its samples start
+struct DaqReplaySource
+{
+    int nFormat;
+    uInt32 nChannels;
+    uInt32 nSampleType;
+    uInt64 nOffset;
+    uInt64 nScans;
+    uInt32 nCoeffs;
+};
+
+struct DaqReplayTask
+{
+    bool bUsed;
+    char lpDevice[DAQ_REPLAY_NAME_LENGTH];
+    DaqReplayConfig Config;
+    DaqReplaySource Source;
+    DaqMappedFile File;
+
+    // Samples interleaved by scan: the mapped file, or the decoded
+    // text. Scaling holds nCoeffs per channel of an int16 recording.
+    const char *lpSamples;
+    float64 *lpDecoded;
+    float64 *lpScaling;
+
+    uInt32 nChannels;
+    int lpIndex[DAQ_REPLAY_MAX_CHANNELS];
+    float64 lpRange[DAQ_REPLAY_MAX_CHANNELS];
+    float64 fRate;
+    int32 nSampleMode;
+    uInt64 nSamples;
+    uInt64 nBufferScans;
+    bool bBufferSet;
+    bool bRunning;
+    std::chrono::steady_clock::time_point tStart;
+    uInt64 nScan;
+
+    // Last sample clock tick waited for, in single-point timing
+    uInt64 nTick;
+
+    // Bytes of the samples last asked to be prefetched
+    uInt64 nPrefetchFirst;
+    uInt64 nPrefetchEnd;
+};
+
+// True for the names the replay serves: "file:" and a path
+static inline bool daqReplayIsDevice(const char *lpDevice)
+{
+    size_t nPrefix = strlen(DAQ_REPLAY_PREFIX);
+
+    return lpDevice != NULL && strncmp(lpDevice, DAQ_REPLAY_PREFIX, nPrefix) == 0 && lpDevice[nPrefix] != '\0' &&
+           strlen(lpDevice) < DAQ_REPLAY_NAME_LENGTH;
+}
+
+static inline size_t daqReplaySampleSize(uInt32 nSampleType)
+{
+    return (nSampleType == DAQ_REPLAY_FLOAT32) ? sizeof(float32) : daqFileSampleSize(nSampleType);
+}
+
+// True for the files replayed as text, by extension
+static inline bool daqReplayIsText(const char *lpPath)
+{
+    size_t nLength = strlen(lpPath);
+    char lpExtension[5] = "";
+
+    for (size_t i = 0; i < 4 && nLength >= 4; i++)
+    {
+        lpExtension[i] = (char) tolower((unsigned char) lpPath[nLength - 4 + i]);
+    }
+
+    return !strcmp(lpExtension, ".csv") || !strcmp(lpExtension, ".txt");
+}
+
+// Finds the line of a text view starting at *pnAt and moves *pnAt
+// past it. Returns false at the end of the text.
+static inline bool daqReplayNextLine(const char *lpText, size_t nSize, size_t *pnAt, const char **plpLine, size_t *pnLength)
+{
+    if (*pnAt >= nSize)
+    {
+        return false;
+    }
+
+    const char *lpLine = lpText + *pnAt;
+    const char *lpEnd = (const char*) memchr(lpLine, '\n', nSize - *pnAt);
+    size_t nLength = (lpEnd != NULL) ? (size_t) (lpEnd - lpLine) : nSize - *pnAt;
+
+    *plpLine = lpLine;
+    *pnLength = nLength;
+    *pnAt += nLength + 1;
+
+    return true;
+}
+
+// Reads up to nMax numbers from a line into lpValues and returns how
+// many there were. Reading stops at the first field that is not a
+// number, so header lines and blank lines give zero.
+static inline uInt32 daqReplayParseLine(const char *lpLine, size_t nLength, float64 *lpValues, uInt32 nMax)
+{
+    char lpBuffer[DAQ_REPLAY_LINE_LENGTH];
+    uInt32 nValues = 0;
+
+    // Lines are copied so the parser stops at their end, which in a
+    // mapped file may be the last byte of the mapping
+    if (nLength >= sizeof(lpBuffer))
+    {
+        nLength = sizeof(lpBuffer) - 1;
+    }
+
+    memcpy(lpBuffer, lpLine, nLength);
+    lpBuffer[nLength] = '\0';
+
+    const char *p = lpBuffer;
+
+    while (nValues < nMax)
+    {
+        while (*p == ',' || *p == ';' || *p == ' ' || *p == '\t' || *p == '\r')
+        {
+            p++;
+        }
+
+        char *lpEnd;
+        float64 fValue = strtod(p, &lpEnd);
+
+        if (lpEnd == p)
+        {
+            break;
+        }
+
+        lpValues[nValues++] = fValue;
+        p = lpEnd;
+    }
+
+    return nValues;
+}
+
+// Opens the file of a replay device and finds out what it holds.
+// The file is left open but not mapped.
+static inline int32 daqReplayDescribe(DaqMappedFile *pFile, const char *lpDevice, const DaqReplayConfig *pConfig, DaqReplaySource *pSource)
+{
+    const char *lpPath = lpDevice + strlen(DAQ_REPLAY_PREFIX);
+
+    memset(pSource, 0, sizeof(DaqReplaySource));
+
+    if (!pFile->Open(lpPath) || pFile->Size() == 0)
+    {
+        pFile->Close();
+        return DAQmxErrorInvalidDeviceID;
+    }
+
+    unsigned long long nSize = pFile->Size();
+    const char *lpHeader = (nSize >= sizeof(DaqFileHeader)) ? pFile->Map(0, sizeof(DaqFileHeader)) : NULL;
+
+    if (lpHeader != NULL && memcmp(lpHeader, DAQ_FILE_MAGIC, 8) == 0)
+    {
+        DaqFileHeader Header;
+
+        memcpy(&Header, lpHeader, sizeof(Header));
+
+        if (daqFileCheckHeader(&Header, nSize) && Header.nChannels <= DAQ_REPLAY_MAX_CHANNELS)
+        {
+            pSource->nFormat = DAQ_REPLAY_RECORDING;
+            pSource->nChannels = Header.nChannels;
+            pSource->nSampleType = Header.nSampleType;
+            pSource->nOffset = Header.nHeaderSize;
+            pSource->nScans = daqFileScans(&Header, nSize);
+            pSource->nCoeffs = Header.nCoeffs;
+        }
+    }
+    else if (daqReplayIsText(lpPath))
+    {
+        const char *lpText = pFile->Map(0, (size_t) nSize);
+        const char *lpLine;
+        size_t nAt = 0, nLength;
+        float64 lpValues[DAQ_REPLAY_MAX_CHANNELS + 1];
+
+        // Channels are counted on the first numeric line
+        while (lpText != NULL && pSource->nChannels == 0 && daqReplayNextLine(lpText, (size_t) nSize, &nAt, &lpLine, &nLength))
+        {
+            pSource->nChannels = daqReplayParseLine(lpLine, nLength, lpValues, DAQ_REPLAY_MAX_CHANNELS + 1);
+            pSource->nOffset = (uInt64) (lpLine - lpText);
+        }
+
+        pSource->nFormat = DAQ_REPLAY_TEXT;
+        pSource->nSampleType = DAQ_FILE_FLOAT64;
+
+        // Counted when the text is decoded
+        pSource->nScans = (pSource->nChannels > 0 && pSource->nChannels <= DAQ_REPLAY_MAX_CHANNELS) ? 1 : 0;
+    }
+    else
+    {
+        pSource->nFormat = DAQ_REPLAY_BINARY;
+        pSource->nChannels = pConfig->nChannels;
+        pSource->nSampleType = pConfig->nSampleType;
+        pSource->nScans = nSize / (pConfig->nChannels * daqReplaySampleSize(pConfig->nSampleType));
+    }
+
+    pFile->Unmap();
+
+    if (pSource->nScans == 0)
+    {
+        pFile->Close();
+        return DAQmxErrorInvalidDeviceID;
+    }
+
+    return 0;
+}
+
+// Decodes a text file described by daqReplayDescribe into memory,
+// interleaved by scan, and counts its scans. Every numeric line must
+// hold a value for every channel.
+static inline int32 daqReplayDecode(DaqMappedFile *pFile, DaqReplaySource *pSource, float64 **plpDecoded)
+{
+    size_t nSize = (size_t) pFile->Size();
+    const char *lpText = pFile->Map(0, nSize);
+    const char *lpLine;
+    size_t nAt = (size_t) pSource->nOffset, nLength;
+    uInt64 nScans = 0;
+    float64 lpValues[DAQ_REPLAY_MAX_CHANNELS + 1];
+
+    *plpDecoded = NULL;
+
+    if (lpText == NULL)
+    {
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    // Every line that has a digit is a scan
+    while (daqReplayNextLine(lpText, nSize, &nAt, &lpLine, &nLength))
+    {
+        for (size_t i = 0; i < nLength; i++)
+        {
+            if (isdigit((unsigned char) lpLine[i]))
+            {
+                nScans++;
+                break;
+            }
+        }
+    }
+
+    float64 *lpDecoded = (float64*) malloc((size_t) nScans * pSource->nChannels * sizeof(float64));
+
+    if (lpDecoded == NULL)
+    {
+        pFile->Unmap();
+        return DAQmxErrorPALMemoryFull;
+    }
+
+    uInt64 nScan = 0;
+    nAt = (size_t) pSource->nOffset;
+
+    while (nScan < nScans && daqReplayNextLine(lpText, nSize, &nAt, &lpLine, &nLength))
+    {
+        uInt32 nValues = daqReplayParseLine(lpLine, nLength, lpValues, DAQ_REPLAY_MAX_CHANNELS + 1);
+
+        if (nValues == 0)
+        {
+            continue;
+        }
+        else if (nValues != pSource->nChannels)
+        {
+            free(lpDecoded);
+            pFile->Unmap();
+            return DAQmxErrorInvalidDeviceID;
+        }
+
+        memcpy(lpDecoded + nScan * pSource->nChannels, lpValues, nValues * sizeof(float64));
+        nScan++;
+    }
+
+    pFile->Unmap();
+
+    if (nScan != nScans)
+    {
+        free(lpDecoded);
+        return DAQmxErrorInvalidDeviceID;
+    }
+
+    pSource->nOffset = 0;
+    pSource->nScans = nScans;
+    *plpDecoded = lpDecoded;
+
+    return 0;
+}
+
+class DaqReplayBackend : public DaqBackend
+{
+public:
+    DaqReplayBackend() : m_nTargets(0)
+    {
+        m_DefaultConfig.fSpeed = 1;
+        m_DefaultConfig.bLoop = false;
+        m_DefaultConfig.nSampleType = DAQ_FILE_FLOAT64;
+        m_DefaultConfig.nChannels = 1;
+
+        for (int i = 0; i < DAQ_REPLAY_TASKS; i++)
+        {
+            m_lpTasks[i].bUsed = false;
+        }
+    }
+
+    DaqReplayConfig GetConfig(const char *lpDevice)
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        int nTarget = Find(lpDevice);
+
+        return (nTarget < 0) ? m_DefaultConfig : m_lpTargets[nTarget].Config;
+    }
+
+    // Returns false if too many devices are configured
+    bool SetConfig(const char *lpDevice, const DaqReplayConfig *pConfig)
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        int nTarget = Find(lpDevice);
+
+        if (nTarget < 0)
+        {
+            if (m_nTargets == DAQ_REPLAY_TARGETS || strlen(lpDevice) >= sizeof(m_lpTargets[0].lpName))
+            {
+                return false;
+            }
+
+            nTarget = m_nTargets++;
+            strcpy(m_lpTargets[nTarget].lpName, lpDevice);
+        }
+
+        m_lpTargets[nTarget].Config = *pConfig;
+
+        return true;
+    }
+
+    void Reset()
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_nTargets = 0;
+    }
+
+    // Tasks come from a fixed pool, since each owns a mapping
+    int32 CreateTask(const char *lpDevice, TaskHandle *phTask)
+    {
+        DaqReplayConfig Config = GetConfig(lpDevice);
+        DaqReplayTask *pTask = NULL;
+
+        {
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+
+            for (int i = 0; i < DAQ_REPLAY_TASKS && pTask == NULL; i++)
+            {
+                if (!m_lpTasks[i].bUsed)
+                {
+                    pTask = m_lpTasks + i;
+                    pTask->bUsed = true;
+                }
+            }
+        }
+
+        if (pTask == NULL)
+        {
+            return DAQmxErrorPALMemoryFull;
+        }
+
+        strcpy(pTask->lpDevice, lpDevice);
+        pTask->Config = Config;
+        pTask->lpSamples = NULL;
+        pTask->lpDecoded = NULL;
+        pTask->lpScaling = NULL;
+        pTask->nChannels = 0;
+        pTask->fRate = 1000;
+        pTask->nSampleMode = DAQmx_Val_FiniteSamps;
+        pTask->nSamples = 1000;
+        pTask->nBufferScans = 0;
+        pTask->bBufferSet = false;
+        pTask->bRunning = false;
+        pTask->nScan = 0;
+        pTask->nTick = 0;
+
+        int32 nResult = Load(pTask);
+
+        if (nResult < 0)
+        {
+            ClearTask((TaskHandle) pTask);
+            return nResult;
+        }
+
+        *phTask = (TaskHandle) pTask;
+
+        return 0;
+    }
+
+    int32 CreateAIVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName, int32 nTerminal,
+                              float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+        float64 fLimit = (fabs(fMin) > fabs(fMax)) ? fabs(fMin) : fabs(fMax);
+        float64 fRange = 0;
+
+        // The same ranges as the simulated devices
+        for (size_t i = 1; i < sizeof(g_SimAIRanges) / sizeof(g_SimAIRanges[0]); i += 2)
+        {
+            if (g_SimAIRanges[i] >= fLimit)
+            {
+                fRange = g_SimAIRanges[i];
+                break;
+            }
+        }
+
+        if (fRange == 0)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        uInt32 nBefore = pTask->nChannels;
+        int32 nResult = daqSimParseChannels(pTask->lpDevice, lpChannel, "ai", (long) pTask->Source.nChannels, pTask->lpIndex,
+                                            &pTask->nChannels, DAQ_REPLAY_MAX_CHANNELS);
+
+        if (nResult < 0)
+        {
+            pTask->nChannels = nBefore;
+            return nResult;
+        }
+
+        for (uInt32 i = nBefore; i < pTask->nChannels; i++)
+        {
+            pTask->lpRange[i] = fRange;
+        }
+
+        return 0;
+    }
+
+    // A replay has no outputs
+    int32 CreateAOVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName,
+                              float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+    {
+        return DAQmxErrorPhysicalChanDoesNotExist;
+    }
+
+    int32 CfgSampClkTiming(TaskHandle hTask, const char *lpSource, float64 fRate, int32 nEdge, int32 nSampleMode, uInt64 nSamples)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        if (fRate < DAQ_SIM_MIN_RATE || fRate > DAQ_REPLAY_MAX_RATE || nSamples == 0)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        pTask->fRate = fRate;
+        pTask->nSampleMode = nSampleMode;
+        pTask->nSamples = nSamples;
+
+        return 0;
+    }
+
+    int32 CfgInputBuffer(TaskHandle hTask, uInt32 nSamples)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        pTask->nBufferScans = nSamples;
+        pTask->bBufferSet = true;
+
+        return 0;
+    }
+
+    // Files cannot share a start trigger
+    int32 CfgDigEdgeStartTrig(TaskHandle hTask, const char *lpSource, int32 nEdge)
+    {
+        return DAQmxErrorInvalidAttributeValue;
+    }
+
+    int32 TaskControl(TaskHandle hTask, int32 nAction)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        switch (nAction)
+        {
+            case DAQmx_Val_Task_Unreserve:
+            case DAQmx_Val_Task_Stop:
+            case DAQmx_Val_Task_Abort:
+                pTask->bRunning = false;
+                break;
+        }
+
+        return 0;
+    }
+
+    // Picks up the speed and looping configured for the device, and
+    // starts the replay from the beginning of the file
+    int32 StartTask(TaskHandle hTask)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+        DaqReplayConfig Config = GetConfig(pTask->lpDevice);
+
+        if (pTask->nChannels == 0)
+        {
+            return DAQmxErrorInvalidTask;
+        }
+
+        pTask->Config.fSpeed = Config.fSpeed;
+        pTask->Config.bLoop = Config.bLoop;
+
+        if (pTask->nSampleMode == DAQmx_Val_FiniteSamps && !pTask->Config.bLoop && pTask->nSamples > pTask->Source.nScans)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        // Unless told, the driver sizes the buffer to hold a finite
+        // capture, and a continuous one by the rate
+        if (!pTask->bBufferSet)
+        {
+            uInt64 nMinimum = (pTask->fRate <= 100) ? 1000 : (pTask->fRate <= 10000) ? 10000 : (pTask->fRate <= 1000000) ? 100000 : 1000000;
+            pTask->nBufferScans = (pTask->nSamples > nMinimum) ? pTask->nSamples : nMinimum;
+        }
+
+        pTask->nScan = 0;
+        pTask->nTick = 0;
+        pTask->nPrefetchFirst = 0;
+        pTask->nPrefetchEnd = 0;
+        Prefetch(pTask);
+
+        pTask->tStart = std::chrono::steady_clock::now();
+        pTask->bRunning = true;
+
+        return 0;
+    }
+
+    int32 StopTask(TaskHandle hTask)
+    {
+        ((DaqReplayTask*) hTask)->bRunning = false;
+        return 0;
+    }
+
+    int32 ClearTask(TaskHandle hTask)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        pTask->File.Close();
+        free(pTask->lpDecoded);
+        free(pTask->lpScaling);
+
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        pTask->bUsed = false;
+
+        return 0;
+    }
+
+    int32 GetTaskNumChans(TaskHandle hTask, uInt32 *pnChannels)
+    {
+        *pnChannels = ((DaqReplayTask*) hTask)->nChannels;
+        return 0;
+    }
+
+    int32 GetTaskChannels(TaskHandle hTask, char *lpData, uInt32 nSize)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        return CopyChannels(pTask->lpDevice, pTask->lpIndex, pTask->nChannels, lpData, nSize);
+    }
+
+    int32 GetNthTaskChannel(TaskHandle hTask, uInt32 nIndex, char *lpData, int32 nSize)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+        char lpChannel[DAQ_REPLAY_NAME_LENGTH + 8];
+
+        if (nIndex < 1 || nIndex > pTask->nChannels)
+        {
+            return DAQmxErrorPhysicalChanDoesNotExist;
+        }
+
+        snprintf(lpChannel, sizeof(lpChannel), "%s/ai%d", pTask->lpDevice, pTask->lpIndex[nIndex - 1]);
+
+        return daqSimCopyString(lpChannel, lpData, (uInt32) nSize);
+    }
+
+    int32 ReadAnalogF64(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, float64 *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        return Read((DaqReplayTask*) hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead);
+    }
+
+    int32 ReadBinaryI16(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, int16 *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        return Read((DaqReplayTask*) hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead);
+    }
+
+    int32 WriteAnalogF64(TaskHandle hTask, int32 nSamples, bool32 bAutoStart, float64 fTimeout, bool32 nLayout,
+                         const float64 *lpData, int32 *pnWritten)
+    {
+        *pnWritten = 0;
+        return DAQmxErrorInvalidTask;
+    }
+
+    // Sleeps until the tick after the last one waited for, skipping to
+    // the current tick if that one has gone by
+    int32 WaitForNextSampleClock(TaskHandle hTask, float64 fTimeout, bool32 *pbLate)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        *pbLate = 0;
+
+        if (!pTask->bRunning)
+        {
+            int32 nResult = StartTask(hTask);
+
+            if (nResult < 0)
+            {
+                return nResult;
+            }
+        }
+
+        if (pTask->Config.fSpeed <= 0)
+        {
+            pTask->nTick++;
+            return 0;
+        }
+
+        uInt64 nNow = Produced(pTask, 0);
+
+        if (nNow > pTask->nTick + 1)
+        {
+            pTask->nTick = nNow;
+            *pbLate = 1;
+            return 0;
+        }
+
+        pTask->nTick++;
+        std::this_thread::sleep_until(pTask->tStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(pTask->nTick / (pTask->fRate * pTask->Config.fSpeed))));
+
+        return 0;
+    }
+
+    // The scaling of an int16 recording, or volts divided by the size
+    // of one code of the range, as on the simulated devices
+    int32 GetAIDevScalingCoeff(TaskHandle hTask, const char *lpChannel, float64 *lpData, uInt32 nSize)
+    {
+        DaqReplayTask *pTask = (DaqReplayTask*) hTask;
+
+        for (uInt32 i = 0; i < pTask->nChannels; i++)
+        {
+            char lpName[DAQ_REPLAY_NAME_LENGTH + 8];
+
+            snprintf(lpName, sizeof(lpName), "%s/ai%d", pTask->lpDevice, pTask->lpIndex[i]);
+
+            if (!strcmp(lpName, lpChannel))
+            {
+                float64 lpCoeffs[4] = {0, pTask->lpRange[i] / DAQ_SIM_CODES, 0, 0};
+
+                if (pTask->lpScaling != NULL)
+                {
+                    return daqSimCopyArray(pTask->lpScaling + (size_t) pTask->lpIndex[i] * pTask->Source.nCoeffs, pTask->Source.nCoeffs,
+                                           lpData, nSize);
+                }
+
+                return daqSimCopyArray(lpCoeffs, 4, lpData, nSize);
+            }
+        }
+
+        return DAQmxErrorPhysicalChanDoesNotExist;
+    }
+
+    // Raw codes are int16, whether recorded or quantized from volts
+    int32 GetAIResolution(TaskHandle hTask, const char *lpChannel, float64 *pfBits)
+    {
+        *pfBits = 16;
+        return 0;
+    }
+
+    int32 GetDevProductType(const char *lpDevice, char *lpData, uInt32 nSize)
+    {
+        DaqReplaySource Source;
+        int32 nResult = Describe(lpDevice, &Source);
+
+        return (nResult < 0) ? nResult : daqSimCopyString(g_ReplayProducts[Source.nFormat], lpData, nSize);
+    }
+
+    int32 GetDevAIPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize)
+    {
+        DaqReplaySource Source;
+        int lpIndex[DAQ_REPLAY_MAX_CHANNELS];
+        int32 nResult = Describe(lpDevice, &Source);
+
+        if (nResult < 0)
+        {
+            return nResult;
+        }
+
+        for (uInt32 i = 0; i < Source.nChannels; i++)
+        {
+            lpIndex[i] = (int) i;
+        }
+
+        return CopyChannels(lpDevice, lpIndex, Source.nChannels, lpData, nSize);
+    }
+
+    int32 GetDevAOPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize) { return daqSimCopyString("", lpData, nSize); }
+    int32 GetDevAISupportedMeasTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimMeasTypes, 1, lpData, nSize); }
+    int32 GetDevAOSupportedOutputTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimMeasTypes, 0, lpData, nSize); }
+    int32 GetDevAISampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimSampleModes, 3, lpData, nSize); }
+    int32 GetDevAOSampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimSampleModes, 0, lpData, nSize); }
+
+    int32 GetDevAIVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize)
+    {
+        return daqSimCopyArray(g_SimAIRanges, sizeof(g_SimAIRanges) / sizeof(g_SimAIRanges[0]), lpData, nSize);
+    }
+
+    int32 GetDevAOVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimAORanges, 0, lpData, nSize); }
+    int32 GetDevAIMaxSingleChanRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_REPLAY_MAX_RATE; return 0; }
+    int32 GetDevAIMaxMultiChanRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_REPLAY_MAX_RATE; return 0; }
+    int32 GetDevAIMinRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_SIM_MIN_RATE; return 0; }
+    int32 GetDevAISimultaneousSamplingSupported(const char *lpDevice, bool32 *pbValue) { *pbValue = 1; return 0; }
+    int32 GetDevAOSampClkSupported(const char *lpDevice, bool32 *pbValue) { *pbValue = 0; return 0; }
+    int32 GetDevAOMaxRate(const char *lpDevice, float64 *pfRate) { *pfRate = 0; return 0; }
+    int32 GetDevAOMinRate(const char *lpDevice, float64 *pfRate) { *pfRate = 0; return 0; }
+
+private:
+    struct Target
+    {
+        char lpName[DAQ_REPLAY_NAME_LENGTH];
+        DaqReplayConfig Config;
+    };
+
+    int Find(const char *lpName) const
+    {
+        for (int i = 0; i < m_nTargets; i++)
+        {
+            if (!strcmp(m_lpTargets[i].lpName, lpName))
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    int32 Describe(const char *lpDevice, DaqReplaySource *pSource)
+    {
+        DaqMappedFile File;
+        DaqReplayConfig Config = GetConfig(lpDevice);
+
+        return daqReplayDescribe(&File, lpDevice, &Config, pSource);
+    }
+
+    // Opens the file of a new task and maps its samples, or decodes
+    // them if it is text
+    int32 Load(DaqReplayTask *pTask)
+    {
+        DaqReplaySource *pSource = &pTask->Source;
+        int32 nResult = daqReplayDescribe(&pTask->File, pTask->lpDevice, &pTask->Config, pSource);
+
+        if (nResult < 0)
+        {
+            return nResult;
+        }
+
+        if (pSource->nFormat == DAQ_REPLAY_TEXT)
+        {
+            nResult = daqReplayDecode(&pTask->File, pSource, &pTask->lpDecoded);
+            pTask->File.Close();
+            pTask->lpSamples = (const char*) pTask->lpDecoded;
+
+            return nResult;
+        }
+
+        // Codes of an int16 recording are scaled with its coefficients
+        if (pSource->nFormat == DAQ_REPLAY_RECORDING && pSource->nSampleType == DAQ_FILE_INT16 && pSource->nCoeffs > 0)
+        {
+            size_t nBytes = (size_t) pSource->nChannels * pSource->nCoeffs * sizeof(float64);
+            const char *lpHeader = pTask->File.Map(0, (size_t) pSource->nOffset);
+
+            pTask->lpScaling = (float64*) malloc(nBytes);
+
+            if (lpHeader == NULL || pTask->lpScaling == NULL)
+            {
+                return DAQmxErrorPALMemoryFull;
+            }
+
+            memcpy(pTask->lpScaling, lpHeader + sizeof(DaqFileHeader), nBytes);
+        }
+
+        size_t nScanBytes = pSource->nChannels * daqReplaySampleSize(pSource->nSampleType);
+
+        pTask->lpSamples = pTask->File.Map(pSource->nOffset, (size_t) (pSource->nScans * nScanBytes));
+
+        return (pTask->lpSamples == NULL) ? DAQmxErrorPALMemoryFull : 0;
+    }
+
+    int32 CopyChannels(const char *lpDevice, const int *lpIndex, uInt32 nChannels, char *lpData, uInt32 nSize)
+    {
+        char lpList[DAQ_REPLAY_MAX_CHANNELS * (DAQ_REPLAY_NAME_LENGTH + 8)] = "";
+
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            char lpChannel[DAQ_REPLAY_NAME_LENGTH + 8];
+
+            snprintf(lpChannel, sizeof(lpChannel), "%s%s/ai%d", (i > 0) ? ", " : "", lpDevice, lpIndex[i]);
+            strcat(lpList, lpChannel);
+        }
+
+        return daqSimCopyString(lpList, lpData, nSize);
+    }
+
+    // Scans the task can deliver before it ends or runs out of file
+    static uInt64 Last(const DaqReplayTask *pTask)
+    {
+        uInt64 nLast = (pTask->nSampleMode == DAQmx_Val_FiniteSamps) ? pTask->nSamples : ~0ULL;
+
+        return (!pTask->Config.bLoop && pTask->Source.nScans < nLast) ? pTask->Source.nScans : nLast;
+    }
+
+    // Scans delivered so far at Speed times the rate, or as many as
+    // asked for at full speed
+    uInt64 Produced(const DaqReplayTask *pTask, uInt64 nWanted) const
+    {
+        uInt64 nProduced = nWanted;
+        uInt64 nLast = Last(pTask);
+
+        if (pTask->Config.fSpeed > 0)
+        {
+            std::chrono::duration<double> fElapsed = std::chrono::steady_clock::now() - pTask->tStart;
+            float64 fProduced = fElapsed.count() * pTask->fRate * pTask->Config.fSpeed;
+
+            nProduced = (fProduced < (float64) nLast) ? (uInt64) fProduced : nLast;
+        }
+
+        return (nProduced > nLast) ? nLast : nProduced;
+    }
+
+    // Keeps the bytes after the next scan to read on their way into
+    // memory, asking again once half of them have been read
+    void Prefetch(DaqReplayTask *pTask)
+    {
+        if (pTask->lpDecoded != NULL)
+        {
+            return;
+        }
+
+        uInt64 nScanBytes = pTask->Source.nChannels * daqReplaySampleSize(pTask->Source.nSampleType);
+        uInt64 nAt = (pTask->nScan % pTask->Source.nScans) * nScanBytes;
+
+        if (nAt >= pTask->nPrefetchFirst && nAt + DAQ_REPLAY_PREFETCH / 2 <= pTask->nPrefetchEnd)
+        {
+            return;
+        }
+
+        pTask->File.Prefetch(pTask->lpSamples + nAt, DAQ_REPLAY_PREFETCH);
+        pTask->nPrefetchFirst = nAt;
+        pTask->nPrefetchEnd = nAt + DAQ_REPLAY_PREFETCH;
+    }
+
+    static void Store(float64 *lpData, size_t nIndex, float64 fVolts, float64 fCode)
+    {
+        lpData[nIndex] = fVolts;
+    }
+
+    // Quantized and clipped as the converter would
+    static void Store(int16 *lpData, size_t nIndex, float64 fVolts, float64 fCode)
+    {
+        float64 fLevel = floor(fVolts / fCode + 0.5);
+        lpData[nIndex] = (int16) ((fLevel > 32767) ? 32767 : (fLevel < -32768) ? -32768 : fLevel);
+    }
+
+    static void StoreCode(float64 *lpData, size_t nIndex, int16 nCode, const float64 *lpCoeffs, uInt32 nCoeffs)
+    {
+        float64 fVolts = lpCoeffs[nCoeffs - 1];
+
+        for (int k = (int) nCoeffs - 2; k >= 0; k--)
+        {
+            fVolts = fVolts * nCode + lpCoeffs[k];
+        }
+
+        lpData[nIndex] = fVolts;
+    }
+
+    // Codes read as codes are passed through
+    static void StoreCode(int16 *lpData, size_t nIndex, int16 nCode, const float64 *lpCoeffs, uInt32 nCoeffs)
+    {
+        lpData[nIndex] = nCode;
+    }
+
+    // Converts nScans scans of the file from scan nFirst on into the
+    // output, from its scan nOffset on
+    template <typename T>
+    static void Copy(const DaqReplayTask *pTask, uInt64 nFirst, uInt32 nScans, bool32 nFillMode, uInt32 nStride, uInt32 nOffset, T *lpData)
+    {
+        const DaqReplaySource *pSource = &pTask->Source;
+        size_t nColumns = pSource->nChannels;
+        bool bByScan = nFillMode == DAQmx_Val_GroupByScanNumber;
+        size_t nStep = bByScan ? pTask->nChannels : 1;
+        const char *lpFirst = pTask->lpSamples + nFirst * nColumns * daqReplaySampleSize(pSource->nSampleType);
+        bool bSame = bByScan && pTask->nChannels == nColumns && pSource->nSampleType == DAQ_FILE_FLOAT64 && sizeof(T) == sizeof(float64);
+
+        for (uInt32 c = 0; c < pTask->nChannels && bSame; c++)
+        {
+            bSame = pTask->lpIndex[c] == (int) c;
+        }
+
+        // Every channel in file order: the scans are already laid out
+        if (bSame)
+        {
+            memcpy(lpData + (size_t) nOffset * nColumns, lpFirst, (size_t) nScans * nColumns * sizeof(float64));
+            return;
+        }
+
+        for (uInt32 c = 0; c < pTask->nChannels; c++)
+        {
+            size_t nIndex = bByScan ? (size_t) nOffset * pTask->nChannels + c : (size_t) c * nStride + nOffset;
+            size_t nColumn = (size_t) pTask->lpIndex[c];
+            float64 fCode = pTask->lpRange[c] / DAQ_SIM_CODES;
+
+            if (pSource->nSampleType == DAQ_FILE_FLOAT64)
+            {
+                const float64 *ptrSamples = (const float64*) lpFirst + nColumn;
+
+                for (uInt32 i = 0; i < nScans; i++)
+                {
+                    Store(lpData, nIndex + i * nStep, ptrSamples[i * nColumns], fCode);
+                }
+            }
+            else if (pSource->nSampleType == DAQ_REPLAY_FLOAT32)
+            {
+                const float32 *ptrSamples = (const float32*) lpFirst + nColumn;
+
+                for (uInt32 i = 0; i < nScans; i++)
+                {
+                    Store(lpData, nIndex + i * nStep, ptrSamples[i * nColumns], fCode);
+                }
+            }
+            else
+            {
+                const int16 *ptrSamples = (const int16*) lpFirst + nColumn;
+                float64 lpLinear[2] = {0, fCode};
+                const float64 *lpCoeffs = (pTask->lpScaling != NULL) ? pTask->lpScaling + nColumn * pSource->nCoeffs : lpLinear;
+                uInt32 nCoeffs = (pTask->lpScaling != NULL) ? pSource->nCoeffs : 2;
+
+                for (uInt32 i = 0; i < nScans; i++)
+                {
+                    StoreCode(lpData, nIndex + i * nStep, ptrSamples[i * nColumns], lpCoeffs, nCoeffs);
+                }
+            }
+        }
+    }
+
+    // Copies the next nScans scans of the task, starting over at the
+    // end of the file
+    template <typename T>
+    static void Deliver(const DaqReplayTask *pTask, uInt32 nScans, bool32 nFillMode, uInt32 nStride, T *lpData)
+    {
+        uInt32 nDone = 0;
+
+        while (nDone < nScans)
+        {
+            uInt64 nAt = (pTask->nScan + nDone) % pTask->Source.nScans;
+            uInt64 nRun = pTask->Source.nScans - nAt;
+
+            if (nRun > nScans - nDone)
+            {
+                nRun = nScans - nDone;
+            }
+
+            Copy(pTask, nAt, (uInt32) nRun, nFillMode, nStride, nDone, lpData);
+            nDone += (uInt32) nRun;
+        }
+    }
+
+    template <typename T>
+    int32 Read(DaqReplayTask *pTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, T *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        *pnRead = 0;
+
+        // Reading starts a task that was not started, as in the driver
+        if (!pTask->bRunning)
+        {
+            int32 nResult = StartTask((TaskHandle) pTask);
+
+            if (nResult < 0)
+            {
+                return nResult;
+            }
+        }
+
+        // In single-point timing every read takes the scan of the last
+        // tick waited for
+        if (pTask->nSampleMode == DAQmx_Val_HWTimedSinglePoint)
+        {
+            if (nSize < pTask->nChannels)
+            {
+                return DAQmxErrorInvalidAttributeValue;
+            }
+            else if (pTask->nTick >= Last(pTask))
+            {
+                return DAQmxErrorSamplesNotYetAvailable;
+            }
+
+            pTask->nScan = pTask->nTick;
+            Deliver(pTask, 1, nFillMode, 1, lpData);
+            *pnRead = 1;
+
+            return 0;
+        }
+
+        uInt64 nLimit = nSize / pTask->nChannels;
+        uInt64 nWanted;
+
+        if (nSamples < 0)
+        {
+            // Whatever is available, or the rest of a finite capture
+            nWanted = Produced(pTask, (pTask->nSampleMode == DAQmx_Val_FiniteSamps) ? pTask->nSamples : pTask->nScan + nLimit) - pTask->nScan;
+        }
+        else
+        {
+            nWanted = (uInt64) nSamples;
+        }
+
+        if (pTask->nSampleMode == DAQmx_Val_FiniteSamps && pTask->nScan + nWanted > pTask->nSamples)
+        {
+            nWanted = pTask->nSamples - pTask->nScan;
+        }
+
+        if (nWanted > nLimit)
+        {
+            nWanted = nLimit;
+        }
+
+        // Samples left unread for longer than the buffer holds are lost,
+        // which a finite task only risks with a buffer set smaller than
+        // the capture
+        if (pTask->Config.fSpeed > 0 && Produced(pTask, 0) - pTask->nScan > pTask->nBufferScans)
+        {
+            return DAQmxErrorSamplesNoLongerAvailable;
+        }
+
+        uInt64 nEnd = pTask->nScan + nWanted;
+
+        if (pTask->Config.fSpeed > 0 && Produced(pTask, nEnd) < nEnd)
+        {
+            // Sleep until the last sample would be converted, or the timeout
+            std::chrono::steady_clock::time_point tReady = pTask->tStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(nEnd / (pTask->fRate * pTask->Config.fSpeed)));
+
+            if (fTimeout >= 0)
+            {
+                std::chrono::steady_clock::time_point tDeadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(fTimeout));
+
+                if (tDeadline < tReady)
+                {
+                    tReady = tDeadline;
+                }
+            }
+
+            std::this_thread::sleep_until(tReady);
+        }
+
+        uInt64 nProduced = Produced(pTask, nEnd);
+        uInt32 nScans = (uInt32) ((nProduced < nEnd) ? nProduced - pTask->nScan : nWanted);
+        uInt32 nStride = (nSamples < 0) ? nScans : (uInt32) nSamples;
+
+        Deliver(pTask, nScans, nFillMode, nStride, lpData);
+
+        pTask->nScan += nScans;
+        *pnRead = (int32) nScans;
+        Prefetch(pTask);
+
+        return (nScans < nWanted) ? DAQmxErrorSamplesNotYetAvailable : 0;
+    }
+
+    std::mutex m_Mutex;
+    Target m_lpTargets[DAQ_REPLAY_TARGETS];
+    int m_nTargets;
+    DaqReplayTask m_lpTasks[DAQ_REPLAY_TASKS];
+    DaqReplayConfig m_DefaultConfig;
+};
+
+#endif
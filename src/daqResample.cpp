@@ -0,0 +1,298 @@
+/*************************************************************/
+// daqResample.cpp
+//
+// Resamples captures by a rational factor with a fractional delay,
+// or brings captures taken at different rates, on different devices
+// or at different times, to a common timebase, one channel per
+// thread
+//
+//                       ------ ARGUMENTS ------
+//
+// [Data (f)] = daqResample(Data (f), Up (n), Down (n), Delay (f))
+// [Data (f)] = daqResample(Captures (c), Rates (f), Rate (f), Starts (f))
+//
+// - c denotes a cell array
+// - f denotes a real matrix
+// - n denotes a natural value
+//
+//            - Data: samples laid out as daqAdquireData returns them: a
+//                    row vector for a single channel or a matrix with one
+//                    column per channel. The output has Up/Down times as
+//                    many samples, or as many as fit in the shortest
+//                    capture
+//
+//        - Up, Down: the output rate is Up/Down times the input rate.
+//                    Neither may be larger than 1024
+//
+//           - Delay: optional delay of every channel, or of all of them,
+//                    in input samples. Output m is the input at
+//                    m * Down / Up - Delay, interpolated between samples.
+//                    Delays that are not a multiple of 1/Up are resolved
+//                    to about 1/512 of a sample
+//
+//        - Captures: the captures to align, each laid out like Data
+//
+//           - Rates: the rate of every capture, in samples per second
+//
+//            - Rate: the rate of the output. Every Rate/Rates(i) must be
+//                    a ratio of integers up to 1024
+//
+//          - Starts: optional time of the first sample of every capture,
+//                    in seconds. Output m is taken at m / Rate
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqParallel.h"
+#include "daqResample.h"
+
+// Samples of a channel handed to the resampler at a time
+#define DAQ_RESAMPLE_BLOCK 65536
+
+// Relative error allowed between Rate/Rates(i) and its ratio
+#define DAQ_RESAMPLE_TOLERANCE 1e-9
+
+// Most captures a single call may align
+#define DAQ_RESAMPLE_MAX_INPUTS 64
+
+// One capture to resample: its samples, and where its channels go
+struct DaqResampleInput
+{
+    const float64 *lpData;
+    uInt64 nSamples;
+    uInt32 nChannels;
+    uInt32 nFirst;
+    int nUp;
+    int nDown;
+    DaqResampler *pResampler;
+};
+
+// Checks a capture and returns its samples per channel and channels
+void getCapture(const mxArray *pData, const char *lpName, uInt64 *pnSamples, uInt32 *pnChannels)
+{
+    char lpOutput[256];
+    
+    if (pData == NULL || !mxIsDouble(pData) || mxIsComplex(pData) || mxIsEmpty(pData) || mxGetNumberOfDimensions(pData) != 2)
+    {
+        sprintf(lpOutput, "%s must be a real double matrix.", lpName);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    // A single channel comes as a row vector
+    *pnChannels = (uInt32) ((mxGetM(pData) == 1) ? 1 : mxGetN(pData));
+    *pnSamples = (mxGetM(pData) == 1) ? mxGetN(pData) : mxGetM(pData);
+}
+
+// Returns a natural factor no larger than DAQ_RESAMPLE_MAX_FACTOR
+int getFactor(const mxArray *pValue, int nArgument)
+{
+    char lpOutput[128];
+    double fValue = (mxIsNumeric(pValue) && mxGetNumberOfElements(pValue) == 1) ? mxGetScalar(pValue) : 0;
+    
+    if (fValue < 1 || fValue > DAQ_RESAMPLE_MAX_FACTOR || fValue != floor(fValue))
+    {
+        sprintf(lpOutput, "Input argument %d must be a natural value up to %d.", nArgument, DAQ_RESAMPLE_MAX_FACTOR);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return (int) fValue;
+}
+
+// Checks a real vector of nLength values, or a scalar that goes for
+// all of them if bShared is set, and copies it to lpValues
+void getVector(const mxArray *pValue, int nArgument, size_t nLength, bool bShared, float64 *lpValues)
+{
+    char lpOutput[128];
+    size_t nElements = mxGetNumberOfElements(pValue);
+    
+    if (!mxIsDouble(pValue) || mxIsComplex(pValue) || (nElements != nLength && !(bShared && nElements == 1)))
+    {
+        sprintf(lpOutput, "Input argument %d must be a real vector of %d values%s.", nArgument, (int) nLength,
+                bShared ? " or a scalar" : "");
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    for (size_t i = 0; i < nLength; i++)
+    {
+        lpValues[i] = mxGetPr(pValue)[(nElements == 1) ? 0 : i];
+        
+        if (!mxIsFinite(lpValues[i]))
+        {
+            sprintf(lpOutput, "Input argument %d must hold finite values.", nArgument);
+            mexErrMsgTxt(lpOutput);
+        }
+    }
+}
+
+// Resamples every channel of every input into its column of lpOut,
+// nLength samples each, one channel per thread
+void resampleInputs(DaqResampleInput *lpInputs, int nInputs, uInt32 nChannels, size_t nLength, float64 *lpOut)
+{
+    DaqResampleInput **lpOwners = (DaqResampleInput**) mxMalloc(nChannels * sizeof(DaqResampleInput*));
+    
+    for (int k = 0; k < nInputs; k++)
+    {
+        for (uInt32 i = 0; i < lpInputs[k].nChannels; i++)
+        {
+            lpOwners[lpInputs[k].nFirst + i] = lpInputs + k;
+        }
+    }
+    
+    auto Work = [&](size_t nColumn)
+    {
+        DaqResampleInput *pInput = lpOwners[nColumn];
+        uInt32 nChannel = (uInt32) nColumn - pInput->nFirst;
+        const float64 *lpIn = pInput->lpData + nChannel * pInput->nSamples;
+        float64 *lpColumn = lpOut + nColumn * nLength;
+        size_t nWritten = 0;
+        
+        for (uInt64 i = 0; i < pInput->nSamples && nWritten < nLength; i += DAQ_RESAMPLE_BLOCK)
+        {
+            size_t nBlock = (pInput->nSamples - i < DAQ_RESAMPLE_BLOCK) ? (size_t) (pInput->nSamples - i) : DAQ_RESAMPLE_BLOCK;
+            nWritten += pInput->pResampler->Process(nChannel, lpIn + i, nBlock, lpColumn + nWritten, nLength - nWritten);
+        }
+        
+        nWritten += pInput->pResampler->Flush(nChannel, lpColumn + nWritten, nLength - nWritten);
+    };
+    
+    daqParallelFor(nChannels, Work);
+    
+    mxFree(lpOwners);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 3 && nrhs != 4)
+    {
+        mexErrMsgTxt("Three or four inputs required.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    bool bAlign = mxIsCell(prhs[0]);
+    int nInputs = bAlign ? (int) mxGetNumberOfElements(prhs[0]) : 1;
+    char lpOutput[128];
+    
+    if (nInputs < 1 || nInputs > DAQ_RESAMPLE_MAX_INPUTS)
+    {
+        sprintf(lpOutput, "Input argument 1 must hold between 1 and %d captures.", DAQ_RESAMPLE_MAX_INPUTS);
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    DaqResampleInput lpInputs[DAQ_RESAMPLE_MAX_INPUTS];
+    uInt32 nChannels = 0;
+    
+    for (int k = 0; k < nInputs; k++)
+    {
+        const mxArray *pData = bAlign ? mxGetCell(prhs[0], k) : prhs[0];
+        
+        sprintf(lpOutput, bAlign ? "Capture %d" : "Input argument 1", k + 1);
+        getCapture(pData, lpOutput, &lpInputs[k].nSamples, &lpInputs[k].nChannels);
+        
+        lpInputs[k].lpData = mxGetPr(pData);
+        lpInputs[k].nFirst = nChannels;
+        nChannels += lpInputs[k].nChannels;
+    }
+    
+    float64 *lpDelays = (float64*) mxCalloc(nChannels, sizeof(float64));
+    
+    if (bAlign)
+    {
+        float64 fRate = (mxIsDouble(prhs[2]) && mxGetNumberOfElements(prhs[2]) == 1) ? mxGetScalar(prhs[2]) : 0;
+        float64 lpRates[DAQ_RESAMPLE_MAX_INPUTS], lpStarts[DAQ_RESAMPLE_MAX_INPUTS];
+        
+        getVector(prhs[1], 2, nInputs, false, lpRates);
+        
+        if (!(fRate > 0) || !mxIsFinite(fRate))
+        {
+            mexErrMsgTxt("Input argument 3 must be a positive rate.");
+        }
+        
+        if (nrhs == 4)
+        {
+            getVector(prhs[3], 4, nInputs, false, lpStarts);
+        }
+        
+        for (int k = 0; k < nInputs; k++)
+        {
+            if (!(lpRates[k] > 0) || !daqResampleRatio(fRate / lpRates[k], DAQ_RESAMPLE_TOLERANCE, &lpInputs[k].nUp, &lpInputs[k].nDown))
+            {
+                sprintf(lpOutput, "The rate of capture %d cannot be brought to Rate by a ratio of integers up to %d.", k + 1,
+                        DAQ_RESAMPLE_MAX_FACTOR);
+                mexErrMsgTxt(lpOutput);
+            }
+            
+            // Output m is at m / Rate: sample Starts(k) * Rates(k) of its input
+            for (uInt32 i = 0; i < lpInputs[k].nChannels && nrhs == 4; i++)
+            {
+                lpDelays[lpInputs[k].nFirst + i] = lpStarts[k] * lpRates[k];
+            }
+        }
+    }
+    else
+    {
+        lpInputs[0].nUp = getFactor(prhs[1], 2);
+        lpInputs[0].nDown = getFactor(prhs[2], 3);
+        
+        if (nrhs == 4)
+        {
+            getVector(prhs[3], 4, nChannels, true, lpDelays);
+        }
+    }
+    
+    // The resamplers own native memory, so nothing may fail from here
+    // until they are freed
+    DaqResampler lpResamplers[DAQ_RESAMPLE_MAX_INPUTS];
+    size_t nLength = 0;
+    bool bReady = true;
+    
+    for (int k = 0; k < nInputs && bReady; k++)
+    {
+        DaqResampleInput *pInput = lpInputs + k;
+        
+        pInput->pResampler = lpResamplers + k;
+        bReady = pInput->pResampler->Init(pInput->nUp, pInput->nDown, lpDelays + pInput->nFirst, pInput->nChannels,
+                                          DAQ_RESAMPLE_BLOCK);
+        
+        // Every channel stops with the shortest
+        for (uInt32 i = 0; i < pInput->nChannels && bReady; i++)
+        {
+            size_t nChannelLength = (size_t) pInput->pResampler->OutputLength(i, pInput->nSamples);
+            nLength = ((k == 0 && i == 0) || nChannelLength < nLength) ? nChannelLength : nLength;
+        }
+    }
+    
+    mxFree(lpDelays);
+    
+    if (bReady)
+    {
+        plhs[0] = (nChannels == 1) ? mxCreateDoubleMatrix(1, nLength, mxREAL) : mxCreateDoubleMatrix(nLength, nChannels, mxREAL);
+        resampleInputs(lpInputs, nInputs, nChannels, nLength, mxGetPr(plhs[0]));
+    }
+    
+    for (int k = 0; k < nInputs; k++)
+    {
+        lpResamplers[k].Free();
+    }
+    
+    if (!bReady)
+    {
+        mexErrMsgTxt("Not enough memory to resample.");
+    }
+}
@@ -0,0 +1,352 @@
+/*************************************************************/
+// daqResample.h
+//
+// Rational resampling with a fractional delay. For every channel
+//
+//     y[m] = x(m * Down / Up - Delay)
+//
+// where x(t) is the band-limited signal through the samples x[n],
+// evaluated with a Kaiser-windowed sinc that also removes what the
+// lower of both rates cannot hold. The filter is split in phases,
+// one per position between two input samples, so every output is a
+// single inner product with the inputs around it.
+//
+// Samples are given in blocks of any size and the state of each
+// channel is carried from one to the next. Outputs are centered on
+// their inputs rather than delayed by the filter, so each one waits
+// for the half length of the filter after it; Flush gives the last
+// ones once the capture ends, as if it were followed by zeros.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQRESAMPLE_H
+#define DAQRESAMPLE_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daqFilter.h"
+
+#ifndef DAQ_PI
+#define DAQ_PI 3.14159265358979323846
+#endif
+
+// Zero crossings of the sinc on each side, at the lower rate
+#define DAQ_RESAMPLE_ZEROS 16
+
+// Shape of the Kaiser window, about 80 dB of stopband
+#define DAQ_RESAMPLE_BETA 8.0
+
+// Phases between two inputs at least, when a delay is not a whole
+// number of output phases
+#define DAQ_RESAMPLE_DELAY_PHASES 512
+
+// Largest Up or Down factor
+#define DAQ_RESAMPLE_MAX_FACTOR 1024
+
+static inline long long daqGcd(long long a, long long b)
+{
+    while (b != 0)
+    {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+// Floor of a / b for b > 0
+static inline long long daqFloorDiv(long long a, long long b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Modified Bessel function of the first kind and order 0
+static inline float64 daqBesselI0(float64 x)
+{
+    float64 fSum = 1, fTerm = 1;
+
+    for (int k = 1; k < 64 && fTerm > 1e-16 * fSum; k++)
+    {
+        fTerm *= (x / (2 * k)) * (x / (2 * k));
+        fSum += fTerm;
+    }
+
+    return fSum;
+}
+
+// Finds Up / Down equal to fRatio within a relative fTolerance, with
+// neither larger than DAQ_RESAMPLE_MAX_FACTOR, by continued fractions
+static inline bool daqResampleRatio(float64 fRatio, float64 fTolerance, int *pnUp, int *pnDown)
+{
+    long long nUp = 1, nDown = 0, nPrevUp = 0, nPrevDown = 1;
+    float64 fRest = fRatio;
+
+    if (!(fRatio > 0))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 64; i++)
+    {
+        float64 fWhole = floor(fRest);
+
+        if (fWhole > DAQ_RESAMPLE_MAX_FACTOR)
+        {
+            return false;
+        }
+
+        long long nWhole = (long long) fWhole;
+        long long nNextUp = nWhole * nUp + nPrevUp, nNextDown = nWhole * nDown + nPrevDown;
+
+        if (nNextUp > DAQ_RESAMPLE_MAX_FACTOR || nNextDown > DAQ_RESAMPLE_MAX_FACTOR)
+        {
+            return false;
+        }
+
+        nPrevUp = nUp;
+        nPrevDown = nDown;
+        nUp = nNextUp;
+        nDown = nNextDown;
+
+        if (fabs((float64) nUp / nDown - fRatio) <= fTolerance * fRatio)
+        {
+            *pnUp = (int) nUp;
+            *pnDown = (int) nDown;
+            return true;
+        }
+
+        if (fRest - fWhole <= 0)
+        {
+            return false;
+        }
+
+        fRest = 1 / (fRest - fWhole);
+    }
+
+    return false;
+}
+
+class DaqResampler
+{
+public:
+    DaqResampler() : m_lpTaps(NULL), m_lpHistory(NULL), m_lpWork(NULL), m_lpZeros(NULL), m_lpTime(NULL), m_lpDelay(NULL),
+                     m_lpConsumed(NULL), m_lpProduced(NULL), m_nUp(1), m_nDown(1), m_nPhases(1), m_nStep(1), m_nTaps(0),
+                     m_nChannels(0), m_nMaxBlock(0)
+    {
+    }
+
+    ~DaqResampler()
+    {
+        Free();
+    }
+
+    // Prepares the resampler for nChannels channels given in blocks of
+    // at most nMaxBlock samples. lpDelays holds the delay of every
+    // channel in input samples, or is NULL for none. A channel may only
+    // be processed by one thread at a time, but different channels by
+    // different threads.
+    bool Init(int nUp, int nDown, const float64 *lpDelays, uInt32 nChannels, size_t nMaxBlock)
+    {
+        Free();
+
+        long long nGcd = daqGcd(nUp, nDown);
+        bool bFine = false;
+
+        m_nUp = nUp / nGcd;
+        m_nDown = nDown / nGcd;
+
+        // Delays that fall between output phases need finer ones
+        for (uInt32 i = 0; i < nChannels && lpDelays != NULL; i++)
+        {
+            float64 fPhases = lpDelays[i] * m_nUp;
+            bFine = bFine || fabs(fPhases - floor(fPhases + 0.5)) > 1e-9;
+        }
+
+        long long nSub = bFine ? (DAQ_RESAMPLE_DELAY_PHASES + m_nUp - 1) / m_nUp : 1;
+
+        m_nPhases = m_nUp * nSub;
+        m_nStep = m_nDown * nSub;
+
+        // Below 1 when downsampling, where the filter stretches to cut
+        // at the output Nyquist frequency
+        float64 fBand = (m_nUp < m_nDown) ? (float64) m_nUp / m_nDown : 1.0;
+        int nHalf = (int) ceil(DAQ_RESAMPLE_ZEROS / fBand);
+
+        m_nTaps = 2 * nHalf;
+        m_nChannels = nChannels;
+        m_nMaxBlock = (nMaxBlock > (size_t) nHalf) ? nMaxBlock : (size_t) nHalf;
+
+        size_t nHistory = (size_t) (m_nTaps - 1);
+
+        m_lpTaps = (float64*) malloc((size_t) m_nPhases * m_nTaps * sizeof(float64));
+        m_lpHistory = (float64*) calloc(nHistory * nChannels, sizeof(float64));
+        m_lpWork = (float64*) malloc((nHistory + m_nMaxBlock) * nChannels * sizeof(float64));
+        m_lpZeros = (float64*) calloc(nHalf, sizeof(float64));
+        m_lpTime = (long long*) calloc(nChannels, sizeof(long long));
+        m_lpDelay = (long long*) calloc(nChannels, sizeof(long long));
+        m_lpConsumed = (long long*) calloc(nChannels, sizeof(long long));
+        m_lpProduced = (unsigned long long*) calloc(nChannels, sizeof(unsigned long long));
+
+        if (m_lpTaps == NULL || m_lpHistory == NULL || m_lpWork == NULL || m_lpZeros == NULL || m_lpTime == NULL ||
+            m_lpDelay == NULL || m_lpConsumed == NULL || m_lpProduced == NULL)
+        {
+            Free();
+            return false;
+        }
+
+        // Phase p evaluates x(n0 + p / nPhases) from the inputs n0 - nHalf + 1
+        // to n0 + nHalf, in that order
+        for (long long p = 0; p < m_nPhases; p++)
+        {
+            float64 *lpPhase = m_lpTaps + p * m_nTaps;
+            float64 fSum = 0;
+
+            for (int j = 0; j < m_nTaps; j++)
+            {
+                float64 t = (float64) p / m_nPhases + nHalf - 1 - j;
+                float64 u = t / nHalf;
+                float64 fSinc = (t == 0) ? 1.0 : sin(DAQ_PI * fBand * t) / (DAQ_PI * fBand * t);
+
+                lpPhase[j] = (fabs(u) < 1) ? fSinc * daqBesselI0(DAQ_RESAMPLE_BETA * sqrt(1 - u * u)) : 0;
+                fSum += lpPhase[j];
+            }
+
+            // Unit gain at DC for every phase
+            for (int j = 0; j < m_nTaps; j++)
+            {
+                lpPhase[j] /= fSum;
+            }
+        }
+
+        for (uInt32 i = 0; i < nChannels; i++)
+        {
+            m_lpDelay[i] = (lpDelays != NULL) ? (long long) floor(lpDelays[i] * m_nPhases + 0.5) : 0;
+            m_lpTime[i] = -m_lpDelay[i];
+        }
+
+        return true;
+    }
+
+    // Outputs of a channel for a capture of nSamples samples: those
+    // that fall before its end
+    unsigned long long OutputLength(uInt32 nChannel, unsigned long long nSamples) const
+    {
+        long long nEnd = (long long) nSamples * m_nPhases + m_lpDelay[nChannel];
+
+        return (nEnd > 0) ? (unsigned long long) ((nEnd + m_nStep - 1) / m_nStep) : 0;
+    }
+
+    // Adds n <= nMaxBlock samples of a channel and writes to lpOut the
+    // outputs they complete, at most nMax. Returns how many were written.
+    size_t Process(uInt32 nChannel, const float64 *lpIn, size_t n, float64 *lpOut, size_t nMax)
+    {
+        size_t nHistory = (size_t) (m_nTaps - 1);
+        long long nHalf = m_nTaps / 2;
+        float64 *lpHistory = m_lpHistory + nChannel * nHistory;
+        float64 *lpWork = m_lpWork + nChannel * (nHistory + m_nMaxBlock);
+        long long nFirst = m_lpConsumed[nChannel] - (long long) nHistory;
+        long long nLast = m_lpConsumed[nChannel] + (long long) n - 1;
+        long long nTime = m_lpTime[nChannel];
+        size_t nOut = 0;
+
+        memcpy(lpWork, lpHistory, nHistory * sizeof(float64));
+        memcpy(lpWork + nHistory, lpIn, n * sizeof(float64));
+
+        while (nOut < nMax)
+        {
+            long long nWhole = daqFloorDiv(nTime, m_nPhases);
+            long long nPhase = nTime - nWhole * m_nPhases;
+
+            if (nWhole + nHalf > nLast)
+            {
+                break;
+            }
+
+            // Before the capture every input is zero
+            if (nWhole + nHalf < 0)
+            {
+                lpOut[nOut++] = 0;
+            }
+            else
+            {
+                lpOut[nOut++] = daqDot(m_lpTaps + nPhase * m_nTaps, lpWork + (nWhole - nHalf + 1 - nFirst), m_nTaps);
+            }
+
+            nTime += m_nStep;
+        }
+
+        memcpy(lpHistory, lpWork + n, nHistory * sizeof(float64));
+
+        m_lpTime[nChannel] = nTime;
+        m_lpConsumed[nChannel] += (long long) n;
+        m_lpProduced[nChannel] += nOut;
+
+        return nOut;
+    }
+
+    // Writes to lpOut the outputs of a channel still waiting for the
+    // inputs after the end of the capture, at most nMax
+    size_t Flush(uInt32 nChannel, float64 *lpOut, size_t nMax)
+    {
+        unsigned long long nLength = OutputLength(nChannel, (unsigned long long) m_lpConsumed[nChannel]);
+        unsigned long long nLeft = nLength - m_lpProduced[nChannel];
+
+        nMax = (nLeft < nMax) ? (size_t) nLeft : nMax;
+
+        return Process(nChannel, m_lpZeros, (size_t) (m_nTaps / 2), lpOut, nMax);
+    }
+
+    void Free()
+    {
+        free(m_lpTaps);
+        free(m_lpHistory);
+        free(m_lpWork);
+        free(m_lpZeros);
+        free(m_lpTime);
+        free(m_lpDelay);
+        free(m_lpConsumed);
+        free(m_lpProduced);
+
+        m_lpTaps = NULL;
+        m_lpHistory = NULL;
+        m_lpWork = NULL;
+        m_lpZeros = NULL;
+        m_lpTime = NULL;
+        m_lpDelay = NULL;
+        m_lpConsumed = NULL;
+        m_lpProduced = NULL;
+    }
+
+private:
+    float64 *m_lpTaps;
+    float64 *m_lpHistory;
+    float64 *m_lpWork;
+    float64 *m_lpZeros;
+    long long *m_lpTime;
+    long long *m_lpDelay;
+    long long *m_lpConsumed;
+    unsigned long long *m_lpProduced;
+    long long m_nUp;
+    long long m_nDown;
+    long long m_nPhases;
+    long long m_nStep;
+    int m_nTaps;
+    uInt32 m_nChannels;
+    size_t m_nMaxBlock;
+};
+
+#endif
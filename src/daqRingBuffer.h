@@ -0,0 +1,180 @@
+/*************************************************************/
+// daqRingBuffer.h
+//
+// Single-producer/single-consumer lock-free ring buffer used
+// to hand samples from the background reader thread over to
+// the MATLAB thread without ever blocking either side.
+//
+// The producer asks for a contiguous writable region, lets the
+// driver read straight into it and then commits the samples,
+// so no intermediate copy is done on the acquisition side.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQRINGBUFFER_H
+#define DAQRINGBUFFER_H
+
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+class DaqRingBuffer
+{
+public:
+    DaqRingBuffer() : m_pData(NULL), m_nCapacity(0), m_nHead(0), m_nTail(0)
+    {
+    }
+
+    ~DaqRingBuffer()
+    {
+        Free();
+    }
+
+    // Allocates room for nCapacity elements. Must not be called
+    // while a producer or a consumer is using the buffer.
+    bool Allocate(size_t nCapacity)
+    {
+        Free();
+
+        m_pData = (float64*) malloc(nCapacity * sizeof(float64));
+
+        if (m_pData == NULL)
+        {
+            return false;
+        }
+
+        m_nCapacity = nCapacity;
+        m_nHead.store(0, std::memory_order_relaxed);
+        m_nTail.store(0, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    void Free()
+    {
+        if (m_pData != NULL)
+        {
+            free(m_pData);
+            m_pData = NULL;
+        }
+
+        m_nCapacity = 0;
+    }
+
+    size_t Capacity() const
+    {
+        return m_nCapacity;
+    }
+
+    // Storage of the buffer, to lock it in memory
+    float64 *Data() const
+    {
+        return m_pData;
+    }
+
+    // Consumer side: number of elements ready to be read
+    size_t Available() const
+    {
+        return (size_t) (m_nHead.load(std::memory_order_acquire) - m_nTail.load(std::memory_order_relaxed));
+    }
+
+    // Producer side: returns the start of the largest contiguous
+    // free region and stores its length in *nFree
+    float64 *WriteRegion(size_t *nFree)
+    {
+        unsigned long long nHead = m_nHead.load(std::memory_order_relaxed);
+        unsigned long long nTail = m_nTail.load(std::memory_order_acquire);
+        size_t nOffset = (size_t) (nHead % m_nCapacity);
+        size_t nSpace = m_nCapacity - (size_t) (nHead - nTail);
+
+        *nFree = (nSpace < m_nCapacity - nOffset) ? nSpace : m_nCapacity - nOffset;
+
+        return m_pData + nOffset;
+    }
+
+    // Producer side: publishes n elements written through WriteRegion
+    void CommitWrite(size_t n)
+    {
+        m_nHead.store(m_nHead.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // Consumer side: copies up to nMax elements into lpDest and
+    // releases their space to the producer
+    size_t Read(float64 *lpDest, size_t nMax)
+    {
+        unsigned long long nTail = m_nTail.load(std::memory_order_relaxed);
+        size_t nCount = Available();
+
+        if (nCount > nMax)
+        {
+            nCount = nMax;
+        }
+
+        size_t nOffset = (size_t) (nTail % m_nCapacity);
+        size_t nFirst = (nCount < m_nCapacity - nOffset) ? nCount : m_nCapacity - nOffset;
+
+        memcpy(lpDest, m_pData + nOffset, nFirst * sizeof(float64));
+        memcpy(lpDest + nFirst, m_pData, (nCount - nFirst) * sizeof(float64));
+
+        m_nTail.store(nTail + nCount, std::memory_order_release);
+
+        return nCount;
+    }
+
+    // Consumer side: takes nScans interleaved scans of nChannels
+    // elements and writes them as the columns of a column-major
+    // nScans-by-nChannels matrix, which is what MATLAB expects
+    void ReadColumns(float64 *lpDest, size_t nScans, size_t nChannels)
+    {
+        unsigned long long nTail = m_nTail.load(std::memory_order_relaxed);
+        size_t nOffset = (size_t) (nTail % m_nCapacity);
+        const float64 *lpSource = m_pData + nOffset;
+        const float64 *lpEnd = m_pData + m_nCapacity;
+
+        for (size_t i = 0; i < nScans; i++)
+        {
+            // Producers always commit whole scans and the capacity is
+            // a multiple of the scan size, so a scan never wraps
+            if (lpSource == lpEnd)
+            {
+                lpSource = m_pData;
+            }
+
+            for (size_t j = 0; j < nChannels; j++)
+            {
+                lpDest[j * nScans + i] = lpSource[j];
+            }
+
+            lpSource += nChannels;
+        }
+
+        m_nTail.store(nTail + nScans * nChannels, std::memory_order_release);
+    }
+
+private:
+    float64 *m_pData;
+    size_t m_nCapacity;
+
+    // Head and tail are free-running counters, so the buffer never
+    // needs a spare slot to tell full from empty. They are kept on
+    // separate cache lines so both threads do not fight over them.
+    char m_Pad0[64];
+    std::atomic<unsigned long long> m_nHead;
+    char m_Pad1[64];
+    std::atomic<unsigned long long> m_nTail;
+    char m_Pad2[64];
+};
+
+#endif
@@ -0,0 +1,320 @@
+/*************************************************************/
+// daqScale.h
+//
+// Conversion of raw ADC codes to volts using the polynomial the
+// device reports for each channel:
+//
+//     Volts = c0 + c1 * Code + c2 * Code^2 + c3 * Code^3 ...
+//
+// This is the same scaling DAQmxReadAnalogF64 applies, so raw
+// captures can be stored as int16 and converted only when and
+// where they are needed. Processors with AVX2 convert eight codes
+// per iteration, straight into the class of the output. On x86 the
+// AVX2 loop is always built and chosen at run time, so no build flag
+// is needed; building with /arch:AVX2 or -mavx2 only drops the check,
+// and then needs a processor with AVX2.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQSCALE_H
+#define DAQSCALE_H
+
+#if defined(__AVX2__) || defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+#define DAQ_SCALE_AVX2
+#include <immintrin.h>
+#endif
+
+// Lets the AVX2 loop be built without compiling everything for AVX2.
+// MSVC accepts the intrinsics anywhere.
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define DAQ_SCALE_TARGET
+#else
+#define DAQ_SCALE_TARGET __attribute__((target("avx2")))
+#endif
+
+// Maximum number of polynomial coefficients kept per channel
+#define DAQ_SCALE_MAX_COEFFS 8
+
+#ifdef DAQ_SCALE_AVX2
+static inline bool daqScaleDetectAvx2()
+{
+#if defined(__AVX2__)
+    return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int lpInfo[4];
+
+    __cpuid(lpInfo, 0);
+
+    if (lpInfo[0] < 7)
+    {
+        return false;
+    }
+
+    // The system must also save the AVX registers on a task switch
+    __cpuid(lpInfo, 1);
+
+    if ((lpInfo[2] & (1 << 27)) == 0 || (lpInfo[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(lpInfo, 7, 0);
+
+    return (lpInfo[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// Whether the processor runs AVX2, asked once
+static inline bool daqScaleHasAvx2()
+{
+    static const bool bAvx2 = daqScaleDetectAvx2();
+
+    return bAvx2;
+}
+
+// Eight inputs as two vectors of four doubles
+DAQ_SCALE_TARGET static inline void daqScaleLoad8(const int16 *lpIn, __m256d *pLow, __m256d *pHigh)
+{
+    __m256i nCodes = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) lpIn));
+
+    *pLow = _mm256_cvtepi32_pd(_mm256_castsi256_si128(nCodes));
+    *pHigh = _mm256_cvtepi32_pd(_mm256_extracti128_si256(nCodes, 1));
+}
+
+DAQ_SCALE_TARGET static inline void daqScaleLoad8(const float64 *lpIn, __m256d *pLow, __m256d *pHigh)
+{
+    *pLow = _mm256_loadu_pd(lpIn);
+    *pHigh = _mm256_loadu_pd(lpIn + 4);
+}
+
+DAQ_SCALE_TARGET static inline void daqScaleStore8(__m256d fLow, __m256d fHigh, float64 *lpOut)
+{
+    _mm256_storeu_pd(lpOut, fLow);
+    _mm256_storeu_pd(lpOut + 4, fHigh);
+}
+
+DAQ_SCALE_TARGET static inline void daqScaleStore8(__m256d fLow, __m256d fHigh, float32 *lpOut)
+{
+    _mm_storeu_ps(lpOut, _mm256_cvtpd_ps(fLow));
+    _mm_storeu_ps(lpOut + 4, _mm256_cvtpd_ps(fHigh));
+}
+
+// Saturates and rounds half away from zero, as daqScaleStore does
+DAQ_SCALE_TARGET static inline __m128i daqScaleRound4(__m256d fValue)
+{
+    fValue = _mm256_min_pd(_mm256_max_pd(fValue, _mm256_set1_pd(-2147483648.0)), _mm256_set1_pd(2147483647.0));
+
+    __m256d fHalf = _mm256_or_pd(_mm256_and_pd(fValue, _mm256_set1_pd(-0.0)), _mm256_set1_pd(0.5));
+
+    return _mm256_cvttpd_epi32(_mm256_add_pd(fValue, fHalf));
+}
+
+DAQ_SCALE_TARGET static inline void daqScaleStore8(__m256d fLow, __m256d fHigh, int32 *lpOut)
+{
+    _mm_storeu_si128((__m128i*) lpOut, daqScaleRound4(fLow));
+    _mm_storeu_si128((__m128i*) (lpOut + 4), daqScaleRound4(fHigh));
+}
+
+// Scales the inputs of lpIn eight at a time straight into lpOut,
+// returning how many it scaled; the rest are left to the scalar loop
+template <typename S, typename T>
+DAQ_SCALE_TARGET static inline size_t daqScaleAvx2(const S *lpIn, size_t n, const float64 *lpCoeffs, int nCoeffs, T *lpOut)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d fLow, fHigh;
+
+        daqScaleLoad8(lpIn + i, &fLow, &fHigh);
+
+        __m256d fAccLow = _mm256_set1_pd(lpCoeffs[nCoeffs - 1]);
+        __m256d fAccHigh = fAccLow;
+
+        // Horner's rule, highest order first
+        for (int k = nCoeffs - 2; k >= 0; k--)
+        {
+            __m256d fCoeff = _mm256_set1_pd(lpCoeffs[k]);
+
+            fAccLow = _mm256_add_pd(_mm256_mul_pd(fAccLow, fLow), fCoeff);
+            fAccHigh = _mm256_add_pd(_mm256_mul_pd(fAccHigh, fHigh), fCoeff);
+        }
+
+        daqScaleStore8(fAccLow, fAccHigh, lpOut + i);
+    }
+
+    return i;
+}
+#endif
+
+static inline void daqScaleStore(float64 fValue, float64 *pOut)
+{
+    *pOut = fValue;
+}
+
+static inline void daqScaleStore(float64 fValue, float32 *pOut)
+{
+    *pOut = (float32) fValue;
+}
+
+// Rounds to the nearest integer, saturating outside the int32 range
+static inline void daqScaleStore(float64 fValue, int32 *pOut)
+{
+    fValue = (fValue < -2147483648.0) ? -2147483648.0 : (fValue > 2147483647.0) ? 2147483647.0 : fValue;
+    *pOut = (int32) (fValue + ((fValue < 0) ? -0.5 : 0.5));
+}
+
+// Scales n codes like daqScaleCodes and stores them as T in the same
+// pass, so nothing but the output is written. A fixed-point output
+// is obtained by multiplying the coefficients by the inverse of its
+// quantum beforehand. The codes may also be float64, such as volts
+// read from a converter wider than int16, scaled by {0, Gain}.
+template <typename S, typename T>
+static inline void daqScaleCodesTo(const S *lpCodes, size_t n, const float64 *lpCoeffs, int nCoeffs, T *lpOut)
+{
+    size_t i = 0;
+
+    if (nCoeffs <= 0)
+    {
+        for (; i < n; i++)
+        {
+            daqScaleStore(0, lpOut + i);
+        }
+
+        return;
+    }
+
+#ifdef DAQ_SCALE_AVX2
+    if (daqScaleHasAvx2())
+    {
+        i = daqScaleAvx2(lpCodes, n, lpCoeffs, nCoeffs, lpOut);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        float64 fCode = lpCodes[i];
+        float64 fAcc = lpCoeffs[nCoeffs - 1];
+
+        for (int k = nCoeffs - 2; k >= 0; k--)
+        {
+            fAcc = fAcc * fCode + lpCoeffs[k];
+        }
+
+        daqScaleStore(fAcc, lpOut + i);
+    }
+}
+
+// Scales n codes with the nCoeffs coefficients in lpCoeffs,
+// lowest order first
+static inline void daqScaleCodes(const int16 *lpCodes, size_t n, const float64 *lpCoeffs, int nCoeffs, float64 *lpVolts)
+{
+    daqScaleCodesTo(lpCodes, n, lpCoeffs, nCoeffs, lpVolts);
+}
+
+// Fills lpCoeffs, a column-major DAQ_SCALE_MAX_COEFFS-by-nChannels
+// matrix, with the scaling polynomial of every channel of hTask,
+// padding the shorter ones with zeros. *pnCoeffs receives the
+// length of the longest polynomial.
+static inline int32 daqGetScaling(TaskHandle hTask, uInt32 nChannels, float64 *lpCoeffs, uInt32 *pnCoeffs)
+{
+    char lpChannel[256];
+    uInt32 nMax = 0;
+
+    for (uInt32 i = 0; i < nChannels; i++)
+    {
+        float64 *lpColumn = lpCoeffs + (size_t) i * DAQ_SCALE_MAX_COEFFS;
+        int32 nResult = daqGetNthTaskChannel(hTask, i + 1, lpChannel, sizeof(lpChannel));
+
+        if (nResult < 0)
+        {
+            return nResult;
+        }
+
+        for (int k = 0; k < DAQ_SCALE_MAX_COEFFS; k++)
+        {
+            lpColumn[k] = 0;
+        }
+
+        // Called without a buffer, the driver returns the number
+        // of coefficients available
+        int32 nCount = daqGetAIDevScalingCoeff(hTask, lpChannel, NULL, 0);
+
+        if (nCount < 0)
+        {
+            return nCount;
+        }
+
+        if (nCount > DAQ_SCALE_MAX_COEFFS)
+        {
+            nCount = DAQ_SCALE_MAX_COEFFS;
+        }
+
+        nResult = daqGetAIDevScalingCoeff(hTask, lpChannel, lpColumn, nCount);
+
+        if (nResult < 0)
+        {
+            return nResult;
+        }
+
+        if ((uInt32) nCount > nMax)
+        {
+            nMax = nCount;
+        }
+    }
+
+    *pnCoeffs = nMax;
+
+    return 0;
+}
+
+// Stores in *pnBits the resolution of the widest channel of hTask,
+// which only fits the int16 codes of a raw read up to 16 bits
+static inline int32 daqGetResolution(TaskHandle hTask, uInt32 nChannels, uInt32 *pnBits)
+{
+    char lpChannel[256];
+
+    *pnBits = 0;
+
+    for (uInt32 i = 0; i < nChannels; i++)
+    {
+        float64 fBits = 0;
+        int32 nResult = daqGetNthTaskChannel(hTask, i + 1, lpChannel, sizeof(lpChannel));
+
+        if (nResult >= 0)
+        {
+            nResult = daqGetAIResolution(hTask, lpChannel, &fBits);
+        }
+
+        if (nResult < 0)
+        {
+            return nResult;
+        }
+
+        if ((uInt32) fBits > *pnBits)
+        {
+            *pnBits = (uInt32) fBits;
+        }
+    }
+
+    return 0;
+}
+
+#endif
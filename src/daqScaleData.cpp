@@ -0,0 +1,90 @@
+/*************************************************************/
+// daqScaleData.cpp
+//
+// Converts raw ADC codes returned by daqAdquireData into volts
+//
+//                       ------ ARGUMENTS ------
+//
+// [Volts (f)] = daqScaleData(Codes (i), Scaling (f))
+//
+// - i denotes an int16 matrix
+// - f denotes a real matrix
+//
+//           - Codes: raw codes, as returned by daqAdquireData with the
+//                    'Raw' option. A row vector for a single channel or
+//                    a matrix with one column per channel
+//
+//         - Scaling: polynomial coefficients returned together with the
+//                    codes, one column per channel and lowest order first
+//
+//           - Volts: a matrix of the same size as Codes with the scaled
+//                    values. They match what daqAdquireData returns
+//                    without the 'Raw' option
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "daqScale.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 2)
+    {
+        mexErrMsgTxt("Two inputs required.");
+    }
+    else if (nlhs > 1)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxGetClassID(prhs[0]) != mxINT16_CLASS || mxIsComplex(prhs[0]))
+    {
+        mexErrMsgTxt("Input argument 1 must be an int16 matrix.");
+    }
+    else if (!mxIsDouble(prhs[1]) || mxIsComplex(prhs[1]))
+    {
+        mexErrMsgTxt("Input argument 2 must be a real matrix.");
+    }
+    else
+    {
+        size_t nRows = mxGetM(prhs[0]), nCols = mxGetN(prhs[0]);
+        size_t nCoeffs = mxGetM(prhs[1]), nChannels = mxGetN(prhs[1]);
+        
+        // A single channel comes as a row vector
+        size_t nSamples = (nChannels == 1) ? nRows * nCols : nRows;
+        
+        if ((nChannels == 1) ? (nRows != 1 && nCols != 1 && nRows * nCols != 0) : (nCols != nChannels))
+        {
+            mexErrMsgTxt("Scaling must have one column per channel of Codes.");
+        }
+        else if (nCoeffs > DAQ_SCALE_MAX_COEFFS)
+        {
+            mexErrMsgTxt("Too many scaling coefficients.");
+        }
+        
+        plhs[0] = mxCreateNumericMatrix(nRows, nCols, mxDOUBLE_CLASS, mxREAL);
+        
+        const int16 *lpCodes = (const int16*) mxGetData(prhs[0]);
+        const double *lpCoeffs = mxGetPr(prhs[1]);
+        double *lpVolts = mxGetPr(plhs[0]);
+        
+        for (size_t i = 0; i < nChannels; i++)
+        {
+            daqScaleCodes(lpCodes + i * nSamples, nSamples, lpCoeffs + i * nCoeffs, (int) nCoeffs, lpVolts + i * nSamples);
+        }
+    }
+    
+    return;
+}
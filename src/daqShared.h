@@ -0,0 +1,440 @@
+/*************************************************************/
+// daqShared.h
+//
+// Shared-memory ring through which a single adquisition is
+// published to any number of local readers, in MATLAB through
+// daqSubscribe or in programs of their own.
+//
+// The memory starts with a DaqSharedHeader, followed by the scaling
+// of every channel and the channel names, and then nBlocks slots.
+// Each slot is a DaqSharedSlot followed by nBlockScans samples of
+// every channel, grouped by channel (nStride apart). Block s goes
+// to slot s % nBlocks.
+//
+// The writer never waits for the readers. Before writing a slot it
+// sets its sequence to DAQ_SHARED_WRITING, and once the samples are
+// in it stores the block number there and then raises nPublished.
+// A reader copies a block and checks the sequence of its slot before
+// and after the copy: if either is not the block it asked for, the
+// block was overwritten and is lost to that reader, which then skips
+// ahead to the oldest block still available.
+//
+// Nothing in this file may call the MEX API: the writer thread is
+// not a MATLAB thread, and readers need not be MATLAB at all.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQSHARED_H
+#define DAQSHARED_H
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daqFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define DAQ_SHARED_MAGIC "NIDAQSHM"
+#define DAQ_SHARED_VERSION 1
+
+// Header and slots start on cache lines of their own
+#define DAQ_SHARED_ALIGN 64
+
+// Longest name a ring can be published under
+#define DAQ_SHARED_NAME 128
+
+// Sequence of a slot being written
+#define DAQ_SHARED_WRITING 0xFFFFFFFFFFFFFFFFULL
+
+// States of the writer
+#define DAQ_SHARED_RUNNING 1
+#define DAQ_SHARED_STOPPED 2
+
+struct DaqSharedHeader
+{
+    char lpMagic[8];
+    uInt32 nVersion;
+    uInt32 nHeaderSize;
+    uInt32 nChannels;
+    uInt32 nSampleType;
+    uInt32 nBlockScans;
+    uInt32 nBlocks;
+    uInt32 nSlotSize;
+    uInt32 nCoeffs;
+    uInt32 nChannelsLength;
+    uInt32 nProcess;
+    float64 fRate;
+    float64 fRange;
+    uInt64 nTotalSize;
+
+    // Written while running
+    std::atomic<uInt64> nPublished;
+    std::atomic<int32> nState;
+    std::atomic<int32> nError;
+};
+
+struct DaqSharedSlot
+{
+    std::atomic<uInt64> nSequence;
+    uInt32 nScans;
+    uInt32 nStride;
+};
+
+static inline size_t daqSharedAlign(size_t nSize)
+{
+    return (nSize + DAQ_SHARED_ALIGN - 1) / DAQ_SHARED_ALIGN * DAQ_SHARED_ALIGN;
+}
+
+static inline uInt32 daqSharedHeaderSize(uInt32 nChannels, uInt32 nCoeffs, uInt32 nChannelsLength)
+{
+    return (uInt32) daqSharedAlign(sizeof(DaqSharedHeader) + (size_t) nChannels * nCoeffs * sizeof(float64) + nChannelsLength);
+}
+
+static inline uInt32 daqSharedSlotSize(uInt32 nChannels, uInt32 nBlockScans, uInt32 nSampleType)
+{
+    return (uInt32) daqSharedAlign(sizeof(DaqSharedSlot) + (size_t) nChannels * nBlockScans * daqFileSampleSize(nSampleType));
+}
+
+static inline DaqSharedSlot *daqSharedSlot(const DaqSharedHeader *pHeader, uInt64 nSequence)
+{
+    return (DaqSharedSlot*) ((char*) pHeader + pHeader->nHeaderSize + (size_t) (nSequence % pHeader->nBlocks) * pHeader->nSlotSize);
+}
+
+// Scaling of the channels, nCoeffs per channel and lowest order first
+static inline const float64 *daqSharedScaling(const DaqSharedHeader *pHeader)
+{
+    return (const float64*) (pHeader + 1);
+}
+
+// Channel names, as the task lists them, not terminated
+static inline const char *daqSharedChannels(const DaqSharedHeader *pHeader)
+{
+    return (const char*) (daqSharedScaling(pHeader) + (size_t) pHeader->nChannels * pHeader->nCoeffs);
+}
+
+// Checks a header found in shared memory of nSize bytes
+static inline bool daqSharedCheckHeader(const DaqSharedHeader *pHeader, size_t nSize)
+{
+    if (nSize < sizeof(DaqSharedHeader) || memcmp(pHeader->lpMagic, DAQ_SHARED_MAGIC, 8) != 0 ||
+        pHeader->nVersion != DAQ_SHARED_VERSION)
+    {
+        return false;
+    }
+
+    // The rest of the header was written before the magic
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (pHeader->nChannels == 0 || pHeader->nSampleType > DAQ_FILE_INT16 || pHeader->nBlocks == 0 || pHeader->nBlockScans == 0)
+    {
+        return false;
+    }
+
+    return pHeader->nHeaderSize == daqSharedHeaderSize(pHeader->nChannels, pHeader->nCoeffs, pHeader->nChannelsLength) &&
+           pHeader->nSlotSize == daqSharedSlotSize(pHeader->nChannels, pHeader->nBlockScans, pHeader->nSampleType) &&
+           pHeader->nTotalSize == pHeader->nHeaderSize + (uInt64) pHeader->nBlocks * pHeader->nSlotSize &&
+           pHeader->nTotalSize <= nSize;
+}
+
+// Oldest block a reader can still get. The slot after the newest
+// block may be being written, so it does not count.
+static inline uInt64 daqSharedOldest(const DaqSharedHeader *pHeader, uInt64 nPublished)
+{
+    return (nPublished >= pHeader->nBlocks) ? nPublished - pHeader->nBlocks + 1 : 0;
+}
+
+// Copies block nSequence into lpOut, channel i starting at
+// lpOut + i * nOutStride samples, and stores its scans per channel.
+// Returns false, with lpOut partly overwritten, if the block is no
+// longer in the ring.
+static inline bool daqSharedCopyBlock(const DaqSharedHeader *pHeader, uInt64 nSequence, void *lpOut, size_t nOutStride, uInt32 *pnScans)
+{
+    DaqSharedSlot *pSlot = daqSharedSlot(pHeader, nSequence);
+    size_t nSampleSize = daqFileSampleSize(pHeader->nSampleType);
+
+    if (pSlot->nSequence.load(std::memory_order_acquire) != nSequence)
+    {
+        return false;
+    }
+
+    uInt32 nScans = pSlot->nScans, nStride = pSlot->nStride;
+
+    if (nScans <= nStride && nStride <= pHeader->nBlockScans)
+    {
+        for (uInt32 i = 0; i < pHeader->nChannels; i++)
+        {
+            memcpy((char*) lpOut + i * nOutStride * nSampleSize, (const char*) (pSlot + 1) + (size_t) i * nStride * nSampleSize,
+                   nScans * nSampleSize);
+        }
+    }
+
+    // The samples must have been read before the sequence is checked
+    // again, or a block written meanwhile could go unnoticed
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    *pnScans = nScans;
+
+    return pSlot->nSequence.load(std::memory_order_relaxed) == nSequence && nScans <= nStride;
+}
+
+// Whether the process that wrote a header is still running. On
+// Windows, memory outlives its writer only while readers hold it.
+static inline bool daqSharedWriterAlive(const DaqSharedHeader *pHeader)
+{
+#ifdef _WIN32
+    return pHeader->nState.load() == DAQ_SHARED_RUNNING;
+#else
+    return pHeader->nState.load() == DAQ_SHARED_RUNNING && (kill((pid_t) pHeader->nProcess, 0) == 0 || errno == EPERM);
+#endif
+}
+
+// Named memory shared between processes: a POSIX shared memory
+// object, or a named file mapping on Windows
+class DaqSharedMemory
+{
+public:
+    DaqSharedMemory() : m_nPrefix(0), m_pView(NULL), m_nSize(0), m_bOwner(false)
+    {
+        m_lpName[0] = 0;
+#ifdef _WIN32
+        m_hMapping = NULL;
+#else
+        m_nFile = -1;
+#endif
+    }
+
+    ~DaqSharedMemory()
+    {
+        Close();
+    }
+
+    // Creates the memory for writing. Fails if the name is taken.
+    bool Create(const char *lpName, size_t nSize)
+    {
+        Close();
+
+        if (!SetName(lpName))
+        {
+            return false;
+        }
+
+#ifdef _WIN32
+        m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD) ((unsigned long long) nSize >> 32),
+                                        (DWORD) nSize, m_lpName);
+
+        if (m_hMapping == NULL || GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            Close();
+            return false;
+        }
+
+        m_pView = MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, nSize);
+#else
+        m_nFile = shm_open(m_lpName, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+        if (m_nFile < 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_bOwner = true;
+
+        if (ftruncate(m_nFile, (off_t) nSize) != 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_pView = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_nFile, 0);
+        m_pView = (m_pView == MAP_FAILED) ? NULL : m_pView;
+#endif
+
+        m_bOwner = true;
+        m_nSize = nSize;
+
+        if (m_pView == NULL)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Opens memory created by another process, read-only
+    bool Open(const char *lpName)
+    {
+        Close();
+
+        if (!SetName(lpName))
+        {
+            return false;
+        }
+
+#ifdef _WIN32
+        MEMORY_BASIC_INFORMATION Info;
+
+        m_hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, m_lpName);
+        m_pView = (m_hMapping != NULL) ? MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+        if (m_pView == NULL || VirtualQuery(m_pView, &Info, sizeof(Info)) == 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_nSize = Info.RegionSize;
+#else
+        struct stat Stat;
+
+        m_nFile = shm_open(m_lpName, O_RDONLY, 0);
+
+        if (m_nFile < 0 || fstat(m_nFile, &Stat) != 0 || Stat.st_size <= 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_nSize = (size_t) Stat.st_size;
+        m_pView = mmap(NULL, m_nSize, PROT_READ, MAP_SHARED, m_nFile, 0);
+
+        if (m_pView == MAP_FAILED)
+        {
+            m_pView = NULL;
+            Close();
+            return false;
+        }
+#endif
+
+        return true;
+    }
+
+    // Frees the name of memory left behind by a writer that ended
+    // without closing it. Windows does so when the writer ends.
+    bool Remove(const char *lpName)
+    {
+        Close();
+
+        if (!SetName(lpName))
+        {
+            return false;
+        }
+
+#ifndef _WIN32
+        shm_unlink(m_lpName);
+#endif
+
+        return true;
+    }
+
+    void *Data() const
+    {
+        return m_pView;
+    }
+
+    size_t Size() const
+    {
+        return m_nSize;
+    }
+
+    // Name the memory was opened with, as given
+    const char *Name() const
+    {
+        return m_lpName + m_nPrefix;
+    }
+
+    // Unmaps the memory. The writer also removes its name, so a new
+    // writer can take it while readers finish with the old memory.
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_pView != NULL)
+        {
+            UnmapViewOfFile(m_pView);
+        }
+
+        if (m_hMapping != NULL)
+        {
+            CloseHandle(m_hMapping);
+            m_hMapping = NULL;
+        }
+#else
+        if (m_pView != NULL)
+        {
+            munmap(m_pView, m_nSize);
+        }
+
+        if (m_nFile >= 0)
+        {
+            close(m_nFile);
+            m_nFile = -1;
+        }
+
+        if (m_bOwner)
+        {
+            shm_unlink(m_lpName);
+        }
+#endif
+
+        m_pView = NULL;
+        m_nSize = 0;
+        m_bOwner = false;
+    }
+
+private:
+    // Names are local to the session on Windows and must start with
+    // a slash elsewhere
+    bool SetName(const char *lpName)
+    {
+#ifdef _WIN32
+        const char *lpPrefix = "Local\\";
+#else
+        const char *lpPrefix = "/";
+#endif
+
+        if (lpName[0] == 0 || strlen(lpName) >= DAQ_SHARED_NAME || strchr(lpName, '/') != NULL || strchr(lpName, '\\') != NULL)
+        {
+            return false;
+        }
+
+        m_nPrefix = strlen(lpPrefix);
+        sprintf(m_lpName, "%s%s", lpPrefix, lpName);
+
+        return true;
+    }
+
+    char m_lpName[DAQ_SHARED_NAME + 8];
+    size_t m_nPrefix;
+#ifdef _WIN32
+    HANDLE m_hMapping;
+#else
+    int m_nFile;
+#endif
+    void *m_pView;
+    size_t m_nSize;
+    bool m_bOwner;
+};
+
+#endif
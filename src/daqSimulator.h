@@ -0,0 +1,1263 @@
+/*************************************************************/
+// daqSimulator.h
+//
+// Simulated devices, used through the same calls as the real
+// driver so the library can be exercised and benchmarked without
+// NI hardware. Every device named SimDev followed by a number has
+// eight analog inputs, SimDev1/ai0 to SimDev1/ai7, sampled
+// simultaneously at up to 1 MS/s with 16-bit codes.
+//
+// Samples are produced in real time from the moment a task starts:
+// a read waits until the samples it asks for would have been
+// converted, plus a fixed latency per call, and a continuous task
+// overflows if it is not read fast enough, as real hardware does.
+// With real time disabled, samples are produced as fast as they
+// are read, which measures the overhead of the library alone.
+//
+// Each channel outputs a sine, gaussian noise, a step or what was
+// last written to an analog output of the device, plus an offset
+// and optional noise. Signals are configured per device or
+// per channel and are picked up every time a task starts.
+//
+// A task given another simulated device's "/SimDevN/ai/StartTrigger"
+// as its start trigger waits, once started, until a task on that
+// device starts, and then samples from the same instant, which is
+// how devices sharing a start trigger and sample clock behave.
+//
+// Included by daqDriver.h, which defines DaqBackend.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQSIMULATOR_H
+#define DAQSIMULATOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DAQ_SIM_PREFIX "SimDev"
+#define DAQ_SIM_DEVICE_NAMES "SimDev1"
+#define DAQ_SIM_PRODUCT "Simulated DAQ"
+#define DAQ_SIM_AI_CHANNELS 8
+#define DAQ_SIM_AO_CHANNELS 2
+#define DAQ_SIM_MAX_RATE 1000000.0
+#define DAQ_SIM_MIN_RATE 0.1
+#define DAQ_SIM_CODES 32768.0
+#define DAQ_SIM_TARGETS 64
+#define DAQ_SIM_NAME_LENGTH 64
+
+#define DAQ_SIM_SINE 0
+#define DAQ_SIM_NOISE 1
+#define DAQ_SIM_STEP 2
+#define DAQ_SIM_OUTPUT 3
+
+// Default latencies, in seconds
+#define DAQ_SIM_READ_LATENCY 50e-6
+#define DAQ_SIM_SETUP_LATENCY 2e-3
+
+static const float64 g_SimAIRanges[] = {-0.1, 0.1, -0.2, 0.2, -0.5, 0.5, -1, 1, -2, 2, -5, 5, -10, 10};
+static const float64 g_SimAORanges[] = {-10, 10};
+static const int32 g_SimMeasTypes[] = {DAQmx_Val_Voltage};
+static const int32 g_SimSampleModes[] = {DAQmx_Val_FiniteSamps, DAQmx_Val_ContSamps, DAQmx_Val_HWTimedSinglePoint};
+
+struct DaqSimSignal
+{
+    int nShape;
+    float64 fAmplitude;
+    float64 fFrequency;
+    float64 fOffset;
+    float64 fNoise;
+    float64 fDelay;
+};
+
+struct DaqSimTiming
+{
+    float64 fReadLatency;
+    float64 fSetupLatency;
+    bool bRealtime;
+};
+
+struct DaqSimTask
+{
+    char lpDevice[DAQ_SIM_NAME_LENGTH];
+    uInt32 nChannels;
+    int lpIndex[DAQ_SIM_AI_CHANNELS];
+    float64 lpRange[DAQ_SIM_AI_CHANNELS];
+    DaqSimSignal lpSignals[DAQ_SIM_AI_CHANNELS];
+    DaqSimTiming Timing;
+    float64 fRate;
+    int32 nSampleMode;
+    uInt64 nSamples;
+    uInt64 nBufferScans;
+    bool bBufferSet;
+    bool bCommitted;
+    bool bRunning;
+    bool bOutput;
+    std::chrono::steady_clock::time_point tStart;
+    uInt64 nScan;
+
+    // Last sample clock tick waited for, in single-point timing
+    uInt64 nTick;
+
+    // Level of every channel that follows an analog output
+    float64 lpLevel[DAQ_SIM_AI_CHANNELS];
+
+    // Device whose start triggers this task, and the number of starts
+    // it had seen when this task was armed
+    char lpTrigger[DAQ_SIM_NAME_LENGTH];
+    uInt64 nArmed;
+    bool bArmed;
+
+    // Sines are generated by rotating a phasor once per sample
+    float64 lpRe[DAQ_SIM_AI_CHANNELS];
+    float64 lpIm[DAQ_SIM_AI_CHANNELS];
+    float64 lpRotRe[DAQ_SIM_AI_CHANNELS];
+    float64 lpRotIm[DAQ_SIM_AI_CHANNELS];
+
+    unsigned long long nRandom;
+    bool bSpare;
+    float64 fSpare;
+};
+
+// True for the names the simulator serves: SimDev and a number
+static inline bool daqSimIsDevice(const char *lpDevice)
+{
+    size_t nPrefix = strlen(DAQ_SIM_PREFIX);
+
+    if (lpDevice == NULL || strncmp(lpDevice, DAQ_SIM_PREFIX, nPrefix) != 0 || lpDevice[nPrefix] == '\0')
+    {
+        return false;
+    }
+
+    for (const char *p = lpDevice + nPrefix; *p != '\0'; p++)
+    {
+        if (!isdigit((unsigned char) *p))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Copies a string property with the driver conventions: without a
+// buffer the size needed is returned; if it does not fit, it is
+// truncated and the size needed is returned too
+static inline int32 daqSimCopyString(const char *lpValue, char *lpData, uInt32 nSize)
+{
+    uInt32 nNeeded = (uInt32) strlen(lpValue) + 1;
+
+    if (lpData == NULL || nSize == 0)
+    {
+        return (int32) nNeeded;
+    }
+
+    strncpy(lpData, lpValue, nSize);
+    lpData[nSize - 1] = '\0';
+
+    return (nSize < nNeeded) ? (int32) nNeeded : 0;
+}
+
+template <typename T>
+static inline int32 daqSimCopyArray(const T *lpValue, uInt32 nCount, T *lpData, uInt32 nSize)
+{
+    if (lpData == NULL || nSize == 0)
+    {
+        return (int32) nCount;
+    }
+
+    memcpy(lpData, lpValue, ((nSize < nCount) ? nSize : nCount) * sizeof(T));
+
+    return 0;
+}
+
+// Appends the indices of a list such as "SimDev1/ai0:3, SimDev1/ai5"
+// to lpIndex, which holds *pnChannels of at most nCapacity. lpType is
+// "ai" or "ao", of which lpDevice has nMax.
+static inline int32 daqSimParseChannels(const char *lpDevice, const char *lpList, const char *lpType, long nMax,
+                                        int *lpIndex, uInt32 *pnChannels, uInt32 nCapacity)
+{
+    const char *p = lpList;
+    size_t nDevice = strlen(lpDevice);
+
+    while (true)
+    {
+        while (*p == ' ' || *p == ',')
+        {
+            p++;
+        }
+
+        if (*p == '\0')
+        {
+            break;
+        }
+
+        if (strncmp(p, lpDevice, nDevice) != 0 || p[nDevice] != '/' || strncmp(p + nDevice + 1, lpType, 2) != 0 ||
+            !isdigit((unsigned char) p[nDevice + 3]))
+        {
+            return DAQmxErrorPhysicalChanDoesNotExist;
+        }
+
+        char *lpEnd;
+        long nFirst = strtol(p + nDevice + 3, &lpEnd, 10), nLast = nFirst;
+
+        if (*lpEnd == ':')
+        {
+            nLast = strtol(lpEnd + 1, &lpEnd, 10);
+        }
+
+        while (*lpEnd == ' ')
+        {
+            lpEnd++;
+        }
+
+        if ((*lpEnd != ',' && *lpEnd != '\0') || nFirst >= nMax || nLast >= nMax)
+        {
+            return DAQmxErrorPhysicalChanDoesNotExist;
+        }
+
+        long nStep = (nLast >= nFirst) ? 1 : -1;
+
+        for (long k = nFirst; ; k += nStep)
+        {
+            if (*pnChannels == nCapacity)
+            {
+                return DAQmxErrorPhysicalChanDoesNotExist;
+            }
+
+            lpIndex[(*pnChannels)++] = (int) k;
+
+            if (k == nLast)
+            {
+                break;
+            }
+        }
+
+        p = lpEnd;
+    }
+
+    return 0;
+}
+
+// Uniform in (0, 1], from an xorshift64* generator
+static inline float64 daqSimUniform(DaqSimTask *pTask)
+{
+    pTask->nRandom ^= pTask->nRandom >> 12;
+    pTask->nRandom ^= pTask->nRandom << 25;
+    pTask->nRandom ^= pTask->nRandom >> 27;
+
+    return ((pTask->nRandom * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0) + (1.0 / 9007199254740992.0);
+}
+
+// Standard normal, two at a time with the Box-Muller transform
+static inline float64 daqSimGauss(DaqSimTask *pTask)
+{
+    if (pTask->bSpare)
+    {
+        pTask->bSpare = false;
+        return pTask->fSpare;
+    }
+
+    float64 fRadius = sqrt(-2 * log(daqSimUniform(pTask)));
+    float64 fAngle = 2 * 3.14159265358979323846 * daqSimUniform(pTask);
+
+    pTask->fSpare = fRadius * sin(fAngle);
+    pTask->bSpare = true;
+
+    return fRadius * cos(fAngle);
+}
+
+class DaqSimBackend : public DaqBackend
+{
+public:
+    DaqSimBackend() : m_nTargets(0), m_nStarts(0), m_nOutputs(0)
+    {
+        m_DefaultTiming.fReadLatency = DAQ_SIM_READ_LATENCY;
+        m_DefaultTiming.fSetupLatency = DAQ_SIM_SETUP_LATENCY;
+        m_DefaultTiming.bRealtime = true;
+    }
+
+    // Signal a channel outputs when nothing was configured for it:
+    // a 1 V sine of 100 Hz times the channel number plus one
+    static DaqSimSignal DefaultSignal(int nIndex)
+    {
+        DaqSimSignal Signal;
+
+        Signal.nShape = DAQ_SIM_SINE;
+        Signal.fAmplitude = 1;
+        Signal.fFrequency = 100.0 * (nIndex + 1);
+        Signal.fOffset = 0;
+        Signal.fNoise = 0;
+        Signal.fDelay = 0;
+
+        return Signal;
+    }
+
+    // Signal of channel nIndex of a device: the one configured for
+    // the channel, else the one configured for the device
+    DaqSimSignal GetSignal(const char *lpDevice, int nIndex)
+    {
+        char lpChannel[DAQ_SIM_NAME_LENGTH + 8];
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+
+        snprintf(lpChannel, sizeof(lpChannel), "%s/ai%d", lpDevice, nIndex);
+
+        int nTarget = Find(lpChannel);
+
+        if (nTarget < 0 || !m_lpTargets[nTarget].bSignal)
+        {
+            nTarget = Find(lpDevice);
+        }
+
+        return (nTarget < 0 || !m_lpTargets[nTarget].bSignal) ? DefaultSignal(nIndex) : m_lpTargets[nTarget].Signal;
+    }
+
+    // Signal configured for exactly this device or channel, if any
+    bool FindSignal(const char *lpTarget, DaqSimSignal *pSignal)
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        int nTarget = Find(lpTarget);
+
+        if (nTarget < 0 || !m_lpTargets[nTarget].bSignal)
+        {
+            return false;
+        }
+
+        *pSignal = m_lpTargets[nTarget].Signal;
+
+        return true;
+    }
+
+    // Configures the signal of a channel, or of every channel of a
+    // device not configured on its own. Returns false if too many
+    // channels are configured.
+    bool SetSignal(const char *lpTarget, const DaqSimSignal *pSignal)
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        int nTarget = Add(lpTarget);
+
+        if (nTarget < 0)
+        {
+            return false;
+        }
+
+        m_lpTargets[nTarget].Signal = *pSignal;
+        m_lpTargets[nTarget].bSignal = true;
+
+        return true;
+    }
+
+    DaqSimTiming GetTiming(const char *lpDevice)
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        int nTarget = Find(lpDevice);
+
+        return (nTarget < 0 || !m_lpTargets[nTarget].bTiming) ? m_DefaultTiming : m_lpTargets[nTarget].Timing;
+    }
+
+    bool SetTiming(const char *lpDevice, const DaqSimTiming *pTiming)
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        int nTarget = Add(lpDevice);
+
+        if (nTarget < 0)
+        {
+            return false;
+        }
+
+        m_lpTargets[nTarget].Timing = *pTiming;
+        m_lpTargets[nTarget].bTiming = true;
+
+        return true;
+    }
+
+    // Forgets every configuration and sets the outputs back to zero
+    void Reset()
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_nTargets = 0;
+        m_nOutputs = 0;
+    }
+
+    int32 CreateTask(const char *lpDevice, TaskHandle *phTask)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) calloc(1, sizeof(DaqSimTask));
+
+        if (pTask == NULL)
+        {
+            return DAQmxErrorPALMemoryFull;
+        }
+
+        strncpy(pTask->lpDevice, lpDevice, DAQ_SIM_NAME_LENGTH - 1);
+        pTask->fRate = 1000;
+        pTask->nSampleMode = DAQmx_Val_FiniteSamps;
+        pTask->nSamples = 1000;
+        *phTask = (TaskHandle) pTask;
+
+        return 0;
+    }
+
+    int32 CreateAIVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName, int32 nTerminal,
+                              float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+        float64 fLimit = (fabs(fMin) > fabs(fMax)) ? fabs(fMin) : fabs(fMax);
+        float64 fRange = 0;
+
+        // The smallest range that fits, as the driver chooses it
+        for (size_t i = 1; i < sizeof(g_SimAIRanges) / sizeof(g_SimAIRanges[0]); i += 2)
+        {
+            if (g_SimAIRanges[i] >= fLimit)
+            {
+                fRange = g_SimAIRanges[i];
+                break;
+            }
+        }
+
+        if (fRange == 0)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        uInt32 nBefore = pTask->nChannels;
+        if (pTask->bOutput)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        int32 nResult = daqSimParseChannels(pTask->lpDevice, lpChannel, "ai", DAQ_SIM_AI_CHANNELS, pTask->lpIndex, &pTask->nChannels,
+                                            DAQ_SIM_AI_CHANNELS);
+
+        if (nResult < 0)
+        {
+            pTask->nChannels = nBefore;
+            return nResult;
+        }
+
+        for (uInt32 i = nBefore; i < pTask->nChannels; i++)
+        {
+            pTask->lpRange[i] = fRange;
+        }
+
+        pTask->bCommitted = false;
+
+        return 0;
+    }
+
+    // Output tasks only hold outputs, as in the driver
+    int32 CreateAOVoltageChan(TaskHandle hTask, const char *lpChannel, const char *lpName,
+                              float64 fMin, float64 fMax, int32 nUnits, const char *lpScale)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+        uInt32 nBefore = pTask->nChannels;
+
+        if ((nBefore > 0 && !pTask->bOutput) || fMin < g_SimAORanges[0] || fMax > g_SimAORanges[1] || fMin >= fMax)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        int32 nResult = daqSimParseChannels(pTask->lpDevice, lpChannel, "ao", DAQ_SIM_AO_CHANNELS, pTask->lpIndex, &pTask->nChannels,
+                                            DAQ_SIM_AI_CHANNELS);
+
+        if (nResult < 0)
+        {
+            pTask->nChannels = nBefore;
+            return nResult;
+        }
+
+        for (uInt32 i = nBefore; i < pTask->nChannels; i++)
+        {
+            pTask->lpRange[i] = g_SimAORanges[1];
+        }
+
+        pTask->bOutput = true;
+        pTask->bCommitted = false;
+
+        return 0;
+    }
+
+    int32 CfgSampClkTiming(TaskHandle hTask, const char *lpSource, float64 fRate, int32 nEdge, int32 nSampleMode, uInt64 nSamples)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        if (fRate < DAQ_SIM_MIN_RATE || fRate > DAQ_SIM_MAX_RATE || nSamples == 0)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        pTask->fRate = fRate;
+        pTask->nSampleMode = nSampleMode;
+        pTask->nSamples = nSamples;
+        pTask->bCommitted = false;
+
+        return 0;
+    }
+
+    int32 CfgInputBuffer(TaskHandle hTask, uInt32 nSamples)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        pTask->nBufferScans = nSamples;
+        pTask->bBufferSet = true;
+        pTask->bCommitted = false;
+
+        return 0;
+    }
+
+    // Only the start trigger of another simulated device is accepted
+    int32 CfgDigEdgeStartTrig(TaskHandle hTask, const char *lpSource, int32 nEdge)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+        const char *lpSlash = (lpSource[0] == '/') ? strchr(lpSource + 1, '/') : NULL;
+        size_t nDevice = (lpSlash != NULL) ? (size_t) (lpSlash - lpSource - 1) : 0;
+        char lpDevice[DAQ_SIM_NAME_LENGTH];
+
+        if (nDevice == 0 || nDevice >= sizeof(lpDevice) || strcmp(lpSlash, "/ai/StartTrigger") != 0)
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        memcpy(lpDevice, lpSource + 1, nDevice);
+        lpDevice[nDevice] = '\0';
+
+        if (!daqSimIsDevice(lpDevice) || !strcmp(lpDevice, pTask->lpDevice))
+        {
+            return DAQmxErrorInvalidAttributeValue;
+        }
+
+        strcpy(pTask->lpTrigger, lpDevice);
+        pTask->bCommitted = false;
+
+        return 0;
+    }
+
+    int32 TaskControl(TaskHandle hTask, int32 nAction)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        switch (nAction)
+        {
+            case DAQmx_Val_Task_Commit:
+                Commit(pTask);
+                break;
+            case DAQmx_Val_Task_Unreserve:
+                pTask->bRunning = false;
+                pTask->bCommitted = false;
+                break;
+            case DAQmx_Val_Task_Stop:
+            case DAQmx_Val_Task_Abort:
+                pTask->bRunning = false;
+                break;
+        }
+
+        return 0;
+    }
+
+    int32 StartTask(TaskHandle hTask)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        if (pTask->nChannels == 0)
+        {
+            return DAQmxErrorInvalidTask;
+        }
+
+        Commit(pTask);
+
+        pTask->Timing = GetTiming(pTask->lpDevice);
+
+        for (uInt32 i = 0; i < pTask->nChannels; i++)
+        {
+            DaqSimSignal *pSignal = pTask->lpSignals + i;
+
+            *pSignal = GetSignal(pTask->lpDevice, pTask->lpIndex[i]);
+
+            float64 fStep = 2 * 3.14159265358979323846 * pSignal->fFrequency / pTask->fRate;
+
+            pTask->lpRe[i] = 1;
+            pTask->lpIm[i] = 0;
+            pTask->lpRotRe[i] = cos(fStep);
+            pTask->lpRotIm[i] = sin(fStep);
+        }
+
+        pTask->nRandom = 0x9E3779B97F4A7C15ULL;
+        pTask->bSpare = false;
+        pTask->nScan = 0;
+        pTask->nTick = 0;
+        pTask->bRunning = true;
+        memset(pTask->lpLevel, 0, sizeof(pTask->lpLevel));
+
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+
+        // A triggered task is armed; the others trigger theirs. Outputs
+        // neither wait nor trigger.
+        if (pTask->bOutput)
+        {
+            pTask->tStart = std::chrono::steady_clock::now();
+            pTask->bArmed = false;
+        }
+        else if (pTask->lpTrigger[0] != '\0')
+        {
+            Start *pStart = AddStart(pTask->lpTrigger);
+
+            pTask->nArmed = (pStart != NULL) ? pStart->nCount : 0;
+            pTask->bArmed = true;
+        }
+        else
+        {
+            Start *pStart = AddStart(pTask->lpDevice);
+
+            pTask->tStart = std::chrono::steady_clock::now();
+            pTask->bArmed = false;
+
+            if (pStart != NULL)
+            {
+                pStart->tStart = pTask->tStart;
+                pStart->nCount++;
+                m_Started.notify_all();
+            }
+        }
+
+        return 0;
+    }
+
+    int32 StopTask(TaskHandle hTask)
+    {
+        ((DaqSimTask*) hTask)->bRunning = false;
+        return 0;
+    }
+
+    int32 ClearTask(TaskHandle hTask)
+    {
+        free(hTask);
+        return 0;
+    }
+
+    int32 GetTaskNumChans(TaskHandle hTask, uInt32 *pnChannels)
+    {
+        *pnChannels = ((DaqSimTask*) hTask)->nChannels;
+        return 0;
+    }
+
+    int32 GetTaskChannels(TaskHandle hTask, char *lpData, uInt32 nSize)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+        char lpList[DAQ_SIM_AI_CHANNELS * (DAQ_SIM_NAME_LENGTH + 8)] = "";
+
+        for (uInt32 i = 0; i < pTask->nChannels; i++)
+        {
+            char lpChannel[DAQ_SIM_NAME_LENGTH + 8];
+
+            snprintf(lpChannel, sizeof(lpChannel), "%s%s/ai%d", (i > 0) ? ", " : "", pTask->lpDevice, pTask->lpIndex[i]);
+            strcat(lpList, lpChannel);
+        }
+
+        return daqSimCopyString(lpList, lpData, nSize);
+    }
+
+    int32 GetNthTaskChannel(TaskHandle hTask, uInt32 nIndex, char *lpData, int32 nSize)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+        char lpChannel[DAQ_SIM_NAME_LENGTH + 8];
+
+        if (nIndex < 1 || nIndex > pTask->nChannels)
+        {
+            return DAQmxErrorPhysicalChanDoesNotExist;
+        }
+
+        snprintf(lpChannel, sizeof(lpChannel), "%s/ai%d", pTask->lpDevice, pTask->lpIndex[nIndex - 1]);
+
+        return daqSimCopyString(lpChannel, lpData, (uInt32) nSize);
+    }
+
+    int32 ReadAnalogF64(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, float64 *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        return Read((DaqSimTask*) hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead);
+    }
+
+    int32 ReadBinaryI16(TaskHandle hTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, int16 *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        return Read((DaqSimTask*) hTask, nSamples, fTimeout, nFillMode, lpData, nSize, pnRead);
+    }
+
+    // Only the last scan written matters, since outputs are read back
+    // as levels
+    int32 WriteAnalogF64(TaskHandle hTask, int32 nSamples, bool32 bAutoStart, float64 fTimeout, bool32 nLayout,
+                         const float64 *lpData, int32 *pnWritten)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        *pnWritten = 0;
+
+        if (!pTask->bOutput || nSamples < 1)
+        {
+            return DAQmxErrorInvalidTask;
+        }
+
+        if (!pTask->bRunning && bAutoStart)
+        {
+            StartTask(hTask);
+        }
+
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        Output *pOutput = AddOutput(pTask->lpDevice);
+
+        if (pOutput == NULL)
+        {
+            return DAQmxErrorPALMemoryFull;
+        }
+
+        for (uInt32 c = 0; c < pTask->nChannels; c++)
+        {
+            float64 fValue = (nLayout == DAQmx_Val_GroupByScanNumber) ? lpData[(size_t) (nSamples - 1) * pTask->nChannels + c] :
+                                                                         lpData[(size_t) c * nSamples + nSamples - 1];
+
+            // Clipped to the output range
+            pOutput->lpValues[pTask->lpIndex[c]] = (fValue > g_SimAORanges[1]) ? g_SimAORanges[1] :
+                                                   (fValue < g_SimAORanges[0]) ? g_SimAORanges[0] : fValue;
+        }
+
+        *pnWritten = nSamples;
+
+        return 0;
+    }
+
+    // Sleeps until the tick after the last one waited for. If that one
+    // has already gone by, the loop is late and skips to the current
+    // tick, as the hardware does.
+    int32 WaitForNextSampleClock(TaskHandle hTask, float64 fTimeout, bool32 *pbLate)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        *pbLate = 0;
+
+        if (!pTask->bRunning)
+        {
+            int32 nResult = StartTask(hTask);
+
+            if (nResult < 0)
+            {
+                return nResult;
+            }
+        }
+
+        if (pTask->bArmed && !WaitTrigger(pTask, fTimeout))
+        {
+            return DAQmxErrorSamplesNotYetAvailable;
+        }
+
+        if (!pTask->Timing.bRealtime)
+        {
+            pTask->nTick++;
+            return 0;
+        }
+
+        uInt64 nNow = Produced(pTask, 0);
+
+        if (nNow > pTask->nTick + 1)
+        {
+            pTask->nTick = nNow;
+            *pbLate = 1;
+            return 0;
+        }
+
+        pTask->nTick++;
+        std::this_thread::sleep_until(pTask->tStart +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(pTask->nTick / pTask->fRate)));
+
+        return 0;
+    }
+
+    // Codes are volts divided by the size of one code of the range
+    int32 GetAIDevScalingCoeff(TaskHandle hTask, const char *lpChannel, float64 *lpData, uInt32 nSize)
+    {
+        DaqSimTask *pTask = (DaqSimTask*) hTask;
+
+        for (uInt32 i = 0; i < pTask->nChannels; i++)
+        {
+            char lpName[DAQ_SIM_NAME_LENGTH + 8];
+
+            snprintf(lpName, sizeof(lpName), "%s/ai%d", pTask->lpDevice, pTask->lpIndex[i]);
+
+            if (!strcmp(lpName, lpChannel))
+            {
+                float64 lpCoeffs[4] = {0, pTask->lpRange[i] / DAQ_SIM_CODES, 0, 0};
+
+                return daqSimCopyArray(lpCoeffs, 4, lpData, nSize);
+            }
+        }
+
+        return DAQmxErrorPhysicalChanDoesNotExist;
+    }
+
+    // The converter has as many codes as an int16
+    int32 GetAIResolution(TaskHandle hTask, const char *lpChannel, float64 *pfBits)
+    {
+        *pfBits = 16;
+        return 0;
+    }
+
+    int32 GetDevProductType(const char *lpDevice, char *lpData, uInt32 nSize)
+    {
+        return daqSimCopyString(DAQ_SIM_PRODUCT, lpData, nSize);
+    }
+
+    int32 GetDevAIPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize)
+    {
+        return CopyChannels(lpDevice, "ai", DAQ_SIM_AI_CHANNELS, lpData, nSize);
+    }
+
+    int32 GetDevAOPhysicalChans(const char *lpDevice, char *lpData, uInt32 nSize)
+    {
+        return CopyChannels(lpDevice, "ao", DAQ_SIM_AO_CHANNELS, lpData, nSize);
+    }
+
+    int32 GetDevAISupportedMeasTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimMeasTypes, 1, lpData, nSize); }
+    int32 GetDevAOSupportedOutputTypes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimMeasTypes, 1, lpData, nSize); }
+    int32 GetDevAISampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimSampleModes, 3, lpData, nSize); }
+    int32 GetDevAOSampModes(const char *lpDevice, int32 *lpData, uInt32 nSize) { return daqSimCopyArray(g_SimSampleModes, 3, lpData, nSize); }
+
+    int32 GetDevAIVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize)
+    {
+        return daqSimCopyArray(g_SimAIRanges, sizeof(g_SimAIRanges) / sizeof(g_SimAIRanges[0]), lpData, nSize);
+    }
+
+    int32 GetDevAOVoltageRngs(const char *lpDevice, float64 *lpData, uInt32 nSize)
+    {
+        return daqSimCopyArray(g_SimAORanges, sizeof(g_SimAORanges) / sizeof(g_SimAORanges[0]), lpData, nSize);
+    }
+
+    int32 GetDevAIMaxSingleChanRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_SIM_MAX_RATE; return 0; }
+    int32 GetDevAIMaxMultiChanRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_SIM_MAX_RATE; return 0; }
+    int32 GetDevAIMinRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_SIM_MIN_RATE; return 0; }
+    int32 GetDevAISimultaneousSamplingSupported(const char *lpDevice, bool32 *pbValue) { *pbValue = 1; return 0; }
+    int32 GetDevAOSampClkSupported(const char *lpDevice, bool32 *pbValue) { *pbValue = 1; return 0; }
+    int32 GetDevAOMaxRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_SIM_MAX_RATE; return 0; }
+    int32 GetDevAOMinRate(const char *lpDevice, float64 *pfRate) { *pfRate = DAQ_SIM_MIN_RATE; return 0; }
+
+private:
+    struct Output
+    {
+        char lpDevice[DAQ_SIM_NAME_LENGTH];
+        float64 lpValues[DAQ_SIM_AO_CHANNELS];
+    };
+
+    struct Start
+    {
+        char lpDevice[DAQ_SIM_NAME_LENGTH];
+        std::chrono::steady_clock::time_point tStart;
+        uInt64 nCount;
+    };
+
+    struct Target
+    {
+        char lpName[DAQ_SIM_NAME_LENGTH + 8];
+        DaqSimSignal Signal;
+        DaqSimTiming Timing;
+        bool bSignal;
+        bool bTiming;
+    };
+
+    int Find(const char *lpName) const
+    {
+        for (int i = 0; i < m_nTargets; i++)
+        {
+            if (!strcmp(m_lpTargets[i].lpName, lpName))
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    int Add(const char *lpName)
+    {
+        for (int i = 0; i < m_nTargets; i++)
+        {
+            if (!strcmp(m_lpTargets[i].lpName, lpName))
+            {
+                return i;
+            }
+        }
+
+        if (m_nTargets == DAQ_SIM_TARGETS || strlen(lpName) >= sizeof(m_lpTargets[0].lpName))
+        {
+            return -1;
+        }
+
+        Target *pTarget = m_lpTargets + m_nTargets;
+
+        strcpy(pTarget->lpName, lpName);
+        pTarget->bSignal = false;
+        pTarget->bTiming = false;
+
+        return m_nTargets++;
+    }
+
+    // Output levels of a device, all zero until written. Called with
+    // the mutex held.
+    Output *AddOutput(const char *lpDevice)
+    {
+        for (int i = 0; i < m_nOutputs; i++)
+        {
+            if (!strcmp(m_lpOutputs[i].lpDevice, lpDevice))
+            {
+                return m_lpOutputs + i;
+            }
+        }
+
+        if (m_nOutputs == DAQ_SIM_TARGETS)
+        {
+            return NULL;
+        }
+
+        Output *pOutput = m_lpOutputs + m_nOutputs++;
+
+        strcpy(pOutput->lpDevice, lpDevice);
+        memset(pOutput->lpValues, 0, sizeof(pOutput->lpValues));
+
+        return pOutput;
+    }
+
+    // Start record of a device, added on first use. Called with the
+    // mutex held.
+    Start *AddStart(const char *lpDevice)
+    {
+        for (int i = 0; i < m_nStarts; i++)
+        {
+            if (!strcmp(m_lpStarts[i].lpDevice, lpDevice))
+            {
+                return m_lpStarts + i;
+            }
+        }
+
+        if (m_nStarts == DAQ_SIM_TARGETS)
+        {
+            return NULL;
+        }
+
+        Start *pStart = m_lpStarts + m_nStarts++;
+
+        strcpy(pStart->lpDevice, lpDevice);
+        pStart->nCount = 0;
+
+        return pStart;
+    }
+
+    // Waits up to fTimeout seconds (forever if negative) for the
+    // trigger of an armed task and takes its start time from it
+    bool WaitTrigger(DaqSimTask *pTask, float64 fTimeout)
+    {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        Start *pStart = AddStart(pTask->lpTrigger);
+
+        if (pStart == NULL)
+        {
+            return false;
+        }
+
+        auto Triggered = [&]() { return pStart->nCount > pTask->nArmed; };
+
+        if (fTimeout < 0)
+        {
+            m_Started.wait(Lock, Triggered);
+        }
+        else if (!m_Started.wait_for(Lock, std::chrono::duration<double>(fTimeout), Triggered))
+        {
+            return false;
+        }
+
+        pTask->tStart = pStart->tStart;
+        pTask->bArmed = false;
+
+        return true;
+    }
+
+    // Charges the setup latency once per configuration, as committing
+    // a real task programs the hardware
+    void Commit(DaqSimTask *pTask)
+    {
+        if (pTask->bCommitted)
+        {
+            return;
+        }
+
+        float64 fLatency = GetTiming(pTask->lpDevice).fSetupLatency;
+
+        if (fLatency > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(fLatency));
+        }
+
+        // Unless told, the driver sizes the buffer to hold a finite
+        // capture, and a continuous one by the rate
+        if (!pTask->bBufferSet)
+        {
+            uInt64 nMinimum = (pTask->fRate <= 100) ? 1000 : (pTask->fRate <= 10000) ? 10000 : (pTask->fRate <= 1000000) ? 100000 : 1000000;
+            pTask->nBufferScans = (pTask->nSamples > nMinimum) ? pTask->nSamples : nMinimum;
+        }
+
+        pTask->bCommitted = true;
+    }
+
+    int32 CopyChannels(const char *lpDevice, const char *lpType, int nChannels, char *lpData, uInt32 nSize)
+    {
+        char lpList[DAQ_SIM_AI_CHANNELS * (DAQ_SIM_NAME_LENGTH + 8)] = "";
+
+        for (int i = 0; i < nChannels; i++)
+        {
+            char lpChannel[DAQ_SIM_NAME_LENGTH + 8];
+
+            snprintf(lpChannel, sizeof(lpChannel), "%s%s/%s%d", (i > 0) ? ", " : "", lpDevice, lpType, i);
+            strcat(lpList, lpChannel);
+        }
+
+        return daqSimCopyString(lpList, lpData, nSize);
+    }
+
+    // Scans converted so far, or as many as asked for when not
+    // running in real time
+    uInt64 Produced(const DaqSimTask *pTask, uInt64 nWanted) const
+    {
+        uInt64 nProduced = nWanted;
+
+        if (pTask->Timing.bRealtime)
+        {
+            std::chrono::duration<double> fElapsed = std::chrono::steady_clock::now() - pTask->tStart;
+            nProduced = (uInt64) (fElapsed.count() * pTask->fRate);
+        }
+
+        if (pTask->nSampleMode == DAQmx_Val_FiniteSamps && nProduced > pTask->nSamples)
+        {
+            nProduced = pTask->nSamples;
+        }
+
+        return nProduced;
+    }
+
+    static void Store(float64 *lpData, size_t nIndex, int16 nCode, float64 fCode)
+    {
+        lpData[nIndex] = nCode * fCode;
+    }
+
+    static void Store(int16 *lpData, size_t nIndex, int16 nCode, float64 fCode)
+    {
+        lpData[nIndex] = nCode;
+    }
+
+    template <typename T>
+    void Generate(DaqSimTask *pTask, uInt32 nScans, bool32 nFillMode, uInt32 nStride, T *lpData)
+    {
+        float64 lpOutputs[DAQ_SIM_AO_CHANNELS];
+
+        {
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+            Output *pOutput = AddOutput(pTask->lpDevice);
+
+            if (pOutput != NULL)
+            {
+                memcpy(lpOutputs, pOutput->lpValues, sizeof(lpOutputs));
+            }
+            else
+            {
+                memset(lpOutputs, 0, sizeof(lpOutputs));
+            }
+        }
+
+        for (uInt32 c = 0; c < pTask->nChannels; c++)
+        {
+            const DaqSimSignal *pSignal = pTask->lpSignals + c;
+            float64 fCode = pTask->lpRange[c] / DAQ_SIM_CODES;
+            float64 fRe = pTask->lpRe[c], fIm = pTask->lpIm[c];
+            float64 fRotRe = pTask->lpRotRe[c], fRotIm = pTask->lpRotIm[c];
+            uInt64 nStepScan = (uInt64) (pSignal->fDelay * pTask->fRate);
+
+            // Outputs are followed through a first order lag of Delay seconds
+            float64 fTarget = pSignal->fAmplitude * lpOutputs[pTask->lpIndex[c] % DAQ_SIM_AO_CHANNELS];
+            float64 fLag = (pSignal->fDelay > 0) ? 1 - exp(-1 / (pSignal->fDelay * pTask->fRate)) : 1;
+
+            for (uInt32 i = 0; i < nScans; i++)
+            {
+                float64 fValue = pSignal->fOffset;
+
+                switch (pSignal->nShape)
+                {
+                    case DAQ_SIM_SINE:
+                    {
+                        fValue += pSignal->fAmplitude * fIm;
+
+                        float64 fNext = fRe * fRotRe - fIm * fRotIm;
+                        fIm = fRe * fRotIm + fIm * fRotRe;
+                        fRe = fNext;
+                        break;
+                    }
+                    case DAQ_SIM_NOISE:
+                        fValue += pSignal->fAmplitude * daqSimGauss(pTask);
+                        break;
+                    case DAQ_SIM_STEP:
+                        fValue += (pTask->nScan + i >= nStepScan) ? pSignal->fAmplitude : 0;
+                        break;
+                    case DAQ_SIM_OUTPUT:
+                        pTask->lpLevel[c] += fLag * (fTarget - pTask->lpLevel[c]);
+                        fValue += pTask->lpLevel[c];
+                        break;
+                }
+
+                if (pSignal->fNoise > 0)
+                {
+                    fValue += pSignal->fNoise * daqSimGauss(pTask);
+                }
+
+                // Quantized and clipped as the converter would
+                float64 fLevel = floor(fValue / fCode + 0.5);
+                int16 nCode = (int16) ((fLevel > 32767) ? 32767 : (fLevel < -32768) ? -32768 : fLevel);
+                size_t nIndex = (nFillMode == DAQmx_Val_GroupByScanNumber) ? (size_t) i * pTask->nChannels + c : (size_t) c * nStride + i;
+
+                Store(lpData, nIndex, nCode, fCode);
+            }
+
+            // Keeps rounding errors from changing the amplitude
+            float64 fNorm = 1 / sqrt(fRe * fRe + fIm * fIm);
+
+            pTask->lpRe[c] = fRe * fNorm;
+            pTask->lpIm[c] = fIm * fNorm;
+        }
+    }
+
+    template <typename T>
+    int32 Read(DaqSimTask *pTask, int32 nSamples, float64 fTimeout, bool32 nFillMode, T *lpData, uInt32 nSize, int32 *pnRead)
+    {
+        *pnRead = 0;
+
+        // Reading starts a task that was not started, as in the driver
+        if (!pTask->bRunning)
+        {
+            int32 nResult = StartTask((TaskHandle) pTask);
+
+            if (nResult < 0)
+            {
+                return nResult;
+            }
+        }
+
+        if (pTask->bArmed && !WaitTrigger(pTask, fTimeout))
+        {
+            return DAQmxErrorSamplesNotYetAvailable;
+        }
+
+        if (pTask->Timing.fReadLatency > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(pTask->Timing.fReadLatency));
+        }
+
+        // In single-point timing every read takes the scan of the last
+        // tick waited for
+        if (pTask->nSampleMode == DAQmx_Val_HWTimedSinglePoint)
+        {
+            if (nSize < pTask->nChannels)
+            {
+                return DAQmxErrorInvalidAttributeValue;
+            }
+
+            pTask->nScan = pTask->nTick;
+            Generate(pTask, 1, nFillMode, 1, lpData);
+            *pnRead = 1;
+
+            return 0;
+        }
+
+        uInt64 nLimit = nSize / pTask->nChannels;
+        uInt64 nWanted;
+
+        if (nSamples < 0)
+        {
+            // Whatever is available, or the rest of a finite capture
+            nWanted = Produced(pTask, (pTask->nSampleMode == DAQmx_Val_FiniteSamps) ? pTask->nSamples : pTask->nScan + nLimit) - pTask->nScan;
+        }
+        else
+        {
+            nWanted = (uInt64) nSamples;
+        }
+
+        if (pTask->nSampleMode == DAQmx_Val_FiniteSamps && pTask->nScan + nWanted > pTask->nSamples)
+        {
+            nWanted = pTask->nSamples - pTask->nScan;
+        }
+
+        if (nWanted > nLimit)
+        {
+            nWanted = nLimit;
+        }
+
+        // Samples left unread for longer than the buffer holds are lost,
+        // which a finite task only risks with a buffer set smaller than
+        // the capture. Once a read is waiting, it takes them as they arrive.
+        if (pTask->Timing.bRealtime && Produced(pTask, 0) - pTask->nScan > pTask->nBufferScans)
+        {
+            return DAQmxErrorSamplesNoLongerAvailable;
+        }
+
+        uInt64 nEnd = pTask->nScan + nWanted;
+
+        if (pTask->Timing.bRealtime && Produced(pTask, nEnd) < nEnd)
+        {
+            // Sleep until the last sample would be converted, or the timeout
+            std::chrono::steady_clock::time_point tReady = pTask->tStart +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(nEnd / pTask->fRate));
+
+            if (fTimeout >= 0)
+            {
+                std::chrono::steady_clock::time_point tDeadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(fTimeout));
+
+                if (tDeadline < tReady)
+                {
+                    tReady = tDeadline;
+                }
+            }
+
+            std::this_thread::sleep_until(tReady);
+        }
+
+        uInt64 nProduced = Produced(pTask, nEnd);
+        uInt32 nScans = (uInt32) ((nProduced < nEnd) ? nProduced - pTask->nScan : nWanted);
+        uInt32 nStride = (nSamples < 0) ? nScans : (uInt32) nSamples;
+
+        Generate(pTask, nScans, nFillMode, nStride, lpData);
+
+        pTask->nScan += nScans;
+        *pnRead = (int32) nScans;
+
+        return (nScans < nWanted) ? DAQmxErrorSamplesNotYetAvailable : 0;
+    }
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Started;
+    Target m_lpTargets[DAQ_SIM_TARGETS];
+    int m_nTargets;
+    Start m_lpStarts[DAQ_SIM_TARGETS];
+    int m_nStarts;
+    Output m_lpOutputs[DAQ_SIM_TARGETS];
+    int m_nOutputs;
+    DaqSimTiming m_DefaultTiming;
+};
+
+#endif
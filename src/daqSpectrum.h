@@ -0,0 +1,225 @@
+/*************************************************************/
+// daqSpectrum.h
+//
+// Welch power spectral density accumulated block by block as a
+// capture is read, so only one segment per channel and the running
+// sum of the periodograms are ever kept. For each channel the
+// result matches
+//
+//     pwelch(x, hann(NFFT), Overlap, NFFT, Rate)
+//
+// in MATLAB terms: a one-sided density in V^2/Hz, averaged over
+// every complete segment. Segments that would run past the end of
+// the capture are dropped, as pwelch does.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQSPECTRUM_H
+#define DAQSPECTRUM_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "daqFft.h"
+
+class DaqSpectrum
+{
+public:
+    DaqSpectrum() : m_lpWindow(NULL), m_lpSegments(NULL), m_lpFill(NULL), m_lpSum(NULL), m_lpWork(NULL),
+                    m_lpRe(NULL), m_lpIm(NULL), m_lpCount(NULL), m_nSize(0), m_nOverlap(0), m_nChannels(0), m_fWindowPower(0)
+    {
+    }
+
+    ~DaqSpectrum()
+    {
+        Free();
+    }
+
+    // Prepares nChannels channels for segments of nSize samples, a
+    // power of two, consecutive ones sharing nOverlap samples
+    bool Init(size_t nSize, size_t nOverlap, uInt32 nChannels)
+    {
+        Free();
+
+        if (nOverlap >= nSize || !m_Fft.Init(nSize))
+        {
+            return false;
+        }
+
+        m_nSize = nSize;
+        m_nOverlap = nOverlap;
+        m_nChannels = nChannels;
+
+        size_t nBins = Bins();
+
+        m_lpWindow = (float64*) malloc(nSize * sizeof(float64));
+        m_lpSegments = (float64*) malloc(nSize * nChannels * sizeof(float64));
+        m_lpFill = (size_t*) calloc(nChannels, sizeof(size_t));
+        m_lpSum = (float64*) calloc(nBins * nChannels, sizeof(float64));
+        m_lpWork = (float64*) malloc(nSize * sizeof(float64));
+        m_lpRe = (float64*) malloc(nBins * sizeof(float64));
+        m_lpIm = (float64*) malloc(nBins * sizeof(float64));
+        m_lpCount = (unsigned long long*) calloc(nChannels, sizeof(unsigned long long));
+
+        if (m_lpWindow == NULL || m_lpSegments == NULL || m_lpFill == NULL || m_lpSum == NULL || m_lpWork == NULL ||
+            m_lpRe == NULL || m_lpIm == NULL || m_lpCount == NULL)
+        {
+            Free();
+            return false;
+        }
+
+        // Symmetric Hann window, as hann(NFFT) returns it
+        m_fWindowPower = 0;
+
+        for (size_t i = 0; i < nSize; i++)
+        {
+            m_lpWindow[i] = 0.5 - 0.5 * cos(2 * DAQ_PI * i / (nSize - 1));
+            m_fWindowPower += m_lpWindow[i] * m_lpWindow[i];
+        }
+
+        return true;
+    }
+
+    // Number of frequency bins, from 0 to Rate / 2
+    size_t Bins() const
+    {
+        return m_nSize / 2 + 1;
+    }
+
+    // Adds n new samples of a channel. Every segment completed by
+    // them is windowed, transformed and added to the running sum.
+    void Process(uInt32 nChannel, const float64 *lpIn, size_t n)
+    {
+        float64 *lpSegment = m_lpSegments + nChannel * m_nSize;
+        size_t nFill = m_lpFill[nChannel];
+
+        while (n > 0)
+        {
+            size_t nCopy = (m_nSize - nFill < n) ? m_nSize - nFill : n;
+
+            memcpy(lpSegment + nFill, lpIn, nCopy * sizeof(float64));
+            nFill += nCopy;
+            lpIn += nCopy;
+            n -= nCopy;
+
+            if (nFill < m_nSize)
+            {
+                break;
+            }
+
+            Accumulate(nChannel, lpSegment);
+
+            // The overlap becomes the start of the next segment
+            memmove(lpSegment, lpSegment + m_nSize - m_nOverlap, m_nOverlap * sizeof(float64));
+            nFill = m_nOverlap;
+        }
+
+        m_lpFill[nChannel] = nFill;
+    }
+
+    // Number of segments averaged so far for a channel
+    unsigned long long Segments(uInt32 nChannel) const
+    {
+        return m_lpCount[nChannel];
+    }
+
+    // Writes the averaged one-sided density of every channel to
+    // lpOut, Bins() values per channel, in V^2/Hz. Channels without
+    // a complete segment are filled with zeros.
+    void Result(float64 fRate, float64 *lpOut) const
+    {
+        size_t nBins = Bins();
+
+        for (uInt32 c = 0; c < m_nChannels; c++)
+        {
+            const float64 *lpSum = m_lpSum + c * nBins;
+            float64 *lpDensity = lpOut + c * nBins;
+
+            if (m_lpCount[c] == 0)
+            {
+                memset(lpDensity, 0, nBins * sizeof(float64));
+                continue;
+            }
+
+            // Every bin but DC and Nyquist also holds the power of
+            // its negative frequency
+            float64 fScale = 1.0 / (fRate * m_fWindowPower * m_lpCount[c]);
+
+            for (size_t k = 0; k < nBins; k++)
+            {
+                lpDensity[k] = lpSum[k] * ((k == 0 || k == nBins - 1) ? fScale : 2 * fScale);
+            }
+        }
+    }
+
+    void Free()
+    {
+        m_Fft.Free();
+
+        free(m_lpWindow);
+        free(m_lpSegments);
+        free(m_lpFill);
+        free(m_lpSum);
+        free(m_lpWork);
+        free(m_lpRe);
+        free(m_lpIm);
+        free(m_lpCount);
+
+        m_lpWindow = NULL;
+        m_lpSegments = NULL;
+        m_lpFill = NULL;
+        m_lpSum = NULL;
+        m_lpWork = NULL;
+        m_lpRe = NULL;
+        m_lpIm = NULL;
+        m_lpCount = NULL;
+    }
+
+private:
+    void Accumulate(uInt32 nChannel, const float64 *lpSegment)
+    {
+        float64 *lpSum = m_lpSum + nChannel * Bins();
+        size_t nBins = Bins();
+
+        for (size_t i = 0; i < m_nSize; i++)
+        {
+            m_lpWork[i] = lpSegment[i] * m_lpWindow[i];
+        }
+
+        m_Fft.Real(m_lpWork, m_lpRe, m_lpIm);
+
+        for (size_t k = 0; k < nBins; k++)
+        {
+            lpSum[k] += m_lpRe[k] * m_lpRe[k] + m_lpIm[k] * m_lpIm[k];
+        }
+
+        m_lpCount[nChannel]++;
+    }
+
+    DaqFft m_Fft;
+    float64 *m_lpWindow;
+    float64 *m_lpSegments;
+    size_t *m_lpFill;
+    float64 *m_lpSum;
+    float64 *m_lpWork;
+    float64 *m_lpRe;
+    float64 *m_lpIm;
+    unsigned long long *m_lpCount;
+    size_t m_nSize;
+    size_t m_nOverlap;
+    uInt32 m_nChannels;
+    float64 m_fWindowPower;
+};
+
+#endif
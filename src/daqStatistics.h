@@ -0,0 +1,359 @@
+/*************************************************************/
+// daqStatistics.h
+//
+// Windowed aggregates of an adquisition: the minimum, maximum,
+// mean, RMS and standard deviation of every window of samples of
+// each channel, plus a histogram of the whole capture. Samples are
+// consumed as they are read and only the aggregates are kept.
+//
+// Every block is reduced on its own, with its mean taken first so
+// the squared deviations do not cancel, and then merged into its
+// window with the pairwise update of Chan et al. The reductions use
+// AVX2 on processors that have it, chosen at run time as in
+// daqScale.h.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQSTATISTICS_H
+#define DAQSTATISTICS_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daqScale.h"
+
+#ifdef DAQ_SCALE_AVX2
+// Minimum, maximum and sum of the first n elements, n a multiple of
+// 4 and not 0
+DAQ_SCALE_TARGET static inline void daqStatsRangeAvx2(const float64 *x, size_t n, float64 *pfMin, float64 *pfMax, float64 *pfSum)
+{
+    __m256d fMin4 = _mm256_loadu_pd(x);
+    __m256d fMax4 = fMin4;
+    __m256d fSum4 = _mm256_setzero_pd();
+
+    for (size_t i = 0; i < n; i += 4)
+    {
+        __m256d fValues = _mm256_loadu_pd(x + i);
+
+        fMin4 = _mm256_min_pd(fMin4, fValues);
+        fMax4 = _mm256_max_pd(fMax4, fValues);
+        fSum4 = _mm256_add_pd(fSum4, fValues);
+    }
+
+    float64 lpMin[4], lpMax[4], lpSum[4];
+
+    _mm256_storeu_pd(lpMin, fMin4);
+    _mm256_storeu_pd(lpMax, fMax4);
+    _mm256_storeu_pd(lpSum, fSum4);
+
+    for (int k = 0; k < 4; k++)
+    {
+        *pfMin = (lpMin[k] < *pfMin) ? lpMin[k] : *pfMin;
+        *pfMax = (lpMax[k] > *pfMax) ? lpMax[k] : *pfMax;
+    }
+
+    *pfSum = (lpSum[0] + lpSum[1]) + (lpSum[2] + lpSum[3]);
+}
+
+// Sum of the squared deviations of the first n elements from fMean,
+// n a multiple of 8
+DAQ_SCALE_TARGET static inline float64 daqStatsDeviationAvx2(const float64 *x, size_t n, float64 fMean)
+{
+    __m256d fMean4 = _mm256_set1_pd(fMean);
+    __m256d fAcc0 = _mm256_setzero_pd();
+    __m256d fAcc1 = _mm256_setzero_pd();
+
+    for (size_t i = 0; i < n; i += 8)
+    {
+        __m256d fD0 = _mm256_sub_pd(_mm256_loadu_pd(x + i), fMean4);
+        __m256d fD1 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 4), fMean4);
+
+        fAcc0 = _mm256_add_pd(fAcc0, _mm256_mul_pd(fD0, fD0));
+        fAcc1 = _mm256_add_pd(fAcc1, _mm256_mul_pd(fD1, fD1));
+    }
+
+    float64 fLanes[4];
+
+    _mm256_storeu_pd(fLanes, _mm256_add_pd(fAcc0, fAcc1));
+
+    return (fLanes[0] + fLanes[1]) + (fLanes[2] + fLanes[3]);
+}
+#endif
+
+// Minimum, maximum and sum of n > 0 elements
+static inline void daqStatsRange(const float64 *x, size_t n, float64 *pfMin, float64 *pfMax, float64 *pfSum)
+{
+    size_t i = 0;
+    float64 fMin = x[0], fMax = x[0], fSum = 0;
+
+#ifdef DAQ_SCALE_AVX2
+    if (n >= 4 && daqScaleHasAvx2())
+    {
+        i = n - n % 4;
+        daqStatsRangeAvx2(x, i, &fMin, &fMax, &fSum);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        fMin = (x[i] < fMin) ? x[i] : fMin;
+        fMax = (x[i] > fMax) ? x[i] : fMax;
+        fSum += x[i];
+    }
+
+    *pfMin = fMin;
+    *pfMax = fMax;
+    *pfSum = fSum;
+}
+
+// Sum of the squared deviations of n elements from fMean
+static inline float64 daqStatsDeviation(const float64 *x, size_t n, float64 fMean)
+{
+    size_t i = 0;
+    float64 fSum = 0;
+
+#ifdef DAQ_SCALE_AVX2
+    if (n >= 8 && daqScaleHasAvx2())
+    {
+        i = n - n % 8;
+        fSum = daqStatsDeviationAvx2(x, i, fMean);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        fSum += (x[i] - fMean) * (x[i] - fMean);
+    }
+
+    return fSum;
+}
+
+class DaqStatistics
+{
+public:
+    DaqStatistics() : m_lpMin(NULL), m_lpMax(NULL), m_lpMean(NULL), m_lpM2(NULL), m_lpCount(NULL), m_lpHistogram(NULL),
+                      m_lpPosition(NULL), m_nChannels(0), m_nWindow(1), m_nWindows(0), m_nBins(0), m_fLow(0), m_fScale(0)
+    {
+    }
+
+    ~DaqStatistics()
+    {
+        Free();
+    }
+
+    // Prepares nWindows windows of nWindow samples for nChannels
+    // channels, and a histogram of nBins bins between fLow and fHigh,
+    // or none if nBins is 0
+    bool Init(uInt32 nChannels, unsigned long long nWindow, size_t nWindows, int nBins, float64 fLow, float64 fHigh)
+    {
+        Free();
+
+        size_t nCells = nWindows * nChannels;
+
+        m_nChannels = nChannels;
+        m_nWindow = nWindow;
+        m_nWindows = nWindows;
+        m_nBins = nBins;
+        m_fLow = fLow;
+        m_fScale = nBins / (fHigh - fLow);
+
+        m_lpMin = (float64*) malloc(nCells * sizeof(float64));
+        m_lpMax = (float64*) malloc(nCells * sizeof(float64));
+        m_lpMean = (float64*) calloc(nCells, sizeof(float64));
+        m_lpM2 = (float64*) calloc(nCells, sizeof(float64));
+        m_lpCount = (unsigned long long*) calloc(nCells, sizeof(unsigned long long));
+        m_lpHistogram = (unsigned long long*) calloc((size_t) nBins * nChannels + 1, sizeof(unsigned long long));
+        m_lpPosition = (unsigned long long*) calloc(nChannels, sizeof(unsigned long long));
+
+        if (m_lpMin == NULL || m_lpMax == NULL || m_lpMean == NULL || m_lpM2 == NULL || m_lpCount == NULL ||
+            m_lpHistogram == NULL || m_lpPosition == NULL)
+        {
+            Free();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Adds n new samples of a channel
+    void Process(uInt32 nChannel, const float64 *lpIn, size_t n)
+    {
+        unsigned long long nPosition = m_lpPosition[nChannel];
+        size_t i = 0;
+
+        while (i < n)
+        {
+            size_t nWindow = (size_t) (nPosition / m_nWindow);
+
+            if (nWindow >= m_nWindows)
+            {
+                break;
+            }
+
+            unsigned long long nLeft = (nWindow + 1) * m_nWindow - nPosition;
+            size_t nBlock = (n - i < nLeft) ? n - i : (size_t) nLeft;
+
+            Merge(nWindow * m_nChannels + nChannel, lpIn + i, nBlock);
+            i += nBlock;
+            nPosition += nBlock;
+        }
+
+        m_lpPosition[nChannel] = nPosition;
+
+        if (m_nBins > 0)
+        {
+            unsigned long long *lpHistogram = m_lpHistogram + (size_t) nChannel * m_nBins;
+
+            // Samples outside the range count in the outer bins
+            for (size_t k = 0; k < i; k++)
+            {
+                float64 fBin = (lpIn[k] - m_fLow) * m_fScale;
+                int nBin = (fBin <= 0) ? 0 : (fBin >= m_nBins) ? m_nBins - 1 : (int) fBin;
+
+                lpHistogram[nBin]++;
+            }
+        }
+    }
+
+    // Windows that received samples, which may be fewer than those
+    // prepared if the adquisition ended early
+    size_t Windows() const
+    {
+        size_t nWindows = 0;
+
+        for (size_t w = 0; w < m_nWindows; w++)
+        {
+            nWindows = (m_lpCount[w * m_nChannels] > 0) ? w + 1 : nWindows;
+        }
+
+        return nWindows;
+    }
+
+    // Writes the aggregates of the first nWindows windows as
+    // column-major nWindows by nChannels matrices. Any of them may be
+    // NULL. The standard deviation is normalized by n - 1, as MATLAB's
+    // std, and the RMS by n.
+    void Result(size_t nWindows, float64 *lpMin, float64 *lpMax, float64 *lpMean, float64 *lpRms, float64 *lpStd) const
+    {
+        for (uInt32 c = 0; c < m_nChannels; c++)
+        {
+            for (size_t w = 0; w < nWindows; w++)
+            {
+                size_t nCell = w * m_nChannels + c, nOut = c * nWindows + w;
+                float64 fCount = (float64) m_lpCount[nCell];
+                float64 fMean = m_lpMean[nCell];
+
+                if (lpMin != NULL)
+                {
+                    lpMin[nOut] = m_lpMin[nCell];
+                }
+
+                if (lpMax != NULL)
+                {
+                    lpMax[nOut] = m_lpMax[nCell];
+                }
+
+                if (lpMean != NULL)
+                {
+                    lpMean[nOut] = fMean;
+                }
+
+                if (lpRms != NULL)
+                {
+                    lpRms[nOut] = sqrt(fMean * fMean + m_lpM2[nCell] / fCount);
+                }
+
+                if (lpStd != NULL)
+                {
+                    lpStd[nOut] = (fCount > 1) ? sqrt(m_lpM2[nCell] / (fCount - 1)) : 0;
+                }
+            }
+        }
+    }
+
+    // Histogram counts, nBins per channel
+    const unsigned long long *Histogram() const
+    {
+        return m_lpHistogram;
+    }
+
+    void Free()
+    {
+        free(m_lpMin);
+        free(m_lpMax);
+        free(m_lpMean);
+        free(m_lpM2);
+        free(m_lpCount);
+        free(m_lpHistogram);
+        free(m_lpPosition);
+
+        m_lpMin = NULL;
+        m_lpMax = NULL;
+        m_lpMean = NULL;
+        m_lpM2 = NULL;
+        m_lpCount = NULL;
+        m_lpHistogram = NULL;
+        m_lpPosition = NULL;
+    }
+
+private:
+    // Reduces a block and merges it into a window
+    void Merge(size_t nCell, const float64 *x, size_t n)
+    {
+        float64 fMin, fMax, fSum;
+
+        daqStatsRange(x, n, &fMin, &fMax, &fSum);
+
+        float64 fMean = fSum / n;
+        float64 fM2 = daqStatsDeviation(x, n, fMean);
+        unsigned long long nCount = m_lpCount[nCell];
+
+        if (nCount == 0)
+        {
+            m_lpMin[nCell] = fMin;
+            m_lpMax[nCell] = fMax;
+            m_lpMean[nCell] = fMean;
+            m_lpM2[nCell] = fM2;
+        }
+        else
+        {
+            float64 fTotal = (float64) (nCount + n);
+            float64 fDelta = fMean - m_lpMean[nCell];
+
+            m_lpMin[nCell] = (fMin < m_lpMin[nCell]) ? fMin : m_lpMin[nCell];
+            m_lpMax[nCell] = (fMax > m_lpMax[nCell]) ? fMax : m_lpMax[nCell];
+            m_lpMean[nCell] += fDelta * n / fTotal;
+            m_lpM2[nCell] += fM2 + fDelta * fDelta * ((float64) nCount * n / fTotal);
+        }
+
+        m_lpCount[nCell] = nCount + n;
+    }
+
+    float64 *m_lpMin;
+    float64 *m_lpMax;
+    float64 *m_lpMean;
+    float64 *m_lpM2;
+    unsigned long long *m_lpCount;
+    unsigned long long *m_lpHistogram;
+    unsigned long long *m_lpPosition;
+    uInt32 m_nChannels;
+    unsigned long long m_nWindow;
+    size_t m_nWindows;
+    int m_nBins;
+    float64 m_fLow;
+    float64 m_fScale;
+};
+
+#endif
@@ -0,0 +1,258 @@
+/*************************************************************/
+// daqSubscribe.cpp
+//
+// Reads an adquisition that another MATLAB session publishes with
+// daqAdquireData('publish', ...). The ring of blocks is mapped
+// read-only and the writer never waits for its readers, so any
+// number of them can follow the same adquisition.
+//
+//                       ------ ARGUMENTS ------
+//
+// [Info (t)] = daqSubscribe(Name (s))
+// [Data (f), Next (n), Lost (n)] = daqSubscribe(Name (s), Sequence (n))
+//
+// - n denotes a natural value
+// - f denotes a real matrix
+// - s denotes a string
+// - t denotes a structure
+//
+//            - Name: name the adquisition is published under
+//
+//            - Info: structure with the Rate, Range, Channels, SampleType
+//                    ('double' or 'int16') and Scaling coefficients of the
+//                    adquisition, the BlockSamples and Blocks of the ring,
+//                    the number of blocks Published so far and whether
+//                    the writer is still Running
+//
+//        - Sequence: first block to read, from 0. Every block published
+//                    since then and still in the ring is returned. Use 0
+//                    to start with the oldest one
+//
+//            - Data: the samples of those blocks, laid out as
+//                    daqAdquireData returns them: a row vector for a
+//                    single channel or a matrix with one column per
+//                    channel. Empty if no new block has been published
+//
+//            - Next: Sequence to pass on the next call
+//
+//            - Lost: blocks overwritten by the writer before they could
+//                    be read. Reading more often, or publishing with more
+//                    'Blocks', avoids losing them
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqShared.h"
+
+// The ring last read, kept mapped between calls
+static DaqSharedMemory g_Memory;
+
+void outMexError(int nError)
+{
+    if (nError != 0)
+    {
+        int nSize = daqGetErrorString(nError, NULL, 0);
+        char *lpError = (char*) mxMalloc(nSize);
+        daqGetErrorString(nError, lpError, nSize);
+        char lpOutput[256];
+        
+        sprintf(lpOutput, "DAQmx Error %d: %s.", nError, lpError);
+        mxFree(lpError);
+        
+        mexErrMsgTxt(lpOutput);
+    }
+}
+
+void onExit()
+{
+    g_Memory.Close();
+}
+
+// Maps the ring published under lpName. A ring whose writer stopped
+// is opened again, in case a new writer took its name.
+const DaqSharedHeader *openRing(const char *lpName)
+{
+    const DaqSharedHeader *pHeader = (const DaqSharedHeader*) g_Memory.Data();
+    
+    if (pHeader != NULL && !strcmp(g_Memory.Name(), lpName) && pHeader->nState.load() == DAQ_SHARED_RUNNING)
+    {
+        return pHeader;
+    }
+    
+    DaqSharedMemory Memory;
+    
+    if (!Memory.Open(lpName) || !daqSharedCheckHeader((const DaqSharedHeader*) Memory.Data(), Memory.Size()))
+    {
+        // The stopped ring can still be read until it is emptied
+        if (pHeader != NULL && !strcmp(g_Memory.Name(), lpName))
+        {
+            return pHeader;
+        }
+        
+        mexErrMsgTxt("Nothing is published under that name.");
+    }
+    
+    g_Memory.Close();
+    
+    if (!g_Memory.Open(lpName) || !daqSharedCheckHeader((const DaqSharedHeader*) g_Memory.Data(), g_Memory.Size()))
+    {
+        g_Memory.Close();
+        mexErrMsgTxt("Nothing is published under that name.");
+    }
+    
+    return (const DaqSharedHeader*) g_Memory.Data();
+}
+
+mxArray *createInfo(const DaqSharedHeader *pHeader)
+{
+    const char *lpFields[] = {"Rate", "Range", "Channels", "SampleType", "Scaling", "BlockSamples", "Blocks", "Published", "Running"};
+    mxArray *pInfo = mxCreateStructMatrix(1, 1, 9, lpFields);
+    char *lpNames = (char*) mxCalloc(pHeader->nChannelsLength + 1, sizeof(char));
+    
+    memcpy(lpNames, daqSharedChannels(pHeader), pHeader->nChannelsLength);
+    
+    mxArray *pScaling = mxCreateNumericMatrix(pHeader->nCoeffs, pHeader->nChannels, mxDOUBLE_CLASS, mxREAL);
+    memcpy(mxGetPr(pScaling), daqSharedScaling(pHeader), (size_t) pHeader->nChannels * pHeader->nCoeffs * sizeof(float64));
+    
+    mxSetField(pInfo, 0, "Rate", mxCreateDoubleScalar(pHeader->fRate));
+    mxSetField(pInfo, 0, "Range", mxCreateDoubleScalar(pHeader->fRange));
+    mxSetField(pInfo, 0, "Channels", mxCreateString(lpNames));
+    mxSetField(pInfo, 0, "SampleType", mxCreateString(pHeader->nSampleType == DAQ_FILE_INT16 ? "int16" : "double"));
+    mxSetField(pInfo, 0, "Scaling", pScaling);
+    mxSetField(pInfo, 0, "BlockSamples", mxCreateDoubleScalar(pHeader->nBlockScans));
+    mxSetField(pInfo, 0, "Blocks", mxCreateDoubleScalar(pHeader->nBlocks));
+    mxSetField(pInfo, 0, "Published", mxCreateDoubleScalar((double) pHeader->nPublished.load()));
+    mxSetField(pInfo, 0, "Running", mxCreateLogicalScalar(daqSharedWriterAlive(pHeader)));
+    
+    mxFree(lpNames);
+    
+    return pInfo;
+}
+
+void readBlocks(int nlhs, mxArray *plhs[], const DaqSharedHeader *pHeader, uInt64 nSequence)
+{
+    uInt64 nPublished = pHeader->nPublished.load(std::memory_order_acquire);
+    uInt64 nOldest = daqSharedOldest(pHeader, nPublished);
+    uInt64 nLost = 0;
+    
+    // A sequence ahead of the ring belongs to an earlier writer
+    if (nSequence > nPublished)
+    {
+        nSequence = nOldest;
+    }
+    else if (nSequence < nOldest)
+    {
+        nLost = nOldest - nSequence;
+        nSequence = nOldest;
+    }
+    
+    uInt32 nChannels = pHeader->nChannels;
+    size_t nRows = (size_t) (nPublished - nSequence) * pHeader->nBlockScans;
+    mxClassID nClass = (pHeader->nSampleType == DAQ_FILE_INT16) ? mxINT16_CLASS : mxDOUBLE_CLASS;
+    size_t nSampleSize = daqFileSampleSize(pHeader->nSampleType);
+    
+    plhs[0] = (nChannels == 1) ? mxCreateNumericMatrix(1, nRows, nClass, mxREAL) :
+                                 mxCreateNumericMatrix(nRows, nChannels, nClass, mxREAL);
+    
+    char *ptrData = (char*) mxGetData(plhs[0]);
+    size_t nCopied = 0;
+    
+    for (; nSequence < nPublished; nSequence++)
+    {
+        uInt32 nScans = 0;
+        
+        if (daqSharedCopyBlock(pHeader, nSequence, ptrData + nCopied * nSampleSize, nRows, &nScans))
+        {
+            nCopied += nScans;
+        }
+        else
+        {
+            nLost++;
+        }
+    }
+    
+    // Short or lost blocks leave the columns apart
+    if (nCopied < nRows)
+    {
+        for (uInt32 i = 1; i < nChannels; i++)
+        {
+            memmove(ptrData + i * nCopied * nSampleSize, ptrData + i * nRows * nSampleSize, nCopied * nSampleSize);
+        }
+        
+        if (nChannels == 1)
+        {
+            mxSetN(plhs[0], nCopied);
+        }
+        else
+        {
+            mxSetM(plhs[0], nCopied);
+        }
+    }
+    
+    // Only report a failure of the writer once every block before it
+    // has been handed over
+    if (nCopied == 0 && nLost == 0)
+    {
+        outMexError(pHeader->nError.load());
+    }
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = mxCreateDoubleScalar((double) nSequence);
+    }
+    
+    if (nlhs > 2)
+    {
+        plhs[2] = mxCreateDoubleScalar((double) nLost);
+    }
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    mexAtExit(onExit);
+    
+    if (nrhs != 1 && nrhs != 2)
+    {
+        mexErrMsgTxt("One or two inputs required.");
+    }
+    else if (nlhs > ((nrhs == 1) ? 1 : 3))
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    else if (mxIsChar(prhs[0]) != 1 || mxGetM(prhs[0]) != 1)
+    {
+        mexErrMsgTxt("Input argument 1 must be a string.");
+    }
+    else if (nrhs == 2 && (mxIsNumeric(prhs[1]) != 1 || mxGetNumberOfElements(prhs[1]) != 1 || mxGetScalar(prhs[1]) < 0 ||
+                           mxGetScalar(prhs[1]) != (double) (uInt64) mxGetScalar(prhs[1])))
+    {
+        mexErrMsgTxt("Input argument 2 must be a natural value or 0.");
+    }
+    
+    char *lpName = mxArrayToString(prhs[0]);
+    const DaqSharedHeader *pHeader = openRing(lpName);
+    
+    mxFree(lpName);
+    
+    if (nrhs == 1)
+    {
+        plhs[0] = createInfo(pHeader);
+        return;
+    }
+    
+    readBlocks(nlhs, plhs, pHeader, (uInt64) mxGetScalar(prhs[1]));
+}
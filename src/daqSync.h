@@ -0,0 +1,134 @@
+/*************************************************************/
+// daqSync.h
+//
+// Synchronized adquisition from several devices. The first
+// device is the master: every other task takes its sample clock
+// from the master's ai/SampleClock terminal and waits for its
+// ai/StartTrigger, so all of them sample at the same instants.
+// The driver routes both signals over the RTSI cable or the PXI
+// backplane.
+//
+// Every device is then read on its own thread straight into its
+// columns of the result, so the call takes about as long as a
+// single device would.
+//
+// Nothing in this file may call the MEX API, so the reads can run
+// on worker threads.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQSYNC_H
+#define DAQSYNC_H
+
+#include <stdio.h>
+#include <thread>
+#include "daqRead.h"
+
+// Most devices a single call may synchronize
+#define DAQ_SYNC_MAX_DEVICES 16
+
+// One device of a synchronized adquisition
+struct DaqSyncDevice
+{
+    TaskHandle hTask;
+    uInt32 nChannels;
+    float64 *lpData;
+    float64 *lpScratch;
+    DaqCallTiming *pTiming;
+    uInt64 nRead;
+    int32 nResult;
+};
+
+// Makes hTask, a finite task on another device, follow the sample
+// clock and start trigger of lpMaster
+static inline int32 daqSyncFollow(TaskHandle hTask, const char *lpMaster, float64 fRate, uInt64 nSamples)
+{
+    char lpTerminal[256];
+
+    snprintf(lpTerminal, sizeof(lpTerminal), "/%s/ai/SampleClock", lpMaster);
+
+    int32 nResult = daqCfgSampClkTiming(hTask, lpTerminal, fRate, DAQmx_Val_Rising, DAQmx_Val_FiniteSamps, nSamples);
+
+    if (nResult >= 0)
+    {
+        snprintf(lpTerminal, sizeof(lpTerminal), "/%s/ai/StartTrigger", lpMaster);
+        nResult = daqCfgDigEdgeStartTrig(hTask, lpTerminal, DAQmx_Val_Rising);
+    }
+
+    return nResult;
+}
+
+// Starts the followers first, so they are armed when the master
+// starts and triggers them. Stops the tasks already started if one
+// of them fails.
+static inline int32 daqSyncStart(DaqSyncDevice *lpDevices, int nDevices)
+{
+    for (int i = nDevices - 1; i >= 0; i--)
+    {
+        int32 nResult = daqStartTask(lpDevices[i].hTask);
+
+        if (nResult < 0)
+        {
+            for (int k = nDevices - 1; k > i; k--)
+            {
+                daqStopTask(lpDevices[k].hTask);
+            }
+
+            return nResult;
+        }
+    }
+
+    return 0;
+}
+
+static inline void daqSyncReader(DaqSyncDevice *pDevice, float64 fRate, uInt64 nSamples)
+{
+    pDevice->nResult = daqReadChunked(pDevice->hTask, fRate, nSamples, pDevice->nChannels, pDevice->lpData,
+                                      pDevice->lpScratch, &pDevice->nRead, pDevice->pTiming);
+}
+
+// Reads nSamples samples per channel from every started device at
+// once, one thread per device. Each device has its own timing, if
+// any, since the threads cannot share one. Returns the first error,
+// in device order.
+static inline int32 daqSyncRead(DaqSyncDevice *lpDevices, int nDevices, float64 fRate, uInt64 nSamples)
+{
+    std::thread lpReaders[DAQ_SYNC_MAX_DEVICES];
+
+    // The calling thread reads the master itself
+    for (int i = 1; i < nDevices; i++)
+    {
+        lpReaders[i] = std::thread(daqSyncReader, lpDevices + i, fRate, nSamples);
+    }
+
+    daqSyncReader(lpDevices, fRate, nSamples);
+
+    for (int i = 1; i < nDevices; i++)
+    {
+        lpReaders[i].join();
+    }
+
+    for (int i = 0; i < nDevices; i++)
+    {
+        if (lpDevices[i].nResult < 0)
+        {
+            return lpDevices[i].nResult;
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*************************************************************/
+// daqTaskCache.h
+//
+// Keeps configured DAQmx tasks alive between calls to a MEX
+// function, so a repeated adquisition only has to start, read
+// and stop the task instead of creating it from scratch.
+//
+// Tasks are keyed by device, channel, range, rate and number
+// of samples. Only one task per device is kept committed (its
+// resources reserved); the rest stay verified and are committed
+// again when they are used.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQTASKCACHE_H
+#define DAQTASKCACHE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// Maximum number of tasks kept alive. The least recently used
+// one is cleared when a new task does not fit.
+#define DAQ_TASK_CACHE_SIZE 16
+
+struct DaqCachedTask
+{
+    char *lpDevice;
+    char *lpChannel;
+    float64 fMaxVolts;
+    float64 fRate;
+    uInt64 nSamples;
+    uInt32 nChannels;
+    TaskHandle hTask;
+    bool bCommitted;
+    unsigned long long nLastUse;
+};
+
+struct DaqTaskCache
+{
+    DaqCachedTask Entries[DAQ_TASK_CACHE_SIZE];
+    int nCount;
+    unsigned long long nClock;
+};
+
+static inline char *daqStrDup(const char *lpString)
+{
+    char *lpCopy = (char*) malloc(strlen(lpString) + 1);
+
+    if (lpCopy != NULL)
+    {
+        strcpy(lpCopy, lpString);
+    }
+
+    return lpCopy;
+}
+
+static inline void daqTaskCacheRemove(DaqTaskCache *pCache, int nIndex)
+{
+    DaqCachedTask *pEntry = &pCache->Entries[nIndex];
+
+    daqClearTask(pEntry->hTask);
+    free(pEntry->lpDevice);
+    free(pEntry->lpChannel);
+
+    pCache->Entries[nIndex] = pCache->Entries[pCache->nCount - 1];
+    pCache->nCount--;
+}
+
+static inline DaqCachedTask *daqTaskCacheFind(DaqTaskCache *pCache, const char *lpDevice, const char *lpChannel,
+                                              float64 fMaxVolts, float64 fRate, uInt64 nSamples)
+{
+    for (int i = 0; i < pCache->nCount; i++)
+    {
+        DaqCachedTask *pEntry = &pCache->Entries[i];
+
+        if (pEntry->fMaxVolts == fMaxVolts && pEntry->fRate == fRate && pEntry->nSamples == nSamples &&
+            !strcmp(pEntry->lpChannel, lpChannel) && !strcmp(pEntry->lpDevice, lpDevice))
+        {
+            pEntry->nLastUse = ++pCache->nClock;
+            return pEntry;
+        }
+    }
+
+    return NULL;
+}
+
+// Adds an already configured task to the cache, which takes
+// ownership of it. Returns NULL if it could not be stored, in
+// which case the task has been cleared.
+static inline DaqCachedTask *daqTaskCacheInsert(DaqTaskCache *pCache, const char *lpDevice, const char *lpChannel,
+                                                float64 fMaxVolts, float64 fRate, uInt64 nSamples, TaskHandle hTask)
+{
+    if (pCache->nCount == DAQ_TASK_CACHE_SIZE)
+    {
+        int nOldest = 0;
+
+        for (int i = 1; i < pCache->nCount; i++)
+        {
+            if (pCache->Entries[i].nLastUse < pCache->Entries[nOldest].nLastUse)
+            {
+                nOldest = i;
+            }
+        }
+
+        daqTaskCacheRemove(pCache, nOldest);
+    }
+
+    DaqCachedTask *pEntry = &pCache->Entries[pCache->nCount];
+
+    pEntry->lpDevice = daqStrDup(lpDevice);
+    pEntry->lpChannel = daqStrDup(lpChannel);
+    pEntry->nChannels = 1;
+
+    if (pEntry->lpDevice == NULL || pEntry->lpChannel == NULL || daqGetTaskNumChans(hTask, &pEntry->nChannels) < 0)
+    {
+        free(pEntry->lpDevice);
+        free(pEntry->lpChannel);
+        daqClearTask(hTask);
+        return NULL;
+    }
+
+    pEntry->fMaxVolts = fMaxVolts;
+    pEntry->fRate = fRate;
+    pEntry->nSamples = nSamples;
+    pEntry->hTask = hTask;
+    pEntry->bCommitted = false;
+    pEntry->nLastUse = ++pCache->nClock;
+    pCache->nCount++;
+
+    return pEntry;
+}
+
+// Unreserves every committed task on lpDevice, so another task
+// can use the device. Pass pKeep to leave one of them untouched.
+static inline void daqTaskCacheRelease(DaqTaskCache *pCache, const char *lpDevice, DaqCachedTask *pKeep)
+{
+    for (int i = 0; i < pCache->nCount; i++)
+    {
+        DaqCachedTask *pEntry = &pCache->Entries[i];
+
+        if (pEntry != pKeep && pEntry->bCommitted && !strcmp(pEntry->lpDevice, lpDevice))
+        {
+            daqTaskControl(pEntry->hTask, DAQmx_Val_Task_Unreserve);
+            pEntry->bCommitted = false;
+        }
+    }
+}
+
+// Makes sure the task is committed, so starting it only has to
+// arm the hardware
+static inline int32 daqTaskCacheCommit(DaqTaskCache *pCache, DaqCachedTask *pEntry)
+{
+    if (pEntry->bCommitted)
+    {
+        return 0;
+    }
+
+    daqTaskCacheRelease(pCache, pEntry->lpDevice, pEntry);
+
+    int32 nResult = daqTaskControl(pEntry->hTask, DAQmx_Val_Task_Commit);
+
+    if (nResult >= 0)
+    {
+        pEntry->bCommitted = true;
+    }
+
+    return nResult;
+}
+
+static inline void daqTaskCacheEvict(DaqTaskCache *pCache, DaqCachedTask *pEntry)
+{
+    daqTaskCacheRemove(pCache, (int) (pEntry - pCache->Entries));
+}
+
+// Drops every task on lpDevice, so the next ones are created anew
+static inline void daqTaskCacheForget(DaqTaskCache *pCache, const char *lpDevice)
+{
+    for (int i = pCache->nCount - 1; i >= 0; i--)
+    {
+        if (!strcmp(pCache->Entries[i].lpDevice, lpDevice))
+        {
+            daqTaskCacheRemove(pCache, i);
+        }
+    }
+}
+
+static inline void daqTaskCacheClear(DaqTaskCache *pCache)
+{
+    while (pCache->nCount > 0)
+    {
+        daqTaskCacheRemove(pCache, pCache->nCount - 1);
+    }
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*************************************************************/
+// daqTiming.h
+//
+// Timing of the phases of an adquisition: configuring the task,
+// starting it, the driver reads and the copies and processing
+// done with the samples. DaqCallTiming holds one call and
+// DaqTimingStats accumulates many, with a latency histogram per
+// phase.
+//
+// Every function accepts a NULL DaqCallTiming and then does
+// nothing, so an uninstrumented call costs one comparison per
+// phase.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQTIMING_H
+#define DAQTIMING_H
+
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+#define DAQ_PHASE_CREATE 0
+#define DAQ_PHASE_CHANNEL 1
+#define DAQ_PHASE_CLOCK 2
+#define DAQ_PHASE_LIMITS 3
+#define DAQ_PHASE_COMMIT 4
+#define DAQ_PHASE_START 5
+#define DAQ_PHASE_READ 6
+#define DAQ_PHASE_COPY 7
+#define DAQ_PHASE_PROCESS 8
+#define DAQ_PHASE_STOP 9
+#define DAQ_PHASE_TOTAL 10
+#define DAQ_PHASES 11
+
+// Bin 0 counts phases under 1 us, bin k those from 2^(k-1) to 2^k us,
+// and the last one everything longer
+#define DAQ_TIMING_BINS 26
+
+// Names of the phases, as the fields they are reported in
+static inline const char **daqTimingPhaseNames()
+{
+    static const char *lpNames[DAQ_PHASES] =
+    {
+        "Create", "Channel", "Clock", "Limits", "Commit", "Start", "Read", "Copy", "Process", "Stop", "Total"
+    };
+
+    return lpNames;
+}
+
+struct DaqCallTiming
+{
+    double lpSeconds[DAQ_PHASES];
+    double fTotalStart;
+    uInt64 nRequested;
+    uInt64 nRead;
+    uInt64 nBytes;
+    uInt64 nReads;
+    uInt32 nChannels;
+    int32 nError;
+    bool bCached;
+};
+
+struct DaqTimingStats
+{
+    uInt64 nCalls;
+    uInt64 nErrors;
+    int32 nLastError;
+    uInt64 nSamples;
+    uInt64 nBytes;
+    uInt64 nReads;
+    double lpSeconds[DAQ_PHASES];
+    double lpMax[DAQ_PHASES];
+    uInt64 lpHistogram[DAQ_PHASES][DAQ_TIMING_BINS];
+};
+
+static inline double daqTimingNow()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void daqTimingInit(DaqCallTiming *pTiming, uInt64 nRequested)
+{
+    if (pTiming != NULL)
+    {
+        memset(pTiming, 0, sizeof(DaqCallTiming));
+        pTiming->nRequested = nRequested;
+        pTiming->fTotalStart = daqTimingNow();
+    }
+}
+
+// Start of a phase, to be passed to daqTimingEnd
+static inline double daqTimingBegin(const DaqCallTiming *pTiming)
+{
+    return (pTiming != NULL) ? daqTimingNow() : 0;
+}
+
+// Adds the time since fStart to a phase. Phases run more than once,
+// such as every driver read, add up.
+static inline void daqTimingEnd(DaqCallTiming *pTiming, int nPhase, double fStart)
+{
+    if (pTiming != NULL)
+    {
+        pTiming->lpSeconds[nPhase] += daqTimingNow() - fStart;
+    }
+}
+
+// Keeps the first driver error of the call
+static inline void daqTimingError(DaqCallTiming *pTiming, int32 nResult)
+{
+    if (pTiming != NULL && nResult < 0 && pTiming->nError == 0)
+    {
+        pTiming->nError = nResult;
+    }
+}
+
+// Counts one driver read of nRead scans of nSize-byte samples
+static inline void daqTimingRead(DaqCallTiming *pTiming, int32 nRead, uInt32 nChannels, size_t nSize)
+{
+    if (pTiming != NULL)
+    {
+        pTiming->nReads++;
+
+        if (nRead > 0)
+        {
+            pTiming->nRead += nRead;
+            pTiming->nBytes += (uInt64) nRead * nChannels * nSize;
+        }
+    }
+}
+
+// Closes the total of the call
+static inline void daqTimingFinish(DaqCallTiming *pTiming)
+{
+    if (pTiming != NULL)
+    {
+        pTiming->lpSeconds[DAQ_PHASE_TOTAL] = daqTimingNow() - pTiming->fTotalStart;
+    }
+}
+
+static inline int daqTimingBin(double fSeconds)
+{
+    double fLimit = 1e-6;
+    int nBin = 0;
+
+    while (nBin < DAQ_TIMING_BINS - 1 && fSeconds >= fLimit)
+    {
+        fLimit *= 2;
+        nBin++;
+    }
+
+    return nBin;
+}
+
+// Upper edge of a histogram bin in seconds; the last has none
+static inline double daqTimingBinEdge(int nBin)
+{
+    return ldexp(1e-6, nBin);
+}
+
+static inline void daqTimingStatsClear(DaqTimingStats *pStats)
+{
+    memset(pStats, 0, sizeof(DaqTimingStats));
+}
+
+// Adds a finished call. Phases the call did not go through, such as
+// creating a task that was cached, are not counted in the histogram.
+static inline void daqTimingStatsAdd(DaqTimingStats *pStats, const DaqCallTiming *pTiming)
+{
+    if (pTiming == NULL)
+    {
+        return;
+    }
+
+    pStats->nCalls++;
+    pStats->nSamples += pTiming->nRead;
+    pStats->nBytes += pTiming->nBytes;
+    pStats->nReads += pTiming->nReads;
+
+    if (pTiming->nError < 0)
+    {
+        pStats->nErrors++;
+        pStats->nLastError = pTiming->nError;
+    }
+
+    for (int i = 0; i < DAQ_PHASES; i++)
+    {
+        double fSeconds = pTiming->lpSeconds[i];
+
+        if (fSeconds <= 0)
+        {
+            continue;
+        }
+
+        pStats->lpSeconds[i] += fSeconds;
+        pStats->lpHistogram[i][daqTimingBin(fSeconds)]++;
+
+        if (fSeconds > pStats->lpMax[i])
+        {
+            pStats->lpMax[i] = fSeconds;
+        }
+    }
+}
+
+#endif
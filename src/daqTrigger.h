@@ -0,0 +1,396 @@
+/*************************************************************/
+// daqTrigger.h
+//
+// Software triggered capture. Blocks are handed to DaqTrigger as
+// they are read; one channel is scanned for the trigger condition
+// and, for every event, a window of PreTrigger samples before the
+// trigger and PostTrigger samples from it on is kept for every
+// channel. Samples between events are discarded as soon as they
+// stop being possible pre-trigger history, so the memory used
+// only depends on the window and the number of events.
+//
+// The last PreTrigger samples of every channel are kept in front
+// of the block being processed, so a window is always contiguous
+// even when it starts in a previous block.
+//
+// The condition scan uses AVX2 on processors that have it, chosen
+// at run time as in daqScale.h.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQTRIGGER_H
+#define DAQTRIGGER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "daqScale.h"
+
+// The signal crosses fLow upwards or downwards, changes by at least
+// fLow from one sample to the next (or at most, if fLow is negative),
+// or leaves the window [fLow, fHigh]
+#define DAQ_TRIGGER_RISING 0
+#define DAQ_TRIGGER_FALLING 1
+#define DAQ_TRIGGER_SLOPE 2
+#define DAQ_TRIGGER_WINDOW 3
+
+struct DaqTriggerCondition
+{
+    int nType;
+    float64 fLow;
+    float64 fHigh;
+};
+
+static inline bool daqTriggerMatch(const DaqTriggerCondition *pCondition, float64 fPrevious, float64 fCurrent)
+{
+    switch (pCondition->nType)
+    {
+        case DAQ_TRIGGER_RISING:
+            return fPrevious < pCondition->fLow && fCurrent >= pCondition->fLow;
+        case DAQ_TRIGGER_FALLING:
+            return fPrevious > pCondition->fLow && fCurrent <= pCondition->fLow;
+        case DAQ_TRIGGER_SLOPE:
+            return (pCondition->fLow >= 0) ? fCurrent - fPrevious >= pCondition->fLow : fCurrent - fPrevious <= pCondition->fLow;
+        default:
+            return (fCurrent < pCondition->fLow || fCurrent > pCondition->fHigh) &&
+                   !(fPrevious < pCondition->fLow || fPrevious > pCondition->fHigh);
+    }
+}
+
+#ifdef DAQ_SCALE_AVX2
+// Lanes of x[i-1], x[i] meeting the condition, as a bit mask
+DAQ_SCALE_TARGET static inline int daqTriggerMask(const DaqTriggerCondition *pCondition, __m256d fPrevious, __m256d fCurrent)
+{
+    __m256d fLow = _mm256_set1_pd(pCondition->fLow);
+    __m256d fMatch;
+
+    switch (pCondition->nType)
+    {
+        case DAQ_TRIGGER_RISING:
+            fMatch = _mm256_and_pd(_mm256_cmp_pd(fPrevious, fLow, _CMP_LT_OQ), _mm256_cmp_pd(fCurrent, fLow, _CMP_GE_OQ));
+            break;
+        case DAQ_TRIGGER_FALLING:
+            fMatch = _mm256_and_pd(_mm256_cmp_pd(fPrevious, fLow, _CMP_GT_OQ), _mm256_cmp_pd(fCurrent, fLow, _CMP_LE_OQ));
+            break;
+        case DAQ_TRIGGER_SLOPE:
+            if (pCondition->fLow >= 0)
+            {
+                fMatch = _mm256_cmp_pd(_mm256_sub_pd(fCurrent, fPrevious), fLow, _CMP_GE_OQ);
+            }
+            else
+            {
+                fMatch = _mm256_cmp_pd(_mm256_sub_pd(fCurrent, fPrevious), fLow, _CMP_LE_OQ);
+            }
+            break;
+        default:
+        {
+            __m256d fHigh = _mm256_set1_pd(pCondition->fHigh);
+            __m256d fOut = _mm256_or_pd(_mm256_cmp_pd(fCurrent, fLow, _CMP_LT_OQ), _mm256_cmp_pd(fCurrent, fHigh, _CMP_GT_OQ));
+            __m256d fWasOut = _mm256_or_pd(_mm256_cmp_pd(fPrevious, fLow, _CMP_LT_OQ), _mm256_cmp_pd(fPrevious, fHigh, _CMP_GT_OQ));
+
+            fMatch = _mm256_andnot_pd(fWasOut, fOut);
+            break;
+        }
+    }
+
+    return _mm256_movemask_pd(fMatch);
+}
+
+// Scans [nFirst, nEnd) four samples at a time and returns the first
+// i that meets the condition, or where the scalar loop takes over
+DAQ_SCALE_TARGET static inline size_t daqTriggerFindAvx2(const DaqTriggerCondition *pCondition, const float64 *lpData, size_t nFirst,
+                                                  size_t nEnd)
+{
+    size_t i = nFirst;
+
+    for (; i + 4 <= nEnd; i += 4)
+    {
+        int nMask = daqTriggerMask(pCondition, _mm256_loadu_pd(lpData + i - 1), _mm256_loadu_pd(lpData + i));
+
+        if (nMask != 0)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                if (nMask & (1 << k))
+                {
+                    return i + k;
+                }
+            }
+        }
+    }
+
+    return i;
+}
+#endif
+
+// First i in [nFirst, nEnd) where lpData[i - 1], lpData[i] meet the
+// condition, or nEnd. nFirst must be at least 1.
+static inline size_t daqTriggerFind(const DaqTriggerCondition *pCondition, const float64 *lpData, size_t nFirst, size_t nEnd)
+{
+    size_t i = nFirst;
+
+#ifdef DAQ_SCALE_AVX2
+    if (daqScaleHasAvx2())
+    {
+        i = daqTriggerFindAvx2(pCondition, lpData, nFirst, nEnd);
+    }
+#endif
+
+    for (; i < nEnd; i++)
+    {
+        if (daqTriggerMatch(pCondition, lpData[i - 1], lpData[i]))
+        {
+            return i;
+        }
+    }
+
+    return nEnd;
+}
+
+class DaqTrigger
+{
+public:
+    DaqTrigger() : m_bFailed(false), m_lpWindow(NULL), m_lpEvents(NULL), m_lpPositions(NULL)
+    {
+    }
+
+    ~DaqTrigger()
+    {
+        Free();
+    }
+
+    // Prepares the capture of up to nMaxEvents events of nPre + nPost
+    // samples per channel, triggered on channel nTrigger. After an
+    // event, triggers are ignored for nHoldOff samples. Blocks are
+    // at most nBlock samples long.
+    bool Init(const DaqTriggerCondition *pCondition, uInt32 nChannels, uInt32 nTrigger, uInt32 nPre, uInt32 nPost,
+              uInt64 nHoldOff, uInt32 nMaxEvents, uInt32 nBlock)
+    {
+        Free();
+
+        m_Condition = *pCondition;
+        m_nChannels = nChannels;
+        m_nTrigger = nTrigger;
+        m_nPre = nPre;
+        m_nPost = nPost;
+        m_nHoldOff = (nHoldOff > 0) ? nHoldOff : 1;
+        m_nMaxEvents = nMaxEvents;
+
+        // At least the previous sample is needed to detect an edge
+        m_nKeep = (nPre > 0) ? nPre : 1;
+        m_nSpan = (size_t) m_nKeep + nBlock;
+        m_nHave = 0;
+        m_nPosition = 0;
+        m_nArm = m_nKeep;
+        m_nEvents = 0;
+        m_nComplete = 0;
+        m_nCapacity = 0;
+        m_lpWindow = (float64*) malloc(m_nSpan * nChannels * sizeof(float64));
+
+        return m_lpWindow != NULL;
+    }
+
+    // Samples per channel of an event
+    size_t Length() const
+    {
+        return (size_t) m_nPre + m_nPost;
+    }
+
+    uInt32 Events() const
+    {
+        return m_nComplete;
+    }
+
+    bool Done() const
+    {
+        return m_nComplete == m_nMaxEvents;
+    }
+
+    bool Failed() const
+    {
+        return m_bFailed;
+    }
+
+    // Channel nChannel of event nEvent, Length() samples
+    const float64 *Event(uInt32 nEvent, uInt32 nChannel) const
+    {
+        return m_lpEvents + ((size_t) nEvent * m_nChannels + nChannel) * Length();
+    }
+
+    // Index of the trigger sample of an event, from 0
+    uInt64 Position(uInt32 nEvent) const
+    {
+        return m_lpPositions[nEvent];
+    }
+
+    // Scans a block of nRead samples per channel, channel i starting
+    // at lpChunk + i * nStride
+    void Process(const float64 *lpChunk, uInt32 nRead, uInt32 nStride)
+    {
+        size_t nTotal = m_nHave + (size_t) nRead;
+        uInt64 nBase = m_nPosition - m_nHave;
+
+        for (uInt32 c = 0; c < m_nChannels; c++)
+        {
+            memcpy(m_lpWindow + c * m_nSpan + m_nHave, lpChunk + (size_t) c * nStride, nRead * sizeof(float64));
+        }
+
+        Detect(nBase, nTotal);
+        Collect(nBase, nTotal);
+
+        // Keep the history the next block may need
+        size_t nKeep = (nTotal < m_nKeep) ? nTotal : m_nKeep;
+
+        for (uInt32 c = 0; c < m_nChannels; c++)
+        {
+            memmove(m_lpWindow + c * m_nSpan, m_lpWindow + c * m_nSpan + nTotal - nKeep, nKeep * sizeof(float64));
+        }
+
+        m_nPosition += nRead;
+        m_nHave = nKeep;
+    }
+
+    void Free()
+    {
+        free(m_lpWindow);
+        free(m_lpEvents);
+        free(m_lpPositions);
+
+        m_lpWindow = NULL;
+        m_lpEvents = NULL;
+        m_lpPositions = NULL;
+        m_bFailed = false;
+    }
+
+private:
+    // Starts an event for every trigger among the new samples
+    void Detect(uInt64 nBase, size_t nTotal)
+    {
+        const float64 *lpData = m_lpWindow + m_nTrigger * m_nSpan;
+        size_t nFirst = (m_nHave > 1) ? m_nHave : 1;
+
+        while (m_nEvents < m_nMaxEvents)
+        {
+            if (m_nArm > nBase + nFirst)
+            {
+                if (m_nArm >= nBase + nTotal)
+                {
+                    break;
+                }
+
+                nFirst = (size_t) (m_nArm - nBase);
+            }
+
+            size_t nFound = daqTriggerFind(&m_Condition, lpData, nFirst, nTotal);
+
+            if (nFound == nTotal || !Grow())
+            {
+                break;
+            }
+
+            m_lpPositions[m_nEvents++] = nBase + nFound;
+            m_nArm = nBase + nFound + m_nHoldOff;
+            nFirst = nFound + 1;
+        }
+    }
+
+    // Copies to every unfinished event the part of its window that is
+    // in the buffer and was not copied before
+    void Collect(uInt64 nBase, size_t nTotal)
+    {
+        uInt64 nEnd = nBase + nTotal;
+
+        for (uInt32 k = m_nComplete; k < m_nEvents; k++)
+        {
+            uInt64 nStart = m_lpPositions[k] - m_nPre;
+            uInt64 nStop = m_lpPositions[k] + m_nPost;
+            uInt64 nFrom = (m_lpPositions[k] < m_nPosition) ? m_nPosition : nStart;
+            uInt64 nTo = (nStop < nEnd) ? nStop : nEnd;
+
+            for (uInt32 c = 0; nFrom < nTo && c < m_nChannels; c++)
+            {
+                memcpy(m_lpEvents + ((size_t) k * m_nChannels + c) * Length() + (nFrom - nStart),
+                       m_lpWindow + c * m_nSpan + (nFrom - nBase), (size_t) (nTo - nFrom) * sizeof(float64));
+            }
+
+            // Events start in order and have the same length
+            if (nStop <= nEnd && k == m_nComplete)
+            {
+                m_nComplete++;
+            }
+        }
+    }
+
+    // Makes room for one more event
+    bool Grow()
+    {
+        if (m_nEvents < m_nCapacity)
+        {
+            return true;
+        }
+
+        uInt32 nCapacity = (m_nCapacity == 0) ? 16 : m_nCapacity * 2;
+
+        if (nCapacity > m_nMaxEvents)
+        {
+            nCapacity = m_nMaxEvents;
+        }
+
+        float64 *lpEvents = (float64*) realloc(m_lpEvents, (size_t) nCapacity * m_nChannels * Length() * sizeof(float64));
+
+        if (lpEvents != NULL)
+        {
+            m_lpEvents = lpEvents;
+        }
+
+        uInt64 *lpPositions = (uInt64*) realloc(m_lpPositions, (size_t) nCapacity * sizeof(uInt64));
+
+        if (lpPositions != NULL)
+        {
+            m_lpPositions = lpPositions;
+        }
+
+        if (lpEvents == NULL || lpPositions == NULL)
+        {
+            m_bFailed = true;
+            return false;
+        }
+
+        m_nCapacity = nCapacity;
+
+        return true;
+    }
+
+    DaqTriggerCondition m_Condition;
+    uInt32 m_nChannels;
+    uInt32 m_nTrigger;
+    uInt32 m_nPre;
+    uInt32 m_nPost;
+    uInt64 m_nHoldOff;
+    uInt32 m_nMaxEvents;
+    size_t m_nKeep;
+    size_t m_nSpan;
+    size_t m_nHave;
+    uInt64 m_nPosition;
+    uInt64 m_nArm;
+    uInt32 m_nEvents;
+    uInt32 m_nComplete;
+    uInt32 m_nCapacity;
+    bool m_bFailed;
+    float64 *m_lpWindow;
+    float64 *m_lpEvents;
+    uInt64 *m_lpPositions;
+};
+
+#endif
@@ -0,0 +1,247 @@
+/*************************************************************/
+// daqXCorr.cpp
+//
+// Cross-correlates every pair of channels of a capture, or the
+// pairs given, to estimate the delay between them. The spectrum of
+// every channel is computed once and shared by all of its pairs,
+// and the pairs are spread over all cores
+//
+//                       ------ ARGUMENTS ------
+//
+// [Lags (f), Peaks (f), Correlation (f)] = daqXCorr(Data (f), 'MaxLag', MaxLag (n),
+//     'Pairs', Pairs (f), 'Scale', Scale (s), 'Threads', Threads (n))
+//
+// - f denotes a real matrix
+// - n denotes a natural value
+// - s denotes a string
+//
+//            - Data: samples laid out as daqAdquireData returns them: a
+//                    row vector for a single channel or a matrix with one
+//                    column per channel
+//
+//            - Lags: for every pair, the lag in samples at which the
+//                    correlation is largest in absolute value. It is
+//                    positive when the first channel of the pair is a
+//                    delayed copy of the second
+//
+//           - Peaks: the correlation at Lags, one row per pair
+//
+//     - Correlation: the correlation of every pair in a column, from lag
+//                    -MaxLag to MaxLag. Column p matches
+//                    xcorr(Data(:, Pairs(p, 1)), Data(:, Pairs(p, 2)), MaxLag, Scale)
+//
+//        - 'MaxLag': largest lag computed. Defaults to the number of
+//                    samples minus one
+//
+//         - 'Pairs': channels to correlate, one pair per row. Defaults to
+//                    every pair of distinct channels, [1 2; 1 3; ... 2 3; ...],
+//                    or [1 1] for a single channel
+//
+//         - 'Scale': 'none' (the default), 'biased', 'unbiased' or
+//                    'coeff', as in xcorr
+//
+//       - 'Threads': threads to use. Defaults to as many as the machine
+//                    has
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#include "daqDriver.h"
+#include "mex.h"
+#include "string.h"
+#include "daqXCorr.h"
+
+// Returns a natural value, or zero as well if bZero is set
+size_t getNatural(const mxArray *pValue, const char *lpName, bool bZero)
+{
+    char lpOutput[128];
+    double fValue = (mxIsNumeric(pValue) && mxGetNumberOfElements(pValue) == 1) ? mxGetScalar(pValue) : -1;
+    
+    if (fValue < (bZero ? 0 : 1) || fValue != floor(fValue) || !mxIsFinite(fValue))
+    {
+        sprintf(lpOutput, "Option '%s' must be a natural value%s.", lpName, bZero ? " or zero" : "");
+        mexErrMsgTxt(lpOutput);
+    }
+    
+    return (size_t) fValue;
+}
+
+// Returns the scaling named by an option value
+int getScale(const mxArray *pValue)
+{
+    char *lpScale = (mxIsChar(pValue) == 1) ? mxArrayToString(pValue) : NULL;
+    int nScale = (lpScale == NULL) ? -1 :
+                 !strcmp(lpScale, "none") ? DAQ_XCORR_NONE :
+                 !strcmp(lpScale, "biased") ? DAQ_XCORR_BIASED :
+                 !strcmp(lpScale, "unbiased") ? DAQ_XCORR_UNBIASED :
+                 !strcmp(lpScale, "coeff") ? DAQ_XCORR_COEFF : -1;
+    
+    mxFree(lpScale);
+    
+    if (nScale < 0)
+    {
+        mexErrMsgTxt("Option 'Scale' must be 'none', 'biased', 'unbiased' or 'coeff'.");
+    }
+    
+    return nScale;
+}
+
+// Checks a Pairs-by-2 matrix of channels among nChannels and returns
+// them zero-based, two per pair, in memory the caller frees
+uInt32* getPairs(const mxArray *pValue, uInt32 nChannels, size_t *pnPairs)
+{
+    char lpOutput[128];
+    
+    if (!mxIsDouble(pValue) || mxIsComplex(pValue) || mxGetNumberOfDimensions(pValue) != 2 || mxGetN(pValue) != 2 ||
+        mxGetM(pValue) == 0)
+    {
+        mexErrMsgTxt("Option 'Pairs' must be a matrix with two columns.");
+    }
+    
+    size_t nPairs = mxGetM(pValue);
+    const double *ptrPairs = mxGetPr(pValue);
+    uInt32 *lpPairs = (uInt32*) mxMalloc(2 * nPairs * sizeof(uInt32));
+    
+    for (size_t p = 0; p < nPairs; p++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            double fChannel = ptrPairs[k * nPairs + p];
+            
+            if (fChannel < 1 || fChannel > nChannels || fChannel != floor(fChannel))
+            {
+                sprintf(lpOutput, "Option 'Pairs' must hold channels between 1 and %d.", (int) nChannels);
+                mexErrMsgTxt(lpOutput);
+            }
+            
+            lpPairs[2 * p + k] = (uInt32) fChannel - 1;
+        }
+    }
+    
+    *pnPairs = nPairs;
+    
+    return lpPairs;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 1 || nrhs % 2 != 1)
+    {
+        mexErrMsgTxt("The data followed by option name and value pairs required.");
+    }
+    else if (nlhs > 3)
+    {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    
+    const mxArray *pData = prhs[0];
+    
+    if (!mxIsDouble(pData) || mxIsComplex(pData) || mxIsEmpty(pData) || mxGetNumberOfDimensions(pData) != 2)
+    {
+        mexErrMsgTxt("Input argument 1 must be a real double matrix.");
+    }
+    
+    // A single channel comes as a row vector
+    uInt32 nChannels = (uInt32) ((mxGetM(pData) == 1) ? 1 : mxGetN(pData));
+    size_t nSamples = (mxGetM(pData) == 1) ? mxGetN(pData) : mxGetM(pData);
+    size_t nMaxLag = nSamples - 1, nPairs = 0;
+    unsigned int nThreads = 0;
+    int nScale = DAQ_XCORR_NONE;
+    uInt32 *lpPairs = NULL;
+    char lpOutput[256];
+    
+    for (int i = 1; i < nrhs; i += 2)
+    {
+        if (mxIsChar(prhs[i]) != 1)
+        {
+            mexErrMsgTxt("Option names must be strings.");
+        }
+        
+        char *lpName = mxArrayToString(prhs[i]);
+        
+        if (!strcmp(lpName, "MaxLag"))
+        {
+            nMaxLag = getNatural(prhs[i + 1], lpName, true);
+        }
+        else if (!strcmp(lpName, "Pairs"))
+        {
+            mxFree(lpPairs);
+            lpPairs = getPairs(prhs[i + 1], nChannels, &nPairs);
+        }
+        else if (!strcmp(lpName, "Scale"))
+        {
+            nScale = getScale(prhs[i + 1]);
+        }
+        else if (!strcmp(lpName, "Threads"))
+        {
+            nThreads = (unsigned int) getNatural(prhs[i + 1], lpName, false);
+        }
+        else
+        {
+            sprintf(lpOutput, "Unknown option '%.200s'.", lpName);
+            mxFree(lpName);
+            mexErrMsgTxt(lpOutput);
+        }
+        
+        mxFree(lpName);
+    }
+    
+    if (lpPairs == NULL)
+    {
+        nPairs = daqXCorrPairs(nChannels);
+        lpPairs = (uInt32*) mxMalloc(2 * nPairs * sizeof(uInt32));
+        daqXCorrAllPairs(nChannels, lpPairs);
+    }
+    
+    plhs[0] = mxCreateDoubleMatrix(nPairs, 1, mxREAL);
+    
+    mxArray *pPeaks = mxCreateDoubleMatrix(nPairs, 1, mxREAL);
+    mxArray *pCorrelation = (nlhs > 2) ? mxCreateDoubleMatrix(2 * nMaxLag + 1, nPairs, mxREAL) : NULL;
+    
+    // The correlator owns native memory and threads, so nothing may
+    // fail from here until it is freed
+    DaqCorrelator Correlator;
+    bool bReady = Correlator.Init(nChannels, lpPairs, nPairs, nMaxLag, nSamples, nScale,
+                                  (pCorrelation != NULL) ? mxGetPr(pCorrelation) : NULL, nThreads);
+    
+    mxFree(lpPairs);
+    
+    if (bReady)
+    {
+        Correlator.Process(mxGetPr(pData), nSamples, nSamples);
+        Correlator.Finish();
+        Correlator.Peaks(mxGetPr(plhs[0]), mxGetPr(pPeaks));
+    }
+    
+    Correlator.Free();
+    
+    if (!bReady)
+    {
+        mexErrMsgTxt("Not enough memory to correlate.");
+    }
+    
+    if (nlhs > 1)
+    {
+        plhs[1] = pPeaks;
+    }
+    else
+    {
+        mxDestroyArray(pPeaks);
+    }
+    
+    if (nlhs > 2)
+    {
+        plhs[2] = pCorrelation;
+    }
+}
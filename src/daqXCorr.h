@@ -0,0 +1,465 @@
+/*************************************************************/
+// daqXCorr.h
+//
+// Cross-correlation of pairs of channels over the lags -MaxLag to
+// MaxLag, fed block by block as a capture is read. For a pair of
+// channels x and y the result matches
+//
+//     xcorr(x, y, MaxLag, Scale)
+//
+// in MATLAB terms: R(l) is the sum of x(n + l) * y(n), so the peak is
+// at a positive lag when x is a delayed copy of y.
+//
+// Every block of B samples of y is correlated with the B + 2 * MaxLag
+// samples of x around it by one transform of at least that length,
+// and the results are added up, so the result is exact whatever the
+// block length. The spectra of every channel are computed once per
+// block and shared by all the pairs it is part of, then the pairs
+// are spread over a work-stealing pool of threads.
+/*************************************************************/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library.
+
+#ifndef DAQXCORR_H
+#define DAQXCORR_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daqFft.h"
+#include "daqParallel.h"
+
+// Normalizations of the correlation, as xcorr names them
+#define DAQ_XCORR_NONE 0
+#define DAQ_XCORR_BIASED 1
+#define DAQ_XCORR_UNBIASED 2
+#define DAQ_XCORR_COEFF 3
+
+// Smallest transform used when a capture takes several blocks. The
+// transform is also at least eight times MaxLag, so at least three
+// quarters of every transform are new samples.
+#define DAQ_XCORR_MIN_FFT 4096
+
+// Flags of the channels the pairs use
+#define DAQ_XCORR_FIRST 1
+#define DAQ_XCORR_SECOND 2
+
+// Number of pairs of distinct channels among nChannels, or the one
+// autocorrelation of a single channel
+static inline size_t daqXCorrPairs(uInt32 nChannels)
+{
+    return (nChannels == 1) ? 1 : (size_t) nChannels * (nChannels - 1) / 2;
+}
+
+// Fills lpPairs with the daqXCorrPairs(nChannels) pairs, as the
+// zero-based channels of each, in the order (0, 1), (0, 2) ... (1, 2)
+static inline void daqXCorrAllPairs(uInt32 nChannels, uInt32 *lpPairs)
+{
+    size_t p = 0;
+
+    if (nChannels == 1)
+    {
+        lpPairs[0] = 0;
+        lpPairs[1] = 0;
+        return;
+    }
+
+    for (uInt32 i = 0; i < nChannels; i++)
+    {
+        for (uInt32 j = i + 1; j < nChannels; j++, p++)
+        {
+            lpPairs[2 * p] = i;
+            lpPairs[2 * p + 1] = j;
+        }
+    }
+}
+
+class DaqCorrelator
+{
+public:
+    DaqCorrelator() : m_lpPairs(NULL), m_lpUsed(NULL), m_lpWindows(NULL), m_lpFirstRe(NULL), m_lpFirstIm(NULL),
+                      m_lpSecondRe(NULL), m_lpSecondIm(NULL), m_lpEnergy(NULL), m_lpScratch(NULL), m_lpSums(NULL),
+                      m_lpLags(NULL), m_lpPeaks(NULL), m_bOwnSums(false), m_nChannels(0), m_nPairs(0), m_nMaxLag(0),
+                      m_nSize(0), m_nBins(0), m_nBlock(0), m_nFill(0), m_nSamples(0), m_nScale(DAQ_XCORR_NONE)
+    {
+    }
+
+    ~DaqCorrelator()
+    {
+        Free();
+    }
+
+    // Prepares the nPairs pairs of zero-based channels in lpPairs, two
+    // per pair, among nChannels channels. nSamples is the most samples
+    // per channel Process will be given, or 0 if it is not known; a
+    // capture that fits a single transform is then correlated at once
+    // in Finish. The scaled correlation of every pair is left in
+    // lpCorrelation, 2 * nMaxLag + 1 values per pair, if it is given.
+    // nThreads is the number of threads to use, or 0 for as many as
+    // the work can keep busy.
+    bool Init(uInt32 nChannels, const uInt32 *lpPairs, size_t nPairs, size_t nMaxLag, uInt64 nSamples, int nScale,
+              float64 *lpCorrelation, unsigned int nThreads)
+    {
+        Free();
+
+        size_t nSize = DAQ_XCORR_MIN_FFT, nSingle = 4;
+
+        while (nSize < 8 * nMaxLag)
+        {
+            nSize *= 2;
+        }
+
+        while (nSingle < nSamples + 2 * nMaxLag)
+        {
+            nSingle *= 2;
+        }
+
+        m_nSize = (nSamples > 0 && nSingle < nSize) ? nSingle : nSize;
+        m_nBins = m_nSize / 2 + 1;
+        m_nBlock = m_nSize - 2 * nMaxLag;
+        m_nChannels = nChannels;
+        m_nPairs = nPairs;
+        m_nMaxLag = nMaxLag;
+        m_nScale = nScale;
+
+        // The x samples before the capture are zeros
+        m_nFill = nMaxLag;
+        m_nSamples = 0;
+
+        if (!m_Fft.Init(m_nSize))
+        {
+            return false;
+        }
+
+        m_Pool.Start((nThreads > 0) ? nThreads : daqParallelThreads((2 * nChannels > nPairs) ? 2 * nChannels : nPairs));
+
+        // A single block needs no sums: its correlation is the result
+        m_bOwnSums = lpCorrelation == NULL && !(nSamples > 0 && nSamples <= m_nBlock);
+        m_lpSums = m_bOwnSums ? (float64*) calloc(nPairs * Lags(), sizeof(float64)) : lpCorrelation;
+
+        if (m_lpSums != NULL)
+        {
+            memset(m_lpSums, 0, nPairs * Lags() * sizeof(float64));
+        }
+
+        m_lpPairs = (uInt32*) malloc(2 * nPairs * sizeof(uInt32));
+        m_lpUsed = (unsigned char*) calloc(nChannels, 1);
+        m_lpWindows = (float64*) calloc((size_t) nChannels * m_nSize, sizeof(float64));
+        m_lpFirstRe = (float64*) malloc((size_t) nChannels * m_nBins * sizeof(float64));
+        m_lpFirstIm = (float64*) malloc((size_t) nChannels * m_nBins * sizeof(float64));
+        m_lpSecondRe = (float64*) malloc((size_t) nChannels * m_nBins * sizeof(float64));
+        m_lpSecondIm = (float64*) malloc((size_t) nChannels * m_nBins * sizeof(float64));
+        m_lpEnergy = (float64*) calloc(nChannels, sizeof(float64));
+        m_lpScratch = (float64*) malloc(m_Pool.Threads() * Scratch() * sizeof(float64));
+        m_lpLags = (float64*) calloc(nPairs, sizeof(float64));
+        m_lpPeaks = (float64*) calloc(nPairs, sizeof(float64));
+
+        if ((m_bOwnSums && m_lpSums == NULL) || m_lpPairs == NULL || m_lpUsed == NULL || m_lpWindows == NULL ||
+            m_lpFirstRe == NULL || m_lpFirstIm == NULL || m_lpSecondRe == NULL || m_lpSecondIm == NULL ||
+            m_lpEnergy == NULL || m_lpScratch == NULL || m_lpLags == NULL || m_lpPeaks == NULL)
+        {
+            Free();
+            return false;
+        }
+
+        memcpy(m_lpPairs, lpPairs, 2 * nPairs * sizeof(uInt32));
+
+        for (size_t p = 0; p < nPairs; p++)
+        {
+            m_lpUsed[lpPairs[2 * p]] |= DAQ_XCORR_FIRST;
+            m_lpUsed[lpPairs[2 * p + 1]] |= DAQ_XCORR_SECOND;
+        }
+
+        return true;
+    }
+
+    // Number of lags of every correlation
+    size_t Lags() const
+    {
+        return 2 * m_nMaxLag + 1;
+    }
+
+    // Adds n samples of every channel, channel i starting at
+    // lpChunk + i * nStride. Every block completed is correlated.
+    void Process(const float64 *lpChunk, size_t n, size_t nStride)
+    {
+        while (n > 0)
+        {
+            size_t nCopy = (m_nSize - m_nFill < n) ? m_nSize - m_nFill : n;
+
+            for (uInt32 i = 0; i < m_nChannels; i++)
+            {
+                memcpy(m_lpWindows + i * m_nSize + m_nFill, lpChunk + i * nStride, nCopy * sizeof(float64));
+            }
+
+            m_nFill += nCopy;
+            lpChunk += nCopy;
+            n -= nCopy;
+
+            if (m_nFill == m_nSize)
+            {
+                Block(m_nBlock);
+                Shift();
+            }
+        }
+    }
+
+    // Correlates the samples left, with zeros after the capture, and
+    // scales the result
+    void Finish()
+    {
+        size_t nLeft = (m_nFill > m_nMaxLag) ? m_nFill - m_nMaxLag : 0;
+
+        while (nLeft > 0)
+        {
+            size_t nBlock = (nLeft < m_nBlock) ? nLeft : m_nBlock;
+
+            for (uInt32 i = 0; i < m_nChannels; i++)
+            {
+                memset(m_lpWindows + i * m_nSize + m_nFill, 0, (m_nSize - m_nFill) * sizeof(float64));
+            }
+
+            Block(nBlock);
+            Shift();
+            nLeft -= nBlock;
+        }
+
+        if (m_lpSums == NULL)
+        {
+            return;
+        }
+
+        auto Work = [&](size_t p, unsigned int nThread)
+        {
+            Result(p, m_lpSums + p * Lags());
+        };
+
+        m_Pool.Run(m_nPairs, Work);
+    }
+
+    // Samples per channel correlated so far
+    uInt64 Samples() const
+    {
+        return m_nSamples;
+    }
+
+    // Copies the lag of the largest absolute correlation of every
+    // pair to lpLags, and the correlation at that lag to lpPeaks
+    void Peaks(float64 *lpLags, float64 *lpPeaks) const
+    {
+        memcpy(lpLags, m_lpLags, m_nPairs * sizeof(float64));
+        memcpy(lpPeaks, m_lpPeaks, m_nPairs * sizeof(float64));
+    }
+
+    void Free()
+    {
+        m_Pool.Stop();
+        m_Fft.Free();
+
+        if (m_bOwnSums)
+        {
+            free(m_lpSums);
+        }
+
+        free(m_lpPairs);
+        free(m_lpUsed);
+        free(m_lpWindows);
+        free(m_lpFirstRe);
+        free(m_lpFirstIm);
+        free(m_lpSecondRe);
+        free(m_lpSecondIm);
+        free(m_lpEnergy);
+        free(m_lpScratch);
+        free(m_lpLags);
+        free(m_lpPeaks);
+
+        m_lpSums = NULL;
+        m_lpPairs = NULL;
+        m_lpUsed = NULL;
+        m_lpWindows = NULL;
+        m_lpFirstRe = NULL;
+        m_lpFirstIm = NULL;
+        m_lpSecondRe = NULL;
+        m_lpSecondIm = NULL;
+        m_lpEnergy = NULL;
+        m_lpScratch = NULL;
+        m_lpLags = NULL;
+        m_lpPeaks = NULL;
+        m_bOwnSums = false;
+    }
+
+private:
+    // Scratch values per thread: a padded input, the bins of a cross
+    // spectrum and its inverse
+    size_t Scratch() const
+    {
+        return 2 * m_nSize + 2 * m_nBins;
+    }
+
+    // Correlates the first nBlock samples after the MaxLag oldest ones
+    // of every window, as y, with the whole windows, as x
+    void Block(size_t nBlock)
+    {
+        // Each channel needs the spectrum of its window to be the x of
+        // a pair, and the one of its block to be the y
+        auto Spectra = [&](size_t nItem, unsigned int nThread)
+        {
+            uInt32 i = (uInt32) (nItem / 2);
+            const float64 *lpWindow = m_lpWindows + i * m_nSize;
+            float64 *lpInput = m_lpScratch + nThread * Scratch();
+
+            if (nItem % 2 == 0 && (m_lpUsed[i] & DAQ_XCORR_FIRST))
+            {
+                m_Fft.Real(lpWindow, m_lpFirstRe + i * m_nBins, m_lpFirstIm + i * m_nBins);
+            }
+            else if (nItem % 2 == 1 && m_lpUsed[i] != 0)
+            {
+                float64 fEnergy = 0;
+
+                for (size_t k = 0; k < nBlock; k++)
+                {
+                    lpInput[k] = lpWindow[m_nMaxLag + k];
+                    fEnergy += lpInput[k] * lpInput[k];
+                }
+
+                m_lpEnergy[i] += fEnergy;
+
+                if (m_lpUsed[i] & DAQ_XCORR_SECOND)
+                {
+                    memset(lpInput + nBlock, 0, (m_nSize - nBlock) * sizeof(float64));
+                    m_Fft.Real(lpInput, m_lpSecondRe + i * m_nBins, m_lpSecondIm + i * m_nBins);
+                }
+            }
+        };
+
+        m_Pool.Run(2 * (size_t) m_nChannels, Spectra);
+        m_nSamples += nBlock;
+
+        // Lag l of a pair is bin MaxLag + l of the inverse of X * conj(Y)
+        auto Pairs = [&](size_t p, unsigned int nThread)
+        {
+            size_t nFirst = m_lpPairs[2 * p] * m_nBins, nSecond = m_lpPairs[2 * p + 1] * m_nBins;
+            float64 *lpRe = m_lpScratch + nThread * Scratch() + m_nSize;
+            float64 *lpIm = lpRe + m_nBins;
+            float64 *lpOut = lpIm + m_nBins;
+
+            for (size_t k = 0; k < m_nBins; k++)
+            {
+                float64 fReX = m_lpFirstRe[nFirst + k], fImX = m_lpFirstIm[nFirst + k];
+                float64 fReY = m_lpSecondRe[nSecond + k], fImY = m_lpSecondIm[nSecond + k];
+
+                lpRe[k] = fReX * fReY + fImX * fImY;
+                lpIm[k] = fImX * fReY - fReX * fImY;
+            }
+
+            m_Fft.InverseReal(lpRe, lpIm, lpOut);
+
+            if (m_lpSums == NULL)
+            {
+                Result(p, lpOut);
+                return;
+            }
+
+            float64 *lpSum = m_lpSums + p * Lags();
+
+            for (size_t k = 0; k < Lags(); k++)
+            {
+                lpSum[k] += lpOut[k];
+            }
+        };
+
+        m_Pool.Run(m_nPairs, Pairs);
+    }
+
+    // Keeps the 2 * MaxLag newest samples of every window
+    void Shift()
+    {
+        for (uInt32 i = 0; i < m_nChannels; i++)
+        {
+            float64 *lpWindow = m_lpWindows + i * m_nSize;
+
+            memmove(lpWindow, lpWindow + m_nBlock, 2 * m_nMaxLag * sizeof(float64));
+        }
+
+        m_nFill = 2 * m_nMaxLag;
+    }
+
+    // Scales the complete correlation of pair p in place and finds
+    // its peak
+    void Result(size_t p, float64 *lpCorrelation)
+    {
+        float64 fScale = 1;
+
+        if (m_nScale == DAQ_XCORR_BIASED && m_nSamples > 0)
+        {
+            fScale = 1.0 / m_nSamples;
+        }
+        else if (m_nScale == DAQ_XCORR_COEFF)
+        {
+            float64 fEnergy = m_lpEnergy[m_lpPairs[2 * p]] * m_lpEnergy[m_lpPairs[2 * p + 1]];
+
+            fScale = (fEnergy > 0) ? 1.0 / sqrt(fEnergy) : 1;
+        }
+
+        size_t nPeak = 0;
+
+        for (size_t k = 0; k < Lags(); k++)
+        {
+            uInt64 nLag = (k < m_nMaxLag) ? m_nMaxLag - k : k - m_nMaxLag;
+
+            // Unbiased lags are averages of the samples that overlap
+            if (m_nScale == DAQ_XCORR_UNBIASED)
+            {
+                fScale = (nLag < m_nSamples) ? 1.0 / (m_nSamples - nLag) : 1;
+            }
+
+            lpCorrelation[k] *= fScale;
+
+            if (fabs(lpCorrelation[k]) > fabs(lpCorrelation[nPeak]))
+            {
+                nPeak = k;
+            }
+        }
+
+        m_lpLags[p] = (float64) nPeak - (float64) m_nMaxLag;
+        m_lpPeaks[p] = lpCorrelation[nPeak];
+    }
+
+    DaqFft m_Fft;
+    DaqThreadPool m_Pool;
+    uInt32 *m_lpPairs;
+    unsigned char *m_lpUsed;
+    float64 *m_lpWindows;
+    float64 *m_lpFirstRe;
+    float64 *m_lpFirstIm;
+    float64 *m_lpSecondRe;
+    float64 *m_lpSecondIm;
+    float64 *m_lpEnergy;
+    float64 *m_lpScratch;
+    float64 *m_lpSums;
+    float64 *m_lpLags;
+    float64 *m_lpPeaks;
+    bool m_bOwnSums;
+    uInt32 m_nChannels;
+    size_t m_nPairs;
+    size_t m_nMaxLag;
+    size_t m_nSize;
+    size_t m_nBins;
+    size_t m_nBlock;
+    size_t m_nFill;
+    uInt64 m_nSamples;
+    int m_nScale;
+};
+
+#endif